@@ -0,0 +1,528 @@
+/**
+ * micro benchmarks of hot paths in picam360-common and host
+ * results are printed as a table, --json writes google-benchmark compatible json to diff between releases
+ */
+
+#define _GNU_SOURCE //pthread_setname_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "quaternion.h"
+#include "mrevent.h"
+#include "rtp.h"
+#include "stream_framer.h"
+#include "frame_meta.h"
+#include "status_publisher.h"
+#include "cam_attitude.h"
+
+#include <mat4/type.h>
+#include <mat4/identity.h>
+#include <mat4/fromQuat.h>
+
+#ifndef PICAM360_BENCH_VERSION
+#define PICAM360_BENCH_VERSION "unknown"
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define NUM_OF_INPUTS 256 //power of 2
+#define MAX_ITERATIONS 1000000000LL
+#define MAX_REPETITIONS 32
+
+//returns bytes processed, 0 : not a throughput benchmark
+typedef uint64_t (*BENCH_FUNC)(int64_t iterations);
+
+typedef struct _BENCH_T {
+	const char *name;
+	BENCH_FUNC func;
+} BENCH_T;
+
+typedef struct _BENCH_RESULT_T {
+	const char *name;
+	int64_t iterations;
+	double real_ns; //per iteration, median of repetitions
+	double cpu_ns;
+	double min_real_ns;
+	double max_real_ns;
+	double bytes_per_sec; //0 : n/a
+} BENCH_RESULT_T;
+
+static volatile float lg_sink; //keeps results alive
+static VECTOR4D_T lg_quats[NUM_OF_INPUTS];
+
+static void init_inputs() {
+	srand(360);
+	for (int i = 0; i < NUM_OF_INPUTS; i++) {
+		VECTOR4D_T q = quaternion_get_from_y((rand() % 3600) * M_PI / 1800);
+		q = quaternion_multiply(q, quaternion_get_from_x((rand() % 1800 - 900) * M_PI / 1800));
+		q = quaternion_multiply(q, quaternion_get_from_z((rand() % 3600) * M_PI / 1800));
+		lg_quats[i] = quaternion_normalize(q);
+	}
+}
+
+///////////////////////////////////////////
+#if (1) //quaternion and matrix
+
+static uint64_t bench_quaternion_multiply(int64_t iterations) {
+	VECTOR4D_T q = quaternion_init();
+	for (int64_t i = 0; i < iterations; i++) {
+		q = quaternion_multiply(q, lg_quats[i & (NUM_OF_INPUTS - 1)]);
+	}
+	lg_sink = q.w;
+	return 0;
+}
+
+static uint64_t bench_quaternion_get_euler(int64_t iterations) {
+	float sum = 0;
+	for (int64_t i = 0; i < iterations; i++) {
+		float r1, r2, r3;
+		quaternion_get_euler(lg_quats[i & (NUM_OF_INPUTS - 1)], &r1, &r2, &r3, EULER_SEQUENCE_YXZ);
+		sum += r1 + r2 + r3;
+	}
+	lg_sink = sum;
+	return 0;
+}
+
+static uint64_t bench_mat4_cam_attitude(int64_t iterations) {
+	float cam_offset[3] = { 0.01, -0.02, 0.03 };
+	float cam_matrix[16];
+	float unif_matrix[16];
+	float sum = 0;
+	for (int64_t i = 0; i < iterations; i++) {
+		//cam matrix from the device quaternion, as get_cam_attitude in picam360_capture.c
+		mat4_identity(cam_matrix);
+		mat4_fromQuat(cam_matrix, lg_quats[(i + 1) & (NUM_OF_INPUTS - 1)].ary);
+		cam_attitude_get_matrix(lg_quats[i & (NUM_OF_INPUTS - 1)], cam_matrix, cam_offset, unif_matrix);
+		sum += unif_matrix[(int) (i & 15)];
+	}
+	lg_sink = sum;
+	return 0;
+}
+
+#endif //quaternion and matrix
+
+///////////////////////////////////////////
+#if (1) //rtp
+
+static RTP_T *lg_rtp = NULL;
+static unsigned char lg_payload[RTP_MAXPAYLOADSIZE];
+
+//tx to a udp socket on loopback which is never read, the kernel drops what overflows
+static RTP_T *get_rtp() {
+	if (lg_rtp) {
+		return lg_rtp;
+	}
+	int sink_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in addr = { };
+	socklen_t addr_len = sizeof(addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (sink_fd < 0 || bind(sink_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || getsockname(sink_fd, (struct sockaddr*) &addr, &addr_len) < 0) {
+		perror("bench : sink socket");
+		exit(-1);
+	}
+	for (int i = 0; i < sizeof(lg_payload); i++) {
+		lg_payload[i] = (unsigned char) (i * 7 + 1);
+	}
+	lg_rtp = create_rtp(0, RTP_SOCKET_TYPE_NONE, "127.0.0.1", ntohs(addr.sin_port), RTP_SOCKET_TYPE_UDP, 0);
+	return lg_rtp;
+}
+
+static uint64_t rtp_sendpacket_n(int64_t iterations, int payload_len) {
+	RTP_T *rtp = get_rtp();
+	for (int64_t i = 0; i < iterations; i++) {
+		rtp_sendpacket(rtp, lg_payload, payload_len, 110);
+	}
+	rtp_flush(rtp);
+	return (uint64_t) iterations * payload_len;
+}
+
+static uint64_t bench_rtp_sendpacket_1k(int64_t iterations) {
+	return rtp_sendpacket_n(iterations, 1024);
+}
+
+static uint64_t bench_rtp_sendpacket_max(int64_t iterations) {
+	return rtp_sendpacket_n(iterations, RTP_MAXPAYLOADSIZE);
+}
+
+#endif //rtp
+
+///////////////////////////////////////////
+#if (1) //stream framing
+
+#define STREAM_LEN (4 * 1024 * 1024)
+
+typedef struct _STREAM_T {
+	unsigned char *data;
+	int len;
+	int chunk_len; //as read from socket or pipe
+	uint64_t frames;
+} STREAM_T;
+
+static void count_callback(unsigned char *data, unsigned int data_len, void *user_data) {
+	STREAM_T *stream = (STREAM_T*) user_data;
+	stream->frames++;
+	lg_sink = data[data_len - 1];
+}
+
+static uint64_t push_stream(STREAM_T *stream, STREAM_FRAMER_T *framer, int64_t iterations) {
+	for (int64_t i = 0; i < iterations; i++) {
+		for (int off = 0; off < stream->len; off += stream->chunk_len) {
+			stream_framer_push(framer, stream->data + off, MIN(stream->chunk_len, stream->len - off));
+		}
+	}
+	return (uint64_t) iterations * stream->len;
+}
+
+//0xFF 0xE1 len "rtp\0" rtp packet, as rtp_sendpacket writes
+static uint64_t bench_xmp_framer(int64_t iterations) {
+	static STREAM_T stream = { };
+	static STREAM_FRAMER_T framer;
+	if (stream.data == NULL) {
+		const unsigned char XMP_MARKER[] = { 0xFF, 0xE1 };
+		stream.data = (unsigned char*) malloc(STREAM_LEN);
+		stream.chunk_len = RTP_MAXPACKETSIZE;
+		srand(360);
+		for (;;) {
+			int payload_len = 200 + rand() % (RTP_MAXPAYLOADSIZE - 200);
+			int len = 8 + 12 + payload_len;
+			if (stream.len + len > STREAM_LEN) {
+				break;
+			}
+			unsigned char *p = stream.data + stream.len;
+			p[0] = 0xFF;
+			p[1] = 0xE1;
+			p[2] = len & 0xFF;
+			p[3] = (len >> 8) & 0xFF;
+			memcpy(p + 4, "rtp", 4);
+			for (int i = 8; i < len; i++) {
+				p[i] = (unsigned char) (rand() % 0xFF);
+			}
+			stream.len += len;
+		}
+		stream_framer_init(&framer, XMP_MARKER, sizeof(XMP_MARKER), rtp_get_xmp_len, count_callback, &stream);
+	}
+	return push_stream(&stream, &framer, iterations);
+}
+
+//annex-b from encoder pipe, as in gst_encoder
+static uint64_t bench_annexb_split(int64_t iterations) {
+	static STREAM_T stream = { };
+	static STREAM_FRAMER_T framer;
+	if (stream.data == NULL) {
+		const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
+		stream.data = (unsigned char*) malloc(STREAM_LEN);
+		stream.chunk_len = 64 * 1024;
+		srand(360);
+		for (;;) {
+			int nal_len = (rand() % 8 == 0) ? 20 + rand() % 40 : 1000 + rand() % 60000; //parameter sets and slices
+			int len = sizeof(SC) + nal_len;
+			if (stream.len + len > STREAM_LEN) {
+				break;
+			}
+			unsigned char *p = stream.data + stream.len;
+			memcpy(p, SC, sizeof(SC));
+			for (int i = sizeof(SC); i < len; i++) { //no start code emulation in payload
+				p[i] = (unsigned char) (1 + rand() % 0xFF);
+			}
+			stream.len += len;
+		}
+		stream_framer_init(&framer, SC, sizeof(SC), NULL, count_callback, &stream);
+	}
+	return push_stream(&stream, &framer, iterations);
+}
+
+#endif //stream framing
+
+///////////////////////////////////////////
+#if (1) //metadata and status
+
+//fields of xmp() in host
+static uint64_t bench_xmp_frame_meta(int64_t iterations) {
+	unsigned char buff[FRAME_META_APP_MAX_LEN];
+	FRAME_META_T meta = { };
+	meta.fields = FRAME_META_TIMESTAMP | FRAME_META_CAMERA_QUAT | FRAME_META_COMPASS | FRAME_META_TEMPERATURE | FRAME_META_CAMERA_OFFSET;
+	meta.compass.x = 0.3;
+	meta.compass.y = -0.1;
+	meta.compass.z = 0.9;
+	meta.temperature = 45.5;
+	meta.camera_offset.w = 0.5;
+	uint64_t bytes = 0;
+	for (int64_t i = 0; i < iterations; i++) {
+		meta.timestamp_us = 1500000000000000ULL + i * 33333;
+		meta.camera_quat = lg_quats[i & (NUM_OF_INPUTS - 1)];
+		bytes += MAX(frame_meta_write_app(&meta, buff, sizeof(buff)), 0);
+	}
+	lg_sink = buff[bytes % 16];
+	return bytes;
+}
+
+#define NUM_OF_STATUSES 16
+
+static int64_t lg_status_counter = 0;
+
+static void bench_status_get_value(void *user_data, char *buff, int buff_len) {
+	STATUS_T *status = (STATUS_T*) user_data;
+	if (strcmp(status->name, "info") == 0) { //long text, deflated
+		int len = 0;
+		for (int i = 0; len < 2048 && len < buff_len; i++) {
+			len += snprintf(buff + len, buff_len - len, "cam%d fps %.1f skip %d kbps %d\n", i % 2, 29.9, (int) (lg_status_counter % 7), 4000 + i);
+		}
+	} else {
+		VECTOR4D_T q = lg_quats[lg_status_counter & (NUM_OF_INPUTS - 1)];
+		snprintf(buff, buff_len, "%f,%f,%f,%f", q.x, q.y, q.z, q.w);
+	}
+}
+
+static void count_send(const unsigned char *data, int data_len, void *user_data) {
+	*(uint64_t*) user_data += data_len;
+}
+
+//every status changes in every update, as quaternion at full rate
+static uint64_t bench_status_publisher(int64_t iterations) {
+	static STATUS_PUBLISHER_T pub;
+	static STATUS_T statuses[NUM_OF_STATUSES];
+	static STATUS_T *status_ptrs[NUM_OF_STATUSES + 1];
+	static uint64_t sent_bytes = 0;
+	if (status_ptrs[0] == NULL) {
+		status_publisher_init(&pub, RTP_MAXPAYLOADSIZE, count_send, &sent_bytes);
+		pub.interval = 0;
+		pub.snapshot_interval = 0;
+		for (int i = 0; i < NUM_OF_STATUSES; i++) {
+			if (i == 0) {
+				strcpy(statuses[i].name, "info");
+			} else {
+				snprintf(statuses[i].name, sizeof(statuses[i].name), "status%d", i);
+			}
+			statuses[i].get_value = bench_status_get_value;
+			statuses[i].user_data = &statuses[i];
+			status_ptrs[i] = &statuses[i];
+		}
+	}
+	uint64_t start_bytes = sent_bytes;
+	for (int64_t i = 0; i < iterations; i++) {
+		lg_status_counter++;
+		status_publisher_update(&pub, status_ptrs, lg_status_counter * 0.01);
+	}
+	return sent_bytes - start_bytes;
+}
+
+#endif //metadata and status
+
+///////////////////////////////////////////
+#if (1) //mrevent
+
+static MREVENT_T lg_ping;
+static MREVENT_T lg_pong;
+
+static void *pong_thread_func(void *arg) {
+	pthread_setname_np(pthread_self(), "BENCH PONG");
+	for (;;) {
+		if (mrevent_wait(&lg_ping, 1000000) != 0) {
+			continue;
+		}
+		mrevent_reset(&lg_ping);
+		mrevent_trigger(&lg_pong);
+	}
+	return NULL;
+}
+
+//trigger to wake of another thread and back, as request_frame_event and arrived_frame_event
+static uint64_t bench_mrevent_round_trip(int64_t iterations) {
+	static pthread_t pong_thread = 0;
+	if (pong_thread == 0) {
+		mrevent_init(&lg_ping);
+		mrevent_init(&lg_pong);
+		pthread_create(&pong_thread, NULL, pong_thread_func, NULL);
+	}
+	for (int64_t i = 0; i < iterations; i++) {
+		mrevent_trigger(&lg_ping);
+		mrevent_wait(&lg_pong, 1000000);
+		mrevent_reset(&lg_pong);
+	}
+	return 0;
+}
+
+#endif //mrevent
+
+static const BENCH_T lg_benches[] = { //
+		{ "quaternion_multiply", bench_quaternion_multiply }, //
+		{ "quaternion_get_euler", bench_quaternion_get_euler }, //
+		{ "mat4_cam_attitude", bench_mat4_cam_attitude }, //
+		{ "rtp_sendpacket/1024", bench_rtp_sendpacket_1k }, //
+		{ "rtp_sendpacket/max", bench_rtp_sendpacket_max }, //
+		{ "xmp_framer/4MB", bench_xmp_framer }, //
+		{ "annexb_split/4MB", bench_annexb_split }, //
+		{ "xmp_frame_meta", bench_xmp_frame_meta }, //
+		{ "status_publisher_update/16", bench_status_publisher }, //
+		{ "mrevent_round_trip", bench_mrevent_round_trip }, //
+		};
+
+static double now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double d = *(const double*) a - *(const double*) b;
+	return (d > 0) - (d < 0);
+}
+
+//iterations are grown until a run takes min_time, then the run is repeated
+static void run_bench(const BENCH_T *bench, double min_time, int repetitions, BENCH_RESULT_T *result) {
+	int64_t iterations = 1;
+	bench->func(1); //warm up and lazy setup
+	for (;;) {
+		double s = now_ns(CLOCK_MONOTONIC);
+		bench->func(iterations);
+		double elapsed = (now_ns(CLOCK_MONOTONIC) - s) / 1e9;
+		if (elapsed >= min_time || iterations >= MAX_ITERATIONS) {
+			break;
+		}
+		double scale = (elapsed > 0) ? min_time * 1.4 / elapsed : 10;
+		iterations = MIN((int64_t) (iterations * MIN(MAX(scale, 2), 10)), MAX_ITERATIONS);
+	}
+
+	double real_ns[MAX_REPETITIONS];
+	double cpu_ns[MAX_REPETITIONS];
+	double bytes_per_sec[MAX_REPETITIONS];
+	for (int r = 0; r < repetitions; r++) {
+		double s = now_ns(CLOCK_MONOTONIC);
+		double cs = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+		uint64_t bytes = bench->func(iterations);
+		double elapsed = now_ns(CLOCK_MONOTONIC) - s;
+		cpu_ns[r] = (now_ns(CLOCK_PROCESS_CPUTIME_ID) - cs) / iterations;
+		real_ns[r] = elapsed / iterations;
+		bytes_per_sec[r] = (elapsed > 0) ? bytes * 1e9 / elapsed : 0;
+	}
+	result->name = bench->name;
+	result->iterations = iterations;
+	result->bytes_per_sec = bytes_per_sec[0];
+	qsort(real_ns, repetitions, sizeof(double), compare_double);
+	qsort(cpu_ns, repetitions, sizeof(double), compare_double);
+	qsort(bytes_per_sec, repetitions, sizeof(double), compare_double);
+	result->real_ns = real_ns[repetitions / 2];
+	result->cpu_ns = cpu_ns[repetitions / 2];
+	result->min_real_ns = real_ns[0];
+	result->max_real_ns = real_ns[repetitions - 1];
+	result->bytes_per_sec = bytes_per_sec[repetitions / 2];
+}
+
+static void write_json(FILE *fp, const char *executable, BENCH_RESULT_T *results, int num_of_results, int repetitions) {
+	char date[64];
+	char host_name[256] = { };
+	time_t t = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&t));
+	gethostname(host_name, sizeof(host_name) - 1);
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"context\": {\n");
+	fprintf(fp, "    \"date\": \"%s\",\n", date);
+	fprintf(fp, "    \"host_name\": \"%s\",\n", host_name);
+	fprintf(fp, "    \"executable\": \"%s\",\n", executable);
+	fprintf(fp, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(fp, "    \"picam360_version\": \"%s\",\n", PICAM360_BENCH_VERSION);
+#ifdef NDEBUG
+	fprintf(fp, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(fp, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"benchmarks\": [\n");
+	for (int i = 0; i < num_of_results; i++) {
+		BENCH_RESULT_T *r = &results[i];
+		fprintf(fp, "    {\n");
+		fprintf(fp, "      \"name\": \"%s\",\n", r->name);
+		fprintf(fp, "      \"run_name\": \"%s\",\n", r->name);
+		fprintf(fp, "      \"run_type\": \"iteration\",\n");
+		fprintf(fp, "      \"repetitions\": %d,\n", repetitions);
+		fprintf(fp, "      \"iterations\": %lld,\n", (long long) r->iterations);
+		fprintf(fp, "      \"real_time\": %.3f,\n", r->real_ns);
+		fprintf(fp, "      \"cpu_time\": %.3f,\n", r->cpu_ns);
+		fprintf(fp, "      \"min_real_time\": %.3f,\n", r->min_real_ns);
+		fprintf(fp, "      \"max_real_time\": %.3f,\n", r->max_real_ns);
+		if (r->bytes_per_sec > 0) {
+			fprintf(fp, "      \"bytes_per_second\": %.0f,\n", r->bytes_per_sec);
+		}
+		fprintf(fp, "      \"time_unit\": \"ns\"\n");
+		fprintf(fp, "    }%s\n", (i + 1 < num_of_results) ? "," : "");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+	const char *json_path = NULL;
+	const char *filter = NULL;
+	double min_time = 0.5;
+	int repetitions = 5;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:f:t:r:l")) != -1) {
+		switch (opt) {
+		case 'j':
+			json_path = optarg;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 'r':
+			repetitions = MIN(MAX(atoi(optarg), 1), MAX_REPETITIONS);
+			break;
+		case 'l':
+			for (int i = 0; i < sizeof(lg_benches) / sizeof(lg_benches[0]); i++) {
+				printf("%s\n", lg_benches[i].name);
+			}
+			return 0;
+		default:
+			printf("Usage: %s [-j json_path] [-f name_filter] [-t min_time_sec] [-r repetitions] [-l]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	init_inputs();
+
+	const int num_of_benches = sizeof(lg_benches) / sizeof(lg_benches[0]);
+	BENCH_RESULT_T results[num_of_benches];
+	int num_of_results = 0;
+	printf("%-28s %14s %14s %12s %14s\n", "benchmark", "time(ns)", "cpu(ns)", "iterations", "MB/s");
+	for (int i = 0; i < num_of_benches; i++) {
+		if (filter && strstr(lg_benches[i].name, filter) == NULL) {
+			continue;
+		}
+		BENCH_RESULT_T *r = &results[num_of_results++];
+		run_bench(&lg_benches[i], min_time, repetitions, r);
+		char mbps[32] = "-";
+		if (r->bytes_per_sec > 0) {
+			snprintf(mbps, sizeof(mbps), "%.1f", r->bytes_per_sec / (1024 * 1024));
+		}
+		printf("%-28s %14.1f %14.1f %12lld %14s\n", r->name, r->real_ns, r->cpu_ns, (long long) r->iterations, mbps);
+		fflush(stdout);
+	}
+
+	if (json_path) {
+		FILE *fp = fopen(json_path, "w");
+		if (fp == NULL) {
+			perror(json_path);
+			return -1;
+		}
+		write_json(fp, argv[0], results, num_of_results, repetitions);
+		fclose(fp);
+		printf("%s written\n", json_path);
+	}
+	return 0;
+}
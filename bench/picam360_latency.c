@@ -0,0 +1,663 @@
+/**
+ * end-to-end latency harness, a stand-in client on loopback
+ * sends poses with client keys, receives the rtp video stream and matches the frame meta sei to the poses
+ * the host and this harness have to share the wall clock, run both on one box (see README)
+ */
+
+#define _GNU_SOURCE //pthread_setname_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "quaternion.h"
+#include "rtp.h"
+#include "frame_meta.h"
+#include "pose_slot.h"
+
+#ifndef PICAM360_BENCH_VERSION
+#define PICAM360_BENCH_VERSION "unknown"
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define PT_CMD 101
+#define PT_POSE 109
+#define PT_CAM_BASE 110
+
+#define SENT_RING_SIZE 4096 //by pose seq
+#define STALL_FACTOR 1.5 //frame interval over mean
+
+typedef struct _OPTIONS_T {
+	int rx_port;
+	char host_ip[64];
+	int host_port;
+	float pose_rate; //hz
+	float duration; //sec
+	float warmup; //sec
+	int frame_id;
+	int pt;
+	bool legacy; //set_view_quaternion command instead of binary pose
+	const char *host_cmd;
+	const char *decoder_cmd;
+	const char *json_path;
+	float limit_ms; //p99 of total, 0 : no limit
+} OPTIONS_T;
+
+enum STAGE {
+	STAGE_UPLINK, //sent to applied by renderer, network and pose slot wait
+	STAGE_IDLE, //applied to render start
+	STAGE_RENDER,
+	STAGE_ENCODE,
+	STAGE_DOWNLINK, //sei timestamp to last nal of the picture received
+	STAGE_TOTAL, //pose sent to picture received
+	STAGE_NUM,
+};
+
+static const char *lg_stage_names[STAGE_NUM] = { "uplink", "idle", "render", "encode", "downlink", "total" };
+
+typedef struct _SAMPLES_T {
+	double *values;
+	int num;
+	int size;
+} SAMPLES_T;
+
+typedef struct _SENT_T {
+	uint32_t seq;
+	uint64_t time_us;
+} SENT_T;
+
+typedef struct _PICTURE_T {
+	bool valid;
+	FRAME_META_T meta;
+	uint64_t arrival_us; //eoi of the last nal so far
+	int bytes;
+} PICTURE_T;
+
+enum RX_STATE {
+	RX_HEADER, RX_NAL, RX_EOI,
+};
+
+static OPTIONS_T lg_options = { 9004, "127.0.0.1", 9005, 30, 10, 2, 0, PT_CAM_BASE, false, NULL, NULL, NULL, 0 };
+static volatile bool lg_run = true;
+static RTP_T *lg_rtp = NULL;
+static FILE *lg_decoder = NULL;
+static uint64_t lg_start_us = 0;
+static uint64_t lg_warmup_end_us = 0;
+static uint16_t lg_session = 0; //seq restarts on every run
+
+static pthread_mutex_t lg_mutex = PTHREAD_MUTEX_INITIALIZER; //everything below
+static SENT_T lg_sent[SENT_RING_SIZE];
+static uint32_t lg_poses_sent = 0;
+
+static enum RX_STATE lg_rx_state = RX_HEADER;
+static unsigned char *lg_nal = NULL;
+static int lg_nal_pos = 0;
+static int lg_nal_size = 0;
+static PICTURE_T lg_picture = { };
+static char lg_last_client_key[256] = { };
+
+static SAMPLES_T lg_stages[STAGE_NUM] = { };
+static SAMPLES_T lg_arrivals = { }; //usec from start
+static int lg_frames = 0; //after warmup
+static int lg_frames_matched = 0;
+static int lg_frames_unmatched = 0;
+static uint64_t lg_packets = 0;
+static uint64_t lg_bytes = 0;
+static int lg_packets_lost = 0;
+static int lg_desync = 0;
+static int lg_last_seq_num = -1;
+static bool lg_rx_closed = false;
+
+static uint64_t now_us() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static uint32_t read_be32(const unsigned char *p) {
+	return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void samples_push(SAMPLES_T *_this, double value) {
+	if (_this->num == _this->size) {
+		_this->size = MAX(_this->size * 2, 1024);
+		_this->values = (double*) realloc(_this->values, sizeof(double) * _this->size);
+	}
+	_this->values[_this->num++] = value;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double da = *(const double*) a;
+	double db = *(const double*) b;
+	return (da > db) - (da < db);
+}
+
+typedef struct _SUMMARY_T {
+	int count;
+	double mean;
+	double stddev;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+} SUMMARY_T;
+
+//nearest rank percentiles
+static SUMMARY_T samples_summarize(const SAMPLES_T *_this) {
+	SUMMARY_T s = { };
+	s.count = _this->num;
+	if (s.count == 0) {
+		return s;
+	}
+	double *sorted = (double*) malloc(sizeof(double) * s.count);
+	memcpy(sorted, _this->values, sizeof(double) * s.count);
+	qsort(sorted, s.count, sizeof(double), compare_double);
+	double sum = 0;
+	for (int i = 0; i < s.count; i++) {
+		sum += sorted[i];
+	}
+	s.mean = sum / s.count;
+	double var = 0;
+	for (int i = 0; i < s.count; i++) {
+		var += (sorted[i] - s.mean) * (sorted[i] - s.mean);
+	}
+	s.stddev = sqrt(var / s.count);
+#define PERCENTILE(p) sorted[MIN((int) ceil(s.count * (p) / 100.0), s.count) - 1]
+	s.p50 = PERCENTILE(50);
+	s.p90 = PERCENTILE(90);
+	s.p99 = PERCENTILE(99);
+#undef PERCENTILE
+	s.max = sorted[s.count - 1];
+	free(sorted);
+	return s;
+}
+
+///////////////////////////////////////////
+#if (1) //pose sender
+
+static void send_pose(uint32_t seq, uint64_t time_us) {
+	//yaw keeps rotating 90 deg/sec so that every pose differs
+	double t = (time_us - lg_start_us) / 1000000.0;
+	VECTOR4D_T quat = quaternion_get_from_y(fmod(t * M_PI / 2, 2 * M_PI));
+	char client_key[32];
+	snprintf(client_key, sizeof(client_key), "%u", seq);
+
+	if (lg_options.legacy) {
+		char cmd[512];
+		int len = snprintf(cmd, sizeof(cmd),
+				"<picam360:command id=\"%u\" value=\"set_view_quaternion quat=%.6f,%.6f,%.6f,%.6f fov=120 client_key=%s client_time=%.3f id=%d\" />",
+				seq, quat.x, quat.y, quat.z, quat.w, client_key, time_us / 1000.0, lg_options.frame_id);
+		rtp_sendpacket(lg_rtp, (unsigned char*) cmd, len + 1, PT_CMD);
+	} else {
+		POSE_T pose = { };
+		pose.flags = POSE_FLAG_FOV | POSE_FLAG_CLIENT_TIME | POSE_FLAG_CLIENT_KEY | POSE_FLAG_SEQ;
+		pose.frame_id = lg_options.frame_id;
+		pose.session = lg_session;
+		pose.seq = seq;
+		pose.quat = quat;
+		pose.fov = 120;
+		pose.client_time = time_us / 1000.0;
+		strncpy(pose.client_key, client_key, sizeof(pose.client_key) - 1);
+		unsigned char packet[POSE_MESSAGE_LEN];
+		int len = pose_message_encode(&pose, packet, sizeof(packet));
+		rtp_sendpacket(lg_rtp, packet, len, PT_POSE);
+	}
+	rtp_flush(lg_rtp);
+}
+
+static void *pose_thread_func(void *arg) {
+	pthread_setname_np(pthread_self(), "POSE SENDER");
+
+	long interval_ns = (long) (1000000000.0 / lg_options.pose_rate);
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	uint32_t seq = 0;
+	while (lg_run) {
+		seq++;
+		uint64_t time_us = now_us();
+		pthread_mutex_lock(&lg_mutex);
+		lg_sent[seq % SENT_RING_SIZE].seq = seq;
+		lg_sent[seq % SENT_RING_SIZE].time_us = time_us;
+		lg_poses_sent++;
+		pthread_mutex_unlock(&lg_mutex);
+		send_pose(seq, time_us);
+
+		next.tv_nsec += interval_ns;
+		next.tv_sec += next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	return NULL;
+}
+
+#endif //pose sender
+
+///////////////////////////////////////////
+#if (1) //stream receiver
+
+//called with lg_mutex
+static void finish_picture() {
+	PICTURE_T *pic = &lg_picture;
+	if (!pic->valid || pic->arrival_us == 0) {
+		return;
+	}
+	pic->valid = false;
+	if (pic->arrival_us < lg_warmup_end_us) {
+		if (pic->meta.fields & FRAME_META_CLIENT_KEY) {
+			strncpy(lg_last_client_key, pic->meta.client_key, sizeof(lg_last_client_key) - 1);
+		}
+		return;
+	}
+	lg_frames++;
+	samples_push(&lg_arrivals, (double) (pic->arrival_us - lg_start_us));
+
+	//the key stays on frames until next pose is applied, only its first frame shows the pose
+	if (!(pic->meta.fields & FRAME_META_CLIENT_KEY) || strcmp(pic->meta.client_key, lg_last_client_key) == 0) {
+		return;
+	}
+	strncpy(lg_last_client_key, pic->meta.client_key, sizeof(lg_last_client_key) - 1);
+
+	char *end = NULL;
+	uint32_t seq = strtoul(pic->meta.client_key, &end, 10);
+	SENT_T *sent = &lg_sent[seq % SENT_RING_SIZE];
+	if (end == pic->meta.client_key || sent->seq != seq || sent->time_us == 0) {
+		lg_frames_unmatched++;
+		return;
+	}
+	lg_frames_matched++;
+
+	double arrival_ms = pic->arrival_us / 1000.0;
+	double sent_ms = sent->time_us / 1000.0;
+	samples_push(&lg_stages[STAGE_TOTAL], arrival_ms - sent_ms);
+	if ((pic->meta.fields & FRAME_META_TIMING) && (pic->meta.fields & FRAME_META_TIMESTAMP)) {
+		//timestamp is taken right after encode, apply time is traced back by timing
+		double timestamp_ms = pic->meta.timestamp_us / 1000.0;
+		double applied_ms = timestamp_ms - (pic->meta.encoded + pic->meta.frame_processed + pic->meta.idle_time) * 1000;
+		samples_push(&lg_stages[STAGE_UPLINK], applied_ms - sent_ms);
+		samples_push(&lg_stages[STAGE_IDLE], pic->meta.idle_time * 1000);
+		samples_push(&lg_stages[STAGE_RENDER], pic->meta.frame_processed * 1000);
+		samples_push(&lg_stages[STAGE_ENCODE], pic->meta.encoded * 1000);
+		samples_push(&lg_stages[STAGE_DOWNLINK], arrival_ms - timestamp_ms);
+	}
+}
+
+//SOI, 4-byte length, sei nal
+static bool receive_header(const unsigned char *data, int data_len) {
+	if (data_len < 7 || data_len - 6 != read_be32(data + 2)) {
+		return false;
+	}
+	bool h265;
+	if (data[0] == 'H' && data[1] == 'E') {
+		h265 = true;
+	} else if (data[0] == 'N' && data[1] == 'A') {
+		h265 = false;
+	} else {
+		return false;
+	}
+	FRAME_META_T meta = { };
+	if (!frame_meta_read_sei(data + 6, data_len - 6, h265, &meta)) { //legacy xml after one byte nal header
+		char xml[FRAME_META_SEI_MAX_LEN + 1];
+		int len = MIN(data_len - 7, FRAME_META_SEI_MAX_LEN);
+		memcpy(xml, data + 7, len);
+		xml[len] = '\0';
+		frame_meta_parse_xml(xml, &meta);
+	}
+	if (meta.fields & FRAME_META_VIEW_QUAT) { //first nal of a picture
+		finish_picture();
+		memset(&lg_picture, 0, sizeof(lg_picture));
+		lg_picture.valid = true;
+		lg_picture.meta = meta;
+	}
+	lg_rx_state = RX_NAL;
+	lg_nal_pos = 0;
+	return true;
+}
+
+static void receive_nal(const unsigned char *data, int data_len) {
+	if (lg_nal_pos + data_len > lg_nal_size) {
+		lg_nal_size = MAX(lg_nal_pos + data_len, lg_nal_size * 2);
+		lg_nal = (unsigned char*) realloc(lg_nal, lg_nal_size);
+	}
+	memcpy(lg_nal + lg_nal_pos, data, data_len);
+	lg_nal_pos += data_len;
+	if (lg_nal_pos < 4 || lg_nal_pos < 4 + read_be32(lg_nal)) {
+		return;
+	}
+	if (lg_decoder) { //annex-b
+		const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
+		if (fwrite(SC, 1, sizeof(SC), lg_decoder) != sizeof(SC) || fwrite(lg_nal + 4, 1, lg_nal_pos - 4, lg_decoder) != lg_nal_pos - 4) {
+			printf("decoder : pipe closed\n");
+			pclose(lg_decoder);
+			lg_decoder = NULL;
+		}
+	}
+	lg_rx_state = RX_EOI;
+}
+
+static void rtp_callback(unsigned char *data, unsigned int data_len, unsigned char pt, unsigned int seq_num, void *user_data) {
+	if (data_len == 0) {
+		return;
+	}
+	uint64_t now = now_us();
+	pthread_mutex_lock(&lg_mutex);
+	if (lg_rx_closed) {
+		pthread_mutex_unlock(&lg_mutex);
+		return;
+	}
+	if (lg_last_seq_num >= 0 && seq_num != ((lg_last_seq_num + 1) & 0xFFFF)) {
+		lg_packets_lost += (seq_num - lg_last_seq_num - 1) & 0xFFFF;
+	}
+	lg_last_seq_num = seq_num & 0xFFFF;
+	if (pt != lg_options.pt) {
+		pthread_mutex_unlock(&lg_mutex);
+		return;
+	}
+	lg_packets++;
+	lg_bytes += data_len;
+
+	switch (lg_rx_state) {
+	case RX_HEADER:
+		if (!receive_header(data, data_len)) {
+			lg_desync++;
+		}
+		break;
+	case RX_NAL:
+		receive_nal(data, data_len);
+		break;
+	case RX_EOI:
+		if (data_len == 2 && ((data[0] == 'V' && data[1] == 'C') || (data[0] == 'L' && data[1] == 'U'))) {
+			lg_picture.arrival_us = now;
+			lg_picture.bytes += lg_nal_pos;
+			lg_rx_state = RX_HEADER;
+		} else {
+			lg_desync++;
+			lg_rx_state = RX_HEADER;
+			receive_header(data, data_len);
+		}
+		break;
+	}
+	pthread_mutex_unlock(&lg_mutex);
+}
+
+#endif //stream receiver
+
+///////////////////////////////////////////
+#if (1) //report
+
+typedef struct _FPS_T {
+	double fps;
+	double interval_mean_ms;
+	double interval_stddev_ms;
+	double interval_p99_ms;
+	double interval_max_ms;
+	int stalls;
+} FPS_T;
+
+static FPS_T get_fps_stability() {
+	FPS_T f = { };
+	if (lg_arrivals.num < 2) {
+		return f;
+	}
+	SAMPLES_T intervals = { };
+	for (int i = 1; i < lg_arrivals.num; i++) {
+		samples_push(&intervals, (lg_arrivals.values[i] - lg_arrivals.values[i - 1]) / 1000);
+	}
+	SUMMARY_T s = samples_summarize(&intervals);
+	f.fps = (lg_arrivals.num - 1) * 1000000.0 / (lg_arrivals.values[lg_arrivals.num - 1] - lg_arrivals.values[0]);
+	f.interval_mean_ms = s.mean;
+	f.interval_stddev_ms = s.stddev;
+	f.interval_p99_ms = s.p99;
+	f.interval_max_ms = s.max;
+	for (int i = 0; i < intervals.num; i++) {
+		if (intervals.values[i] > s.mean * STALL_FACTOR) {
+			f.stalls++;
+		}
+	}
+	free(intervals.values);
+	return f;
+}
+
+static void print_report(const FPS_T *fps, const SUMMARY_T *stages) {
+	printf("\n");
+	printf("frames %d (%.2f fps), interval stddev %.2f ms, p99 %.2f ms, max %.2f ms, stalls %d\n", lg_frames, fps->fps,
+			fps->interval_stddev_ms, fps->interval_p99_ms, fps->interval_max_ms, fps->stalls);
+	printf("poses sent %u, shown %d, unmatched %d, rtp lost %d, desync %d\n", lg_poses_sent, lg_frames_matched, lg_frames_unmatched,
+			lg_packets_lost, lg_desync);
+	printf("%-10s %8s %10s %10s %10s %10s %10s\n", "stage(ms)", "count", "mean", "p50", "p90", "p99", "max");
+	for (int i = 0; i < STAGE_NUM; i++) {
+		const SUMMARY_T *s = &stages[i];
+		printf("%-10s %8d %10.2f %10.2f %10.2f %10.2f %10.2f\n", lg_stage_names[i], s->count, s->mean, s->p50, s->p90, s->p99, s->max);
+	}
+}
+
+static void write_json(FILE *fp, const char *executable, const FPS_T *fps, const SUMMARY_T *stages) {
+	char date[64];
+	time_t t = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&t));
+	char host_name[256] = { };
+	gethostname(host_name, sizeof(host_name) - 1);
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"context\": {\n");
+	fprintf(fp, "    \"date\": \"%s\",\n", date);
+	fprintf(fp, "    \"host_name\": \"%s\",\n", host_name);
+	fprintf(fp, "    \"executable\": \"%s\",\n", executable);
+	fprintf(fp, "    \"version\": \"%s\",\n", PICAM360_BENCH_VERSION);
+	fprintf(fp, "    \"pose_mode\": \"%s\",\n", lg_options.legacy ? "command" : "binary");
+	fprintf(fp, "    \"pose_rate\": %.1f,\n", lg_options.pose_rate);
+	fprintf(fp, "    \"duration\": %.1f,\n", lg_options.duration);
+	fprintf(fp, "    \"warmup\": %.1f,\n", lg_options.warmup);
+	fprintf(fp, "    \"frame_id\": %d,\n", lg_options.frame_id);
+	fprintf(fp, "    \"pt\": %d,\n", lg_options.pt);
+	fprintf(fp, "    \"decoded\": %s\n", lg_options.decoder_cmd ? "true" : "false");
+	fprintf(fp, "  },\n");
+	fprintf(fp, "  \"frames\": %d,\n", lg_frames);
+	fprintf(fp, "  \"fps\": %.3f,\n", fps->fps);
+	fprintf(fp, "  \"interval_mean_ms\": %.3f,\n", fps->interval_mean_ms);
+	fprintf(fp, "  \"interval_stddev_ms\": %.3f,\n", fps->interval_stddev_ms);
+	fprintf(fp, "  \"interval_p99_ms\": %.3f,\n", fps->interval_p99_ms);
+	fprintf(fp, "  \"interval_max_ms\": %.3f,\n", fps->interval_max_ms);
+	fprintf(fp, "  \"stalls\": %d,\n", fps->stalls);
+	fprintf(fp, "  \"poses_sent\": %u,\n", lg_poses_sent);
+	fprintf(fp, "  \"poses_shown\": %d,\n", lg_frames_matched);
+	fprintf(fp, "  \"unmatched\": %d,\n", lg_frames_unmatched);
+	fprintf(fp, "  \"rtp_packets\": %llu,\n", (unsigned long long) lg_packets);
+	fprintf(fp, "  \"rtp_bytes\": %llu,\n", (unsigned long long) lg_bytes);
+	fprintf(fp, "  \"rtp_lost\": %d,\n", lg_packets_lost);
+	fprintf(fp, "  \"desync\": %d,\n", lg_desync);
+	fprintf(fp, "  \"stages\": [\n");
+	for (int i = 0; i < STAGE_NUM; i++) {
+		const SUMMARY_T *s = &stages[i];
+		fprintf(fp, "    {\n");
+		fprintf(fp, "      \"name\": \"%s\",\n", lg_stage_names[i]);
+		fprintf(fp, "      \"count\": %d,\n", s->count);
+		fprintf(fp, "      \"mean\": %.3f,\n", s->mean);
+		fprintf(fp, "      \"p50\": %.3f,\n", s->p50);
+		fprintf(fp, "      \"p90\": %.3f,\n", s->p90);
+		fprintf(fp, "      \"p99\": %.3f,\n", s->p99);
+		fprintf(fp, "      \"max\": %.3f,\n", s->max);
+		fprintf(fp, "      \"time_unit\": \"ms\"\n");
+		fprintf(fp, "    }%s\n", (i == STAGE_NUM - 1) ? "" : ",");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+}
+
+#endif //report
+
+///////////////////////////////////////////
+#if (1) //host process
+
+//own process group, sh -c may not exec the command
+static pid_t start_host(const char *cmd) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		setpgid(0, 0);
+		execl("/bin/sh", "sh", "-c", cmd, (char*) NULL);
+		_exit(127);
+	}
+	if (pid < 0) {
+		perror("fork");
+	}
+	return pid;
+}
+
+static void stop_host(pid_t pid) {
+	kill(-pid, SIGTERM);
+	for (int i = 0; i < 50; i++) { //5 sec
+		if (waitpid(pid, NULL, WNOHANG) == pid) {
+			return;
+		}
+		usleep(100 * 1000);
+	}
+	printf("host : not terminated, killed\n");
+	kill(-pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+}
+
+#endif //host process
+
+static void sigint_handler(int sig) {
+	lg_run = false;
+}
+
+int main(int argc, char *argv[]) {
+	int opt;
+	while ((opt = getopt(argc, argv, "p:i:P:r:d:w:n:t:cx:D:j:L:")) != -1) {
+		switch (opt) {
+		case 'p':
+			lg_options.rx_port = atoi(optarg);
+			break;
+		case 'i':
+			strncpy(lg_options.host_ip, optarg, sizeof(lg_options.host_ip) - 1);
+			break;
+		case 'P':
+			lg_options.host_port = atoi(optarg);
+			break;
+		case 'r':
+			lg_options.pose_rate = atof(optarg);
+			break;
+		case 'd':
+			lg_options.duration = atof(optarg);
+			break;
+		case 'w':
+			lg_options.warmup = atof(optarg);
+			break;
+		case 'n':
+			lg_options.frame_id = atoi(optarg);
+			break;
+		case 't':
+			lg_options.pt = atoi(optarg);
+			break;
+		case 'c':
+			lg_options.legacy = true;
+			break;
+		case 'x':
+			lg_options.host_cmd = optarg;
+			break;
+		case 'D':
+			lg_options.decoder_cmd = optarg;
+			break;
+		case 'j':
+			lg_options.json_path = optarg;
+			break;
+		case 'L':
+			lg_options.limit_ms = atof(optarg);
+			break;
+		default:
+			printf("Usage: %s [-p rx_port] [-i host_ip] [-P host_rtcp_port] [-r pose_rate] [-d duration_sec] [-w warmup_sec]\n", argv[0]);
+			printf("       [-n frame_id] [-t pt] [-c] [-x host_cmd] [-D decoder_cmd] [-j json_path] [-L p99_limit_ms]\n");
+			return -1;
+		}
+	}
+	if (lg_options.pose_rate <= 0) {
+		lg_options.pose_rate = 30;
+	}
+	signal(SIGINT, sigint_handler);
+	signal(SIGTERM, sigint_handler);
+	signal(SIGPIPE, SIG_IGN); //decoder may exit
+
+	pid_t host_pid = -1;
+	if (lg_options.host_cmd) {
+		host_pid = start_host(lg_options.host_cmd);
+	}
+	if (lg_options.decoder_cmd) {
+		lg_decoder = popen(lg_options.decoder_cmd, "w");
+		if (lg_decoder == NULL) {
+			perror(lg_options.decoder_cmd);
+		}
+	}
+
+	lg_start_us = now_us();
+	lg_session = pose_session_new();
+	lg_warmup_end_us = lg_start_us + (uint64_t) (lg_options.warmup * 1000000);
+	lg_rtp = create_rtp(lg_options.rx_port, RTP_SOCKET_TYPE_UDP, lg_options.host_ip, lg_options.host_port, RTP_SOCKET_TYPE_UDP, 0);
+	if (lg_rtp == NULL) {
+		printf("failed to open rtp\n");
+		return -1;
+	}
+	rtp_add_callback(lg_rtp, rtp_callback, NULL);
+
+	printf("latency : poses %.1f hz to %s:%d, video on %d pt %d, %.1f + %.1f sec\n", lg_options.pose_rate, lg_options.host_ip,
+			lg_options.host_port, lg_options.rx_port, lg_options.pt, lg_options.warmup, lg_options.duration);
+	pthread_t pose_thread;
+	pthread_create(&pose_thread, NULL, pose_thread_func, NULL);
+
+	uint64_t end_us = lg_warmup_end_us + (uint64_t) (lg_options.duration * 1000000);
+	while (lg_run && now_us() < end_us) {
+		usleep(100 * 1000);
+	}
+	lg_run = false;
+	pthread_join(pose_thread, NULL);
+
+	//delete_rtp waits for next udp packet to stop receiving, rtp is left to the process exit
+	pthread_mutex_lock(&lg_mutex);
+	lg_rx_closed = true;
+	finish_picture();
+	pthread_mutex_unlock(&lg_mutex);
+	if (lg_decoder) {
+		pclose(lg_decoder);
+		lg_decoder = NULL;
+	}
+	if (host_pid > 0) {
+		stop_host(host_pid);
+	}
+
+	FPS_T fps = get_fps_stability();
+	SUMMARY_T stages[STAGE_NUM];
+	for (int i = 0; i < STAGE_NUM; i++) {
+		stages[i] = samples_summarize(&lg_stages[i]);
+	}
+	print_report(&fps, stages);
+
+	if (lg_options.json_path) {
+		FILE *fp = fopen(lg_options.json_path, "w");
+		if (fp == NULL) {
+			perror(lg_options.json_path);
+			return -1;
+		}
+		write_json(fp, argv[0], &fps, stages);
+		fclose(fp);
+		printf("%s written\n", lg_options.json_path);
+	}
+
+	if (stages[STAGE_TOTAL].count == 0) {
+		printf("no frame showed a sent pose\n");
+		return 2;
+	}
+	if (lg_options.limit_ms > 0 && stages[STAGE_TOTAL].p99 > lg_options.limit_ms) {
+		printf("total p99 %.2f ms is over %.2f ms\n", stages[STAGE_TOTAL].p99, lg_options.limit_ms);
+		return 1;
+	}
+	return 0;
+}
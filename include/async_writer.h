@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define ASYNC_WRITER_ALIGN 4096 //for O_DIRECT
+#define ASYNC_WRITER_CHUNK (256 * 1024) //writer wakes up when this much is buffered
+#define ASYNC_WRITER_MAX_WRITE (4 * 1024 * 1024)
+#define ASYNC_WRITER_FLUSH_MS 500 //smaller amount is written after this
+#define ASYNC_WRITER_STALL_MS 100 //a write longer than this counts as stall
+
+typedef struct _ASYNC_WRITER_STATS_T {
+	uint64_t written_bytes;
+	uint64_t dropped_bytes; //buffer was full
+	uint32_t dropped_writes;
+	uint32_t stalls;
+	float max_write_ms;
+	int max_pending; //peak of buffered bytes
+	bool open_failed; //every write is dropped
+} ASYNC_WRITER_STATS_T;
+
+//write behind file, writes never block on storage, data not fitting in the buffer is dropped
+typedef struct _ASYNC_WRITER_T {
+	char path[256];
+	int fd; //-1 until opened on writer thread
+	bool direct;
+	uint64_t sync_size; //fdatasync interval in bytes, 0 : only on close
+
+	unsigned char *buff;
+	int buff_size; //multiple of ASYNC_WRITER_ALIGN
+	uint64_t head; //total bytes queued
+	uint64_t tail; //total bytes taken by writer thread
+	uint64_t sync_head; //fdatasync once written up to here
+	bool closing;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	ASYNC_WRITER_STATS_T stats;
+} ASYNC_WRITER_T;
+
+//file is created on writer thread, so that a slow storage does not block the caller
+//NULL without memory or thread, open failure is reported by stats
+ASYNC_WRITER_T *async_writer_open(const char *path, int buff_size, uint64_t sync_size, bool direct);
+//remaining data is written, synced and freed on writer thread, _this must not be used after this
+void async_writer_close(ASYNC_WRITER_T *_this);
+//all or nothing, returns false if dropped
+bool async_writer_write(ASYNC_WRITER_T *_this, const void *data, int data_len);
+bool async_writer_writev(ASYNC_WRITER_T *_this, const struct iovec *iov, int iovcnt);
+//write queued data now and fdatasync it, does not wait
+void async_writer_flush(ASYNC_WRITER_T *_this);
+void async_writer_get_stats(ASYNC_WRITER_T *_this, ASYNC_WRITER_STATS_T *stats);
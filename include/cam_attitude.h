@@ -0,0 +1,7 @@
+#pragma once
+
+#include "quaternion.h"
+
+//texture lookup matrix of a camera for a view, transposed for opengl
+//cam_matrix : camera orientation Rc, cam_offset : roll, pitch, yaw of the camera mount
+void cam_attitude_get_matrix(VECTOR4D_T view_quat, const float *cam_matrix, const float *cam_offset, float *unif_matrix);
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define COMMAND_CHANNEL_WINDOW 32 //commands in flight
+#define COMMAND_CHANNEL_MAX_CMD_LEN 256
+#define COMMAND_CHANNEL_INITIAL_RTO_MS 50
+#define COMMAND_CHANNEL_MIN_RTO_MS 20
+#define COMMAND_CHANNEL_MAX_RTO_MS 2000 //doubled on each timeout up to this
+#define COMMAND_CHANNEL_LEGACY_RTOS 5 //timeouts without any ack before legacy xml commands
+#define COMMAND_CHANNEL_MAX_PENDING 1024 //oldest one is dropped over this
+
+typedef void (*COMMAND_CHANNEL_SEND)(const unsigned char *data, int data_len, void *user_data);
+typedef void (*COMMAND_CHANNEL_DELIVER)(const char *cmd, void *user_data);
+
+//not yet in window, superseded ones are replaced in place
+typedef struct _COMMAND_CHANNEL_PENDING_T {
+	char cmd[COMMAND_CHANNEL_MAX_CMD_LEN];
+	char key[96]; //empty : never coalesced
+	double queued_time;
+	struct _COMMAND_CHANNEL_PENDING_T *next;
+} COMMAND_CHANNEL_PENDING_T;
+
+typedef struct _COMMAND_CHANNEL_SLOT_T {
+	uint32_t seq;
+	char cmd[COMMAND_CHANNEL_MAX_CMD_LEN];
+	char key[96];
+	bool superseded; //retransmitted as nop
+	bool acked;
+	int transmissions;
+	double queued_time;
+	double sent_time;
+} COMMAND_CHANNEL_SLOT_T;
+
+typedef struct _COMMAND_CHANNEL_T {
+	pthread_mutex_t mutex;
+	int max_packet_len;
+	uint32_t session; //receiver restarts sequence on change
+
+	//sender
+	COMMAND_CHANNEL_PENDING_T *pending;
+	int pending_num;
+	COMMAND_CHANNEL_SLOT_T slots[COMMAND_CHANNEL_WINDOW]; //by seq
+	uint32_t send_base; //oldest unacked
+	uint32_t next_seq;
+	float srtt_ms; //0 : no sample
+	float rttvar_ms;
+	int backoff; //rto is doubled by this, reset on ack
+	bool peer_acked; //peer knows the binary protocol
+	bool legacy; //<picam360:command /> stop and wait, acked by ack_command_id status
+
+	//receiver
+	uint32_t peer_session;
+	uint32_t recv_cum; //delivered up to
+	bool recv_has[COMMAND_CHANNEL_WINDOW];
+	char recv_cmd[COMMAND_CHANNEL_WINDOW][COMMAND_CHANNEL_MAX_CMD_LEN];
+
+	COMMAND_CHANNEL_SEND send_data;
+	COMMAND_CHANNEL_SEND send_ack;
+	COMMAND_CHANNEL_DELIVER deliver;
+	void *user_data;
+
+	//stats
+	uint64_t queued;
+	uint64_t coalesced;
+	uint64_t acked;
+	uint64_t retransmitted;
+	uint64_t dropped; //pending over COMMAND_CHANNEL_MAX_PENDING
+	uint64_t delivered;
+	float latency_ms; //ewma of queued to acked
+	float max_latency_ms;
+	double stats_time;
+	uint64_t stats_acked;
+	float commands_per_sec;
+} COMMAND_CHANNEL_T;
+
+void command_channel_init(COMMAND_CHANNEL_T *_this, int max_packet_len, COMMAND_CHANNEL_SEND send_data, COMMAND_CHANNEL_SEND send_ack,
+		COMMAND_CHANNEL_DELIVER deliver, void *user_data);
+void command_channel_deinit(COMMAND_CHANNEL_T *_this);
+//a queued command of the same name and id is replaced by a later one
+void command_channel_push(COMMAND_CHANNEL_T *_this, const char *cmd, double now);
+//sends new commands and retransmits timed out ones
+void command_channel_update(COMMAND_CHANNEL_T *_this, double now);
+//data from sender, delivers in order and sends ack; false if not a packet of this channel
+bool command_channel_receive_data(COMMAND_CHANNEL_T *_this, const unsigned char *data, int data_len);
+void command_channel_receive_ack(COMMAND_CHANNEL_T *_this, const unsigned char *data, int data_len, double now);
+//ack_command_id status of an upstream peer without binary acks
+void command_channel_receive_legacy_ack(COMMAND_CHANNEL_T *_this, int id, double now);
+int command_channel_get_in_flight(COMMAND_CHANNEL_T *_this);
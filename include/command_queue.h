@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COMMAND_QUEUE_POOL_SIZE 1024 //nodes allocated beyond this are freed on release
+#define COMMAND_QUEUE_MAX_CMD_LEN 256
+
+typedef struct _COMMAND_QUEUE_NODE_T {
+	struct _COMMAND_QUEUE_NODE_T *next;
+	uint32_t free_next; //index + 1 in pool free list, 0 : end
+	bool pooled;
+	char cmd[COMMAND_QUEUE_MAX_CMD_LEN];
+} COMMAND_QUEUE_NODE_T;
+
+//intrusive mpsc queue, push from any thread, pop from one thread, both lock free
+typedef struct _COMMAND_QUEUE_T {
+	COMMAND_QUEUE_NODE_T *head; //last pushed
+	COMMAND_QUEUE_NODE_T *tail; //next to pop, consumer only
+	COMMAND_QUEUE_NODE_T stub;
+
+	COMMAND_QUEUE_NODE_T *pool;
+	uint64_t free_head; //tag << 32 | index + 1, tag avoids aba
+} COMMAND_QUEUE_T;
+
+void command_queue_init(COMMAND_QUEUE_T *_this);
+void command_queue_deinit(COMMAND_QUEUE_T *_this);
+//cmd is truncated to COMMAND_QUEUE_MAX_CMD_LEN - 1
+void command_queue_push(COMMAND_QUEUE_T *_this, const char *cmd);
+//consumer only, node has to be released after use
+COMMAND_QUEUE_NODE_T *command_queue_pop(COMMAND_QUEUE_T *_this);
+void command_queue_release(COMMAND_QUEUE_T *_this, COMMAND_QUEUE_NODE_T *node);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int (*COMMAND_HANDLER)(void *user_data, const char *cmd);
+
+typedef struct _COMMAND_REGISTRY_ENTRY_T {
+	char name[64]; //empty : free
+	uint32_t hash;
+	COMMAND_HANDLER handler;
+	void *user_data;
+} COMMAND_REGISTRY_ENTRY_T;
+
+//open addressing by name, not thread safe, handlers are added and looked up on main loop
+typedef struct _COMMAND_REGISTRY_T {
+	COMMAND_REGISTRY_ENTRY_T *entries;
+	int size; //power of 2
+	int num;
+} COMMAND_REGISTRY_T;
+
+void command_registry_init(COMMAND_REGISTRY_T *_this);
+void command_registry_deinit(COMMAND_REGISTRY_T *_this);
+//replaces handler of same name
+void command_registry_add(COMMAND_REGISTRY_T *_this, const char *name, COMMAND_HANDLER handler, void *user_data);
+const COMMAND_REGISTRY_ENTRY_T *command_registry_find(COMMAND_REGISTRY_T *_this, const char *name, int name_len);
+//handler of first word of cmd, or of its prefix before '.' for plugins; NULL if none
+const COMMAND_REGISTRY_ENTRY_T *command_registry_lookup(COMMAND_REGISTRY_T *_this, const char *cmd);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "picam360_capture_plugin.h"
+
+typedef struct _ENCODER_POOL_KEY_T {
+	char name[64];
+	int width;
+	int height;
+	int kbps;
+	int fps;
+} ENCODER_POOL_KEY_T;
+
+typedef struct _ENCODER_LEASE_T {
+	ENCODER_T *encoder;
+	ENCODER_POOL_KEY_T key;
+	bool warm; //initialized before it was leased
+
+	//forwarded from encoder while leased
+	ENCODER_STREAM_CALLBACK callback;
+	void *user_data;
+
+	struct timeval leased_time;
+	bool first_nal_received;
+	float time_to_first_nal_ms;
+
+	struct _ENCODER_LEASE_T *next;
+} ENCODER_LEASE_T;
+
+typedef struct _ENCODER_POOL_ENTRY_T {
+	ENCODER_FACTORY_T *factory;
+	ENCODER_POOL_KEY_T key;
+	int num; //encoders kept warm
+	struct _ENCODER_POOL_ENTRY_T *next;
+} ENCODER_POOL_ENTRY_T;
+
+typedef struct _ENCODER_POOL_T {
+	pthread_mutex_t mutex;
+	ENCODER_POOL_ENTRY_T *entries;
+	ENCODER_LEASE_T *idle; //initialized and never fed
+	ENCODER_T *spares[16]; //created but not initialized, reused by refill
+	int spare_num;
+
+	//encoders are initialized here, off the render loop
+	bool run;
+	bool refill_requested;
+	pthread_cond_t refill_cond;
+	pthread_t refill_thread;
+} ENCODER_POOL_T;
+
+void encoder_pool_init(ENCODER_POOL_T *_this);
+void encoder_pool_deinit(ENCODER_POOL_T *_this);
+void encoder_pool_add_entry(ENCODER_POOL_T *_this, ENCODER_FACTORY_T *factory, const ENCODER_POOL_KEY_T *key, int num);
+//wakes refill thread, it does not block. called on add_entry and return
+void encoder_pool_refill(ENCODER_POOL_T *_this);
+//encoder must be created but not initialized, it is taken over by pool
+ENCODER_LEASE_T *encoder_pool_lease(ENCODER_POOL_T *_this, ENCODER_T *encoder, const ENCODER_POOL_KEY_T *key, ENCODER_STREAM_CALLBACK callback,
+		void *user_data);
+void encoder_pool_return(ENCODER_POOL_T *_this, ENCODER_LEASE_T *lease);
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "async_writer.h"
+
+#define MP4_MUXER_TIMESCALE 90000
+#define MP4_MUXER_MAX_FRAGMENT_SIZE (2 * 1024 * 1024) //a long gop is split, fragment has to fit in writer buffer
+#define MP4_MUXER_META_MIME "application/x-picam360-frame-meta" //frame_meta block per video sample
+#define MP4_MUXER_MAX_PARAM_LEN 256
+
+enum MP4_CODEC {
+	MP4_CODEC_H264, MP4_CODEC_H265,
+};
+
+typedef struct _MP4_BUFF_T {
+	unsigned char *data;
+	int len;
+	int size;
+} MP4_BUFF_T;
+
+typedef struct _MP4_SAMPLE_T {
+	uint64_t time; //ticks from first sample
+	uint32_t size;
+	uint32_t meta_size;
+	bool key;
+} MP4_SAMPLE_T;
+
+typedef struct _MP4_FRAGMENT_INDEX_T {
+	uint64_t time;
+	uint64_t moof_offset;
+} MP4_FRAGMENT_INDEX_T;
+
+//fragmented mp4 of one h264/h265 track and a timed metadata track, a moof/mdat per gop
+typedef struct _MP4_MUXER_T {
+	ASYNC_WRITER_T *writer;
+	enum MP4_CODEC codec;
+	int width;
+	int height;
+	uint64_t offset; //bytes queued to file
+	bool header_written;
+
+	//parameter sets for sample entry, also kept in band
+	unsigned char params[3][MP4_MUXER_MAX_PARAM_LEN]; //vps, sps, pps
+	int params_len[3];
+
+	//access unit being assembled
+	MP4_BUFF_T sample;
+	MP4_BUFF_T sample_meta;
+	bool sample_vcl;
+	bool sample_key;
+	uint64_t sample_pts_us;
+
+	//fragment being assembled
+	MP4_BUFF_T mdat;
+	MP4_BUFF_T mdat_meta;
+	MP4_SAMPLE_T *samples;
+	int num_samples;
+	int samples_size;
+	uint32_t sequence;
+	uint64_t base_pts_us;
+	uint64_t last_pts_us;
+	uint32_t last_duration;
+
+	MP4_FRAGMENT_INDEX_T *index; //mfra entries of fragments starting with a key sample
+	int num_index;
+	int index_size;
+
+	uint32_t fragments;
+	uint32_t dropped_fragments;
+} MP4_MUXER_T;
+
+//takes writer, which is closed by mp4_muxer_close
+MP4_MUXER_T *mp4_muxer_open(ASYNC_WRITER_T *writer, enum MP4_CODEC codec, int width, int height);
+//writes last fragment and mfra index
+void mp4_muxer_close(MP4_MUXER_T *_this);
+//one nal without start code or length, pts_us 0 : same as previous nal
+//meta is a frame_meta block of the access unit, given with its first slice
+void mp4_muxer_add_nal(MP4_MUXER_T *_this, const unsigned char *nal, int nal_len, uint64_t pts_us, const unsigned char *meta, int meta_len);
@@ -43,10 +43,27 @@
 #include "rtp.h"
 
 #include "picam360_capture_plugin.h"
+#include "view_predictor.h"
+#include "encoder_pool.h"
+#include "rate_controller.h"
+#include "status_publisher.h"
+#include "command_channel.h"
+#include "pose_slot.h"
+#include "command_registry.h"
+#include "command_queue.h"
+#include "async_writer.h"
+#include "mp4_muxer.h"
+#include "metrics.h"
 
 #define TEXTURE_BUFFER_NUM 2
 #define MAX_CAM_NUM 8
 #define MAX_OPERATION_NUM 7
+#define MAX_TILE_NUM 6 //faces of 3x2 cubemap layout
+#define MAX_RENDITION_NUM 4 //simulcast outputs of a frame
+#define KEYFRAME_REQUEST_INTERVAL_MS 250 //requests from clients within this share one keyframe
+#define KEYFRAME_RESTART_INTERVAL_MS 5000 //encoder without request_keyframe is restarted at most this often
+#define SAVE_JPEG_TIMEOUT_SEC 5
+#define SAVE_JPEG_MAX_NUM 2 //snaps encoded at once, more waits in renderer
 #define MAX_QUATERNION_QUEUE_COUNT 128 //keep 1280ms
 #define QUATERNION_QUEUE_RES 10 //10ms
 
@@ -98,6 +115,16 @@ typedef struct _OPTIONS_T {
 	char rtcp_tx_ip[256];
 	int rtcp_tx_port;
 	enum RTP_SOCKET_TYPE rtcp_tx_type;
+
+	char shader_cache_dir[256]; //empty : disabled
+
+	bool xml_meta; //legacy <picam360:frame /> sei and xmp instead of frame_meta blocks
+
+	int record_buffer_mb; //write behind buffer of each output file
+	int record_sync_mb; //fdatasync interval
+	bool record_direct; //O_DIRECT
+
+	int metrics_port; //prometheus text on http://127.0.0.1:port/metrics, 0 : disabled
 } OPTIONS_T;
 
 typedef struct _LIST_T {
@@ -113,6 +140,7 @@ typedef struct _FRAME_INFO_T {
 	struct timeval before_redraw_render_texture;
 	struct timeval after_redraw_render_texture;
 	struct timeval after_encoded;
+	uint32_t tile_mask; //high quality tiles sent with this frame
 } FRAME_INFO_T;
 
 typedef struct _FRAME_T {
@@ -134,7 +162,8 @@ typedef struct _FRAME_T {
 	enum OUTPUT_MODE output_mode;
 	enum OUTPUT_TYPE output_type;
 	char output_filepath[256];
-	int output_fd;
+	ASYNC_WRITER_T *output_writer; //written on encoder output thread
+	MP4_MUXER_T *output_muxer; //.mp4 of h264/h265 stream
 	bool output_start;
 	bool double_size;
 
@@ -145,11 +174,37 @@ typedef struct _FRAME_T {
 	//for unif matrix
 	MPU_T *view_mpu;
 	ENCODER_T *encoder;
+	ENCODER_LEASE_T *encoder_lease; //not NULL while encoder is leased from pool
+	VIEW_PREDICTOR_T view_predictor; //extrapolates client view to its display time
+	int pose_slot; //index of state->pose_slots, -1 : no slot
+	uint32_t pose_version; //of pose slot applied last
+	RATE_CONTROLLER_T rate_controller; //bitrate, fps and resolution from receiver reports
+	uint64_t stream_bytes; //streamed by encoder output thread, atomic
+	uint64_t send_bytes_last; //of send_kbps window, rendering thread
+	double send_time_last;
+	float send_kbps; //this stream only, rtp bandwidth is of all streams
+	float render_scale; //rendered into a sub viewport of texture when < 1
 
 	// for latency cal
 	char client_key[256];
 	struct timeval server_key;
 
+	struct timeval last_keyframe_requested;
+	struct timeval last_keyframe_restarted;
+
+	// for tiled streaming
+	int tile_scale; //0 : not tiled, otherwise downscale factor of low quality layer
+	int tile_index; //-1 : not a tile
+	uint8_t *lq_img_buff;
+	GLuint lq_framebuffer; //low quality layer is downscaled from texture on gpu
+	GLuint lq_texture;
+	uint32_t last_tile_mask; //tiles entering the view need a keyframe
+	struct _FRAME_T *tiles[MAX_TILE_NUM];
+
+	// for simulcast
+	int rendition_index; //-1 : not a rendition
+	struct _FRAME_T *renditions[MAX_RENDITION_NUM];
+
 	void *custom_data;
 	//event
 	void (*after_processed_callback)(struct _PICAM360CAPTURE_T *, struct _FRAME_T *);
@@ -229,6 +284,8 @@ typedef struct _PICAM360CAPTURE_T {
 	bool camera_coordinate_from_device;
 	char default_view_coordinate_mode[64];
 
+	struct timeval startup_time; //for cold-to-first-frame report
+	bool first_frame_rendered;
 	unsigned int next_frame_id;
 	FRAME_T *frame;
 	MODEL_T model_data[MAX_OPERATION_NUM];
@@ -238,9 +295,11 @@ typedef struct _PICAM360CAPTURE_T {
 	DECODER_T *decoders[MAX_CAM_NUM];
 	CAPTURE_T *audio_capture;
 
-	pthread_mutex_t cmd_list_mutex;
-	LIST_T *cmd_list;
-	LIST_T *cmd2upstream_list;
+	COMMAND_REGISTRY_T command_registry; //host commands and plugin names
+	COMMAND_QUEUE_T cmd_queue;
+	COMMAND_QUEUE_T cmd2upstream_queue;
+
+	METRICS_REGISTRY_T metrics; //host and plugins
 
 	MENU_T *menu;
 	bool menu_visible;
@@ -260,8 +319,13 @@ typedef struct _PICAM360CAPTURE_T {
 	CAPTURE_FACTORY_T **capture_factories;
 	DECODER_FACTORY_T **decoder_factories;
 	ENCODER_FACTORY_T **encoder_factories;
+	ENCODER_POOL_T encoder_pool; //pre-initialized encoders for instant stream start
 	RENDERER_T **renderers;
 	STATUS_T **statuses;
 	STATUS_T **watches;
+	STATUS_PUBLISHER_T status_publisher; //changed statuses to downstream
+	COMMAND_CHANNEL_T command_channel; //commands to upstream, acks from upstream
+	POSE_SLOT_T pose_slots[POSE_SLOT_NUM]; //latest view pose of a frame
+	int pose_slot_frame_ids[POSE_SLOT_NUM]; //owner of each slot, -1 : free, written by renderer
 	struct _OPTIONS_T options;
 } PICAM360CAPTURE_T;
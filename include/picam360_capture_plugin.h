@@ -6,6 +6,7 @@
 #include "quaternion.h"
 #include "menu.h"
 #include "rtp.h"
+#include "metrics.h"
 
 //0x00** is reserved by system
 #define PICAM360_HOST_NODE_ID 0x0000
@@ -22,6 +23,10 @@ enum PICAM360_CAPTURE_EVENT {
 enum RENDERING_MODE {
 	RENDERING_MODE_WINDOW, RENDERING_MODE_EQUIRECTANGULAR, RENDERING_MODE_FISHEYE,
 };
+//shader variant selectors passed to RENDERER_T.get_program
+enum RENDERER_OPTION {
+	RENDERER_OPTION_NONE = 0, RENDERER_OPTION_OVERLAP = 1 << 0, RENDERER_OPTION_COLOR_OFFSET = 1 << 1, RENDERER_OPTION_MAX = 1 << 2,
+};
 
 enum PICAM360_CONTROLLER_EVENT {
 	PICAM360_CONTROLLER_EVENT_NONE, PICAM360_CONTROLLER_EVENT_NEXT, PICAM360_CONTROLLER_EVENT_BACK,
@@ -80,8 +85,9 @@ typedef struct _DECODER_FACTORY_T {
 
 typedef struct _RENDERER_T {
 	char name[64];
+	char projection[64]; //declared in frame metadata, empty if output is not a whole sphere
 	void (*init)(void *user_data, const char *common, int num_of_cam);
-	int (*get_program)(void *user_data);
+	int (*get_program)(void *user_data, uint32_t options); //options : RENDERER_OPTION bits
 	void (*render)(void *user_data, float fov);
 	void (*release)(void *user_data);
 	void *user_data;
@@ -93,6 +99,10 @@ typedef struct _ENCODER_T {
 	void (*init)(void *user_data, const int width, const int height, int bitrate_kbps, int fps, ENCODER_STREAM_CALLBACK callback, void *user_data2);
 	void (*release)(void *user_data);
 	void (*add_frame)(void *user_data, const unsigned char *in_data, void *frame_data);
+	//optional, changes rate without restarting stream, NULL : host re-inits encoder
+	void (*reconfigure)(void *user_data, int bitrate_kbps, int fps);
+	//optional, next frame is encoded as IDR with parameter sets, NULL : host re-inits encoder
+	void (*request_keyframe)(void *user_data);
 	void *user_data;
 } ENCODER_T;
 
@@ -147,6 +157,7 @@ typedef struct _PLUGIN_HOST_T {
 	void (*get_texture_size)(uint32_t *width_out, uint32_t *height_out);
 	void (*set_texture_size)(uint32_t width, uint32_t height);
 	int (*load_texture)(const char *filename, uint32_t *tex_out);
+	int (*load_texture_from_memory)(const unsigned char *data, int data_len, uint32_t *tex_out);
 
 	MENU_T *(*get_menu)();
 	bool (*get_menu_visible)();
@@ -170,6 +181,10 @@ typedef struct _PLUGIN_HOST_T {
 	void (*add_status)(STATUS_T *status);
 	void (*add_watch)(STATUS_T *status);
 	void (*add_plugin)(PLUGIN_T *plugin);
+	//handler of commands whose first word is name, takes precedence over plugin name prefix
+	void (*add_command_handler)(const char *name, int (*handler)(void *user_data, const char *cmd), void *user_data);
+	//histogram has msec buckets, same name and labels returns the registered one, update it with metric_inc/set/observe
+	METRIC_T *(*add_metric)(enum METRIC_TYPE type, const char *name, const char *labels, const char *help);
 
 	void (*snap)(uint32_t width, uint32_t height, enum RENDERING_MODE mode, const char *path);
 } PLUGIN_HOST_T;
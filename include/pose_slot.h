@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "quaternion.h"
+
+#define POSE_SLOT_NUM 16 //frames which take view poses at once
+#define POSE_CLIENT_KEY_LEN 32 //in message
+#define POSE_MESSAGE_LEN (12 + 16 + 2 + 8 + 2 + POSE_CLIENT_KEY_LEN)
+#define POSE_SEQ_TIMEOUT 1.0 //sec, seq of a silent sender is not trusted after this
+
+enum POSE_FLAG {
+	POSE_FLAG_FOV = 1 << 0,
+	POSE_FLAG_CLIENT_TIME = 1 << 1,
+	POSE_FLAG_RTT = 1 << 2,
+	POSE_FLAG_CLIENT_KEY = 1 << 3,
+	POSE_FLAG_SEQ = 1 << 4, //older seq than written one is dropped
+};
+
+typedef struct _POSE_T {
+	uint32_t flags; //POSE_FLAG
+	int frame_id;
+	uint16_t session; //sender instance, seq restarts with it
+	uint32_t seq;
+	VECTOR4D_T quat;
+	float fov;
+	double client_time; //ms, client clock
+	float rtt_ms;
+	char client_key[256];
+	double received_time; //sec
+} POSE_T;
+
+//latest pose of a frame, written by receivers, read by renderer without lock
+typedef struct _POSE_SLOT_T {
+	pthread_mutex_t write_mutex; //between writers only
+	uint32_t version; //seqlock, odd while writing
+	POSE_T pose;
+} POSE_SLOT_T;
+
+void pose_slot_init(POSE_SLOT_T *_this);
+void pose_slot_deinit(POSE_SLOT_T *_this);
+//newest wins, returns false if older than written one of same session
+bool pose_slot_write(POSE_SLOT_T *_this, const POSE_T *pose);
+//returns true if written after *version, which is updated
+bool pose_slot_read(POSE_SLOT_T *_this, POSE_T *pose, uint32_t *version);
+
+//fixed size binary message of rtcp
+uint16_t pose_session_new();
+int pose_message_encode(const POSE_T *pose, unsigned char *buff, int buff_len);
+bool pose_message_decode(const unsigned char *data, int data_len, POSE_T *pose);
+//params of set_view_quaternion, false without quat or with negative id
+bool pose_parse_params(const char *params, POSE_T *pose);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RATE_CONTROLLER_HISTORY_NUM 32
+#define RATE_CONTROLLER_LEVEL_NUM 5
+
+enum RATE_CONTROLLER_DELAY_STATE {
+	RATE_CONTROLLER_DELAY_NORMAL, RATE_CONTROLLER_DELAY_OVERUSE, RATE_CONTROLLER_DELAY_UNDERUSE
+};
+
+typedef struct _RATE_CONTROLLER_T {
+	bool enabled;
+	float min_kbps;
+	float max_kbps; //0 : nominal kbps
+	float overuse_threshold; //ms/sec of one way delay growth
+
+	//set by start
+	bool started;
+	float nominal_kbps; //rate of full frame rate and resolution
+	float max_fps;
+	bool scalable; //resolution steps allowed
+
+	//current operating point
+	float target_kbps;
+	int level; //0 : full quality, see level table
+	float fps;
+	float scale;
+
+	//applied to encoder
+	float applied_kbps;
+	int applied_level;
+
+	//receiver feedback
+	int num_of_reports;
+	double last_report_time; //sec
+	float loss; //ewma of loss fraction
+	float receive_kbps; //0 : unknown
+	double owd_time[RATE_CONTROLLER_HISTORY_NUM]; //sec, server clock
+	float owd_ms[RATE_CONTROLLER_HISTORY_NUM]; //client clock - server clock, offset is unknown
+	int owd_cur;
+	int owd_num;
+	float delay_slope; //ms/sec
+	enum RATE_CONTROLLER_DELAY_STATE delay_state;
+
+	double last_update_time;
+	double last_decrease_time;
+	double last_level_change_time;
+} RATE_CONTROLLER_T;
+
+void rate_controller_init(RATE_CONTROLLER_T *_this);
+//called when stream starts, keeps current operating point if already started
+void rate_controller_start(RATE_CONTROLLER_T *_this, float nominal_kbps, float max_fps, bool scalable);
+//owd_ms < 0 : not measured, bytes < 0 : not measured
+void rate_controller_push_report(RATE_CONTROLLER_T *_this, double now, int received, int lost, int bytes, float interval_ms, float owd_ms);
+//returns true if operating point moved enough to be applied, send_kbps is local estimate used without receive rate
+bool rate_controller_update(RATE_CONTROLLER_T *_this, double now, float send_kbps);
+void rate_controller_applied(RATE_CONTROLLER_T *_this);
+const char *rate_controller_get_delay_state_str(RATE_CONTROLLER_T *_this);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "picam360_capture_plugin.h"
+
+#define STATUS_PUBLISHER_DEFAULT_INTERVAL 0.1 //sec
+#define STATUS_PUBLISHER_DEFAULT_SNAPSHOT_INTERVAL 5.0 //sec
+#define STATUS_PUBLISHER_DEFAULT_COMPRESS_THRESHOLD 512 //bytes
+
+typedef void (*STATUS_PUBLISHER_SEND)(const unsigned char *data, int data_len, void *user_data);
+typedef void (*STATUS_PUBLISHER_VALUE_CALLBACK)(const char *name, const char *value, void *user_data);
+
+//rate limit of a status, matched by name
+typedef struct _STATUS_PUBLISHER_INTERVAL_T {
+	char name[64];
+	float interval; //sec
+	struct _STATUS_PUBLISHER_INTERVAL_T *next;
+} STATUS_PUBLISHER_INTERVAL_T;
+
+typedef struct _STATUS_PUBLISHER_ENTRY_T {
+	STATUS_T *status;
+	char *value; //last published
+	uint32_t version; //incremented on change
+	bool dirty; //changed but not sent
+	bool oversize_reported;
+	double last_poll_time;
+	struct _STATUS_PUBLISHER_ENTRY_T *next;
+} STATUS_PUBLISHER_ENTRY_T;
+
+typedef struct _STATUS_PUBLISHER_T {
+	float interval; //sec, poll interval of statuses without own interval
+	float snapshot_interval; //sec, every status is sent for late joiners, 0 : disabled
+	int compress_threshold; //bytes, larger values are deflated, 0 : disabled
+	STATUS_PUBLISHER_INTERVAL_T *intervals;
+
+	STATUS_PUBLISHER_ENTRY_T *entries;
+	double last_snapshot_time;
+
+	int max_packet_len;
+	int value_size;
+	char *value_buff;
+	char *escape_buff; //value as xml attribute
+	int entry_size;
+	char *entry_buff;
+	unsigned char *packet;
+	int packet_len;
+	STATUS_PUBLISHER_SEND send;
+	void *user_data;
+
+	//stats
+	uint64_t sent_bytes;
+	uint64_t sent_entries;
+	uint64_t polled_entries;
+	double stats_time;
+	uint64_t stats_bytes;
+	float bytes_per_sec;
+} STATUS_PUBLISHER_T;
+
+void status_publisher_init(STATUS_PUBLISHER_T *_this, int max_packet_len, STATUS_PUBLISHER_SEND send, void *user_data);
+void status_publisher_deinit(STATUS_PUBLISHER_T *_this);
+//interval < 0 : removes own interval
+void status_publisher_set_interval(STATUS_PUBLISHER_T *_this, const char *name, float interval);
+//statuses is NULL terminated, statuses added later are picked up; sends changed values only
+void status_publisher_update(STATUS_PUBLISHER_T *_this, STATUS_T **statuses, double now);
+//next update sends every status
+void status_publisher_request_snapshot(STATUS_PUBLISHER_T *_this);
+//next update sends the status even if unchanged, e.g. an ack of which packet may be lost
+void status_publisher_resend(STATUS_PUBLISHER_T *_this, STATUS_T *status);
+
+//<picam360:status /> elements of a packet, compressed values are restored
+void status_publisher_parse(const char *data, int data_len, STATUS_PUBLISHER_VALUE_CALLBACK callback, void *user_data);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "quaternion.h"
+
+#define VIEW_PREDICTOR_HISTORY_NUM 16
+
+typedef struct _VIEW_PREDICTOR_SAMPLE_T {
+	VECTOR4D_T quat;
+	double client_time; //sec, client clock
+} VIEW_PREDICTOR_SAMPLE_T;
+
+typedef struct _VIEW_PREDICTOR_T {
+	bool enabled;
+	float gain; //0 : no prediction, 1 : full extrapolation
+	float horizon_ms; //0 : auto
+	float window_ms; //history used for angular velocity
+	float max_angle; //deg, clamp of extrapolated rotation
+
+	VIEW_PREDICTOR_SAMPLE_T history[VIEW_PREDICTOR_HISTORY_NUM];
+	int history_cur;
+	int history_num;
+
+	//server clock - client clock, minimum seen (includes one way latency)
+	double clock_offset;
+	bool clock_offset_valid;
+
+	//auto horizon
+	float rtt_ms; //reported by client
+	float process_ms; //render + encode, ewma, atomic as set by encoder output thread
+
+	//pending predictions to be compared with later samples
+	VIEW_PREDICTOR_SAMPLE_T pending[VIEW_PREDICTOR_HISTORY_NUM];
+	int pending_cur;
+
+	//error statistics in deg
+	int error_num;
+	double error_sum;
+	double error_sq_sum;
+	float error_max;
+} VIEW_PREDICTOR_T;
+
+void view_predictor_init(VIEW_PREDICTOR_T *_this);
+//client_time < 0 : use server_time
+void view_predictor_push(VIEW_PREDICTOR_T *_this, VECTOR4D_T quat, double client_time, double server_time);
+//without lock from encoder output thread, one writer per predictor
+void view_predictor_set_process_time(VIEW_PREDICTOR_T *_this, float process_ms);
+float view_predictor_get_horizon(VIEW_PREDICTOR_T *_this);
+//returns latest sample as is if disabled or not enough history
+bool view_predictor_predict(VIEW_PREDICTOR_T *_this, double server_time, VECTOR4D_T *quat_out);
+void view_predictor_get_stats(VIEW_PREDICTOR_T *_this, float *mean, float *rms, float *max, int *num);
+void view_predictor_reset_stats(VIEW_PREDICTOR_T *_this);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "quaternion.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//block is version byte then tag, length, value; unknown tags are skipped
+#define FRAME_META_VERSION 1
+#define FRAME_META_MAX_LEN 512 //encoded block
+#define FRAME_META_SEI_MAX_LEN (FRAME_META_MAX_LEN * 3 / 2 + 32) //nal with emulation prevention
+#define FRAME_META_APP_MAX_LEN (FRAME_META_MAX_LEN + 16) //segment with marker
+#define FRAME_META_APP_MARKER 0xEB //APP11
+#define FRAME_META_STR_LEN 64
+
+enum FRAME_META_FIELD {
+	FRAME_META_FRAME_ID = 1 << 0,
+	FRAME_META_TIMESTAMP = 1 << 1,
+	FRAME_META_VIEW_QUAT = 1 << 2,
+	FRAME_META_FOV = 1 << 3,
+	FRAME_META_CLIENT_KEY = 1 << 4,
+	FRAME_META_SERVER_KEY = 1 << 5,
+	FRAME_META_TIMING = 1 << 6,
+	FRAME_META_MODE = 1 << 7,
+	FRAME_META_PROJECTION = 1 << 8,
+	FRAME_META_TILE = 1 << 9,
+	FRAME_META_RENDITION = 1 << 10,
+	FRAME_META_TILE_MASK = 1 << 11,
+	FRAME_META_CAMERA_QUAT = 1 << 12,
+	FRAME_META_COMPASS = 1 << 13,
+	FRAME_META_TEMPERATURE = 1 << 14,
+	FRAME_META_CAMERA_OFFSET = 1 << 15,
+};
+
+typedef struct _FRAME_META_T {
+	uint32_t fields; //FRAME_META_FIELD present
+	int frame_id;
+	uint64_t timestamp_us; //wall clock
+	VECTOR4D_T view_quat;
+	float fov;
+	char client_key[256];
+	int server_key;
+	float idle_time; //sec
+	float frame_processed;
+	float encoded;
+	char mode[FRAME_META_STR_LEN];
+	char projection[FRAME_META_STR_LEN];
+	int tile;
+	int rendition;
+	uint32_t tile_mask;
+	int tile_scale;
+	VECTOR4D_T camera_quat;
+	VECTOR4D_T compass;
+	float temperature;
+	VECTOR4D_T camera_offset; //x, y, yaw, horizon_r
+} FRAME_META_T;
+
+//bare block, length or -1 if buff is short
+int frame_meta_encode(const FRAME_META_T *meta, unsigned char *buff, int buff_len);
+bool frame_meta_decode(const unsigned char *data, int data_len, FRAME_META_T *meta);
+
+//user data unregistered sei nal from its nal header, no start code or length
+int frame_meta_write_sei(const FRAME_META_T *meta, bool h265, unsigned char *buff, int buff_len);
+bool frame_meta_read_sei(const unsigned char *nal, int nal_len, bool h265, FRAME_META_T *meta);
+
+//jpeg app segment from its marker
+int frame_meta_write_app(const FRAME_META_T *meta, unsigned char *buff, int buff_len);
+bool frame_meta_read_app(const unsigned char *data, int data_len, FRAME_META_T *meta);
+
+//legacy <picam360:frame /> attributes and xmp elements
+bool frame_meta_parse_xml(const char *xml, FRAME_META_T *meta);
+
+#ifdef __cplusplus
+}
+#endif
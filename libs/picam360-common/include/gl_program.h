@@ -1,4 +1,3 @@
-
 #ifndef _GLPROGRAM_H
 #define _GLPROGRAM_H
 #ifdef USE_GLES
@@ -13,12 +12,17 @@
 //#include "GL/glext.h"
 #endif
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 
+#include <string>
+
 class GLProgram {
 public:
 	GLProgram(const char *common, const char *vertex, const char *fragment, bool is_file);
+	//sources in memory without null terminator (e.g. xxd -i output)
+	GLProgram(const char *common, const char *vertex, int vertex_len, const char *fragment, int fragment_len);
 	virtual ~GLProgram();
 
 	GLuint GetId();
@@ -26,11 +30,16 @@ public:
 		return m_program_id;
 	}
 	;
+	//program binaries are stored under dir, NULL or empty disables the cache
+	static void SetCacheDir(const char *dir);
 private:
 	GLuint m_vertex_id, m_fragment_id, m_program_id;
 	const char *m_common;
 
-	GLuint LoadShader(GLenum shader_type, const char *source, bool is_file);
+	void Build(const std::string &vertex_source, const std::string &fragment_source);
+	bool LoadBinary(const char *filepath);
+	void SaveBinary(const char *filepath);
+	GLuint LoadShader(GLenum shader_type, const std::string &shader_source);
 	char* ReadFile(const char *file);
 };
 
@@ -39,8 +48,10 @@ extern "C" {
 #endif
 
 void *GLProgram_new(const char *common, const char *vertex, const char *fragment, bool is_file);
+void *GLProgram_new_from_memory(const char *common, const char *vertex, int vertex_len, const char *fragment, int fragment_len);
 GLuint GLProgram_GetId(const void *_this);
 void GLProgram_delete(const void *_this);
+void GLProgram_set_cache_dir(const char *dir);
 
 #ifdef __cplusplus
 }
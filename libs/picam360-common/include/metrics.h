@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_NAME_LEN 64
+#define METRICS_LABELS_LEN 128 //key="value",... without braces
+#define METRICS_HELP_LEN 128
+#define METRICS_MAX_BUCKETS 16
+#define METRICS_DEFAULT_BUCKETS { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 } //msec
+
+enum METRIC_TYPE {
+	METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM,
+};
+
+//updates are lock free, metrics live until the registry is deinitialized
+typedef struct _METRIC_T {
+	char name[METRICS_NAME_LEN];
+	char labels[METRICS_LABELS_LEN];
+	char help[METRICS_HELP_LEN];
+	enum METRIC_TYPE type;
+	uint64_t value; //counter, or bits of double gauge
+
+	int num_bounds;
+	double bounds[METRICS_MAX_BUCKETS]; //upper bounds, +Inf is implied
+	uint64_t buckets[METRICS_MAX_BUCKETS + 1]; //not cumulative
+	uint64_t count;
+	uint64_t sum; //bits of double
+
+	struct _METRIC_T *next;
+} METRIC_T;
+
+typedef struct _METRICS_REGISTRY_T {
+	pthread_mutex_t mutex; //registration and exposition
+	METRIC_T *metrics; //same name is kept adjacent
+	int num_metrics;
+
+	int server_fd;
+	bool server_run;
+	pthread_t server_thread;
+} METRICS_REGISTRY_T;
+
+void metrics_registry_init(METRICS_REGISTRY_T *_this);
+void metrics_registry_deinit(METRICS_REGISTRY_T *_this);
+//returns the registered one for same name and labels, NULL on type mismatch
+METRIC_T *metrics_registry_add(METRICS_REGISTRY_T *_this, enum METRIC_TYPE type, const char *name, const char *labels, const char *help);
+//bounds NULL : METRICS_DEFAULT_BUCKETS
+METRIC_T *metrics_registry_add_histogram(METRICS_REGISTRY_T *_this, const char *name, const char *labels, const char *help,
+		const double *bounds, int num_bounds);
+//prometheus text format, compact is one "name{labels} value" line per series without buckets
+//returns length needed like snprintf, buff is always terminated
+int metrics_registry_write(METRICS_REGISTRY_T *_this, char *buff, int buff_len, bool compact);
+//http on 127.0.0.1:port, any request gets the prometheus text
+int metrics_registry_serve(METRICS_REGISTRY_T *_this, int port);
+void metrics_registry_stop(METRICS_REGISTRY_T *_this);
+
+typedef union {
+	double d;
+	uint64_t u;
+} METRIC_BITS_T;
+
+static inline void metric_add(METRIC_T *metric, uint64_t n) {
+	if (metric) {
+		__atomic_add_fetch(&metric->value, n, __ATOMIC_RELAXED);
+	}
+}
+
+static inline void metric_inc(METRIC_T *metric) {
+	metric_add(metric, 1);
+}
+
+static inline void metric_set(METRIC_T *metric, double value) {
+	if (metric) {
+		METRIC_BITS_T bits = { .d = value };
+		__atomic_store_n(&metric->value, bits.u, __ATOMIC_RELAXED);
+	}
+}
+
+static inline double metric_get(METRIC_T *metric) {
+	METRIC_BITS_T bits = { .u = __atomic_load_n(&metric->value, __ATOMIC_RELAXED) };
+	return (metric->type == METRIC_GAUGE) ? bits.d : (double) bits.u;
+}
+
+static inline void metric_observe(METRIC_T *metric, double value) {
+	if (!metric) {
+		return;
+	}
+	int i = 0;
+	while (i < metric->num_bounds && value > metric->bounds[i]) {
+		i++;
+	}
+	__atomic_add_fetch(&metric->buckets[i], 1, __ATOMIC_RELAXED);
+	METRIC_BITS_T old_sum = { .u = __atomic_load_n(&metric->sum, __ATOMIC_RELAXED) };
+	METRIC_BITS_T new_sum;
+	do {
+		new_sum.d = old_sum.d + value;
+	} while (!__atomic_compare_exchange_n(&metric->sum, &old_sum.u, new_sum.u, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	__atomic_add_fetch(&metric->count, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -37,6 +37,9 @@ enum RTP_SOCKET_TYPE rtp_get_rtp_socket_type(const char *type_str);
 typedef void (*RTP_CALLBACK)(unsigned char *data, unsigned int data_len, unsigned char pt, unsigned int seq_num, void *user_data);
 void rtp_add_callback(RTP_T *_this, RTP_CALLBACK callback, void *user_data);
 
+//stream_framer length callback of the 0xFF 0xE1 len "rtp\0" packets written by rtp_sendpacket
+int rtp_get_xmp_len(const unsigned char *head, unsigned int head_len, void *user_data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_FRAMER_MAX_MARKER_LEN 8
+
+//frame starts with marker, data is writable and valid only in the callback
+typedef void (*STREAM_FRAMER_CALLBACK)(unsigned char *data, unsigned int data_len, void *user_data);
+//whole frame length from its head, 0 : need more bytes, -1 : not a frame
+typedef int (*STREAM_FRAMER_GET_FRAME_LEN)(const unsigned char *head, unsigned int head_len, void *user_data);
+
+typedef struct _STREAM_FRAMER_T {
+	unsigned char marker[STREAM_FRAMER_MAX_MARKER_LEN];
+	int marker_len;
+	//NULL : frame ends at next marker (annex-b, ogg)
+	STREAM_FRAMER_GET_FRAME_LEN get_frame_len;
+	STREAM_FRAMER_CALLBACK callback;
+	void *user_data;
+
+	//frame across read buffers, or a marker prefix at the end of a read buffer
+	unsigned char *buff;
+	unsigned int buff_len;
+	unsigned int buff_size;
+	bool in_frame;
+	int frame_len; //for get_frame_len, 0 : unknown
+
+	uint64_t num_of_frames;
+	uint64_t num_of_copied_frames;
+} STREAM_FRAMER_T;
+
+void stream_framer_init(STREAM_FRAMER_T *_this, const unsigned char *marker, int marker_len, STREAM_FRAMER_GET_FRAME_LEN get_frame_len,
+		STREAM_FRAMER_CALLBACK callback, void *user_data);
+void stream_framer_deinit(STREAM_FRAMER_T *_this);
+void stream_framer_push(STREAM_FRAMER_T *_this, unsigned char *data, unsigned int data_len);
+//first marker in [p, end), end if not found
+unsigned char *stream_framer_find_marker(const unsigned char *p, const unsigned char *end, const unsigned char *marker, int marker_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,452 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "frame_meta.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define FIELD_NUM 16
+#define QUAT_SCALE 16384.0 //q14, quaternion elements are in [-1, 1]
+#define Q16_SCALE 65536.0
+#define SEI_USER_DATA_UNREGISTERED 5
+
+static const unsigned char SEI_UUID[16] = { //
+		0x7a, 0x1c, 0x5e, 0x36, 0x0b, 0x4f, 0x4d, 0x8a, 0x9c, 0x36, 0x30, 0x6d, 0x65, 0x74, 0x61, 0x01 };
+static const char APP_ID[] = "picam360"; //with its nul
+
+typedef struct _writer {
+	unsigned char *p;
+	int len;
+	int size;
+	bool overflow;
+} writer;
+
+static void put(writer *w, const void *data, int len) {
+	if (w->len + len > w->size) {
+		w->overflow = true;
+		return;
+	}
+	memcpy(w->p + w->len, data, len);
+	w->len += len;
+}
+
+static void put_u8(writer *w, uint8_t v) {
+	put(w, &v, 1);
+}
+
+static void put_u16(writer *w, uint16_t v) {
+	unsigned char b[2] = { v >> 8, v };
+	put(w, b, 2);
+}
+
+static void put_u32(writer *w, uint32_t v) {
+	unsigned char b[4] = { v >> 24, v >> 16, v >> 8, v };
+	put(w, b, 4);
+}
+
+static void put_u64(writer *w, uint64_t v) {
+	put_u32(w, v >> 32);
+	put_u32(w, v);
+}
+
+static int16_t to_s16(float v, double scale) {
+	double f = v * scale;
+	f = MAX(MIN(f, 32767), -32768);
+	return (int16_t) (f < 0 ? f - 0.5 : f + 0.5);
+}
+
+static int32_t to_s32(float v, double scale) {
+	double f = v * scale;
+	f = MAX(MIN(f, 2147483647.0), -2147483648.0);
+	return (int32_t) (f < 0 ? f - 0.5 : f + 0.5);
+}
+
+static uint32_t to_us(float sec) {
+	return (sec > 0) ? (uint32_t) (sec * 1000000 + 0.5) : 0;
+}
+
+static void put_tag(writer *w, enum FRAME_META_FIELD field, int len) {
+	put_u8(w, __builtin_ctz(field) + 1);
+	put_u8(w, len);
+}
+
+static void put_quat(writer *w, enum FRAME_META_FIELD field, VECTOR4D_T q) {
+	put_tag(w, field, 8);
+	for (int i = 0; i < 4; i++) {
+		put_u16(w, to_s16(q.ary[i], QUAT_SCALE));
+	}
+}
+
+static void put_str(writer *w, enum FRAME_META_FIELD field, const char *str) {
+	int len = MIN(strlen(str), 255);
+	put_tag(w, field, len);
+	put(w, str, len);
+}
+
+int frame_meta_encode(const FRAME_META_T *meta, unsigned char *buff, int buff_len) {
+	writer w = { buff, 0, buff_len, false };
+	put_u8(&w, FRAME_META_VERSION);
+	if (meta->fields & FRAME_META_FRAME_ID) {
+		put_tag(&w, FRAME_META_FRAME_ID, 4);
+		put_u32(&w, meta->frame_id);
+	}
+	if (meta->fields & FRAME_META_TIMESTAMP) {
+		put_tag(&w, FRAME_META_TIMESTAMP, 8);
+		put_u64(&w, meta->timestamp_us);
+	}
+	if (meta->fields & FRAME_META_VIEW_QUAT) {
+		put_quat(&w, FRAME_META_VIEW_QUAT, meta->view_quat);
+	}
+	if (meta->fields & FRAME_META_FOV) { //1/100 degree
+		put_tag(&w, FRAME_META_FOV, 2);
+		put_u16(&w, (uint16_t) MAX(MIN(meta->fov * 100 + 0.5, 65535), 0));
+	}
+	if (meta->fields & FRAME_META_CLIENT_KEY) {
+		put_str(&w, FRAME_META_CLIENT_KEY, meta->client_key);
+	}
+	if (meta->fields & FRAME_META_SERVER_KEY) {
+		put_tag(&w, FRAME_META_SERVER_KEY, 4);
+		put_u32(&w, meta->server_key);
+	}
+	if (meta->fields & FRAME_META_TIMING) { //us
+		put_tag(&w, FRAME_META_TIMING, 12);
+		put_u32(&w, to_us(meta->idle_time));
+		put_u32(&w, to_us(meta->frame_processed));
+		put_u32(&w, to_us(meta->encoded));
+	}
+	if (meta->fields & FRAME_META_MODE) {
+		put_str(&w, FRAME_META_MODE, meta->mode);
+	}
+	if (meta->fields & FRAME_META_PROJECTION) {
+		put_str(&w, FRAME_META_PROJECTION, meta->projection);
+	}
+	if (meta->fields & FRAME_META_TILE) {
+		put_tag(&w, FRAME_META_TILE, 2);
+		put_u16(&w, meta->tile);
+	}
+	if (meta->fields & FRAME_META_RENDITION) {
+		put_tag(&w, FRAME_META_RENDITION, 2);
+		put_u16(&w, meta->rendition);
+	}
+	if (meta->fields & FRAME_META_TILE_MASK) {
+		put_tag(&w, FRAME_META_TILE_MASK, 5);
+		put_u32(&w, meta->tile_mask);
+		put_u8(&w, meta->tile_scale);
+	}
+	if (meta->fields & FRAME_META_CAMERA_QUAT) {
+		put_quat(&w, FRAME_META_CAMERA_QUAT, meta->camera_quat);
+	}
+	if (meta->fields & FRAME_META_COMPASS) { //q16
+		put_tag(&w, FRAME_META_COMPASS, 12);
+		for (int i = 0; i < 3; i++) {
+			put_u32(&w, to_s32(meta->compass.ary[i], Q16_SCALE));
+		}
+	}
+	if (meta->fields & FRAME_META_TEMPERATURE) { //1/100 degree
+		put_tag(&w, FRAME_META_TEMPERATURE, 2);
+		put_u16(&w, to_s16(meta->temperature, 100));
+	}
+	if (meta->fields & FRAME_META_CAMERA_OFFSET) { //q16
+		put_tag(&w, FRAME_META_CAMERA_OFFSET, 16);
+		for (int i = 0; i < 4; i++) {
+			put_u32(&w, to_s32(meta->camera_offset.ary[i], Q16_SCALE));
+		}
+	}
+	return w.overflow ? -1 : w.len;
+}
+
+static uint16_t get_u16(const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static VECTOR4D_T get_quat(const unsigned char *p) {
+	VECTOR4D_T q = { };
+	for (int i = 0; i < 4; i++) {
+		q.ary[i] = (int16_t) get_u16(p + i * 2) / QUAT_SCALE;
+	}
+	return q;
+}
+
+static void get_str(const unsigned char *p, int len, char *str, int str_size) {
+	len = MIN(len, str_size - 1);
+	memcpy(str, p, len);
+	str[len] = '\0';
+}
+
+//fixed size of each field, -1 : variable
+static const int lg_field_len[FIELD_NUM] = { 4, 8, 8, 2, -1, 4, 12, -1, -1, 2, 2, 5, 8, 12, 2, 16 };
+
+bool frame_meta_decode(const unsigned char *data, int data_len, FRAME_META_T *meta) {
+	if (data_len < 1 || data[0] != FRAME_META_VERSION) {
+		return false;
+	}
+	memset(meta, 0, sizeof(FRAME_META_T));
+	for (int i = 1; i + 2 <= data_len;) {
+		int tag = data[i];
+		int len = data[i + 1];
+		const unsigned char *p = data + i + 2;
+		i += 2 + len;
+		if (i > data_len) {
+			return false;
+		}
+		if (tag < 1 || tag > FIELD_NUM || (lg_field_len[tag - 1] >= 0 && lg_field_len[tag - 1] != len)) {
+			continue; //newer or broken
+		}
+		uint32_t field = 1 << (tag - 1);
+		meta->fields |= field;
+		switch (field) {
+		case FRAME_META_FRAME_ID:
+			meta->frame_id = (int32_t) get_u32(p);
+			break;
+		case FRAME_META_TIMESTAMP:
+			meta->timestamp_us = ((uint64_t) get_u32(p) << 32) | get_u32(p + 4);
+			break;
+		case FRAME_META_VIEW_QUAT:
+			meta->view_quat = get_quat(p);
+			break;
+		case FRAME_META_FOV:
+			meta->fov = get_u16(p) / 100.0;
+			break;
+		case FRAME_META_CLIENT_KEY:
+			get_str(p, len, meta->client_key, sizeof(meta->client_key));
+			break;
+		case FRAME_META_SERVER_KEY:
+			meta->server_key = (int32_t) get_u32(p);
+			break;
+		case FRAME_META_TIMING:
+			meta->idle_time = get_u32(p) / 1000000.0;
+			meta->frame_processed = get_u32(p + 4) / 1000000.0;
+			meta->encoded = get_u32(p + 8) / 1000000.0;
+			break;
+		case FRAME_META_MODE:
+			get_str(p, len, meta->mode, sizeof(meta->mode));
+			break;
+		case FRAME_META_PROJECTION:
+			get_str(p, len, meta->projection, sizeof(meta->projection));
+			break;
+		case FRAME_META_TILE:
+			meta->tile = (int16_t) get_u16(p);
+			break;
+		case FRAME_META_RENDITION:
+			meta->rendition = (int16_t) get_u16(p);
+			break;
+		case FRAME_META_TILE_MASK:
+			meta->tile_mask = get_u32(p);
+			meta->tile_scale = p[4];
+			break;
+		case FRAME_META_CAMERA_QUAT:
+			meta->camera_quat = get_quat(p);
+			break;
+		case FRAME_META_COMPASS:
+			for (int j = 0; j < 3; j++) {
+				meta->compass.ary[j] = (int32_t) get_u32(p + j * 4) / Q16_SCALE;
+			}
+			break;
+		case FRAME_META_TEMPERATURE:
+			meta->temperature = (int16_t) get_u16(p) / 100.0;
+			break;
+		case FRAME_META_CAMERA_OFFSET:
+			for (int j = 0; j < 4; j++) {
+				meta->camera_offset.ary[j] = (int32_t) get_u32(p + j * 4) / Q16_SCALE;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+int frame_meta_write_sei(const FRAME_META_T *meta, bool h265, unsigned char *buff, int buff_len) {
+	unsigned char rbsp[FRAME_META_MAX_LEN + 32];
+	writer r = { rbsp, 0, sizeof(rbsp), false };
+	unsigned char block[FRAME_META_MAX_LEN];
+	int block_len = frame_meta_encode(meta, block, sizeof(block));
+	if (block_len < 0) {
+		return -1;
+	}
+	put_u8(&r, SEI_USER_DATA_UNREGISTERED);
+	int payload_size = sizeof(SEI_UUID) + block_len;
+	for (; payload_size >= 255; payload_size -= 255) {
+		put_u8(&r, 0xFF);
+	}
+	put_u8(&r, payload_size);
+	put(&r, SEI_UUID, sizeof(SEI_UUID));
+	put(&r, block, block_len);
+	put_u8(&r, 0x80); //rbsp_trailing_bits
+	if (r.overflow) {
+		return -1;
+	}
+
+	writer w = { buff, 0, buff_len, false };
+	if (h265) {
+		put_u8(&w, 39 << 1); //prefix sei
+		put_u8(&w, 1); //nuh_temporal_id_plus1
+	} else {
+		put_u8(&w, 6); //sei
+	}
+	int zeros = 0;
+	for (int i = 0; i < r.len; i++) {
+		if (zeros >= 2 && rbsp[i] <= 3) { //emulation_prevention_three_byte
+			put_u8(&w, 3);
+			zeros = 0;
+		}
+		put_u8(&w, rbsp[i]);
+		zeros = (rbsp[i] == 0) ? zeros + 1 : 0;
+	}
+	return w.overflow ? -1 : w.len;
+}
+
+bool frame_meta_read_sei(const unsigned char *nal, int nal_len, bool h265, FRAME_META_T *meta) {
+	int header_len = h265 ? 2 : 1;
+	if (nal_len <= header_len) {
+		return false;
+	}
+	if (h265 ? ((nal[0] & 0x7e) >> 1) != 39 : (nal[0] & 0x1f) != 6) {
+		return false;
+	}
+	unsigned char rbsp[FRAME_META_SEI_MAX_LEN];
+	int len = 0;
+	int zeros = 0;
+	for (int i = header_len; i < nal_len && len < (int) sizeof(rbsp); i++) {
+		if (zeros >= 2 && nal[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		rbsp[len++] = nal[i];
+		zeros = (nal[i] == 0) ? zeros + 1 : 0;
+	}
+	for (int i = 0; i + 1 < len;) { //sei messages up to rbsp_trailing_bits
+		int type = 0;
+		int size = 0;
+		while (i < len && rbsp[i] == 0xFF) {
+			type += rbsp[i++];
+		}
+		if (i >= len) {
+			return false;
+		}
+		type += rbsp[i++];
+		while (i < len && rbsp[i] == 0xFF) {
+			size += rbsp[i++];
+		}
+		if (i >= len) {
+			return false;
+		}
+		size += rbsp[i++];
+		if (i + size > len) {
+			return false;
+		}
+		if (type == SEI_USER_DATA_UNREGISTERED && size >= (int) sizeof(SEI_UUID) && memcmp(rbsp + i, SEI_UUID, sizeof(SEI_UUID)) == 0) {
+			return frame_meta_decode(rbsp + i + sizeof(SEI_UUID), size - sizeof(SEI_UUID), meta);
+		}
+		i += size;
+	}
+	return false;
+}
+
+int frame_meta_write_app(const FRAME_META_T *meta, unsigned char *buff, int buff_len) {
+	int header_len = 4 + sizeof(APP_ID);
+	if (buff_len < header_len) {
+		return -1;
+	}
+	int block_len = frame_meta_encode(meta, buff + header_len, buff_len - header_len);
+	if (block_len < 0) {
+		return -1;
+	}
+	int len = header_len + block_len;
+	buff[0] = 0xFF;
+	buff[1] = FRAME_META_APP_MARKER;
+	buff[2] = ((len - 2) >> 8) & 0xFF; //length excludes marker
+	buff[3] = (len - 2) & 0xFF;
+	memcpy(buff + 4, APP_ID, sizeof(APP_ID));
+	return len;
+}
+
+bool frame_meta_read_app(const unsigned char *data, int data_len, FRAME_META_T *meta) {
+	int header_len = 4 + sizeof(APP_ID);
+	if (data_len < header_len || data[0] != 0xFF || data[1] != FRAME_META_APP_MARKER) {
+		return false;
+	}
+	int len = get_u16(data + 2) + 2;
+	if (len < header_len || len > data_len || memcmp(data + 4, APP_ID, sizeof(APP_ID)) != 0) {
+		return false;
+	}
+	return frame_meta_decode(data + header_len, len - header_len, meta);
+}
+
+static const char *find_attr(const char *xml, const char *attr) {
+	const char *p = strstr(xml, attr);
+	return p ? p + strlen(attr) : NULL;
+}
+
+bool frame_meta_parse_xml(const char *xml, FRAME_META_T *meta) {
+	const char *p;
+	memset(meta, 0, sizeof(FRAME_META_T));
+	if ((p = find_attr(xml, " frame_id=\"")) && sscanf(p, "%d", &meta->frame_id) == 1) {
+		meta->fields |= FRAME_META_FRAME_ID;
+	}
+	if ((p = find_attr(xml, " mode=\"")) && sscanf(p, "%63[^\"]", meta->mode) == 1) {
+		meta->fields |= FRAME_META_MODE;
+	}
+	if ((p = find_attr(xml, " projection=\"")) && sscanf(p, "%63[^\"]", meta->projection) == 1) {
+		meta->fields |= FRAME_META_PROJECTION;
+	}
+	if ((p = find_attr(xml, " view_quat=\""))
+			&& sscanf(p, "%f,%f,%f,%f", &meta->view_quat.x, &meta->view_quat.y, &meta->view_quat.z, &meta->view_quat.w) == 4) {
+		meta->fields |= FRAME_META_VIEW_QUAT;
+	}
+	if ((p = find_attr(xml, " fov=\"")) && sscanf(p, "%f", &meta->fov) == 1) {
+		meta->fields |= FRAME_META_FOV;
+	}
+	if ((p = find_attr(xml, " client_key=\"")) && sscanf(p, "%255[^\"]", meta->client_key) == 1) {
+		meta->fields |= FRAME_META_CLIENT_KEY;
+	}
+	if ((p = find_attr(xml, " server_key=\"")) && sscanf(p, "%d", &meta->server_key) == 1) {
+		meta->fields |= FRAME_META_SERVER_KEY;
+	}
+	if ((p = find_attr(xml, " idle_time=\"")) && sscanf(p, "%f", &meta->idle_time) == 1) {
+		meta->fields |= FRAME_META_TIMING;
+		if ((p = find_attr(xml, " frame_processed=\""))) {
+			sscanf(p, "%f", &meta->frame_processed);
+		}
+		if ((p = find_attr(xml, " encoded=\""))) {
+			sscanf(p, "%f", &meta->encoded);
+		}
+	}
+	if ((p = find_attr(xml, " tile=\"")) && sscanf(p, "%d", &meta->tile) == 1) {
+		meta->fields |= FRAME_META_TILE;
+	}
+	if ((p = find_attr(xml, " rendition=\"")) && sscanf(p, "%d", &meta->rendition) == 1) {
+		meta->fields |= FRAME_META_RENDITION;
+	}
+	if ((p = find_attr(xml, " tile_mask=\"")) && sscanf(p, "%u", &meta->tile_mask) == 1) {
+		meta->fields |= FRAME_META_TILE_MASK;
+		if ((p = find_attr(xml, " tile_scale=\""))) {
+			sscanf(p, "%d", &meta->tile_scale);
+		}
+	}
+	//xmp of camera frames
+	if ((p = strstr(xml, "<quaternion"))
+			&& sscanf(p, "<quaternion x=\"%f\" y=\"%f\" z=\"%f\" w=\"%f\" />", &meta->camera_quat.x, &meta->camera_quat.y, &meta->camera_quat.z,
+					&meta->camera_quat.w) == 4) {
+		meta->fields |= FRAME_META_CAMERA_QUAT;
+	}
+	if ((p = strstr(xml, "<compass"))
+			&& sscanf(p, "<compass x=\"%f\" y=\"%f\" z=\"%f\" />", &meta->compass.x, &meta->compass.y, &meta->compass.z) == 3) {
+		meta->fields |= FRAME_META_COMPASS;
+	}
+	if ((p = strstr(xml, "<temperature")) && sscanf(p, "<temperature v=\"%f\" />", &meta->temperature) == 1) {
+		meta->fields |= FRAME_META_TEMPERATURE;
+	}
+	if ((p = strstr(xml, "<offset"))
+			&& sscanf(p, "<offset x=\"%f\" y=\"%f\" yaw=\"%f\" horizon_r=\"%f\" />", &meta->camera_offset.x, &meta->camera_offset.y,
+					&meta->camera_offset.z, &meta->camera_offset.w) == 4) {
+		meta->fields |= FRAME_META_CAMERA_OFFSET;
+	}
+	return meta->fields != 0;
+}
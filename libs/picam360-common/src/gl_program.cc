@@ -1,22 +1,153 @@
 #include "gl_program.h"
 #include <assert.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <sstream>
 #include <stdexcept>
 #include <cstring>
+#include <cstdio>
 #include <chrono>
+#include <vector>
+
+#ifdef USE_GLES
+#include "GLES2/gl2ext.h"
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+static PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinary = NULL;
+static PFNGLPROGRAMBINARYOESPROC glProgramBinary = NULL;
+#endif
+
+#define PROGRAM_BINARY_MAGIC 0x30424750 // "PGB0"
+
+static std::string lg_cache_dir;
+
+static bool is_program_binary_supported() {
+	static int supported = -1;
+	if (supported < 0) {
+		supported = 0;
+#ifdef USE_GLES
+		const char *extensions = (const char*) glGetString(GL_EXTENSIONS);
+		if (extensions && strstr(extensions, "GL_OES_get_program_binary")) {
+			glGetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC) eglGetProcAddress("glGetProgramBinaryOES");
+			glProgramBinary = (PFNGLPROGRAMBINARYOESPROC) eglGetProcAddress("glProgramBinaryOES");
+			supported = (glGetProgramBinary && glProgramBinary) ? 1 : 0;
+		}
+#else
+		supported = (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) ? 1 : 0;
+#endif
+		if (supported) {
+			GLint num_of_formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_of_formats);
+			supported = (num_of_formats > 0) ? 1 : 0;
+		}
+	}
+	return supported == 1;
+}
+
+//fnv-1a
+static uint64_t hash_append(uint64_t hash, const char *str, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t hash_append(uint64_t hash, const char *str) {
+	//include terminator to separate fields
+	return hash_append(hash, str ? str : "", (str ? strlen(str) : 0) + 1);
+}
 
 GLProgram::GLProgram(const char *common, const char *vertex, const char *fragment, bool is_file) {
-	GLint status;
 	m_common = common;
+	m_vertex_id = 0;
+	m_fragment_id = 0;
+
+	std::string sources[2];
+	const char *srcs[2] = { vertex, fragment };
+	for (int i = 0; i < 2; i++) {
+		if (is_file) {
+			char *shader_source = ReadFile(srcs[i]);
+			if (!shader_source) {
+				std::stringstream s;
+				const char *error = std::strerror(errno);
+				s << "Could not load " << srcs[i] << ": " << error;
+				throw std::invalid_argument(s.str());
+			}
+			sources[i] = shader_source;
+			delete[] shader_source;
+		} else {
+			sources[i] = m_common ? m_common : "";
+			sources[i] += srcs[i];
+		}
+	}
+	Build(sources[0], sources[1]);
+}
+
+GLProgram::GLProgram(const char *common, const char *vertex, int vertex_len, const char *fragment, int fragment_len) {
+	m_common = common;
+	m_vertex_id = 0;
+	m_fragment_id = 0;
+
+	std::string vertex_source = m_common ? m_common : "";
+	vertex_source.append(vertex, vertex_len);
+	std::string fragment_source = m_common ? m_common : "";
+	fragment_source.append(fragment, fragment_len);
+	Build(vertex_source, fragment_source);
+}
+
+GLProgram::~GLProgram() {
+	if (m_fragment_id) {
+		glDeleteShader(m_fragment_id);
+	}
+	if (m_vertex_id) {
+		glDeleteShader(m_vertex_id);
+	}
+	glDeleteProgram(m_program_id);
+}
+
+GLuint GLProgram::GetId() {
+	return m_program_id;
+}
+
+void GLProgram::SetCacheDir(const char *dir) {
+	lg_cache_dir = dir ? dir : "";
+	if (!lg_cache_dir.empty()) {
+		mkdir(lg_cache_dir.c_str(), 0777);
+	}
+}
+
+void GLProgram::Build(const std::string &vertex_source, const std::string &fragment_source) {
+	GLint status;
+	char cache_filepath[512] = { };
 	m_program_id = glCreateProgram();
 
-	m_vertex_id = LoadShader(GL_VERTEX_SHADER, vertex, is_file);
-	m_fragment_id = LoadShader(GL_FRAGMENT_SHADER, fragment, is_file);
+	if (!lg_cache_dir.empty() && is_program_binary_supported()) {
+		//binaries are only valid for the same sources on the same driver
+		uint64_t key = 0xcbf29ce484222325ULL;
+		key = hash_append(key, vertex_source.c_str());
+		key = hash_append(key, fragment_source.c_str());
+		key = hash_append(key, (const char*) glGetString(GL_VENDOR));
+		key = hash_append(key, (const char*) glGetString(GL_RENDERER));
+		key = hash_append(key, (const char*) glGetString(GL_VERSION));
+		snprintf(cache_filepath, sizeof(cache_filepath), "%s/%016llx.bin", lg_cache_dir.c_str(), (unsigned long long) key);
+		if (LoadBinary(cache_filepath)) {
+			return;
+		}
+	}
+
+	m_vertex_id = LoadShader(GL_VERTEX_SHADER, vertex_source);
+	m_fragment_id = LoadShader(GL_FRAGMENT_SHADER, fragment_source);
 	glAttachShader(m_program_id, m_vertex_id);
 	glAttachShader(m_program_id, m_fragment_id);
 
+#ifndef USE_GLES
+	if (cache_filepath[0]) {
+		glProgramParameteri(m_program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+#endif
 	glLinkProgram(m_program_id);
 	glGetProgramiv(m_program_id, GL_LINK_STATUS, &status);
 	if (!status) {
@@ -32,46 +163,82 @@ GLProgram::GLProgram(const char *common, const char *vertex, const char *fragmen
 		delete[] msg;
 		throw std::invalid_argument(s.str());
 	}
-}
 
-GLProgram::~GLProgram() {
-	glDeleteShader(m_fragment_id);
-	glDeleteShader(m_vertex_id);
-	glDeleteProgram(m_program_id);
+	if (cache_filepath[0]) {
+		SaveBinary(cache_filepath);
+	}
 }
 
-GLuint GLProgram::GetId() {
-	return m_program_id;
+bool GLProgram::LoadBinary(const char *filepath) {
+	std::FILE *fp = std::fopen(filepath, "rb");
+	if (!fp) {
+		return false;
+	}
+	uint32_t header[3] = { }; //magic, format, length
+	std::vector<char> binary;
+	if (std::fread(header, sizeof(header), 1, fp) == 1 && header[0] == PROGRAM_BINARY_MAGIC) {
+		//length must be the rest of file, a broken or foreign file falls back to source
+		long pos = std::ftell(fp);
+		long remaining = (pos >= 0 && std::fseek(fp, 0, SEEK_END) == 0) ? std::ftell(fp) - pos : -1;
+		if (header[2] > 0 && remaining == (long) header[2] && std::fseek(fp, pos, SEEK_SET) == 0) {
+			binary.resize(header[2]);
+			if (std::fread(binary.data(), 1, binary.size(), fp) != binary.size()) {
+				binary.clear();
+			}
+		}
+	}
+	std::fclose(fp);
+	if (binary.empty()) {
+		return false;
+	}
+
+	GLint status = GL_FALSE;
+	glProgramBinary(m_program_id, (GLenum) header[1], binary.data(), (GLsizei) binary.size());
+	glGetProgramiv(m_program_id, GL_LINK_STATUS, &status);
+	if (!status) { //driver rejected it, rebuild from source
+		glDeleteProgram(m_program_id);
+		m_program_id = glCreateProgram();
+		return false;
+	}
+	return true;
 }
 
-GLuint GLProgram::LoadShader(GLenum shader_type, const char *source, bool is_file) {
-	GLint status;
-	GLuint shader_id;
-	char *shader_source = NULL;
-	if (is_file) {
-		shader_source = ReadFile(source);
-	} else {
-		size_t length = strlen(source);
-		size_t common_length = m_common ? strlen(m_common) : 0;
-		shader_source = new char[common_length + length + 1];
-		if (common_length) {
-			strncpy(shader_source, m_common, common_length);
-		}
-		if (length) {
-			strncpy(shader_source + common_length, source, length);
-		}
-		shader_source[common_length + length] = '\0';
+void GLProgram::SaveBinary(const char *filepath) {
+	GLint length = 0;
+	glGetProgramiv(m_program_id, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(m_program_id, length, &length, &format, binary.data());
+	if (length <= 0) {
+		return;
 	}
 
-	if (!shader_source) {
-		std::stringstream s;
-		const char *error = std::strerror(errno);
-		s << "Could not load " << source << ": " << error;
-		throw std::invalid_argument(s.str());
+	//write to a private file then rename, concurrent instances never see a partial binary
+	char tmp_filepath[512];
+	snprintf(tmp_filepath, sizeof(tmp_filepath), "%s.%d.tmp", filepath, (int) getpid());
+	std::FILE *fp = std::fopen(tmp_filepath, "wb");
+	if (!fp) {
+		return;
+	}
+	uint32_t header[3] = { PROGRAM_BINARY_MAGIC, (uint32_t) format, (uint32_t) length };
+	bool succeeded = (std::fwrite(header, sizeof(header), 1, fp) == 1);
+	succeeded = succeeded && (std::fwrite(binary.data(), 1, length, fp) == (size_t) length);
+	succeeded = (std::fclose(fp) == 0) && succeeded;
+	if (!succeeded || rename(tmp_filepath, filepath) != 0) {
+		remove(tmp_filepath);
 	}
+}
+
+GLuint GLProgram::LoadShader(GLenum shader_type, const std::string &shader_source) {
+	GLint status;
+	GLuint shader_id;
+	const GLchar *source = (const GLchar*) shader_source.c_str();
 
 	shader_id = glCreateShader(shader_type);
-	glShaderSource(shader_id, 1, (const GLchar**) &shader_source, NULL);
+	glShaderSource(shader_id, 1, &source, NULL);
 	glCompileShader(shader_id);
 
 	glGetShaderiv(shader_id, GL_COMPILE_STATUS, &status);
@@ -88,7 +255,6 @@ GLuint GLProgram::LoadShader(GLenum shader_type, const char *source, bool is_fil
 		delete[] msg;
 		throw std::invalid_argument(s.str());
 	}
-	delete[] shader_source;
 
 	return shader_id;
 }
@@ -120,9 +286,15 @@ char* GLProgram::ReadFile(const char *file) {
 void *GLProgram_new(const char *common, const char *vertex_file, const char *fragment_file, bool is_file) {
 	return (void*) new GLProgram(common, vertex_file, fragment_file, is_file);
 }
+void *GLProgram_new_from_memory(const char *common, const char *vertex, int vertex_len, const char *fragment, int fragment_len) {
+	return (void*) new GLProgram(common, vertex, vertex_len, fragment, fragment_len);
+}
 GLuint GLProgram_GetId(const void *_this) {
 	return ((GLProgram*) _this)->GetId();
 }
 void GLProgram_delete(const void *_this) {
 	delete ((GLProgram*) _this);
 }
+void GLProgram_set_cache_dir(const char *dir) {
+	GLProgram::SetCacheDir(dir);
+}
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE //pthread_setname_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metrics.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define HTTP_HEADER "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n"
+#define INITIAL_BUFF_SIZE (16 * 1024)
+
+void metrics_registry_init(METRICS_REGISTRY_T *_this) {
+	memset(_this, 0, sizeof(METRICS_REGISTRY_T));
+	pthread_mutex_init(&_this->mutex, 0);
+	_this->server_fd = -1;
+}
+
+void metrics_registry_deinit(METRICS_REGISTRY_T *_this) {
+	metrics_registry_stop(_this);
+	pthread_mutex_lock(&_this->mutex);
+	for (METRIC_T *metric = _this->metrics; metric;) {
+		METRIC_T *next = metric->next;
+		free(metric);
+		metric = next;
+	}
+	_this->metrics = NULL;
+	_this->num_metrics = 0;
+	pthread_mutex_unlock(&_this->mutex);
+	pthread_mutex_destroy(&_this->mutex);
+}
+
+static METRIC_T *add_metric(METRICS_REGISTRY_T *_this, enum METRIC_TYPE type, const char *name, const char *labels, const char *help,
+		const double *bounds, int num_bounds) {
+	if (name == NULL || name[0] == '\0') {
+		return NULL;
+	}
+	if (labels == NULL) {
+		labels = "";
+	}
+	METRIC_T *metric = NULL;
+	pthread_mutex_lock(&_this->mutex);
+	METRIC_T **pos = &_this->metrics;
+	METRIC_T *last_same_name = NULL;
+	for (METRIC_T *m = _this->metrics; m; m = m->next) {
+		if (strncmp(m->name, name, METRICS_NAME_LEN - 1) == 0) {
+			if (strncmp(m->labels, labels, METRICS_LABELS_LEN - 1) == 0) {
+				metric = (m->type == type) ? m : NULL;
+				pthread_mutex_unlock(&_this->mutex);
+				return metric;
+			}
+			if (m->type != type) {
+				printf("metrics : %s is already registered as other type\n", name);
+				pthread_mutex_unlock(&_this->mutex);
+				return NULL;
+			}
+			last_same_name = m;
+		}
+		pos = &m->next;
+	}
+	if (last_same_name) { //keep series of a name together for exposition
+		pos = &last_same_name->next;
+	}
+
+	metric = (METRIC_T*) malloc(sizeof(METRIC_T));
+	memset(metric, 0, sizeof(METRIC_T));
+	strncpy(metric->name, name, sizeof(metric->name) - 1);
+	strncpy(metric->labels, labels, sizeof(metric->labels) - 1);
+	if (help) {
+		strncpy(metric->help, help, sizeof(metric->help) - 1);
+	}
+	metric->type = type;
+	if (type == METRIC_HISTOGRAM) {
+		metric->num_bounds = MIN(num_bounds, METRICS_MAX_BUCKETS);
+		memcpy(metric->bounds, bounds, sizeof(double) * metric->num_bounds);
+	}
+	metric->next = *pos;
+	*pos = metric;
+	_this->num_metrics++;
+	pthread_mutex_unlock(&_this->mutex);
+	return metric;
+}
+
+METRIC_T *metrics_registry_add(METRICS_REGISTRY_T *_this, enum METRIC_TYPE type, const char *name, const char *labels, const char *help) {
+	if (type == METRIC_HISTOGRAM) {
+		return metrics_registry_add_histogram(_this, name, labels, help, NULL, 0);
+	}
+	return add_metric(_this, type, name, labels, help, NULL, 0);
+}
+
+METRIC_T *metrics_registry_add_histogram(METRICS_REGISTRY_T *_this, const char *name, const char *labels, const char *help,
+		const double *bounds, int num_bounds) {
+	static const double default_bounds[] = METRICS_DEFAULT_BUCKETS;
+	if (bounds == NULL || num_bounds <= 0) {
+		bounds = default_bounds;
+		num_bounds = sizeof(default_bounds) / sizeof(default_bounds[0]);
+	}
+	return add_metric(_this, METRIC_HISTOGRAM, name, labels, help, bounds, num_bounds);
+}
+
+//snprintf which keeps counting after buff is full
+#define APPEND(...) len += snprintf(buff + MIN(len, buff_len), MAX(buff_len - len, 0), __VA_ARGS__)
+
+static const char *format_value(char *str, int str_len, double value) {
+	if (isnan(value)) {
+		return "NaN";
+	} else if (isinf(value)) {
+		return (value > 0) ? "+Inf" : "-Inf";
+	}
+	snprintf(str, str_len, "%.9g", value);
+	return str;
+}
+
+int metrics_registry_write(METRICS_REGISTRY_T *_this, char *buff, int buff_len, bool compact) {
+	static const char *type_str[] = { "counter", "gauge", "histogram" };
+	int len = 0;
+	char str[64];
+	if (buff_len > 0) {
+		buff[0] = '\0';
+	}
+	pthread_mutex_lock(&_this->mutex);
+	const char *last_name = "";
+	for (METRIC_T *m = _this->metrics; m; m = m->next) {
+		const char *lb = m->labels[0] ? "{" : "";
+		const char *rb = m->labels[0] ? "}" : "";
+		if (!compact && strcmp(m->name, last_name) != 0) {
+			if (m->help[0]) {
+				APPEND("# HELP %s %s\n", m->name, m->help);
+			}
+			APPEND("# TYPE %s %s\n", m->name, type_str[m->type]);
+		}
+		last_name = m->name;
+		switch (m->type) {
+		case METRIC_COUNTER:
+			APPEND("%s%s%s%s %llu\n", m->name, lb, m->labels, rb,
+					(unsigned long long) __atomic_load_n(&m->value, __ATOMIC_RELAXED));
+			break;
+		case METRIC_GAUGE:
+			APPEND("%s%s%s%s %s\n", m->name, lb, m->labels, rb, format_value(str, sizeof(str), metric_get(m)));
+			break;
+		case METRIC_HISTOGRAM: {
+			METRIC_BITS_T sum = { .u = __atomic_load_n(&m->sum, __ATOMIC_RELAXED) };
+			uint64_t count = 0;
+			for (int i = 0; i <= m->num_bounds; i++) {
+				count += __atomic_load_n(&m->buckets[i], __ATOMIC_RELAXED);
+				if (compact) {
+					continue;
+				}
+				const char *le = (i < m->num_bounds) ? format_value(str, sizeof(str), m->bounds[i]) : "+Inf";
+				APPEND("%s_bucket{%s%sle=\"%s\"} %llu\n", m->name, m->labels, m->labels[0] ? "," : "", le,
+						(unsigned long long) count);
+			}
+			//count is taken from buckets, it is consistent with +Inf bucket
+			APPEND("%s_sum%s%s%s %s\n", m->name, lb, m->labels, rb, format_value(str, sizeof(str), sum.d));
+			APPEND("%s_count%s%s%s %llu\n", m->name, lb, m->labels, rb, (unsigned long long) count);
+			break;
+		}
+		}
+	}
+	pthread_mutex_unlock(&_this->mutex);
+	return len;
+}
+
+static void write_all(int fd, const char *data, int len) {
+	while (len > 0) {
+		ssize_t res = send(fd, data, len, MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		data += res;
+		len -= res;
+	}
+}
+
+static void *server_thread_func(void *arg) {
+	METRICS_REGISTRY_T *_this = (METRICS_REGISTRY_T*) arg;
+	pthread_setname_np(pthread_self(), "METRICS");
+
+	int buff_size = INITIAL_BUFF_SIZE;
+	char *buff = (char*) malloc(buff_size);
+	while (__atomic_load_n(&_this->server_run, __ATOMIC_ACQUIRE)) {
+		int fd = accept(_this->server_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			break; //closed by metrics_registry_stop
+		}
+		{ //the request is not parsed, read it so that close does not reset
+			struct timeval tv = { 1, 0 };
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			char req[1024];
+			recv(fd, req, sizeof(req), 0);
+		}
+		int len = metrics_registry_write(_this, buff, buff_size, false);
+		if (len >= buff_size) {
+			buff_size = len + INITIAL_BUFF_SIZE;
+			buff = (char*) realloc(buff, buff_size);
+			len = MIN(metrics_registry_write(_this, buff, buff_size, false), buff_size - 1);
+		}
+		write_all(fd, HTTP_HEADER, strlen(HTTP_HEADER));
+		write_all(fd, buff, len);
+		close(fd);
+	}
+	free(buff);
+	return NULL;
+}
+
+int metrics_registry_serve(METRICS_REGISTRY_T *_this, int port) {
+	if (_this->server_fd >= 0) {
+		return -1;
+	}
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("metrics : socket");
+		return -1;
+	}
+	int on = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+		printf("metrics : failed to listen on 127.0.0.1:%d : %s\n", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	_this->server_fd = fd;
+	_this->server_run = true;
+	if (pthread_create(&_this->server_thread, NULL, server_thread_func, (void*) _this) != 0) {
+		_this->server_run = false;
+		_this->server_fd = -1;
+		close(fd);
+		return -1;
+	}
+	printf("metrics : http://127.0.0.1:%d/metrics\n", port);
+	return 0;
+}
+
+void metrics_registry_stop(METRICS_REGISTRY_T *_this) {
+	if (_this->server_fd < 0) {
+		return;
+	}
+	__atomic_store_n(&_this->server_run, false, __ATOMIC_RELEASE);
+	shutdown(_this->server_fd, SHUT_RDWR); //wake up accept
+	pthread_join(_this->server_thread, NULL);
+	close(_this->server_fd);
+	_this->server_fd = -1;
+}
@@ -26,6 +26,7 @@ extern "C" {
 #endif
 
 #include "mrevent.h"
+#include "stream_framer.h"
 
 #ifdef __cplusplus
 }
@@ -513,21 +514,97 @@ static void *buffering_thread_func(void* arg) {
 	return NULL;
 }
 
+struct RECEIVE_CONTEXT {
+	RTP_T *rtp;
+	//for loading
+	unsigned int last_timestamp;
+	uint64_t current_play_time;
+	struct timeval last_time;
+	bool is_first;
+};
+
+//0xFF 0xE1 len(2 bytes, little endian, including this header) "rtp\0" rtp packet
+int rtp_get_xmp_len(const unsigned char *head, unsigned int head_len, void *user_data) {
+	if (head_len < 8) {
+		return 0;
+	}
+	if (memcmp(head + 4, "rtp", 4) != 0) {
+		return -1;
+	}
+	int xmp_len = head[2] + (head[3] << 8);
+	return (xmp_len > 8) ? xmp_len : -1;
+}
+
+static void xmp_callback(unsigned char *data, unsigned int data_len, void *user_data) {
+	struct RECEIVE_CONTEXT *ctx = (struct RECEIVE_CONTEXT*) user_data;
+	RTP_T *_this = ctx->rtp;
+	RTPPacket *pack = new RTPPacket(data_len - 8);
+	memcpy(pack->GetPacketData(), data + 8, data_len - 8);
+	pack->LoadHeader();
+	if (_this->load_fd >= 0) { //wait
+		struct timeval time = { };
+		gettimeofday(&time, NULL);
+		if (ctx->is_first) {
+			ctx->is_first = false;
+			ctx->last_timestamp = pack->timestamp;
+			gettimeofday(&ctx->last_time, NULL);
+		}
+		int elapsed_usec;
+		if (pack->timestamp < ctx->last_timestamp) {
+			elapsed_usec = pack->timestamp + (UINT_MAX - ctx->last_timestamp);
+		} else {
+			elapsed_usec = pack->timestamp - ctx->last_timestamp;
+		}
+		ctx->current_play_time += elapsed_usec;
+		if (_this->auto_play) {
+			struct timeval diff;
+			timersub(&time, &ctx->last_time, &diff);
+			float diff_usec = diff.tv_sec * 1000000 + (float) diff.tv_usec;
+			float _elapsed_usec = ((float) elapsed_usec / _this->play_speed);
+
+			if (diff_usec < _elapsed_usec) {
+				usleep(MIN(_elapsed_usec - diff_usec, 1000000));
+			}
+			ctx->last_time = time;
+			_this->play_time = ctx->current_play_time;
+		}
+		while (_this->load_fd >= 0 && !_this->auto_play) {
+			if (ctx->current_play_time <= _this->play_time) {
+				break;
+			} else {
+				mrevent_reset(&_this->play_time_updated);
+			}
+			mrevent_wait(&_this->play_time_updated, 1000);
+		}
+		ctx->last_timestamp = pack->timestamp;
+	}
+
+	pthread_mutex_lock(&_this->callbacks_mlock);
+	for (std::list<struct RTP_CALLBACK_PAIR>::iterator it = _this->callbacks.begin(); it != _this->callbacks.end(); it++) {
+		(*it).callback(pack->GetPayloadData(), pack->GetPayloadLength(), pack->GetPayloadType(), pack->GetSequenceNumber(), (*it).user_data);
+	}
+	pthread_mutex_unlock(&_this->callbacks_mlock);
+
+	if (_this->record_fd > 0) {
+		pthread_mutex_lock(&_this->record_packet_queue_mlock);
+		_this->record_packet_queue.push_back(pack);
+		mrevent_trigger(&_this->record_packet_ready);
+		pthread_mutex_unlock(&_this->record_packet_queue_mlock);
+	} else {
+		delete pack;
+	}
+}
+
 static void *receive_thread_func(void* arg) {
 	RTP_T *_this = (RTP_T*) arg;
 	pthread_setname_np(pthread_self(), "RTP RECEIVE");
 
-	//for loading
-	unsigned int last_timestamp = 0;
-	uint64_t current_play_time = 0;
-	struct timeval last_time = { };
-	bool is_first = true;
-
-	int marker = 0;
-	int xmp_len = 0;
-	int xmp_pos = 0;
-	bool xmp = false;
-	RTPPacket *pack = NULL;
+	const unsigned char XMP_MARKER[] = { 0xFF, 0xE1 };
+	struct RECEIVE_CONTEXT ctx = { };
+	ctx.rtp = _this;
+	ctx.is_first = true;
+	STREAM_FRAMER_T framer;
+	stream_framer_init(&framer, XMP_MARKER, sizeof(XMP_MARKER), rtp_get_xmp_len, xmp_callback, &ctx);
 	while (_this->receive_run) {
 		int res = mrevent_wait(&_this->buffering_ready, 1000);
 		if (res != 0) {
@@ -543,126 +620,10 @@ static void *receive_thread_func(void* arg) {
 		}
 		pthread_mutex_unlock(&_this->buffering_queue_mlock);
 
-		int data_len = raw_pack->GetPacketLength();
-		unsigned char *buff = raw_pack->GetPacketData();
-
-		for (int i = 0; i < data_len; i++) {
-			if (xmp) {
-				if (xmp_pos == 2) {
-					xmp_len = buff[i];
-					xmp_pos++;
-				} else if (xmp_pos == 3) {
-					xmp_len += buff[i] << 8;
-					xmp_pos++;
-				} else if (xmp_pos == 4) {
-					if (buff[i] == 'r') {
-						xmp_pos++;
-					} else {
-						xmp = false;
-					}
-				} else if (xmp_pos == 5) {
-					if (buff[i] == 't') {
-						xmp_pos++;
-					} else {
-						xmp = false;
-					}
-				} else if (xmp_pos == 6) {
-					if (buff[i] == 'p') {
-						xmp_pos++;
-					} else {
-						xmp = false;
-					}
-				} else if (xmp_pos == 7) { // rtp header
-					if (buff[i] == '\0') {
-						xmp_pos++;
-					} else {
-						xmp = false;
-					}
-				} else {
-					if (xmp_pos == 8) {
-						pack = new RTPPacket(xmp_len - 8);
-					}
-					if (i + (xmp_len - xmp_pos) <= data_len) {
-						memcpy(pack->GetPacketData() + xmp_pos - 8, &buff[i], xmp_len - xmp_pos);
-						i += xmp_len - xmp_pos - 1;
-						xmp_pos = xmp_len;
-						pack->LoadHeader();
-						if (_this->load_fd >= 0) { //wait
-							struct timeval time = { };
-							gettimeofday(&time, NULL);
-							if (is_first) {
-								is_first = false;
-								last_timestamp = pack->timestamp;
-								gettimeofday(&last_time, NULL);
-							}
-							int elapsed_usec;
-							if (pack->timestamp < last_timestamp) {
-								elapsed_usec = pack->timestamp + (UINT_MAX - last_timestamp);
-							} else {
-								elapsed_usec = pack->timestamp - last_timestamp;
-							}
-							current_play_time += elapsed_usec;
-							if (_this->auto_play) {
-								struct timeval diff;
-								timersub(&time, &last_time, &diff);
-								float diff_usec = diff.tv_sec * 1000000 + (float) diff.tv_usec;
-								float _elapsed_usec = ((float) elapsed_usec / _this->play_speed);
-
-								if (diff_usec < _elapsed_usec) {
-									usleep(MIN(_elapsed_usec - diff_usec, 1000000));
-								}
-								last_time = time;
-								_this->play_time = current_play_time;
-							}
-							while (_this->load_fd >= 0 && !_this->auto_play) {
-								if (current_play_time <= _this->play_time) {
-									break;
-								} else {
-									mrevent_reset(&_this->play_time_updated);
-								}
-								mrevent_wait(&_this->play_time_updated, 1000);
-							}
-							last_timestamp = pack->timestamp;
-						}
-
-						pthread_mutex_lock(&_this->callbacks_mlock);
-						for (std::list<struct RTP_CALLBACK_PAIR>::iterator it = _this->callbacks.begin(); it != _this->callbacks.end(); it++) {
-							(*it).callback(pack->GetPayloadData(), pack->GetPayloadLength(), pack->GetPayloadType(), pack->GetSequenceNumber(), (*it).user_data);
-						}
-						pthread_mutex_unlock(&_this->callbacks_mlock);
-
-						if (_this->record_fd > 0) {
-							pthread_mutex_lock(&_this->record_packet_queue_mlock);
-							_this->record_packet_queue.push_back(pack);
-							mrevent_trigger(&_this->record_packet_ready);
-							pthread_mutex_unlock(&_this->record_packet_queue_mlock);
-						} else {
-							delete pack;
-						}
-						pack = NULL;
-						xmp = false;
-					} else {
-						int rest_in_buff = data_len - i;
-						memcpy(pack->GetPacketData() + xmp_pos - 8, &buff[i], rest_in_buff);
-						i = data_len - 1;
-						xmp_pos += rest_in_buff;
-					}
-				}
-			} else {
-				if (marker) {
-					marker = 0;
-					if (buff[i] == 0xE1) { //xmp
-						xmp = true;
-						xmp_pos = 2;
-						xmp_len = 0;
-					}
-				} else if (buff[i] == 0xFF) {
-					marker = 1;
-				}
-			}
-		}
+		stream_framer_push(&framer, raw_pack->GetPacketData(), raw_pack->GetPacketLength());
 		delete raw_pack;
 	}
+	stream_framer_deinit(&framer);
 	return NULL;
 }
 
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "stream_framer.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define INITIAL_BUFF_SIZE (64 * 1024)
+#define HEADER_STEP 64
+
+static void append(STREAM_FRAMER_T *_this, const unsigned char *data, unsigned int data_len) {
+	if (_this->buff_len + data_len > _this->buff_size) { //geometric growth
+		_this->buff_size = MAX(MAX(_this->buff_len + data_len, _this->buff_size * 2), INITIAL_BUFF_SIZE);
+		_this->buff = (unsigned char*) realloc(_this->buff, _this->buff_size);
+	}
+	memcpy(_this->buff + _this->buff_len, data, data_len);
+	_this->buff_len += data_len;
+}
+
+static void emit(STREAM_FRAMER_T *_this, unsigned char *data, unsigned int data_len, bool copied) {
+	_this->num_of_frames++;
+	if (copied) {
+		_this->num_of_copied_frames++;
+	}
+	_this->callback(data, data_len, _this->user_data);
+}
+
+static void end_frame(STREAM_FRAMER_T *_this) {
+	_this->buff_len = 0;
+	_this->in_frame = false;
+	_this->frame_len = 0;
+}
+
+unsigned char *stream_framer_find_marker(const unsigned char *p, const unsigned char *end, const unsigned char *marker, int marker_len) {
+	//memchr is vectorized in libc, last byte of markers is rare in payload (0x01, 'S', 0xE1)
+	const unsigned char last = marker[marker_len - 1];
+	const unsigned char *q = p + marker_len - 1;
+	while (q < end) {
+		q = (const unsigned char*) memchr(q, last, end - q);
+		if (q == NULL) {
+			break;
+		}
+		if (memcmp(q - (marker_len - 1), marker, marker_len - 1) == 0) {
+			return (unsigned char*) q - (marker_len - 1);
+		}
+		q++;
+	}
+	return (unsigned char*) end;
+}
+
+void stream_framer_init(STREAM_FRAMER_T *_this, const unsigned char *marker, int marker_len, STREAM_FRAMER_GET_FRAME_LEN get_frame_len,
+		STREAM_FRAMER_CALLBACK callback, void *user_data) {
+	memset(_this, 0, sizeof(STREAM_FRAMER_T));
+	_this->marker_len = MIN(marker_len, STREAM_FRAMER_MAX_MARKER_LEN);
+	memcpy(_this->marker, marker, _this->marker_len);
+	_this->get_frame_len = get_frame_len;
+	_this->callback = callback;
+	_this->user_data = user_data;
+}
+
+void stream_framer_deinit(STREAM_FRAMER_T *_this) {
+	if (_this->buff) {
+		free(_this->buff);
+		_this->buff = NULL;
+	}
+	_this->buff_size = 0;
+	end_frame(_this);
+}
+
+//a frame continued from previous buffers
+static unsigned char *push_to_buff(STREAM_FRAMER_T *_this, unsigned char *p, unsigned char *end) {
+	const int m = _this->marker_len;
+	if (_this->get_frame_len) {
+		if (_this->frame_len == 0) { //header across buffers
+			unsigned int n = MIN(end - p, HEADER_STEP);
+			append(_this, p, n);
+			int len = _this->get_frame_len(_this->buff, _this->buff_len, _this->user_data);
+			if (len < 0 || (len > 0 && len < m)) { //resync from p
+				end_frame(_this);
+				return p;
+			}
+			if (len == 0) {
+				return p + n;
+			}
+			if (_this->buff_len >= len) {
+				unsigned int rest = _this->buff_len - len;
+				emit(_this, _this->buff, len, true);
+				end_frame(_this);
+				return p + n - rest;
+			}
+			_this->frame_len = len;
+			return p + n;
+		}
+		unsigned int n = MIN(end - p, _this->frame_len - _this->buff_len);
+		append(_this, p, n);
+		if (_this->buff_len == _this->frame_len) {
+			emit(_this, _this->buff, _this->buff_len, true);
+			end_frame(_this);
+		}
+		return p + n;
+	} else {
+		//marker across buffers : tail of buff and head of data
+		unsigned int tail = MIN(_this->buff_len - m, m - 1);
+		if (tail > 0) {
+			unsigned char tmp[2 * STREAM_FRAMER_MAX_MARKER_LEN];
+			unsigned int head = MIN(end - p, m - 1);
+			memcpy(tmp, _this->buff + _this->buff_len - tail, tail);
+			memcpy(tmp + tail, p, head);
+			unsigned char *q = stream_framer_find_marker(tmp, tmp + tail + head, _this->marker, m);
+			if (q < tmp + tail) {
+				unsigned int in_tail = tmp + tail - q;
+				emit(_this, _this->buff, _this->buff_len - in_tail, true);
+				//next frame starts with the split marker
+				end_frame(_this);
+				append(_this, _this->marker, m);
+				_this->in_frame = true;
+				return p + (m - in_tail);
+			}
+		}
+		unsigned char *q = stream_framer_find_marker(p, end, _this->marker, m);
+		append(_this, p, q - p);
+		if (q < end) {
+			emit(_this, _this->buff, _this->buff_len, true);
+			end_frame(_this);
+		}
+		return q;
+	}
+}
+
+//a marker prefix left at the end of previous buffer
+static unsigned char *push_to_prefix(STREAM_FRAMER_T *_this, unsigned char *p, unsigned char *end) {
+	const int m = _this->marker_len;
+	unsigned char tmp[2 * STREAM_FRAMER_MAX_MARKER_LEN];
+	unsigned int prefix = _this->buff_len;
+	unsigned int head = MIN(end - p, m - 1);
+	memcpy(tmp, _this->buff, prefix);
+	memcpy(tmp + prefix, p, head);
+	unsigned char *q = stream_framer_find_marker(tmp, tmp + prefix + head, _this->marker, m);
+	end_frame(_this);
+	if (q < tmp + prefix) {
+		unsigned int in_prefix = tmp + prefix - q;
+		append(_this, _this->marker, m);
+		_this->in_frame = true;
+		return p + (m - in_prefix);
+	}
+	if (p + head == end) { //still a possible prefix
+		unsigned int n = MIN(prefix + head, m - 1);
+		append(_this, tmp + prefix + head - n, n);
+		return end;
+	}
+	return p;
+}
+
+void stream_framer_push(STREAM_FRAMER_T *_this, unsigned char *data, unsigned int data_len) {
+	const int m = _this->marker_len;
+	unsigned char *p = data;
+	unsigned char *end = data + data_len;
+	while (p < end) {
+		if (_this->buff_len > 0) {
+			if (_this->in_frame) {
+				p = push_to_buff(_this, p, end);
+			} else {
+				p = push_to_prefix(_this, p, end);
+			}
+			continue;
+		}
+		unsigned char *q = stream_framer_find_marker(p, end, _this->marker, m);
+		if (q == end) { //keep a possible marker prefix
+			unsigned int n = MIN(end - p, m - 1);
+			append(_this, end - n, n);
+			break;
+		}
+		p = q;
+		if (_this->get_frame_len) {
+			int len = _this->get_frame_len(p, end - p, _this->user_data);
+			if (len < 0 || (len > 0 && len < m)) {
+				p++;
+			} else if (len > 0 && p + len <= end) { //zero copy
+				emit(_this, p, len, false);
+				p += len;
+			} else {
+				append(_this, p, end - p);
+				_this->in_frame = true;
+				_this->frame_len = len;
+				break;
+			}
+		} else {
+			unsigned char *next = stream_framer_find_marker(p + m, end, _this->marker, m);
+			if (next < end) { //zero copy
+				emit(_this, p, next - p, false);
+				p = next;
+			} else {
+				append(_this, p, end - p);
+				_this->in_frame = true;
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,230 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <math.h>
+#if __linux
+#include <sys/prctl.h>
+#endif
+
+#ifdef USE_GLES
+#include "GLES2/gl2.h"
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+#else
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+//#include "GL/gl.h"
+//#include "GL/glut.h"
+//#include "GL/glext.h"
+#endif
+
+#include "gl_program.h"
+#include "glsl/window_fsh.h" //faces are sampled same as window
+#include "glsl/cubemap_vsh.h"
+
+#include "cubemap_renderer.h"
+
+#define PLUGIN_NAME "cubemap_renderer"
+#define CUBEMAP_RENDERER_NAME "CUBEMAP"
+#define EAC_RENDERER_NAME "EAC"
+
+//declared in sei so that clients can map faces back to sphere
+#define CUBEMAP_PROJECTION "cubemap:3x2:+x,-x,+y,-y,+z,-z"
+#define EAC_PROJECTION "eac:3x2:+x,-x,+y,-y,+z,-z"
+
+#define NUM_OF_FACES 6
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+typedef struct _cubemap_renderer {
+	RENDERER_T super;
+
+	bool eac;
+	int num_of_cam;
+	char *common; //preamble of host, any length
+	void *program_objs[RENDERER_OPTION_MAX]; //variants compiled on demand
+	void *program_obj; //current variant
+	GLuint vbo;
+	GLuint vbo_nop;
+	GLuint vao;
+
+	void *user_data;
+} cubemap_renderer;
+
+static int cubemap_mesh(int num_of_steps, GLuint *vbo_out, GLuint *n_out, GLuint *vao_out) {
+	GLuint vbo;
+
+	//independent triangles, strips would bridge faces
+	int n = NUM_OF_FACES * num_of_steps * num_of_steps * 6;
+	float *points = (float*) malloc(sizeof(float) * 4 * n);
+
+	float step = 1.0f / num_of_steps;
+
+	int idx = 0;
+	for (int face = 0; face < NUM_OF_FACES; face++) {
+		for (int i = 0; i < num_of_steps; i++) {	//x
+			for (int j = 0; j < num_of_steps; j++) {	//y
+				const int quad[6][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 0, 1 } };
+				for (int k = 0; k < 6; k++) {
+					points[idx++] = step * (i + quad[k][0]);
+					points[idx++] = step * (j + quad[k][1]);
+					points[idx++] = face;
+					points[idx++] = 1.0;
+				}
+			}
+		}
+	}
+
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * n, points, GL_STATIC_DRAW);
+	free(points);
+
+#ifdef USE_VAO
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+
+	glBindVertexArray(0);
+
+	if (vao_out != NULL)
+		*vao_out = vao;
+#endif
+
+	if (vbo_out != NULL)
+		*vbo_out = vbo;
+	if (n_out != NULL)
+		*n_out = n;
+
+	return 0;
+}
+
+static void *create_program(cubemap_renderer *_this, uint32_t options) {
+	char common[strlen(_this->common) + 128]; //defines below are short
+	snprintf(common, sizeof(common), "%s#define NUM_OF_CAM %d\n%s%s%s", _this->common, _this->num_of_cam, //
+			_this->eac ? "#define USE_EAC\n" : "", //
+			(options & RENDERER_OPTION_OVERLAP) ? "#define USE_OVERLAP\n" : "", //
+			(options & RENDERER_OPTION_COLOR_OFFSET) ? "#define USE_COLOR_OFFSET\n" : "");
+
+	return GLProgram_new_from_memory(common, (const char*) cubemap_vsh, cubemap_vsh_len, (const char*) window_fsh, window_fsh_len);
+}
+
+static void init(void *obj, const char *common, int num_of_cam) {
+	cubemap_renderer *_this = (cubemap_renderer*) obj;
+
+	_this->num_of_cam = num_of_cam;
+	_this->common = strdup(common);
+
+	cubemap_mesh(32, &_this->vbo, &_this->vbo_nop, &_this->vao);
+
+	_this->program_objs[RENDERER_OPTION_NONE] = create_program(_this, RENDERER_OPTION_NONE);
+	_this->program_obj = _this->program_objs[RENDERER_OPTION_NONE];
+}
+static void release(void *obj) {
+	cubemap_renderer *_this = (cubemap_renderer*) obj;
+	free(_this->common);
+	free(obj);
+}
+static int get_program(void *obj, uint32_t options) {
+	cubemap_renderer *_this = (cubemap_renderer*) obj;
+	options &= (RENDERER_OPTION_MAX - 1);
+	if (_this->program_objs[options] == NULL) {
+		_this->program_objs[options] = create_program(_this, options);
+	}
+	_this->program_obj = _this->program_objs[options];
+	return GLProgram_GetId(_this->program_obj);
+}
+static void render(void *obj, float fov) {
+	cubemap_renderer *_this = (cubemap_renderer*) obj;
+
+	int program = GLProgram_GetId(_this->program_obj);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _this->vbo);
+
+#ifdef USE_VAO
+	glBindVertexArray(_this->vao);
+#else
+	GLuint loc = glGetAttribLocation(program, "vPosition");
+	glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(loc);
+#endif
+
+	glDrawArrays(GL_TRIANGLES, 0, _this->vbo_nop);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+#ifdef USE_VAO
+	glBindVertexArray(0);
+#else
+	glDisableVertexAttribArray(loc);
+#endif
+}
+
+static void create_renderer(const char *name, const char *projection, bool eac, RENDERER_T **out_renderer) {
+	RENDERER_T *renderer = (RENDERER_T*) malloc(sizeof(cubemap_renderer));
+	memset(renderer, 0, sizeof(cubemap_renderer));
+	strcpy(renderer->name, name);
+	strcpy(renderer->projection, projection);
+	renderer->release = release;
+	renderer->init = init;
+	renderer->get_program = get_program;
+	renderer->render = render;
+	renderer->user_data = renderer;
+	((cubemap_renderer*) renderer)->eac = eac;
+
+	if (out_renderer) {
+		*out_renderer = renderer;
+	}
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+}
+
+static void save_options(void *user_data, json_t *options) {
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	{//cubemap
+		RENDERER_T *renderer = NULL;
+		create_renderer(CUBEMAP_RENDERER_NAME, CUBEMAP_PROJECTION, false, &renderer);
+		lg_plugin_host->add_renderer(renderer);
+	}
+	{//eac
+		RENDERER_T *renderer = NULL;
+		create_renderer(EAC_RENDERER_NAME, EAC_PROJECTION, true, &renderer);
+		lg_plugin_host->add_renderer(renderer);
+	}
+}
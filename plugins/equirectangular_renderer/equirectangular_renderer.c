@@ -43,7 +43,9 @@ typedef struct _equirectangular_renderer {
 	RENDERER_T super;
 
 	int num_of_cam;
-	void *program_obj;
+	char *common; //preamble of host, any length
+	void *program_objs[RENDERER_OPTION_MAX]; //variants compiled on demand
+	void *program_obj; //current variant
 	GLuint vbo;
 	GLuint vbo_nop;
 	GLuint vao;
@@ -121,33 +123,42 @@ static int board_mesh(int num_of_steps, GLuint *vbo_out, GLuint *n_out, GLuint *
 	return 0;
 }
 
+static void *create_program(equirectangular_renderer *_this, uint32_t options) {
+	char common[strlen(_this->common) + 128]; //defines below are short
+	snprintf(common, sizeof(common), "%s#define NUM_OF_CAM %d\n%s%s", _this->common, _this->num_of_cam, //
+			(options & RENDERER_OPTION_OVERLAP) ? "#define USE_OVERLAP\n" : "", //
+			(options & RENDERER_OPTION_COLOR_OFFSET) ? "#define USE_COLOR_OFFSET\n" : "");
+
+	void *program_obj;
+	program_obj = GLProgram_new_from_memory(common, (const char*) equirectangular_vsh, equirectangular_vsh_len, (const char*) equirectangular_fsh, equirectangular_fsh_len);
+
+	return program_obj;
+}
+
 static void init(void *obj, const char *common, int num_of_cam) {
 	equirectangular_renderer *_this = (equirectangular_renderer*) obj;
 
 	_this->num_of_cam = num_of_cam;
+	_this->common = strdup(common);
 
 	board_mesh(64, &_this->vbo, &_this->vbo_nop, &_this->vao);
-	{
-		const char *fsh_filepath = "/tmp/tmp.fsh";
-		const char *vsh_filepath = "/tmp/tmp.vsh";
-		int fsh_fd = open(fsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		int vsh_fd = open(vsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fsh_fd, equirectangular_fsh, equirectangular_fsh_len);
-		write(vsh_fd, equirectangular_vsh, equirectangular_vsh_len);
-		close(fsh_fd);
-		close(vsh_fd);
-		_this->program_obj = GLProgram_new(common, vsh_filepath, fsh_filepath, true);
-		remove(fsh_filepath);
-		remove(vsh_filepath);
-	}
+
+	_this->program_objs[RENDERER_OPTION_NONE] = create_program(_this, RENDERER_OPTION_NONE);
+	_this->program_obj = _this->program_objs[RENDERER_OPTION_NONE];
 }
 static void release(void *obj) {
 	equirectangular_renderer *_this = (equirectangular_renderer*) obj;
 	int status;
+	free(_this->common);
 	free(obj);
 }
-static int get_program(void *obj) {
+static int get_program(void *obj, uint32_t options) {
 	equirectangular_renderer *_this = (equirectangular_renderer*) obj;
+	options &= (RENDERER_OPTION_MAX - 1);
+	if (_this->program_objs[options] == NULL) {
+		_this->program_objs[options] = create_program(_this, options);
+	}
+	_this->program_obj = _this->program_objs[options];
 	return GLProgram_GetId(_this->program_obj);
 }
 static void render(void *obj, float fov) {
@@ -180,6 +191,7 @@ static void create_renderer(void *user_data, RENDERER_T **out_renderer) {
 	RENDERER_T *renderer = (RENDERER_T*) malloc(sizeof(equirectangular_renderer));
 	memset(renderer, 0, sizeof(equirectangular_renderer));
 	strcpy(renderer->name, RENDERER_NAME);
+	strcpy(renderer->projection, "equirectangular");
 	renderer->release = release;
 	renderer->init = init;
 	renderer->get_program = get_program;
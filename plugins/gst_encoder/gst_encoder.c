@@ -13,6 +13,7 @@
 #endif
 
 #include "gst_encoder.h"
+#include "stream_framer.h"
 
 #define PLUGIN_NAME "gst_encoder"
 #define H265_ENCODER_NAME "h265"
@@ -25,11 +26,7 @@ typedef struct _gst_encoder {
 	ENCODER_T super;
 
 	//nal
-	bool in_nal;
-	uint32_t nal_len;
 	uint8_t nal_type;
-	uint8_t *nal_buff;
-	uint32_t nal_pos;
 
 	pthread_mutex_t frame_data_queue_mutex;
 	void *frame_data_queue[16];
@@ -62,123 +59,38 @@ static void *get_frame_data(gst_encoder *_this) {
 	return frame_data;
 }
 
-#define ANNEXB
+//start code to nal length as host expects
+static void nal_callback(unsigned char *data, unsigned int data_len, void *user_data) {
+	gst_encoder *_this = (gst_encoder*) user_data;
+	if (data_len <= 4) { // avoid garbage data
+		return;
+	}
+	data[0] = ((data_len - 4) >> 24) & 0xff;
+	data[1] = ((data_len - 4) >> 16) & 0xff;
+	data[2] = ((data_len - 4) >> 8) & 0xff;
+	data[3] = ((data_len - 4) >> 0) & 0xff;
+	_this->nal_type = (data[4] & 0x7e) >> 1;
+
+	//printf("type=%d : len=%d\n", _this->nal_type, data_len);
+
+	void *frame_data = get_frame_data(_this);
+	_this->callback(data, data_len, frame_data, _this->user_data);
+}
+
 static void *pout_thread_func(void* arg) {
-	unsigned int data_len = 0;
+	const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
+	int data_len = 0;
 	unsigned int buff_size = 64 * 1024;
 	unsigned char *data = malloc(buff_size);
 	gst_encoder *_this = (gst_encoder*) arg;
 
-#ifdef ANNEXB
-	unsigned int nal_buff_size = 64 * 1024;
-	int nal_header_count = 0;
-	int data_cur = 0;
-	_this->nal_buff = malloc(nal_buff_size);
-	_this->nal_len = 0;
-#endif
-
+	STREAM_FRAMER_T framer;
+	stream_framer_init(&framer, SC, sizeof(SC), NULL, nal_callback, _this);
 	while ((data_len = read(_this->pout_fd, data, buff_size)) > 0) {
-		//printf("%d ", data_len);
-#ifdef ANNEXB
-		data_cur = 0;
-		for (int i = 0; i < data_len; i++) {
-			if (nal_header_count < 3 && data[i] == 0) {
-				nal_header_count++;
-			} else if (nal_header_count == 3 && data[i] == 1) {
-				if (_this->nal_len != 0) {
-					int len = (i + 1) - 4 - data_cur;
-					if (len > 0) { // avoid garbage data
-						if (_this->nal_len + len > nal_buff_size) { // resize buffer
-							char *new_buff;
-							nal_buff_size += len;
-							new_buff = malloc(nal_buff_size);
-							memcpy(new_buff, _this->nal_buff, _this->nal_len);
-							free(_this->nal_buff);
-							_this->nal_buff = new_buff;
-						}
-						memcpy(_this->nal_buff + _this->nal_len, data + data_cur, len);
-					}
-					_this->nal_len += len;
-					//new nal
-					_this->nal_len += i - 4;
-					_this->nal_buff[0] = ((_this->nal_len - 4) >> 24) & 0xff;
-					_this->nal_buff[1] = ((_this->nal_len - 4) >> 16) & 0xff;
-					_this->nal_buff[2] = ((_this->nal_len - 4) >> 8) & 0xff;
-					_this->nal_buff[3] = ((_this->nal_len - 4) >> 0) & 0xff;
-					_this->nal_type = (_this->nal_buff[4] & 0x7e) >> 1;
-
-					//printf("type=%d : len=%d\n", _this->nal_type, _this->nal_len);
-
-					void *frame_data = get_frame_data(_this);
-					_this->callback(_this->nal_buff, _this->nal_len, frame_data, _this->user_data);
-				}
-				_this->nal_len = 4;
-				data_cur = i + 1;
-				nal_header_count = 0;
-			} else {
-				nal_header_count = 0;
-			}
-		}
-		if (_this->nal_len != 0) { // avoid garbage data
-			int len = data_len - data_cur;
-			if (len > 0) {
-				if (_this->nal_len + len > nal_buff_size) { // resize buffer
-					char *new_buff;
-					nal_buff_size += len;
-					new_buff = malloc(nal_buff_size);
-					memcpy(new_buff, _this->nal_buff, _this->nal_len);
-					free(_this->nal_buff);
-					_this->nal_buff = new_buff;
-				}
-				memcpy(_this->nal_buff + _this->nal_len, data + data_cur, len);
-			}
-			_this->nal_len += len;
-		}
-#else
-		for (int i = 0; i < data_len;) {
-			if (!_this->in_nal) {
-				_this->in_nal = true;
-				_this->nal_len = data[i] << 24 | data[i + 1] << 16 | data[i + 2] << 8 | data[i + 3];
-				_this->nal_len += 4; //start code
-				_this->nal_type = (data[i + 4] & 0x7e) >> 1;
-				if (_this->nal_len > 1024 * 1024) {
-					printf("something wrong in h264 stream at %d\n", i);
-					_this->in_nal = false;
-
-					break;
-				}
-				if (i + _this->nal_len <= data_len) {
-					void *frame_data = get_frame_data(_this);
-					_this->callback(data + i, _this->nal_len, frame_data, _this->user_data);
-					i += _this->nal_len;
-					_this->in_nal = false;
-				} else {
-					_this->nal_pos = 0;
-					_this->nal_buff = (uint8_t*) malloc(_this->nal_len);
-				}
-			} else {
-				int rest = _this->nal_len - _this->nal_pos;
-				if (i + rest <= data_len) {
-					memcpy(_this->nal_buff + _this->nal_pos, data + i, rest);
-
-					void *frame_data = get_frame_data(_this);
-					_this->callback(_this->nal_buff, _this->nal_len, frame_data, _this->user_data);
-
-					free(_this->nal_buff);
-					_this->nal_buff = NULL;
-
-					i += rest;
-					_this->in_nal = false;
-				} else {
-					int len = data_len - i;
-					memcpy(_this->nal_buff + _this->nal_pos, data + i, len);
-					_this->nal_pos += len;
-					i += len;
-				}
-			}
-		}
-#endif
+		stream_framer_push(&framer, data, data_len);
 	}
+	stream_framer_deinit(&framer);
+	free(data);
 	return NULL;
 }
 
@@ -0,0 +1,897 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#ifdef USE_GLES
+#include "GLES2/gl2.h"
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+#else
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+
+#include "gl_program.h"
+#include "frame_meta.h"
+#include "glsl/yuv_fsh.h"
+#include "glsl/yuv_vsh.h"
+
+#include "libav_decoder.h"
+
+#define PLUGIN_NAME "libav_decoder"
+#define DECODER_NAME "libav_decoder"
+
+#define MAX_BUFFER_NUM 4
+#define PLANE_NUM 3
+#define AU_QUEUE_SIZE 8
+#define FRAME_META_MAP_SIZE 64
+#define KEYFRAME_WAIT_MAX 60 //frames, streams with intra refresh have no idr to wait for
+#define FPS_LOG_INTERVAL 10 //sec
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+//applied on next codec open
+static int lg_threads = 0; //0 : auto
+static bool lg_frame_threads = false; //more throughput, but threads - 1 frames of latency
+//applied on next frame
+static bool lg_view_quat = true; //view_quat of the frame is used as camera attitude
+
+//taken from the header pack sei of stream_callback
+typedef struct _frame_meta {
+	int frame_id;
+	bool view_info;
+	VECTOR4D_T view_quat;
+	float fov;
+	char client_key[64];
+	int server_key;
+	struct timeval received; //access unit completed
+} frame_meta;
+
+//annex-b access unit, sei of picam360 is not included
+typedef struct _access_unit {
+	unsigned char *data;
+	int len;
+	int size;
+	enum AVCodecID codec_id;
+	bool keyframe;
+	int vcl_num;
+	frame_meta meta;
+} access_unit;
+
+//8bit planes as given by libavcodec or swscale
+typedef struct _yuv_image {
+	int width;
+	int height;
+	const uint8_t *planes[PLANE_NUM];
+	int stride[PLANE_NUM];
+	int plane_width[PLANE_NUM];
+	int plane_height[PLANE_NUM];
+	bool full_range;
+	bool bt709;
+} yuv_image;
+
+typedef struct _libav_decoder {
+	DECODER_T super;
+
+	int cam_num;
+#ifdef USE_GLES
+	EGLDisplay display;
+	EGLContext shared_context;
+	EGLContext context;
+	EGLSurface surface;
+#else
+	GLFWwindow *glfw_window;
+#endif
+	GLuint *cam_texture;
+	int n_buffers;
+	int texture_cur;
+	int texture_width[MAX_BUFFER_NUM]; //as allocated by this decoder
+	int texture_height[MAX_BUFFER_NUM];
+
+	//reassembly in decode(), rtp thread only
+	unsigned char *nal_data; //length prefixed as sent
+	int nal_len;
+	int nal_size;
+	frame_meta nal_meta;
+	bool nal_receiving;
+	enum AVCodecID codec_id;
+	access_unit au;
+	int boundary_num; //access units ended by the next one
+	bool multi_slice; //until seen, an access unit is completed at its slice
+
+	//complete access units, decoded in decode_thread
+	access_unit queue[AU_QUEUE_SIZE];
+	int queue_head;
+	int queue_num;
+	bool wait_keyframe;
+	int wait_num;
+	access_unit working;
+	pthread_mutex_t queue_mutex;
+	pthread_cond_t queue_cond;
+	bool run;
+	pthread_t decode_thread;
+
+	AVCodecContext *codec_ctx;
+	AVPacket *pkt;
+	AVFrame *frame;
+	AVFrame *conv_frame;
+	struct SwsContext *sws_ctx;
+	int64_t next_pts;
+	frame_meta meta_map[FRAME_META_MAP_SIZE]; //by pts
+	yuv_image image;
+	frame_meta last_meta;
+
+	void *program;
+	GLuint vbo;
+	GLuint vao;
+	GLuint fbo;
+	GLuint plane_texture[PLANE_NUM];
+	int plane_texture_width[PLANE_NUM];
+	int plane_texture_height[PLANE_NUM];
+
+	int dropped; //access units never decoded
+	int skipped; //decoded, but a newer one was waiting
+	float fps;
+	int fps_frame_num;
+	int fps_window_num;
+	struct timeval fps_time;
+	double latency_ms;
+	double latency_max_ms;
+} libav_decoder;
+
+static void ensure_buffer(unsigned char **buff, int *size, int required) {
+	if (*size < required) {
+		*buff = realloc(*buff, required);
+		*size = required;
+	}
+}
+
+static double get_elapsed_ms(struct timeval *s, struct timeval *f) {
+	return (f->tv_sec - s->tv_sec) * 1000.0 + (f->tv_usec - s->tv_usec) / 1000.0;
+}
+
+//'NA' ... 'LU' for h264, 'HE' ... 'VC' for h265, see stream_callback
+static enum AVCodecID get_codec_id(const unsigned char *data) {
+	if (data[0] == 0x4E && data[1] == 0x41) {
+		return AV_CODEC_ID_H264;
+	} else if (data[0] == 0x48 && data[1] == 0x45) {
+		return AV_CODEC_ID_HEVC;
+	}
+	return AV_CODEC_ID_NONE;
+}
+
+static bool is_eoi(enum AVCodecID codec_id, const unsigned char *data, int data_len) {
+	if (data_len != 2) {
+		return false;
+	}
+	if (codec_id == AV_CODEC_ID_H264) {
+		return data[0] == 0x4C && data[1] == 0x55;
+	} else {
+		return data[0] == 0x56 && data[1] == 0x43;
+	}
+}
+
+//marker, 4 bytes length, then sei nal of frame_meta or legacy xml; a slice may start with the marker bytes too
+static bool read_header_pack(const unsigned char *data, int data_len, frame_meta *meta) {
+	const char tag[] = "<picam360:frame";
+	enum AVCodecID codec_id;
+	if (data_len < 7 || (codec_id = get_codec_id(data)) == AV_CODEC_ID_NONE) {
+		return false;
+	}
+	int len = (data[2] << 24) | (data[3] << 16) | (data[4] << 8) | data[5];
+	if (6 + len != data_len) {
+		return false;
+	}
+	FRAME_META_T src;
+	if (data_len >= 7 + (int) sizeof(tag) - 1 && memcmp(data + 7, tag, sizeof(tag) - 1) == 0) {
+		char xml[512];
+		int xml_len = MIN(data_len - 7, (int) sizeof(xml) - 1);
+		memcpy(xml, data + 7, xml_len);
+		xml[xml_len] = '\0';
+		frame_meta_parse_xml(xml, &src);
+	} else if (!frame_meta_read_sei(data + 6, len, codec_id == AV_CODEC_ID_HEVC, &src)) {
+		return false;
+	}
+	memset(meta, 0, sizeof(frame_meta));
+	meta->frame_id = (src.fields & FRAME_META_FRAME_ID) ? src.frame_id : -1;
+	meta->view_info = (src.fields & FRAME_META_VIEW_QUAT) != 0;
+	meta->view_quat = src.view_quat;
+	meta->fov = src.fov;
+	strncpy(meta->client_key, src.client_key, sizeof(meta->client_key) - 1);
+	meta->server_key = src.server_key;
+	return true;
+}
+
+static void reset_au(access_unit *au) {
+	au->len = 0;
+	au->keyframe = false;
+	au->vcl_num = 0;
+}
+
+static void swap_au(access_unit *a, access_unit *b) {
+	access_unit tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void complete_au(libav_decoder *_this) {
+	access_unit *au = &_this->au;
+	if (au->vcl_num == 0) {
+		reset_au(au);
+		return;
+	}
+	au->codec_id = _this->codec_id;
+	gettimeofday(&au->meta.received, NULL);
+
+	pthread_mutex_lock(&_this->queue_mutex);
+	if (_this->wait_keyframe) {
+		if (!au->keyframe && _this->wait_num++ < KEYFRAME_WAIT_MAX) {
+			_this->dropped++;
+			pthread_mutex_unlock(&_this->queue_mutex);
+			reset_au(au);
+			return;
+		}
+		_this->wait_keyframe = false;
+	}
+	if (au->keyframe && _this->queue_num > 1) { //behind, nothing queued is referenced from here
+		_this->dropped += _this->queue_num;
+		_this->queue_num = 0;
+	} else if (_this->queue_num == AU_QUEUE_SIZE) { //references are lost, restart at next keyframe
+		_this->dropped += _this->queue_num + 1;
+		_this->queue_num = 0;
+		_this->wait_keyframe = true;
+		_this->wait_num = 0;
+		pthread_mutex_unlock(&_this->queue_mutex);
+		reset_au(au);
+		return;
+	}
+	swap_au(au, &_this->queue[(_this->queue_head + _this->queue_num) % AU_QUEUE_SIZE]);
+	_this->queue_num++;
+	pthread_cond_signal(&_this->queue_cond);
+	pthread_mutex_unlock(&_this->queue_mutex);
+	reset_au(au);
+}
+
+#ifdef USE_GLES
+static bool make_context_current(libav_decoder *_this) {
+	EGLint config_attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE };
+	EGLint context_attributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+	EGLint surface_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+	EGLConfig config;
+	EGLint num_config = 0;
+	if (!eglChooseConfig(_this->display, config_attributes, &config, 1, &num_config) || num_config == 0) {
+		return false;
+	}
+	_this->context = eglCreateContext(_this->display, config, _this->shared_context, context_attributes);
+	_this->surface = eglCreatePbufferSurface(_this->display, config, surface_attributes);
+	if (_this->context == EGL_NO_CONTEXT || _this->surface == EGL_NO_SURFACE) {
+		return false;
+	}
+	return eglMakeCurrent(_this->display, _this->surface, _this->surface, _this->context);
+}
+#else
+static bool make_context_current(libav_decoder *_this) {
+	glfwMakeContextCurrent(_this->glfw_window);
+	return true;
+}
+#endif
+
+static void init_gl(libav_decoder *_this) {
+#ifdef USE_GLES
+	char *common = "#version 100\n";
+#else
+	char *common = "#version 330\n";
+#endif
+	float points[] = { 0, 0, 0, 1, 1, 0, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1 };
+
+	glGenBuffers(1, &_this->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, _this->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
+#ifndef USE_GLES
+	glGenVertexArrays(1, &_this->vao);
+	glBindVertexArray(_this->vao);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenFramebuffers(1, &_this->fbo);
+	glGenTextures(PLANE_NUM, _this->plane_texture);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_this->program = GLProgram_new_from_memory(common, (const char*) yuv_vsh, yuv_vsh_len, (const char*) yuv_fsh, yuv_fsh_len);
+}
+
+static void deinit_gl(libav_decoder *_this) {
+	GLProgram_delete(_this->program);
+	glDeleteTextures(PLANE_NUM, _this->plane_texture);
+	glDeleteFramebuffers(1, &_this->fbo);
+#ifndef USE_GLES
+	glDeleteVertexArrays(1, &_this->vao);
+#endif
+	glDeleteBuffers(1, &_this->vbo);
+}
+
+//whole line including padding is uploaded, shader scales into valid area
+static void upload_plane(libav_decoder *_this, int c) {
+	yuv_image *image = &_this->image;
+#ifdef USE_GLES
+	GLint internal_format = GL_LUMINANCE;
+	GLenum format = GL_LUMINANCE;
+#else
+	GLint internal_format = GL_R8;
+	GLenum format = GL_RED;
+#endif
+	glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+	if (_this->plane_texture_width[c] != image->stride[c] || _this->plane_texture_height[c] != image->plane_height[c]) {
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image->stride[c], image->plane_height[c], 0, format, GL_UNSIGNED_BYTE, image->planes[c]);
+		_this->plane_texture_width[c] = image->stride[c];
+		_this->plane_texture_height[c] = image->plane_height[c];
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->stride[c], image->plane_height[c], format, GL_UNSIGNED_BYTE, image->planes[c]);
+	}
+}
+
+static void convert_planes(libav_decoder *_this, GLuint texture) {
+	yuv_image *image = &_this->image;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		upload_plane(_this, c);
+	}
+
+	int program = GLProgram_GetId(_this->program);
+	glBindFramebuffer(GL_FRAMEBUFFER, _this->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, _this->vbo);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		glActiveTexture(GL_TEXTURE0 + c);
+		glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+	}
+	glUniform1i(glGetUniformLocation(program, "y_tex"), 0);
+	glUniform1i(glGetUniformLocation(program, "u_tex"), 1);
+	glUniform1i(glGetUniformLocation(program, "v_tex"), 2);
+	glUniform2f(glGetUniformLocation(program, "y_scale"), (float) image->plane_width[0] / image->stride[0], 1.0);
+	glUniform2f(glGetUniformLocation(program, "uv_scale"), (float) image->plane_width[1] / image->stride[1], 1.0);
+	if (image->full_range) {
+		glUniform3f(glGetUniformLocation(program, "range"), 0.0, 1.0, 1.0);
+	} else {
+		glUniform3f(glGetUniformLocation(program, "range"), 16.0 / 255, 255.0 / 219, 255.0 / 224);
+	}
+	if (image->bt709) {
+		glUniform4f(glGetUniformLocation(program, "coef"), 1.5748, 0.187324, 0.468124, 1.8556);
+	} else {
+		glUniform4f(glGetUniformLocation(program, "coef"), 1.402, 0.344136, 0.714136, 1.772);
+	}
+#ifdef USE_GLES
+	GLuint loc = glGetAttribLocation(program, "vPosition");
+	glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(loc);
+#else
+	glBindVertexArray(_this->vao);
+#endif
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glViewport(0, 0, image->width, image->height);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+#ifdef USE_GLES
+	glDisableVertexAttribArray(loc);
+#else
+	glBindVertexArray(0);
+#endif
+	for (int c = PLANE_NUM - 1; c >= 0; c--) {
+		glActiveTexture(GL_TEXTURE0 + c);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//renderers sample normalized coordinates, so texture follows decoded size
+static void update_texture(libav_decoder *_this, int cur) {
+	yuv_image *image = &_this->image;
+	GLuint texture = _this->cam_texture[cur];
+	GLint width = _this->texture_width[cur];
+	GLint height = _this->texture_height[cur];
+	glBindTexture(GL_TEXTURE_2D, texture);
+#ifndef USE_GLES
+	//host may have reallocated it, gles2 has no size query
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+#endif
+	if (width != image->width || height != image->height) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		_this->texture_width[cur] = image->width;
+		_this->texture_height[cur] = image->height;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	convert_planes(_this, texture);
+}
+
+//yuv420p as is, anything else through swscale
+static bool get_image(libav_decoder *_this, AVFrame *frame) {
+	yuv_image *image = &_this->image;
+	AVFrame *src = frame;
+	enum AVPixelFormat format = frame->format;
+	if (format != AV_PIX_FMT_YUV420P && format != AV_PIX_FMT_YUVJ420P) {
+		if (_this->conv_frame == NULL || _this->conv_frame->width != frame->width || _this->conv_frame->height != frame->height) {
+			av_frame_free(&_this->conv_frame);
+			_this->conv_frame = av_frame_alloc();
+			_this->conv_frame->format = AV_PIX_FMT_YUV420P;
+			_this->conv_frame->width = frame->width;
+			_this->conv_frame->height = frame->height;
+			if (av_frame_get_buffer(_this->conv_frame, 32) < 0) {
+				av_frame_free(&_this->conv_frame);
+				return false;
+			}
+		}
+		_this->sws_ctx = sws_getCachedContext(_this->sws_ctx, frame->width, frame->height, format, frame->width, frame->height,
+				AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+		if (_this->sws_ctx == NULL) {
+			return false;
+		}
+		sws_scale(_this->sws_ctx, (const uint8_t * const *) frame->data, frame->linesize, 0, frame->height, _this->conv_frame->data,
+				_this->conv_frame->linesize);
+		src = _this->conv_frame;
+	}
+	image->width = frame->width;
+	image->height = frame->height;
+	for (int c = 0; c < PLANE_NUM; c++) {
+		image->planes[c] = src->data[c];
+		image->stride[c] = src->linesize[c];
+		image->plane_width[c] = (c == 0) ? frame->width : (frame->width + 1) / 2;
+		image->plane_height[c] = (c == 0) ? frame->height : (frame->height + 1) / 2;
+	}
+	image->full_range = (format == AV_PIX_FMT_YUVJ420P || frame->color_range == AVCOL_RANGE_JPEG);
+	image->bt709 = (frame->colorspace == AVCOL_SPC_BT709);
+	return true;
+}
+
+static void close_codec(libav_decoder *_this) {
+	if (_this->codec_ctx) {
+		avcodec_free_context(&_this->codec_ctx);
+	}
+}
+
+static bool open_codec(libav_decoder *_this, enum AVCodecID codec_id) {
+	if (_this->codec_ctx && _this->codec_ctx->codec_id == codec_id) {
+		return true;
+	}
+	close_codec(_this);
+	const AVCodec *codec = avcodec_find_decoder(codec_id);
+	if (codec == NULL) {
+		printf("%s : no decoder for %s\n", PLUGIN_NAME, avcodec_get_name(codec_id));
+		return false;
+	}
+	AVCodecContext *ctx = avcodec_alloc_context3(codec);
+	ctx->thread_count = lg_threads;
+	ctx->thread_type = FF_THREAD_SLICE;
+	if (lg_frame_threads) {
+		ctx->thread_type |= FF_THREAD_FRAME;
+	} else {
+		ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+	}
+	ctx->flags2 |= AV_CODEC_FLAG2_FAST;
+	int ret = avcodec_open2(ctx, codec, NULL);
+	if (ret < 0) {
+		printf("%s : avcodec_open2 %s failed %d\n", PLUGIN_NAME, codec->name, ret);
+		avcodec_free_context(&ctx);
+		return false;
+	}
+	printf("%s : cam%d %s threads=%d%s\n", PLUGIN_NAME, _this->cam_num, codec->name, ctx->thread_count,
+			(ctx->active_thread_type & FF_THREAD_FRAME) ? " frame" : "");
+	_this->codec_ctx = ctx;
+	return true;
+}
+
+static void update_fps(libav_decoder *_this, double latency_ms) {
+	struct timeval now, diff;
+	gettimeofday(&now, NULL);
+	_this->fps_frame_num++;
+	_this->latency_ms += latency_ms;
+	_this->latency_max_ms = MAX(_this->latency_max_ms, latency_ms);
+	timersub(&now, &_this->fps_time, &diff);
+	float elapsed_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+	if (elapsed_sec >= 1.0) {
+		_this->fps = _this->fps_frame_num / elapsed_sec;
+		if (++_this->fps_window_num % FPS_LOG_INTERVAL == 0) {
+			printf("%s : cam%d %dx%d %.1f fps latency %.3f ms max %.3f ms dropped=%d skipped=%d\n", PLUGIN_NAME, _this->cam_num,
+					_this->image.width, _this->image.height, _this->fps, _this->latency_ms / _this->fps_frame_num, _this->latency_max_ms,
+					_this->dropped, _this->skipped);
+		}
+		_this->fps_frame_num = 0;
+		_this->latency_ms = 0;
+		_this->latency_max_ms = 0;
+		_this->fps_time = now;
+	}
+}
+
+static void output_frame(libav_decoder *_this, AVFrame *frame) {
+	frame_meta *meta = &_this->meta_map[frame->pts % FRAME_META_MAP_SIZE];
+	if (!get_image(_this, frame)) {
+		_this->skipped++;
+		return;
+	}
+	int cur = (_this->texture_cur + 1) % _this->n_buffers;
+	update_texture(_this, cur);
+	glFinish();
+	_this->texture_cur = cur;
+	_this->last_meta = *meta;
+
+	lg_plugin_host->lock_texture();
+	lg_plugin_host->set_cam_texture_cur(_this->cam_num, cur);
+	if (lg_view_quat && meta->view_info) {
+		lg_plugin_host->set_camera_quaternion(_this->cam_num, meta->view_quat);
+	}
+	lg_plugin_host->unlock_texture();
+	lg_plugin_host->send_event(PICAM360_HOST_NODE_ID, PICAM360_CAPTURE_EVENT_TEXTURE0_UPDATED + _this->cam_num);
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	update_fps(_this, get_elapsed_ms(&meta->received, &now));
+}
+
+static void *decode_thread_func(void *arg) {
+	libav_decoder *_this = (libav_decoder*) arg;
+
+	if (!make_context_current(_this)) {
+		printf("%s : no gl context for cam%d\n", PLUGIN_NAME, _this->cam_num);
+		return NULL;
+	}
+	init_gl(_this);
+	gettimeofday(&_this->fps_time, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&_this->queue_mutex);
+		while (_this->run && _this->queue_num == 0) {
+			pthread_cond_wait(&_this->queue_cond, &_this->queue_mutex);
+		}
+		if (!_this->run) {
+			pthread_mutex_unlock(&_this->queue_mutex);
+			break;
+		}
+		access_unit *au = &_this->working;
+		swap_au(au, &_this->queue[_this->queue_head]);
+		_this->queue_head = (_this->queue_head + 1) % AU_QUEUE_SIZE;
+		_this->queue_num--;
+		pthread_mutex_unlock(&_this->queue_mutex);
+
+		if (!open_codec(_this, au->codec_id)) {
+			continue;
+		}
+		int64_t pts = _this->next_pts++;
+		_this->meta_map[pts % FRAME_META_MAP_SIZE] = au->meta;
+		memset(au->data + au->len, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+		_this->pkt->data = au->data;
+		_this->pkt->size = au->len;
+		_this->pkt->pts = pts;
+		int ret = avcodec_send_packet(_this->codec_ctx, _this->pkt);
+		if (ret < 0) {
+			printf("%s : avcodec_send_packet failed %d\n", PLUGIN_NAME, ret);
+			_this->dropped++;
+			continue;
+		}
+		while (avcodec_receive_frame(_this->codec_ctx, _this->frame) == 0) {
+			if (_this->queue_num > 0) { //a newer one is waiting, gpu work is saved
+				_this->skipped++;
+			} else {
+				output_frame(_this, _this->frame);
+			}
+			av_frame_unref(_this->frame);
+		}
+	}
+
+	deinit_gl(_this);
+	return NULL;
+}
+
+static void init(void *obj, int cam_num, void *display, void *context, void *cam_texture, int n_buffers) {
+	libav_decoder *_this = (libav_decoder*) obj;
+
+	_this->cam_num = cam_num;
+#ifdef USE_GLES
+	_this->display = (EGLDisplay) display;
+	_this->shared_context = (EGLContext) context;
+#else
+	_this->glfw_window = (GLFWwindow*) display;
+#endif
+	_this->cam_texture = (GLuint*) cam_texture;
+	_this->n_buffers = MAX(MIN(n_buffers, MAX_BUFFER_NUM), 1);
+	_this->wait_keyframe = true; //nothing decodes before parameter sets
+	_this->pkt = av_packet_alloc();
+	_this->frame = av_frame_alloc();
+
+	pthread_mutex_init(&_this->queue_mutex, 0);
+	pthread_cond_init(&_this->queue_cond, 0);
+	_this->run = true;
+	pthread_create(&_this->decode_thread, NULL, decode_thread_func, (void*) _this);
+}
+
+static void release(void *obj) {
+	libav_decoder *_this = (libav_decoder*) obj;
+
+	if (_this->run) {
+		pthread_mutex_lock(&_this->queue_mutex);
+		_this->run = false;
+		pthread_cond_broadcast(&_this->queue_cond);
+		pthread_mutex_unlock(&_this->queue_mutex);
+		pthread_join(_this->decode_thread, NULL);
+
+		pthread_cond_destroy(&_this->queue_cond);
+		pthread_mutex_destroy(&_this->queue_mutex);
+#ifdef USE_GLES
+		if (_this->context != EGL_NO_CONTEXT) {
+			eglDestroySurface(_this->display, _this->surface);
+			eglDestroyContext(_this->display, _this->context);
+		}
+#endif
+	}
+	close_codec(_this);
+	av_packet_free(&_this->pkt);
+	av_frame_free(&_this->frame);
+	av_frame_free(&_this->conv_frame);
+	sws_freeContext(_this->sws_ctx);
+	for (int i = 0; i < AU_QUEUE_SIZE; i++) {
+		free(_this->queue[i].data);
+	}
+	free(_this->nal_data);
+	free(_this->au.data);
+	free(_this->working.data);
+	free(obj);
+}
+
+static bool is_vcl(enum AVCodecID codec_id, const unsigned char *nal) {
+	if (codec_id == AV_CODEC_ID_HEVC) {
+		return ((nal[0] & 0x7e) >> 1) < 32;
+	} else {
+		int nal_type = nal[0] & 0x1f;
+		return nal_type >= 1 && nal_type <= 5;
+	}
+}
+
+static bool is_keyframe(enum AVCodecID codec_id, const unsigned char *nal) {
+	if (codec_id == AV_CODEC_ID_HEVC) {
+		int nal_type = (nal[0] & 0x7e) >> 1;
+		return nal_type >= 16 && nal_type <= 21; //irap
+	} else {
+		return (nal[0] & 0x1f) == 5; //idr
+	}
+}
+
+//first_mb_in_slice == 0 or first_slice_segment_in_pic_flag, first bit after nal header
+static bool is_first_slice(enum AVCodecID codec_id, const unsigned char *nal, int nal_len) {
+	int header_len = (codec_id == AV_CODEC_ID_HEVC) ? 2 : 1;
+	return nal_len > header_len && (nal[header_len] & 0x80);
+}
+
+//nal types that may only appear before the first slice of an access unit
+static bool is_au_prefix(enum AVCodecID codec_id, const unsigned char *nal) {
+	if (codec_id == AV_CODEC_ID_HEVC) {
+		int nal_type = (nal[0] & 0x7e) >> 1;
+		return (nal_type >= 32 && nal_type <= 35) || nal_type == 39 || (nal_type >= 41 && nal_type <= 44) || (nal_type >= 48 && nal_type <= 55);
+	} else {
+		int nal_type = nal[0] & 0x1f;
+		return (nal_type >= 6 && nal_type <= 9) || (nal_type >= 14 && nal_type <= 18);
+	}
+}
+
+static void append_nal(libav_decoder *_this, const unsigned char *nal, int nal_len) {
+	access_unit *au = &_this->au;
+	bool vcl = is_vcl(_this->codec_id, nal);
+	bool first_slice = vcl && is_first_slice(_this->codec_id, nal, nal_len);
+	if (au->vcl_num > 0 && (first_slice || is_au_prefix(_this->codec_id, nal))) {
+		_this->multi_slice |= (au->vcl_num > 1);
+		_this->boundary_num++;
+		complete_au(_this);
+	} else if (vcl && !first_slice && au->vcl_num == 0 && au->len == 0) { //completed too early
+		_this->multi_slice = true;
+	}
+	if (au->len == 0 || (first_slice && _this->nal_meta.view_info)) { //first slice carries full info
+		au->meta = _this->nal_meta;
+	}
+	if (au->len + 4 + nal_len + AV_INPUT_BUFFER_PADDING_SIZE > au->size) {
+		ensure_buffer(&au->data, &au->size, MAX(au->len + 4 + nal_len + AV_INPUT_BUFFER_PADDING_SIZE, au->size * 2));
+	}
+	const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
+	memcpy(au->data + au->len, SC, sizeof(SC));
+	memcpy(au->data + au->len + sizeof(SC), nal, nal_len);
+	au->len += sizeof(SC) + nal_len;
+	if (vcl) {
+		au->vcl_num++;
+		au->keyframe |= is_keyframe(_this->codec_id, nal);
+		if (!_this->multi_slice && _this->boundary_num > 0) { //no need to wait for the next access unit
+			complete_au(_this);
+		}
+	}
+}
+
+//length prefixed nals as sent, one or more
+static void end_nal_group(libav_decoder *_this) {
+	const unsigned char *data = _this->nal_data;
+	for (int i = 0; i + 4 < _this->nal_len;) {
+		int len = (data[i] << 24) | (data[i + 1] << 16) | (data[i + 2] << 8) | data[i + 3];
+		if (len <= 0 || len > _this->nal_len - i - 4) {
+			printf("%s : cam%d broken nal\n", PLUGIN_NAME, _this->cam_num);
+			return;
+		}
+		append_nal(_this, data + i + 4, len);
+		i += 4 + len;
+	}
+}
+
+//called with rtp payloads, stream_callback sends each nal as header pack with sei, the nal in pieces, then end marker
+static void decode(void *obj, unsigned char *data, int data_len) {
+	libav_decoder *_this = (libav_decoder*) obj;
+	if (data_len < 2) {
+		return;
+	}
+	frame_meta meta;
+	if (read_header_pack(data, data_len, &meta)) {
+		enum AVCodecID codec_id = get_codec_id(data);
+		if (codec_id != _this->codec_id) {
+			complete_au(_this);
+			_this->codec_id = codec_id;
+			_this->boundary_num = 0;
+			_this->multi_slice = false;
+		}
+		_this->nal_meta = meta;
+		_this->nal_len = 0; //previous end marker may be lost
+		_this->nal_receiving = true;
+		return;
+	}
+	if (!_this->nal_receiving) {
+		return;
+	}
+	if (is_eoi(_this->codec_id, data, data_len)) {
+		_this->nal_receiving = false;
+		end_nal_group(_this);
+		return;
+	}
+	if (_this->nal_len + data_len > _this->nal_size) {
+		ensure_buffer(&_this->nal_data, &_this->nal_size, MAX(_this->nal_len + data_len, _this->nal_size * 2));
+	}
+	memcpy(_this->nal_data + _this->nal_len, data, data_len);
+	_this->nal_len += data_len;
+}
+
+static float get_fps(void *obj) {
+	libav_decoder *_this = (libav_decoder*) obj;
+	return _this->fps;
+}
+
+static int get_frameskip(void *obj) {
+	libav_decoder *_this = (libav_decoder*) obj;
+	return _this->dropped + _this->skipped;
+}
+
+static void switch_buffer(void *obj) {
+}
+
+static void create_decoder(void *user_data, DECODER_T **out_decoder) {
+	DECODER_T *decoder = (DECODER_T*) malloc(sizeof(libav_decoder));
+	memset(decoder, 0, sizeof(libav_decoder));
+	strcpy(decoder->name, DECODER_NAME);
+	decoder->release = release;
+	decoder->init = init;
+	decoder->get_fps = get_fps;
+	decoder->get_frameskip = get_frameskip;
+	decoder->decode = decode;
+	decoder->switch_buffer = switch_buffer;
+	decoder->user_data = decoder;
+
+	if (out_decoder) {
+		*out_decoder = decoder;
+	}
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	char buff[256];
+	strncpy(buff, _buff, sizeof(buff));
+	char *cmd = strtok(buff, " \n");
+	if (cmd == NULL) {
+		//do nothing
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_threads", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			if (value >= 0) {
+				lg_threads = value;
+				printf("%s : completed\n", cmd);
+			}
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_frame_threads", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			lg_frame_threads = (value != 0);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_view_quat", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			lg_view_quat = (value != 0);
+			printf("%s : completed\n", cmd);
+		}
+	}
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+	lg_threads = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".threads"));
+	lg_frame_threads = (json_number_value(json_object_get(options, PLUGIN_NAME ".frame_threads")) != 0);
+	json_t *value = json_object_get(options, PLUGIN_NAME ".view_quat");
+	if (value) {
+		lg_view_quat = (json_number_value(value) != 0);
+	}
+}
+
+static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".threads", json_real(lg_threads));
+	json_object_set_new(options, PLUGIN_NAME ".frame_threads", json_real(lg_frame_threads));
+	json_object_set_new(options, PLUGIN_NAME ".view_quat", json_real(lg_view_quat));
+}
+
+static void release_plugin(void *user_data) {
+	free(user_data);
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release_plugin;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	{
+		DECODER_FACTORY_T *decoder_factory = (DECODER_FACTORY_T*) malloc(sizeof(DECODER_FACTORY_T));
+		memset(decoder_factory, 0, sizeof(DECODER_FACTORY_T));
+		strcpy(decoder_factory->name, DECODER_NAME);
+		decoder_factory->release = release_plugin;
+		decoder_factory->create_decoder = create_decoder;
+		decoder_factory->user_data = decoder_factory;
+
+		lg_plugin_host->add_decoder_factory(decoder_factory);
+	}
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "picam360_capture_plugin.h"
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **plugin);
@@ -0,0 +1,487 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+#include <libswscale/swscale.h>
+
+#include "libav_encoder.h"
+
+#define PLUGIN_NAME "libav_encoder"
+#define H265_ENCODER_NAME "libav_h265"
+#define H264_ENCODER_NAME "libav_h264"
+#define MJPEG_ENCODER_NAME "libav_mjpeg"
+
+#define FRAME_QUEUE_SIZE 4
+#define FRAME_DATA_MAP_SIZE 64
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+//applied on next init
+static char lg_preset[64] = "ultrafast";
+static char lg_tune[64] = "zerolatency";
+static int lg_threads = 0; //0 : auto
+static int lg_gop = 0; //0 : fps
+static bool lg_intra_refresh = false; //refresh period is gop
+
+typedef struct _libav_encoder {
+	ENCODER_T super;
+
+	AVCodecContext *codec_ctx;
+	struct SwsContext *sws_ctx;
+	AVPacket *pkt;
+	int width;
+	int height;
+	bool annexb;
+	bool is_h265;
+
+	//converted in add_frame, encoded in encode_thread
+	AVFrame *frames[FRAME_QUEUE_SIZE];
+	void *frame_data[FRAME_QUEUE_SIZE];
+	int frame_queue_head;
+	int frame_queue_num;
+	pthread_mutex_t frame_queue_mutex;
+	pthread_cond_t frame_queue_cond;
+	int64_t next_pts;
+	int pending_kbps; //0 : no change, applied in encode_thread
+	bool keyframe_requested;
+	bool run;
+	pthread_t encode_thread;
+
+	//pts to frame_data, packets carry pts of their source frame
+	int64_t frame_data_pts[FRAME_DATA_MAP_SIZE];
+	void *frame_data_map[FRAME_DATA_MAP_SIZE];
+
+	uint8_t *nal_buff;
+	int nal_buff_size;
+
+	ENCODER_STREAM_CALLBACK callback;
+	void *user_data;
+} libav_encoder;
+
+static void *take_frame_data(libav_encoder *_this, int64_t pts) {
+	int idx = pts % FRAME_DATA_MAP_SIZE;
+	if (pts < 0 || _this->frame_data_pts[idx] != pts) {
+		return NULL;
+	}
+	void *frame_data = _this->frame_data_map[idx];
+	_this->frame_data_map[idx] = NULL;
+	_this->frame_data_pts[idx] = -1;
+	return frame_data;
+}
+
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end) {
+	for (; p + 3 <= end; p++) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1) {
+			return p;
+		}
+	}
+	return end;
+}
+
+static bool is_vcl(libav_encoder *_this, uint8_t nal_header) {
+	if (_this->is_h265) {
+		return ((nal_header & 0x7e) >> 1) < 32;
+	} else {
+		int nal_type = nal_header & 0x1f;
+		return nal_type >= 1 && nal_type <= 5;
+	}
+}
+
+//host expects one nal per callback with 4 bytes length instead of start code
+static void output_packet(libav_encoder *_this, AVPacket *pkt) {
+	void *frame_data = take_frame_data(_this, pkt->pts);
+	if (!_this->annexb) {
+		_this->callback(pkt->data, pkt->size, frame_data, _this->user_data);
+		return;
+	}
+	const uint8_t *end = pkt->data + pkt->size;
+	const uint8_t *sc = find_start_code(pkt->data, end);
+	while (sc < end) {
+		const uint8_t *nal = sc + 3;
+		const uint8_t *next = find_start_code(nal, end);
+		const uint8_t *nal_end = next;
+		while (nal_end > nal && nal_end[-1] == 0) { //zero_byte of 4 bytes start code
+			nal_end--;
+		}
+		int nal_len = nal_end - nal;
+		if (nal_len > 0) {
+			if (nal_len + 4 > _this->nal_buff_size) {
+				_this->nal_buff_size = FFMAX(nal_len + 4, _this->nal_buff_size * 2);
+				_this->nal_buff = realloc(_this->nal_buff, _this->nal_buff_size);
+			}
+			_this->nal_buff[0] = (nal_len >> 24) & 0xff;
+			_this->nal_buff[1] = (nal_len >> 16) & 0xff;
+			_this->nal_buff[2] = (nal_len >> 8) & 0xff;
+			_this->nal_buff[3] = (nal_len >> 0) & 0xff;
+			memcpy(_this->nal_buff + 4, nal, nal_len);
+
+			void *nal_frame_data = NULL;
+			if (frame_data && is_vcl(_this, nal[0])) { //first slice of the frame
+				nal_frame_data = frame_data;
+				frame_data = NULL;
+			}
+			_this->callback(_this->nal_buff, nal_len + 4, nal_frame_data, _this->user_data);
+		}
+		sc = next;
+	}
+	if (frame_data) { //no slice in packet
+		free(frame_data);
+	}
+}
+
+static void *encode_thread_func(void *arg) {
+	libav_encoder *_this = (libav_encoder*) arg;
+	while (1) {
+		pthread_mutex_lock(&_this->frame_queue_mutex);
+		while (_this->run && _this->frame_queue_num == 0) {
+			pthread_cond_wait(&_this->frame_queue_cond, &_this->frame_queue_mutex);
+		}
+		if (!_this->run) {
+			pthread_mutex_unlock(&_this->frame_queue_mutex);
+			break;
+		}
+		int idx = _this->frame_queue_head;
+		int pending_kbps = _this->pending_kbps;
+		_this->pending_kbps = 0;
+		bool keyframe_requested = _this->keyframe_requested;
+		_this->keyframe_requested = false;
+		pthread_mutex_unlock(&_this->frame_queue_mutex);
+
+		if (pending_kbps > 0) { //libx264 reconfigures on bit_rate change, others keep initial rate
+			AVCodecContext *ctx = _this->codec_ctx;
+			ctx->bit_rate = (int64_t) pending_kbps * 1000;
+			ctx->rc_max_rate = ctx->bit_rate;
+			ctx->rc_buffer_size = ctx->bit_rate / FFMAX(ctx->framerate.num, 1) * 2;
+		}
+
+		AVFrame *frame = _this->frames[idx];
+		frame->pict_type = keyframe_requested ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE; //idr with forced-idr
+		{
+			int map_idx = frame->pts % FRAME_DATA_MAP_SIZE;
+			if (_this->frame_data_map[map_idx]) { //never came out of encoder
+				free(_this->frame_data_map[map_idx]);
+			}
+			_this->frame_data_map[map_idx] = _this->frame_data[idx];
+			_this->frame_data_pts[map_idx] = frame->pts;
+			_this->frame_data[idx] = NULL;
+		}
+		int ret = avcodec_send_frame(_this->codec_ctx, frame);
+
+		pthread_mutex_lock(&_this->frame_queue_mutex);
+		_this->frame_queue_head = (_this->frame_queue_head + 1) % FRAME_QUEUE_SIZE;
+		_this->frame_queue_num--;
+		pthread_cond_broadcast(&_this->frame_queue_cond);
+		pthread_mutex_unlock(&_this->frame_queue_mutex);
+
+		if (ret < 0) {
+			printf("%s : avcodec_send_frame failed %d\n", PLUGIN_NAME, ret);
+			continue;
+		}
+		while (avcodec_receive_packet(_this->codec_ctx, _this->pkt) == 0) {
+			output_packet(_this, _this->pkt);
+			av_packet_unref(_this->pkt);
+		}
+	}
+	return NULL;
+}
+
+static const AVCodec *find_codec(libav_encoder *_this) {
+	const AVCodec *codec = NULL;
+	if (strcmp(_this->super.name, H265_ENCODER_NAME) == 0) {
+		codec = avcodec_find_encoder_by_name("libx265");
+		if (codec == NULL) {
+			codec = avcodec_find_encoder(AV_CODEC_ID_HEVC);
+		}
+	} else if (strcmp(_this->super.name, H264_ENCODER_NAME) == 0) {
+		codec = avcodec_find_encoder_by_name("libx264");
+		if (codec == NULL) {
+			codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+		}
+	} else {
+		codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+	}
+	return codec;
+}
+
+static void init(void *obj, const int width, const int height, int bitrate_kbps, int fps, ENCODER_STREAM_CALLBACK callback, void *user_data) {
+	libav_encoder *_this = (libav_encoder*) obj;
+
+	_this->callback = callback;
+	_this->user_data = user_data;
+	_this->width = width;
+	_this->height = height;
+	_this->is_h265 = (strcmp(_this->super.name, H265_ENCODER_NAME) == 0);
+	_this->annexb = (strcmp(_this->super.name, MJPEG_ENCODER_NAME) != 0);
+
+	const AVCodec *codec = find_codec(_this);
+	if (codec == NULL) {
+		printf("%s : no codec for %s\n", PLUGIN_NAME, _this->super.name);
+		return;
+	}
+	AVCodecContext *ctx = avcodec_alloc_context3(codec);
+	ctx->width = width;
+	ctx->height = height;
+	ctx->time_base = (AVRational ) { 1, fps };
+	ctx->framerate = (AVRational ) { fps, 1 };
+	ctx->pix_fmt = _this->annexb ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_YUVJ420P;
+	ctx->bit_rate = (int64_t) bitrate_kbps * 1000;
+	ctx->rc_max_rate = ctx->bit_rate;
+	ctx->rc_buffer_size = ctx->bit_rate / FFMAX(fps, 1) * 2; //two frames of vbv for low latency
+	ctx->gop_size = (lg_gop > 0) ? lg_gop : fps;
+	ctx->max_b_frames = 0;
+	ctx->thread_count = lg_threads;
+	ctx->thread_type = FF_THREAD_SLICE; //frame threads add a frame of latency each
+
+	AVDictionary *opts = NULL;
+	if (strncmp(codec->name, "libx26", 6) == 0) {
+		if (lg_preset[0] != '\0') {
+			av_dict_set(&opts, "preset", lg_preset, 0);
+		}
+		if (lg_tune[0] != '\0') {
+			av_dict_set(&opts, "tune", lg_tune, 0);
+		}
+		av_dict_set(&opts, "forced-idr", "1", 0);
+		if (lg_intra_refresh) { //column of intra blocks sweeps over gop instead of idr bursts
+			if (strcmp(codec->name, "libx264") == 0) {
+				av_dict_set(&opts, "intra-refresh", "1", 0);
+			} else {
+				av_dict_set(&opts, "x265-params", "intra-refresh=1", 0);
+			}
+		}
+	}
+	int ret = avcodec_open2(ctx, codec, &opts);
+	av_dict_free(&opts);
+	if (ret < 0) {
+		printf("%s : avcodec_open2 %s failed %d\n", PLUGIN_NAME, codec->name, ret);
+		avcodec_free_context(&ctx);
+		return;
+	}
+	_this->codec_ctx = ctx;
+	_this->pkt = av_packet_alloc();
+	_this->sws_ctx = sws_getContext(width, height, AV_PIX_FMT_RGB24, width, height, ctx->pix_fmt, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+	for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+		AVFrame *frame = av_frame_alloc();
+		frame->format = ctx->pix_fmt;
+		frame->width = width;
+		frame->height = height;
+		av_frame_get_buffer(frame, 32);
+		_this->frames[i] = frame;
+	}
+	for (int i = 0; i < FRAME_DATA_MAP_SIZE; i++) {
+		_this->frame_data_pts[i] = -1;
+	}
+
+	pthread_mutex_init(&_this->frame_queue_mutex, 0);
+	pthread_cond_init(&_this->frame_queue_cond, 0);
+	_this->run = true;
+	pthread_create(&_this->encode_thread, NULL, encode_thread_func, (void*) _this);
+
+	printf("%s : %s %dx%d %dkbps %dfps preset=%s tune=%s threads=%d intra_refresh=%d\n", PLUGIN_NAME, codec->name, width, height, bitrate_kbps, fps, lg_preset,
+			lg_tune, lg_threads, lg_intra_refresh);
+}
+
+static void release(void *obj) {
+	libav_encoder *_this = (libav_encoder*) obj;
+	if (_this->codec_ctx) {
+		pthread_mutex_lock(&_this->frame_queue_mutex);
+		_this->run = false;
+		pthread_cond_broadcast(&_this->frame_queue_cond);
+		pthread_mutex_unlock(&_this->frame_queue_mutex);
+		pthread_join(_this->encode_thread, NULL);
+
+		for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+			av_frame_free(&_this->frames[i]);
+			if (_this->frame_data[i]) {
+				free(_this->frame_data[i]);
+			}
+		}
+		for (int i = 0; i < FRAME_DATA_MAP_SIZE; i++) {
+			if (_this->frame_data_map[i]) {
+				free(_this->frame_data_map[i]);
+			}
+		}
+		sws_freeContext(_this->sws_ctx);
+		av_packet_free(&_this->pkt);
+		avcodec_free_context(&_this->codec_ctx);
+		pthread_cond_destroy(&_this->frame_queue_cond);
+		pthread_mutex_destroy(&_this->frame_queue_mutex);
+	}
+	if (_this->nal_buff) {
+		free(_this->nal_buff);
+	}
+	free(obj);
+}
+
+//frame_data is malloc'd by host and handed over to the callback
+static void add_frame(void *obj, const unsigned char *in_data, void *frame_data) {
+	libav_encoder *_this = (libav_encoder*) obj;
+	if (_this->codec_ctx == NULL) {
+		if (frame_data) {
+			free(frame_data);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&_this->frame_queue_mutex);
+	while (_this->frame_queue_num == FRAME_QUEUE_SIZE) { //back pressure to renderer
+		pthread_cond_wait(&_this->frame_queue_cond, &_this->frame_queue_mutex);
+	}
+	int idx = (_this->frame_queue_head + _this->frame_queue_num) % FRAME_QUEUE_SIZE;
+	pthread_mutex_unlock(&_this->frame_queue_mutex);
+
+	//only producer touches slots outside of the queue
+	AVFrame *frame = _this->frames[idx];
+	av_frame_make_writable(frame);
+	{
+		const uint8_t * const src[1] = { in_data };
+		const int src_stride[1] = { _this->width * 3 };
+		sws_scale(_this->sws_ctx, src, src_stride, 0, _this->height, frame->data, frame->linesize);
+	}
+	frame->pts = _this->next_pts++;
+	_this->frame_data[idx] = frame_data;
+
+	pthread_mutex_lock(&_this->frame_queue_mutex);
+	_this->frame_queue_num++;
+	pthread_cond_broadcast(&_this->frame_queue_cond);
+	pthread_mutex_unlock(&_this->frame_queue_mutex);
+}
+
+static void reconfigure(void *obj, int bitrate_kbps, int fps) {
+	libav_encoder *_this = (libav_encoder*) obj;
+	if (_this->codec_ctx == NULL) {
+		return;
+	}
+	//fps is handled by host dropping frames, time base stays
+	pthread_mutex_lock(&_this->frame_queue_mutex);
+	_this->pending_kbps = bitrate_kbps;
+	pthread_mutex_unlock(&_this->frame_queue_mutex);
+}
+
+static void request_keyframe(void *obj) {
+	libav_encoder *_this = (libav_encoder*) obj;
+	if (_this->codec_ctx == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&_this->frame_queue_mutex);
+	_this->keyframe_requested = true;
+	pthread_mutex_unlock(&_this->frame_queue_mutex);
+}
+
+static void create_encoder(void *user_data, ENCODER_T **output_encoder) {
+	ENCODER_FACTORY_T *encoder_factory = (ENCODER_FACTORY_T*) user_data;
+	ENCODER_T *encoder = (ENCODER_T*) malloc(sizeof(libav_encoder));
+	memset(encoder, 0, sizeof(libav_encoder));
+	strcpy(encoder->name, encoder_factory->name);
+	encoder->release = release;
+	encoder->init = init;
+	encoder->add_frame = add_frame;
+	encoder->reconfigure = reconfigure;
+	encoder->request_keyframe = request_keyframe;
+	encoder->user_data = encoder;
+
+	if (output_encoder) {
+		*output_encoder = encoder;
+	}
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	char buff[256];
+	strncpy(buff, _buff, sizeof(buff));
+	char *cmd = strtok(buff, " \n");
+	if (cmd == NULL) {
+		//do nothing
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_preset", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			strncpy(lg_preset, param, sizeof(lg_preset) - 1);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_tune", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			strncpy(lg_tune, param, sizeof(lg_tune) - 1);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_threads", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			sscanf(param, "%d", &lg_threads);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_intra_refresh", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			lg_intra_refresh = (value != 0);
+			printf("%s : completed\n", cmd);
+		}
+	}
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+	json_t *value;
+	value = json_object_get(options, PLUGIN_NAME ".preset");
+	if (json_is_string(value)) {
+		strncpy(lg_preset, json_string_value(value), sizeof(lg_preset) - 1);
+	}
+	value = json_object_get(options, PLUGIN_NAME ".tune");
+	if (json_is_string(value)) {
+		strncpy(lg_tune, json_string_value(value), sizeof(lg_tune) - 1);
+	}
+	lg_threads = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".threads"));
+	lg_gop = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".gop"));
+	lg_intra_refresh = (json_number_value(json_object_get(options, PLUGIN_NAME ".intra_refresh")) != 0);
+}
+
+static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".preset", json_string(lg_preset));
+	json_object_set_new(options, PLUGIN_NAME ".tune", json_string(lg_tune));
+	json_object_set_new(options, PLUGIN_NAME ".threads", json_real(lg_threads));
+	json_object_set_new(options, PLUGIN_NAME ".gop", json_real(lg_gop));
+	json_object_set_new(options, PLUGIN_NAME ".intra_refresh", json_real(lg_intra_refresh));
+}
+
+static void release_plugin(void *user_data) {
+	free(user_data);
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release_plugin;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	const char *names[] = { H265_ENCODER_NAME, H264_ENCODER_NAME, MJPEG_ENCODER_NAME };
+	for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		ENCODER_FACTORY_T *encoder_factory = (ENCODER_FACTORY_T*) malloc(sizeof(ENCODER_FACTORY_T));
+		memset(encoder_factory, 0, sizeof(ENCODER_FACTORY_T));
+		strcpy(encoder_factory->name, names[i]);
+		encoder_factory->release = release_plugin;
+		encoder_factory->create_encoder = create_encoder;
+		encoder_factory->user_data = encoder_factory;
+
+		lg_plugin_host->add_encoder_factory(encoder_factory);
+	}
+}
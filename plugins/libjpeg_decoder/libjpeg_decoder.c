@@ -0,0 +1,783 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <sys/time.h>
+
+#ifdef USE_GLES
+#include "GLES2/gl2.h"
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+#else
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#endif
+
+#include <jpeglib.h>
+
+#include "gl_program.h"
+#include "frame_meta.h"
+#include "glsl/yuv_fsh.h"
+#include "glsl/yuv_vsh.h"
+
+#include "libjpeg_decoder.h"
+
+#define PLUGIN_NAME "libjpeg_decoder"
+#define DECODER_NAME "libjpeg_decoder"
+
+#define MAX_BUFFER_NUM 4
+#define MAX_RAW_ROWS 32 //v_samp_factor * scaled block size
+#define PLANE_NUM 3
+#define FPS_LOG_INTERVAL 10 //sec
+
+#if JPEG_LIB_VERSION >= 70
+#define DCT_V_SCALED_SIZE(comp) ((comp)->DCT_v_scaled_size)
+#define DCT_H_SCALED_SIZE(comp) ((comp)->DCT_h_scaled_size)
+#else
+#define DCT_V_SCALED_SIZE(comp) ((comp)->DCT_scaled_size)
+#define DCT_H_SCALED_SIZE(comp) ((comp)->DCT_scaled_size)
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+//applied on next frame
+static int lg_scale = 0; //0 : auto from texture size, 1, 2, 4 or 8 : decoded at 1/scale
+static bool lg_yuv = true; //planes are converted on gpu instead of libjpeg
+
+typedef struct _jpeg_error {
+	struct jpeg_error_mgr super;
+	jmp_buf jmp;
+} jpeg_error;
+
+typedef struct _jpeg_frame {
+	unsigned char *data;
+	int len;
+	int size;
+	bool xmp_info;
+	VECTOR4D_T quaternion;
+	VECTOR4D_T offset;
+} jpeg_frame;
+
+//output of libjpeg, either yuv planes or rgba
+typedef struct _decoded_image {
+	bool yuv;
+	int width;
+	int height;
+	unsigned char *planes[PLANE_NUM];
+	int plane_size[PLANE_NUM];
+	int stride[PLANE_NUM]; //padded to blocks
+	int rows[PLANE_NUM]; //padded to imcu rows
+	int plane_width[PLANE_NUM];
+	int plane_height[PLANE_NUM];
+	unsigned char *rgba;
+	int rgba_size;
+} decoded_image;
+
+typedef struct _libjpeg_decoder {
+	DECODER_T super;
+
+	int cam_num;
+#ifdef USE_GLES
+	EGLDisplay display;
+	EGLContext shared_context;
+	EGLContext context;
+	EGLSurface surface;
+#else
+	GLFWwindow *glfw_window;
+#endif
+	GLuint *cam_texture;
+	int n_buffers;
+	int texture_cur;
+	int texture_width[MAX_BUFFER_NUM]; //as allocated by this decoder
+	int texture_height[MAX_BUFFER_NUM];
+
+	//decode() fills active, complete frame waits in pending, worker decodes working
+	jpeg_frame frames[3];
+	jpeg_frame *active;
+	jpeg_frame *pending;
+	jpeg_frame *working;
+	bool receiving;
+	bool pending_ready;
+	pthread_mutex_t frame_mutex;
+	pthread_cond_t frame_cond;
+	bool run;
+	pthread_t decode_thread;
+
+	struct jpeg_decompress_struct cinfo; //reused across frames
+	jpeg_error jerr;
+	decoded_image image;
+
+	void *program;
+	GLuint vbo;
+	GLuint vao;
+	GLuint fbo;
+	GLuint plane_texture[PLANE_NUM];
+	int plane_texture_width[PLANE_NUM];
+	int plane_texture_height[PLANE_NUM];
+
+	int frameskip;
+	float fps;
+	int fps_frame_num;
+	int fps_window_num;
+	struct timeval fps_time;
+	double decode_ms;
+} libjpeg_decoder;
+
+static void error_exit(j_common_ptr cinfo) {
+	jpeg_error *jerr = (jpeg_error*) cinfo->err;
+	char msg[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, msg);
+	printf("%s : %s\n", PLUGIN_NAME, msg);
+	longjmp(jerr->jmp, 1);
+}
+
+//frame_meta app segment or legacy xmp right after SOI
+static void read_meta(const unsigned char *data, int data_len, jpeg_frame *frame) {
+	FRAME_META_T meta;
+	bool found = false;
+	if (data[0] == 0xFF && data[1] == FRAME_META_APP_MARKER) {
+		found = frame_meta_read_app(data, data_len, &meta);
+	} else if (data[0] == 0xFF && data[1] == 0xE1) { //xmp
+		int xmp_len = ((data[2] << 8) | data[3]) - 2;
+		if (xmp_len > 0 && 4 + xmp_len <= data_len) {
+			char *xmp = malloc(xmp_len + 1);
+			memcpy(xmp, data + 4, xmp_len);
+			xmp[xmp_len] = '\0';
+			int ns_len = strlen(xmp); //namespace, then xml
+			if (ns_len + 1 < xmp_len) {
+				found = frame_meta_parse_xml(xmp + ns_len + 1, &meta);
+			}
+			free(xmp);
+		}
+	}
+	if (!found) {
+		return;
+	}
+	if (meta.fields & FRAME_META_CAMERA_QUAT) {
+		frame->xmp_info = true;
+		frame->quaternion = meta.camera_quat;
+	}
+	if (meta.fields & FRAME_META_CAMERA_OFFSET) {
+		frame->xmp_info = true;
+		frame->offset = meta.camera_offset;
+	}
+}
+
+//largest reduction that still covers the texture, texture size is what renderers sample
+static int get_scale_denom(int width, int height) {
+	if (lg_scale > 0) {
+		return lg_scale;
+	}
+	uint32_t tex_width = 0, tex_height = 0;
+	lg_plugin_host->get_texture_size(&tex_width, &tex_height);
+	for (int denom = 8; denom > 1; denom /= 2) {
+		if (width / denom >= tex_width && height / denom >= tex_height) {
+			return denom;
+		}
+	}
+	return 1;
+}
+
+static void ensure_buffer(unsigned char **buff, int *size, int required) {
+	if (*size < required) {
+		*buff = realloc(*buff, required);
+		*size = required;
+	}
+}
+
+static void read_raw_planes(struct jpeg_decompress_struct *cinfo, decoded_image *image) {
+	for (int c = 0; c < PLANE_NUM; c++) {
+		jpeg_component_info *comp = &cinfo->comp_info[c];
+		image->stride[c] = comp->width_in_blocks * DCT_H_SCALED_SIZE(comp);
+		image->rows[c] = cinfo->total_iMCU_rows * comp->v_samp_factor * DCT_V_SCALED_SIZE(comp);
+		image->plane_width[c] = comp->downsampled_width;
+		image->plane_height[c] = comp->downsampled_height;
+		ensure_buffer(&image->planes[c], &image->plane_size[c], image->stride[c] * image->rows[c]);
+	}
+	JSAMPROW rows[PLANE_NUM][MAX_RAW_ROWS];
+	JSAMPARRAY planes[PLANE_NUM] = { rows[0], rows[1], rows[2] };
+	int imcu_row = 0;
+	while (cinfo->output_scanline < cinfo->output_height) {
+		for (int c = 0; c < PLANE_NUM; c++) {
+			jpeg_component_info *comp = &cinfo->comp_info[c];
+			int num = comp->v_samp_factor * DCT_V_SCALED_SIZE(comp);
+			for (int i = 0; i < num; i++) {
+				rows[c][i] = image->planes[c] + (size_t) (imcu_row * num + i) * image->stride[c];
+			}
+		}
+		jpeg_read_raw_data(cinfo, planes, MAX_RAW_ROWS);
+		imcu_row++;
+	}
+}
+
+static void read_rgba(struct jpeg_decompress_struct *cinfo, decoded_image *image) {
+	ensure_buffer(&image->rgba, &image->rgba_size, cinfo->output_width * cinfo->output_height * 4);
+	while (cinfo->output_scanline < cinfo->output_height) {
+		JSAMPROW row = image->rgba + (size_t) cinfo->output_scanline * cinfo->output_width * 4;
+		jpeg_read_scanlines(cinfo, &row, 1);
+	}
+}
+
+//cpu part, no gl context needed
+static bool decode_image(struct jpeg_decompress_struct *cinfo, jpeg_error *jerr, const unsigned char *data, int data_len, int scale_denom,
+		decoded_image *image) {
+	if (setjmp(jerr->jmp)) {
+		jpeg_abort_decompress(cinfo);
+		return false;
+	}
+	jpeg_mem_src(cinfo, (unsigned char*) data, data_len);
+	jpeg_read_header(cinfo, TRUE);
+	if (scale_denom <= 0) {
+		scale_denom = get_scale_denom(cinfo->image_width, cinfo->image_height);
+	}
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = scale_denom; //dct scaling, skipped coefficients are never computed
+	cinfo->dct_method = JDCT_IFAST;
+	jpeg_calc_output_dimensions(cinfo); //scaled block sizes
+	image->yuv = lg_yuv && cinfo->jpeg_color_space == JCS_YCbCr && cinfo->num_components == PLANE_NUM
+			&& cinfo->comp_info[1].h_samp_factor == cinfo->comp_info[2].h_samp_factor
+			&& cinfo->comp_info[1].v_samp_factor == cinfo->comp_info[2].v_samp_factor
+			&& cinfo->max_v_samp_factor * DCT_V_SCALED_SIZE(&cinfo->comp_info[0]) <= MAX_RAW_ROWS;
+	if (image->yuv) {
+		cinfo->raw_data_out = TRUE;
+	} else {
+		cinfo->out_color_space = JCS_EXT_RGBA;
+		cinfo->do_fancy_upsampling = FALSE;
+	}
+	jpeg_start_decompress(cinfo);
+	image->width = cinfo->output_width;
+	image->height = cinfo->output_height;
+	if (image->yuv) {
+		read_raw_planes(cinfo, image);
+	} else {
+		read_rgba(cinfo, image);
+	}
+	jpeg_finish_decompress(cinfo);
+	return true;
+}
+
+#ifdef USE_GLES
+static bool make_context_current(libjpeg_decoder *_this) {
+	EGLint config_attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT, EGL_NONE };
+	EGLint context_attributes[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+	EGLint surface_attributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+	EGLConfig config;
+	EGLint num_config = 0;
+	if (!eglChooseConfig(_this->display, config_attributes, &config, 1, &num_config) || num_config == 0) {
+		return false;
+	}
+	_this->context = eglCreateContext(_this->display, config, _this->shared_context, context_attributes);
+	_this->surface = eglCreatePbufferSurface(_this->display, config, surface_attributes);
+	if (_this->context == EGL_NO_CONTEXT || _this->surface == EGL_NO_SURFACE) {
+		return false;
+	}
+	return eglMakeCurrent(_this->display, _this->surface, _this->surface, _this->context);
+}
+#else
+static bool make_context_current(libjpeg_decoder *_this) {
+	glfwMakeContextCurrent(_this->glfw_window);
+	return true;
+}
+#endif
+
+static void init_gl(libjpeg_decoder *_this) {
+#ifdef USE_GLES
+	char *common = "#version 100\n";
+#else
+	char *common = "#version 330\n";
+#endif
+	float points[] = { 0, 0, 0, 1, 1, 0, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1 };
+
+	glGenBuffers(1, &_this->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, _this->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
+#ifndef USE_GLES
+	glGenVertexArrays(1, &_this->vao);
+	glBindVertexArray(_this->vao);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenFramebuffers(1, &_this->fbo);
+	glGenTextures(PLANE_NUM, _this->plane_texture);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_this->program = GLProgram_new_from_memory(common, (const char*) yuv_vsh, yuv_vsh_len, (const char*) yuv_fsh, yuv_fsh_len);
+}
+
+static void deinit_gl(libjpeg_decoder *_this) {
+	GLProgram_delete(_this->program);
+	glDeleteTextures(PLANE_NUM, _this->plane_texture);
+	glDeleteFramebuffers(1, &_this->fbo);
+#ifndef USE_GLES
+	glDeleteVertexArrays(1, &_this->vao);
+#endif
+	glDeleteBuffers(1, &_this->vbo);
+}
+
+//whole padded plane is uploaded, shader scales into valid area
+static void upload_plane(libjpeg_decoder *_this, int c) {
+	decoded_image *image = &_this->image;
+#ifdef USE_GLES
+	GLint internal_format = GL_LUMINANCE;
+	GLenum format = GL_LUMINANCE;
+#else
+	GLint internal_format = GL_R8;
+	GLenum format = GL_RED;
+#endif
+	glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+	if (_this->plane_texture_width[c] != image->stride[c] || _this->plane_texture_height[c] != image->rows[c]) {
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image->stride[c], image->rows[c], 0, format, GL_UNSIGNED_BYTE, image->planes[c]);
+		_this->plane_texture_width[c] = image->stride[c];
+		_this->plane_texture_height[c] = image->rows[c];
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->stride[c], image->rows[c], format, GL_UNSIGNED_BYTE, image->planes[c]);
+	}
+}
+
+static void convert_planes(libjpeg_decoder *_this, GLuint texture) {
+	decoded_image *image = &_this->image;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		upload_plane(_this, c);
+	}
+
+	int program = GLProgram_GetId(_this->program);
+	glBindFramebuffer(GL_FRAMEBUFFER, _this->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, _this->vbo);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		glActiveTexture(GL_TEXTURE0 + c);
+		glBindTexture(GL_TEXTURE_2D, _this->plane_texture[c]);
+	}
+	glUniform1i(glGetUniformLocation(program, "y_tex"), 0);
+	glUniform1i(glGetUniformLocation(program, "u_tex"), 1);
+	glUniform1i(glGetUniformLocation(program, "v_tex"), 2);
+	glUniform2f(glGetUniformLocation(program, "y_scale"), (float) image->plane_width[0] / image->stride[0],
+			(float) image->plane_height[0] / image->rows[0]);
+	glUniform2f(glGetUniformLocation(program, "uv_scale"), (float) image->plane_width[1] / image->stride[1],
+			(float) image->plane_height[1] / image->rows[1]);
+	glUniform3f(glGetUniformLocation(program, "range"), 0.0, 1.0, 1.0); //full range bt.601 of jfif
+	glUniform4f(glGetUniformLocation(program, "coef"), 1.402, 0.344136, 0.714136, 1.772);
+#ifdef USE_GLES
+	GLuint loc = glGetAttribLocation(program, "vPosition");
+	glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(loc);
+#else
+	glBindVertexArray(_this->vao);
+#endif
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glViewport(0, 0, image->width, image->height);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+#ifdef USE_GLES
+	glDisableVertexAttribArray(loc);
+#else
+	glBindVertexArray(0);
+#endif
+	for (int c = PLANE_NUM - 1; c >= 0; c--) {
+		glActiveTexture(GL_TEXTURE0 + c);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//renderers sample normalized coordinates, so texture follows decoded size
+static void update_texture(libjpeg_decoder *_this, int cur) {
+	decoded_image *image = &_this->image;
+	GLuint texture = _this->cam_texture[cur];
+	GLint width = _this->texture_width[cur];
+	GLint height = _this->texture_height[cur];
+	glBindTexture(GL_TEXTURE_2D, texture);
+#ifndef USE_GLES
+	//host may have reallocated it, gles2 has no size query
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+#endif
+	if (width != image->width || height != image->height) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->yuv ? NULL : image->rgba);
+		_this->texture_width[cur] = image->width;
+		_this->texture_height[cur] = image->height;
+	} else if (!image->yuv) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image->width, image->height, GL_RGBA, GL_UNSIGNED_BYTE, image->rgba);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (image->yuv) {
+		convert_planes(_this, texture);
+	}
+}
+
+static void update_fps(libjpeg_decoder *_this, double decode_ms) {
+	struct timeval now, diff;
+	gettimeofday(&now, NULL);
+	_this->fps_frame_num++;
+	_this->decode_ms += decode_ms;
+	timersub(&now, &_this->fps_time, &diff);
+	float elapsed_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+	if (elapsed_sec >= 1.0) {
+		_this->fps = _this->fps_frame_num / elapsed_sec;
+		if (++_this->fps_window_num % FPS_LOG_INTERVAL == 0) {
+			printf("%s : cam%d %dx%d %s %.1f fps %.3f ms/frame skip=%d\n", PLUGIN_NAME, _this->cam_num, _this->image.width, _this->image.height,
+					_this->image.yuv ? "yuv" : "rgba", _this->fps, _this->decode_ms / _this->fps_frame_num, _this->frameskip);
+		}
+		_this->fps_frame_num = 0;
+		_this->decode_ms = 0;
+		_this->fps_time = now;
+	}
+}
+
+static void *decode_thread_func(void *arg) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) arg;
+
+	if (!make_context_current(_this)) {
+		printf("%s : no gl context for cam%d\n", PLUGIN_NAME, _this->cam_num);
+		return NULL;
+	}
+	init_gl(_this);
+	gettimeofday(&_this->fps_time, NULL);
+
+	while (1) {
+		pthread_mutex_lock(&_this->frame_mutex);
+		while (_this->run && !_this->pending_ready) {
+			pthread_cond_wait(&_this->frame_cond, &_this->frame_mutex);
+		}
+		if (!_this->run) {
+			pthread_mutex_unlock(&_this->frame_mutex);
+			break;
+		}
+		jpeg_frame *frame = _this->pending;
+		_this->pending = _this->working;
+		_this->working = frame;
+		_this->pending_ready = false;
+		pthread_mutex_unlock(&_this->frame_mutex);
+
+		struct timeval s, f;
+		gettimeofday(&s, NULL);
+		if (!decode_image(&_this->cinfo, &_this->jerr, frame->data, frame->len, 0, &_this->image)) {
+			continue;
+		}
+		int cur = (_this->texture_cur + 1) % _this->n_buffers;
+		update_texture(_this, cur);
+		glFinish();
+		_this->texture_cur = cur;
+		gettimeofday(&f, NULL);
+
+		lg_plugin_host->lock_texture();
+		lg_plugin_host->set_cam_texture_cur(_this->cam_num, cur);
+		if (frame->xmp_info) {
+			lg_plugin_host->set_camera_quaternion(_this->cam_num, frame->quaternion);
+			lg_plugin_host->set_camera_offset(_this->cam_num, frame->offset);
+		}
+		lg_plugin_host->unlock_texture();
+		lg_plugin_host->send_event(PICAM360_HOST_NODE_ID, PICAM360_CAPTURE_EVENT_TEXTURE0_UPDATED + _this->cam_num);
+
+		update_fps(_this, (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0);
+	}
+
+	deinit_gl(_this);
+	return NULL;
+}
+
+static void init(void *obj, int cam_num, void *display, void *context, void *cam_texture, int n_buffers) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) obj;
+
+	_this->cam_num = cam_num;
+#ifdef USE_GLES
+	_this->display = (EGLDisplay) display;
+	_this->shared_context = (EGLContext) context;
+#else
+	_this->glfw_window = (GLFWwindow*) display;
+#endif
+	_this->cam_texture = (GLuint*) cam_texture;
+	_this->n_buffers = MAX(MIN(n_buffers, MAX_BUFFER_NUM), 1);
+	_this->active = &_this->frames[0];
+	_this->pending = &_this->frames[1];
+	_this->working = &_this->frames[2];
+
+	_this->cinfo.err = jpeg_std_error(&_this->jerr.super);
+	_this->jerr.super.error_exit = error_exit;
+	jpeg_create_decompress(&_this->cinfo);
+
+	pthread_mutex_init(&_this->frame_mutex, 0);
+	pthread_cond_init(&_this->frame_cond, 0);
+	_this->run = true;
+	pthread_create(&_this->decode_thread, NULL, decode_thread_func, (void*) _this);
+}
+
+static void release(void *obj) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) obj;
+
+	if (_this->run) {
+		pthread_mutex_lock(&_this->frame_mutex);
+		_this->run = false;
+		pthread_cond_broadcast(&_this->frame_cond);
+		pthread_mutex_unlock(&_this->frame_mutex);
+		pthread_join(_this->decode_thread, NULL);
+
+		jpeg_destroy_decompress(&_this->cinfo);
+		pthread_cond_destroy(&_this->frame_cond);
+		pthread_mutex_destroy(&_this->frame_mutex);
+#ifdef USE_GLES
+		if (_this->context != EGL_NO_CONTEXT) {
+			eglDestroySurface(_this->display, _this->surface);
+			eglDestroyContext(_this->display, _this->context);
+		}
+#endif
+	}
+	for (int i = 0; i < 3; i++) {
+		free(_this->frames[i].data);
+	}
+	for (int c = 0; c < PLANE_NUM; c++) {
+		free(_this->image.planes[c]);
+	}
+	free(_this->image.rgba);
+	free(obj);
+}
+
+//called with rtp payloads, a frame starts with SOI and ends with EOI
+static void decode(void *obj, unsigned char *data, int data_len) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) obj;
+	jpeg_frame *frame = _this->active;
+	if (data_len < 2) {
+		return;
+	}
+	if (data[0] == 0xFF && data[1] == 0xD8) { //SOI
+		_this->receiving = true;
+		frame->len = 0;
+		frame->xmp_info = false;
+		if (data_len > 6) {
+			read_meta(data + 2, data_len - 2, frame);
+		}
+	}
+	if (!_this->receiving) {
+		return;
+	}
+	if (frame->len + data_len > frame->size) {
+		ensure_buffer(&frame->data, &frame->size, MAX(frame->len + data_len, frame->size * 2));
+	}
+	memcpy(frame->data + frame->len, data, data_len);
+	frame->len += data_len;
+
+	if (data[data_len - 2] == 0xFF && data[data_len - 1] == 0xD9) { //EOI
+		_this->receiving = false;
+
+		//only the newest frame is decoded when worker is behind
+		pthread_mutex_lock(&_this->frame_mutex);
+		if (_this->pending_ready) {
+			_this->frameskip++;
+		}
+		_this->active = _this->pending;
+		_this->pending = frame;
+		_this->pending_ready = true;
+		pthread_cond_signal(&_this->frame_cond);
+		pthread_mutex_unlock(&_this->frame_mutex);
+	}
+}
+
+static float get_fps(void *obj) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) obj;
+	return _this->fps;
+}
+
+static int get_frameskip(void *obj) {
+	libjpeg_decoder *_this = (libjpeg_decoder*) obj;
+	return _this->frameskip;
+}
+
+static void switch_buffer(void *obj) {
+}
+
+static void create_decoder(void *user_data, DECODER_T **out_decoder) {
+	DECODER_T *decoder = (DECODER_T*) malloc(sizeof(libjpeg_decoder));
+	memset(decoder, 0, sizeof(libjpeg_decoder));
+	strcpy(decoder->name, DECODER_NAME);
+	decoder->release = release;
+	decoder->init = init;
+	decoder->get_fps = get_fps;
+	decoder->get_frameskip = get_frameskip;
+	decoder->decode = decode;
+	decoder->switch_buffer = switch_buffer;
+	decoder->user_data = decoder;
+
+	if (out_decoder) {
+		*out_decoder = decoder;
+	}
+}
+
+typedef struct _bench_params {
+	char path[256];
+	int frame_num;
+} bench_params;
+
+static bool lg_bench_running = false;
+
+//cpu decode time of a file at each scale, gpu conversion is not included
+static void bench(const char *path, int frame_num) {
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL) {
+		printf("%s : can not open %s\n", PLUGIN_NAME, path);
+		return;
+	}
+	fseek(fp, 0, SEEK_END);
+	int data_len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	unsigned char *data = malloc(data_len);
+	data_len = fread(data, 1, data_len, fp);
+	fclose(fp);
+
+	struct jpeg_decompress_struct cinfo;
+	jpeg_error jerr;
+	decoded_image image = { };
+	cinfo.err = jpeg_std_error(&jerr.super);
+	jerr.super.error_exit = error_exit;
+	jpeg_create_decompress(&cinfo);
+	for (int denom = 1; denom <= 4; denom *= 2) {
+		struct timeval s, f;
+		gettimeofday(&s, NULL);
+		bool succeeded = true;
+		for (int i = 0; i < frame_num && succeeded; i++) {
+			succeeded = decode_image(&cinfo, &jerr, data, data_len, denom, &image);
+		}
+		gettimeofday(&f, NULL);
+		if (!succeeded) {
+			break;
+		}
+		double elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
+		printf("%s : bench 1/%d %dx%d %s %.3f ms/frame\n", PLUGIN_NAME, denom, image.width, image.height, image.yuv ? "yuv" : "rgba",
+				elapsed_ms / frame_num);
+	}
+	jpeg_destroy_decompress(&cinfo);
+	for (int c = 0; c < PLANE_NUM; c++) {
+		free(image.planes[c]);
+	}
+	free(image.rgba);
+	free(data);
+}
+
+//out of command handler, it is called on main loop
+static void *bench_thread_func(void *arg) {
+	bench_params *params = (bench_params*) arg;
+	bench(params->path, params->frame_num);
+	printf("%s : completed\n", PLUGIN_NAME ".bench");
+	free(params);
+	lg_bench_running = false;
+	return NULL;
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	char buff[256];
+	strncpy(buff, _buff, sizeof(buff));
+	char *cmd = strtok(buff, " \n");
+	if (cmd == NULL) {
+		//do nothing
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_scale", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			if (value == 0 || value == 1 || value == 2 || value == 4 || value == 8) {
+				lg_scale = value;
+				printf("%s : completed\n", cmd);
+			}
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_yuv", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			int value = 0;
+			sscanf(param, "%d", &value);
+			lg_yuv = (value != 0);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".bench", sizeof(buff)) == 0) {
+		char *path = strtok(NULL, " \n");
+		char *param = strtok(NULL, " \n");
+		int frame_num = 30;
+		if (param != NULL) {
+			sscanf(param, "%d", &frame_num);
+		}
+		if (lg_bench_running) {
+			printf("%s : already running\n", cmd);
+		} else if (path != NULL && frame_num > 0) {
+			bench_params *params = (bench_params*) malloc(sizeof(bench_params));
+			strncpy(params->path, path, sizeof(params->path) - 1);
+			params->path[sizeof(params->path) - 1] = '\0';
+			params->frame_num = frame_num;
+			pthread_t thread;
+			lg_bench_running = true;
+			pthread_create(&thread, NULL, bench_thread_func, (void*) params);
+			pthread_detach(thread);
+		}
+	}
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+	lg_scale = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".scale"));
+	json_t *value = json_object_get(options, PLUGIN_NAME ".yuv");
+	if (value) {
+		lg_yuv = (json_number_value(value) != 0);
+	}
+}
+
+static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".scale", json_real(lg_scale));
+	json_object_set_new(options, PLUGIN_NAME ".yuv", json_real(lg_yuv));
+}
+
+static void release_plugin(void *user_data) {
+	free(user_data);
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release_plugin;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	{
+		DECODER_FACTORY_T *decoder_factory = (DECODER_FACTORY_T*) malloc(sizeof(DECODER_FACTORY_T));
+		memset(decoder_factory, 0, sizeof(DECODER_FACTORY_T));
+		strcpy(decoder_factory->name, DECODER_NAME);
+		decoder_factory->release = release_plugin;
+		decoder_factory->create_decoder = create_decoder;
+		decoder_factory->user_data = decoder_factory;
+
+		lg_plugin_host->add_decoder_factory(decoder_factory);
+	}
+}
@@ -16,12 +16,11 @@
 #include <list>
 
 #include "mjpeg_omx_decoder.h"
+#include "frame_meta.h"
 
 #define PLUGIN_NAME "mjpeg_omx_decoder"
 #define DECODER_NAME "mjpeg_omx_decoder"
 
-#include <rtp.h>
-
 #define TIMEOUT_MS 2000
 
 #ifdef __cplusplus
@@ -62,43 +61,38 @@ extern "C" {
 
 #define MAX_CAM_NUM 2
 #define TEXTURE_BUFFER_NUM 2
+#define INPUT_BUFFER_SIZE (256 * 1024) //a frame goes to omx in one or a few buffers
+#define INPUT_BUFFER_NUM 4
 
-class _PACKET_T {
-public:
-	_PACKET_T() {
-		len = 0;
-		eof = false;
-	}
-	int len;
-	char data[RTP_MAXPAYLOADSIZE];
-	bool eof;
-};
+//whole jpeg in one buffer, reused through the pool of the camera
 class _FRAME_T {
 public:
 	_FRAME_T() {
-		pthread_mutex_init(&packets_mlock, NULL);
-		mrevent_init(&packet_ready);
+		data = NULL;
+		len = 0;
+		size = 0;
+		reset();
+	}
+	~_FRAME_T() {
+		free(data);
+	}
+	void reset() {
+		len = 0;
 		xmp_info = false;
 		memset(&quaternion, 0, sizeof(quaternion));
 		memset(&offset, 0, sizeof(offset));
 	}
-	~_FRAME_T() {
-		_FRAME_T *frame = this;
-		while (!frame->packets.empty()) {
-			_PACKET_T *packet;
-			pthread_mutex_lock(&frame->packets_mlock);
-			packet = *(frame->packets.begin());
-			frame->packets.pop_front();
-			if (frame->packets.empty()) {
-				mrevent_reset(&frame->packet_ready);
-			}
-			pthread_mutex_unlock(&frame->packets_mlock);
-			delete packet;
+	void append(const unsigned char *_data, int _len) {
+		if (len + _len > size) {
+			size = MAX(len + _len, size * 2);
+			data = (unsigned char*) realloc(data, size);
 		}
+		memcpy(data + len, _data, _len);
+		len += _len;
 	}
-	std::list<_PACKET_T *> packets;
-	pthread_mutex_t packets_mlock;
-	MREVENT_T packet_ready;
+	unsigned char *data;
+	int len;
+	int size;
 	bool xmp_info;
 	VECTOR4D_T quaternion;
 	VECTOR4D_T offset;
@@ -117,7 +111,9 @@ public:
 		mrevent_init(&frame_ready);
 		mrevent_init(&buffer_ready);
 		active_frame = NULL;
-		last_frame = NULL;
+		xmp_info = false;
+		memset(&quaternion, 0, sizeof(quaternion));
+		memset(&offset, 0, sizeof(offset));
 		memset(egl_buffer, 0, sizeof(egl_buffer));
 		egl_render = NULL;
 		video_decode = NULL;
@@ -129,6 +125,15 @@ public:
 		mrevent_init(&texture_update);
 		n_buffers = 0;
 	}
+	~_SENDFRAME_ARG_T() {
+		delete active_frame;
+		for (std::list<_FRAME_T *>::iterator it = frames.begin(); it != frames.end(); it++) {
+			delete *it;
+		}
+		for (std::list<_FRAME_T *>::iterator it = frame_pool.begin(); it != frame_pool.end(); it++) {
+			delete *it;
+		}
+	}
 #ifdef USE_GLES
 	EGLDisplay display;
 	EGLContext context;
@@ -140,13 +145,16 @@ public:
 	int decodedcount;
 	float fps;
 	int frameskip;
-	std::list<_FRAME_T *> frames;
-	pthread_mutex_t frames_mlock;
+	std::list<_FRAME_T *> frames; //complete, newest only
+	std::list<_FRAME_T *> frame_pool;
+	pthread_mutex_t frames_mlock; //for frames and frame_pool, taken once per frame
 	MREVENT_T frame_ready;
 	MREVENT_T buffer_ready;
 	pthread_t cam_thread;
-	_FRAME_T *active_frame;
-	_FRAME_T *last_frame;
+	_FRAME_T *active_frame; //receiving in decode()
+	bool xmp_info; //of last frame sent to omx
+	VECTOR4D_T quaternion;
+	VECTOR4D_T offset;
 	COMPONENT_T* video_decode;
 	COMPONENT_T* resize;
 	OMX_BUFFERHEADERTYPE* egl_buffer[2];
@@ -180,9 +188,9 @@ static void my_fill_buffer_done(void* data, COMPONENT_T* comp) {
 	if (lg_plugin_host) {
 		lg_plugin_host->lock_texture();
 		lg_plugin_host->set_cam_texture_cur(cam_num, cur);
-		if (send_frame_arg->last_frame && send_frame_arg->last_frame->xmp_info) {
-			lg_plugin_host->set_camera_quaternion(cam_num, send_frame_arg->last_frame->quaternion);
-			lg_plugin_host->set_camera_offset(cam_num, send_frame_arg->last_frame->offset);
+		if (send_frame_arg->xmp_info) {
+			lg_plugin_host->set_camera_quaternion(cam_num, send_frame_arg->quaternion);
+			lg_plugin_host->set_camera_offset(cam_num, send_frame_arg->offset);
 		}
 		lg_plugin_host->unlock_texture();
 		lg_plugin_host->send_event(PICAM360_HOST_NODE_ID, PICAM360_CAPTURE_EVENT_TEXTURE0_UPDATED + cam_num);
@@ -382,6 +390,41 @@ static int port_setting_changed(_SENDFRAME_ARG_T *send_frame_arg) {
 	return 0;
 }
 
+//larger input buffers, so a frame needs fewer OMX_EmptyThisBuffer
+static bool set_input_buffers(_SENDFRAME_ARG_T *send_frame_arg) {
+	OMX_PARAM_PORTDEFINITIONTYPE portdef;
+	OMX_INIT_STRUCTURE(portdef);
+	portdef.nPortIndex = 130;
+	if (OMX_GetParameter(ILC_GET_HANDLE(send_frame_arg->video_decode), OMX_IndexParamPortDefinition, &portdef) != OMX_ErrorNone) {
+		return true;
+	}
+	portdef.nBufferSize = MAX(portdef.nBufferSize, INPUT_BUFFER_SIZE);
+	portdef.nBufferCountActual = MAX(portdef.nBufferCountMin, INPUT_BUFFER_NUM);
+	if (OMX_SetParameter(ILC_GET_HANDLE(send_frame_arg->video_decode), OMX_IndexParamPortDefinition, &portdef) != OMX_ErrorNone) {
+		printf("%s : input buffers stay default\n", PLUGIN_NAME);
+	}
+	return true;
+}
+
+//frames_mlock is held
+static _FRAME_T *acquire_frame_locked(_SENDFRAME_ARG_T *send_frame_arg) {
+	_FRAME_T *frame;
+	if (send_frame_arg->frame_pool.empty()) {
+		frame = new _FRAME_T;
+	} else {
+		frame = send_frame_arg->frame_pool.front();
+		send_frame_arg->frame_pool.pop_front();
+	}
+	frame->reset();
+	return frame;
+}
+
+static void release_frame(_SENDFRAME_ARG_T *send_frame_arg, _FRAME_T *frame) {
+	pthread_mutex_lock(&send_frame_arg->frames_mlock);
+	send_frame_arg->frame_pool.push_back(frame);
+	pthread_mutex_unlock(&send_frame_arg->frames_mlock);
+}
+
 static void *sendframe_thread_func(void* arg) {
 	pthread_setname_np(pthread_self(), "MJPEG SENDFRAME");
 
@@ -441,7 +484,7 @@ static void *sendframe_thread_func(void* arg) {
 	format.eCompressionFormat = OMX_VIDEO_CodingMJPEG;
 
 	if (status == 0 && OMX_SetParameter(ILC_GET_HANDLE(send_frame_arg->video_decode), OMX_IndexParamVideoPortFormat, &format) == OMX_ErrorNone
-			&& ilclient_enable_port_buffers(send_frame_arg->video_decode, 130, NULL, NULL, NULL) == 0) {
+			&& set_input_buffers(send_frame_arg) && ilclient_enable_port_buffers(send_frame_arg->video_decode, 130, NULL, NULL, NULL) == 0) {
 		OMX_BUFFERHEADERTYPE *buf;
 		int port_settings_changed = 0;
 		int first_packet = 1;
@@ -457,66 +500,40 @@ static void *sendframe_thread_func(void* arg) {
 			}
 			_FRAME_T *frame = NULL;
 			pthread_mutex_lock(&send_frame_arg->frames_mlock);
-			while (1) {
-				if (!send_frame_arg->frames.empty()) {
-					frame = *(send_frame_arg->frames.begin());
-					send_frame_arg->frames.pop_front();
-					send_frame_arg->framecount++;
-				}
-				if (send_frame_arg->frames.empty()) {
-					mrevent_reset(&send_frame_arg->frame_ready);
-					break;
-				} else {
-					send_frame_arg->frameskip++;
-					delete frame; //skip frame
-					frame = NULL;
-				}
+			if (!send_frame_arg->frames.empty()) {
+				frame = send_frame_arg->frames.front();
+				send_frame_arg->frames.pop_front();
+				send_frame_arg->framecount++;
+			}
+			if (send_frame_arg->frames.empty()) {
+				mrevent_reset(&send_frame_arg->frame_ready);
 			}
 			pthread_mutex_unlock(&send_frame_arg->frames_mlock);
 			if (frame == NULL) {
 				continue;
 			}
-			while (send_frame_arg->cam_run) {
-				{ //fps
-					struct timeval time = { };
-					gettimeofday(&time, NULL);
-
-					struct timeval diff;
-					timersub(&time, &last_time, &diff);
-					float diff_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-					if (diff_sec > 1.0) {
-						float tmp = (float) (send_frame_arg->framecount - last_framecount) / diff_sec;
-						float w = diff_sec / 10;
-						send_frame_arg->fps = send_frame_arg->fps * (1.0 - w) + tmp * w;
-
-						last_framecount = send_frame_arg->framecount;
-						last_time = time;
-					}
-				}
-				int res = mrevent_wait(&frame->packet_ready, 100 * 1000);
-				if (res != 0) {
-					continue;
-				}
-				_PACKET_T *packet = NULL;
-				pthread_mutex_lock(&frame->packets_mlock);
-				if (!frame->packets.empty()) {
-					packet = *(frame->packets.begin());
-					frame->packets.pop_front();
-				}
-				if (frame->packets.empty()) {
-					mrevent_reset(&frame->packet_ready);
+			{ //fps
+				struct timeval time = { };
+				gettimeofday(&time, NULL);
+
+				struct timeval diff;
+				timersub(&time, &last_time, &diff);
+				float diff_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+				if (diff_sec > 1.0) {
+					float tmp = (float) (send_frame_arg->framecount - last_framecount) / diff_sec;
+					float w = diff_sec / 10;
+					send_frame_arg->fps = send_frame_arg->fps * (1.0 - w) + tmp * w;
+
+					last_framecount = send_frame_arg->framecount;
+					last_time = time;
 				}
-				pthread_mutex_unlock(&frame->packets_mlock);
-				if (packet == NULL) {
-					fprintf(stderr, "packet is null\n");
-					continue;
-				}
-				// send the packet
-
+			}
+			for (int offset = 0; offset < frame->len && send_frame_arg->cam_run;) {
 				buf = ilclient_get_input_buffer(send_frame_arg->video_decode, 130, 1);
 
-				data_len = MIN((int )buf->nAllocLen, packet->len);
-				memcpy(buf->pBuffer, packet->data, data_len);
+				data_len = MIN((int )buf->nAllocLen, frame->len - offset);
+				memcpy(buf->pBuffer, frame->data + offset, data_len);
+				offset += data_len;
 
 				if (ilclient_remove_event(send_frame_arg->video_decode, OMX_EventPortSettingsChanged, 131, 0, 0, 1) == 0) {
 					printf("port changed %d\n", cam_num);
@@ -533,9 +550,6 @@ static void *sendframe_thread_func(void* arg) {
 						break;
 					}
 				}
-				if (!data_len) {
-					break;
-				}
 				buf->nFilledLen = data_len;
 
 				buf->nOffset = 0;
@@ -546,7 +560,7 @@ static void *sendframe_thread_func(void* arg) {
 					buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
 				}
 
-				if (packet->eof) {
+				if (offset == frame->len) {
 					buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 				}
 
@@ -554,20 +568,14 @@ static void *sendframe_thread_func(void* arg) {
 					status = -6;
 					break;
 				}
-
-				if (packet->eof) {
-					if (send_frame_arg->last_frame != NULL) {
-						delete send_frame_arg->last_frame;
-					}
-					send_frame_arg->last_frame = frame;
-					delete packet;
-					break;
-				} else {
-					delete packet;
-				}
 			}
+			send_frame_arg->quaternion = frame->quaternion;
+			send_frame_arg->offset = frame->offset;
+			send_frame_arg->xmp_info = frame->xmp_info;
+			release_frame(send_frame_arg, frame);
 		}
 
+		buf = ilclient_get_input_buffer(send_frame_arg->video_decode, 130, 1);
 		buf->nFilledLen = 0;
 		buf->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_EOS;
 
@@ -594,72 +602,77 @@ static void *sendframe_thread_func(void* arg) {
 	return (void *) status;
 }
 
-static void parse_xml(char *xml, _FRAME_T *frame) {
-	frame->xmp_info = true;
-
-	char *q_str = NULL;
-	q_str = strstr(xml, "<quaternion");
-	if (q_str) {
-		sscanf(q_str, "<quaternion x=\"%f\" y=\"%f\" z=\"%f\" w=\"%f\" />", &frame->quaternion.x, &frame->quaternion.y, &frame->quaternion.z, &frame->quaternion.w);
+//frame_meta app segment or legacy xmp right after SOI
+static void read_meta(const unsigned char *data, int data_len, _FRAME_T *frame) {
+	FRAME_META_T meta;
+	bool found = false;
+	if (data[0] == 0xFF && data[1] == FRAME_META_APP_MARKER) {
+		found = frame_meta_read_app(data, data_len, &meta);
+	} else if (data[0] == 0xFF && data[1] == 0xE1) { //xmp
+		int xmp_len = ((data[2] << 8) | data[3]) - 2;
+		if (xmp_len > 0 && 4 + xmp_len <= data_len) {
+			char *xmp = (char*) malloc(xmp_len + 1);
+			memcpy(xmp, data + 4, xmp_len);
+			xmp[xmp_len] = '\0';
+			int ns_len = strlen(xmp); //namespace, then xml
+			if (ns_len + 1 < xmp_len) {
+				found = frame_meta_parse_xml(xmp + ns_len + 1, &meta);
+			}
+			free(xmp);
+		}
+	}
+	if (!found) {
+		return;
 	}
-	q_str = strstr(xml, "<offset");
-	if (q_str) {
-		sscanf(q_str, "<offset x=\"%f\" y=\"%f\" yaw=\"%f\" horizon_r=\"%f\" />", &frame->offset.x, &frame->offset.y, &frame->offset.z, &frame->offset.w);
+	if (meta.fields & FRAME_META_CAMERA_QUAT) {
+		frame->xmp_info = true;
+		frame->quaternion = meta.camera_quat;
+	}
+	if (meta.fields & FRAME_META_CAMERA_OFFSET) {
+		frame->xmp_info = true;
+		frame->offset = meta.camera_offset;
 	}
 }
 
+//rtp payloads are appended to one buffer, a frame is queued once at EOI
 static void decode(void *obj, unsigned char *data, int data_len) {
 	mjpeg_omx_decoder *_this = (mjpeg_omx_decoder*) obj;
-	if (!lg_send_frame_arg[_this->cam_num]) {
+	if (!lg_send_frame_arg[_this->cam_num] || data_len < 2) {
 		return;
 	}
 	_SENDFRAME_ARG_T *send_frame_arg = lg_send_frame_arg[_this->cam_num];
-	if (send_frame_arg->active_frame == NULL) {
-		if (data[0] == 0xFF && data[1] == 0xD8) { //SOI
-			send_frame_arg->active_frame = new _FRAME_T;
-
+	if (data[0] == 0xFF && data[1] == 0xD8) { //SOI, restarts a frame whose EOI was lost
+		if (send_frame_arg->active_frame == NULL) {
 			pthread_mutex_lock(&send_frame_arg->frames_mlock);
-			send_frame_arg->frames.push_back(send_frame_arg->active_frame);
+			send_frame_arg->active_frame = acquire_frame_locked(send_frame_arg);
 			pthread_mutex_unlock(&send_frame_arg->frames_mlock);
-			mrevent_trigger(&send_frame_arg->frame_ready);
-
-			if (data[2] == 0xFF && data[3] == 0xE1) { //xmp
-				int xmp_len = 0;
-				xmp_len = ((unsigned char*) data)[4] << 8;
-				xmp_len += ((unsigned char*) data)[5];
+		} else {
+			send_frame_arg->active_frame->reset();
+		}
 
-				char *xml = (char*) data + strlen((char*) data) + 1;
-				parse_xml(xml, send_frame_arg->active_frame);
-			}
+		if (data_len > 6) {
+			read_meta(data + 2, data_len - 2, send_frame_arg->active_frame);
 		}
 	}
-	if (send_frame_arg->active_frame != NULL) {
-		_PACKET_T *packet = new _PACKET_T;
-		{
-			packet->len = data_len;
-			if (packet->len > RTP_MAXPAYLOADSIZE) {
-				fprintf(stderr, "packet length exceeded. %d\n", packet->len);
-				packet->len = RTP_MAXPAYLOADSIZE;
-			}
-			memcpy(packet->data, data, packet->len);
-		}
-		if (data[data_len - 2] == 0xFF && data[data_len - 1] == 0xD9) { //EOI
-			packet->eof = true;
-
-			pthread_mutex_lock(&send_frame_arg->active_frame->packets_mlock);
-			send_frame_arg->active_frame->packets.push_back(packet);
-			mrevent_trigger(&send_frame_arg->active_frame->packet_ready);
-			pthread_mutex_unlock(&send_frame_arg->active_frame->packets_mlock);
+	_FRAME_T *frame = send_frame_arg->active_frame;
+	if (frame == NULL) {
+		return;
+	}
+	frame->append(data, data_len);
+	if (data[data_len - 2] == 0xFF && data[data_len - 1] == 0xD9) { //EOI
+		send_frame_arg->active_frame = NULL;
 
-			send_frame_arg->active_frame = NULL;
-		} else {
-			pthread_mutex_lock(&send_frame_arg->active_frame->packets_mlock);
-			send_frame_arg->active_frame->packets.push_back(packet);
-			pthread_mutex_unlock(&send_frame_arg->active_frame->packets_mlock);
-			mrevent_trigger(&send_frame_arg->active_frame->packet_ready);
+		//a frame omx has not started yet is superseded
+		pthread_mutex_lock(&send_frame_arg->frames_mlock);
+		while (!send_frame_arg->frames.empty()) {
+			send_frame_arg->frame_pool.push_back(send_frame_arg->frames.front());
+			send_frame_arg->frames.pop_front();
+			send_frame_arg->frameskip++;
 		}
+		send_frame_arg->frames.push_back(frame);
+		pthread_mutex_unlock(&send_frame_arg->frames_mlock);
+		mrevent_trigger(&send_frame_arg->frame_ready);
 	}
-
 }
 static void init(void *obj, int cam_num, void *display, void *context, void *cam_texture, int n_buffers) {
 	mjpeg_omx_decoder *_this = (mjpeg_omx_decoder*) obj;
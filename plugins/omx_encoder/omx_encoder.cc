@@ -38,6 +38,7 @@ using std::chrono::steady_clock;
 using std::chrono::duration_cast;
 
 static PLUGIN_HOST_T *lg_plugin_host = NULL;
+static int lg_intra_refresh_mbs = 0; //0 : idr only
 
 typedef struct _omx_encoder {
 	ENCODER_T super;
@@ -49,7 +50,7 @@ typedef struct _omx_encoder {
 static void init(void *obj, const int width, const int height, int bitrate_kbps, int fps, ENCODER_STREAM_CALLBACK callback, void *user_data) {
 	omx_encoder *_this = (omx_encoder*) obj;
 
-	_this->omxcv = new OmxCv(_this->codec, width, height, bitrate_kbps, fps, 1, callback, user_data);
+	_this->omxcv = new OmxCv(_this->codec, width, height, bitrate_kbps, fps, 1, callback, user_data, lg_intra_refresh_mbs);
 }
 static void release(void *obj) {
 	omx_encoder *_this = (omx_encoder*) obj;
@@ -66,6 +67,22 @@ static void add_frame(void *obj, const unsigned char *in_data, void *frame_data)
 	}
 }
 
+static void reconfigure(void *obj, int bitrate_kbps, int fps) {
+	omx_encoder *_this = (omx_encoder*) obj;
+
+	if (_this->omxcv) {
+		_this->omxcv->SetBitrate(bitrate_kbps);
+	}
+}
+
+static void request_keyframe(void *obj) {
+	omx_encoder *_this = (omx_encoder*) obj;
+
+	if (_this->omxcv) {
+		_this->omxcv->RequestKeyframe();
+	}
+}
+
 static void create_mjpeg_encoder(void *obj, ENCODER_T **out_encoder) {
 	ENCODER_T *encoder = (ENCODER_T*) malloc(sizeof(omx_encoder));
 	memset(encoder, 0, sizeof(omx_encoder));
@@ -88,6 +105,8 @@ static void create_h264_encoder(void *obj, ENCODER_T **out_encoder) {
 	encoder->release = release;
 	encoder->init = init;
 	encoder->add_frame = add_frame;
+	encoder->reconfigure = reconfigure;
+	encoder->request_keyframe = request_keyframe;
 	encoder->user_data = encoder;
 	((omx_encoder*)encoder)->codec = "dummy.h264";
 
@@ -104,9 +123,11 @@ static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id)
 }
 
 static void init_options(void *user_data, json_t *options) {
+	lg_intra_refresh_mbs = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".intra_refresh_mbs"));
 }
 
 static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".intra_refresh_mbs", json_real(lg_intra_refresh_mbs));
 }
 
 void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
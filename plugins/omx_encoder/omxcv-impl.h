@@ -66,10 +66,13 @@ enum CODEC_TYPE {
  */
 class OmxCvImpl {
 public:
-	OmxCvImpl(const char *name, int width, int height, int bitrate, int fpsnum = -1, int fpsden = -1, OMXCV_CALLBACK callback = NULL, void *user_data = NULL);
+	OmxCvImpl(const char *name, int width, int height, int bitrate, int fpsnum = -1, int fpsden = -1, OMXCV_CALLBACK callback = NULL, void *user_data = NULL,
+			int intra_refresh_mbs = 0);
 	virtual ~OmxCvImpl();
 
 	bool process(const unsigned char *in_data, void *frame_data);
+	bool set_bitrate(int bitrate);
+	bool request_keyframe();
 
 private:
 	int m_width, m_height, m_stride, m_bitrate, m_fpsnum, m_fpsden;
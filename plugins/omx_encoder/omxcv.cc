@@ -77,8 +77,10 @@ void OmxCvImpl::my_fill_buffer_done(void* data, COMPONENT_T* comp) {
  * @param [in] bitrate The bitrate, in Kbps.
  * @param [in] fpsnum The FPS numerator.
  * @param [in] fpsden The FPS denominator.
+ * @param [in] intra_refresh_mbs Macroblocks refreshed per frame, 0 for IDR only.
  */
-OmxCvImpl::OmxCvImpl(const char *name, int width, int height, int bitrate, int fpsnum, int fpsden, OMXCV_CALLBACK callback, void *user_data) :
+OmxCvImpl::OmxCvImpl(const char *name, int width, int height, int bitrate, int fpsnum, int fpsden, OMXCV_CALLBACK callback, void *user_data,
+		int intra_refresh_mbs) :
 		m_width(width), m_height(height), m_stride(((width + 31) & ~31) * 3), m_bitrate(bitrate), m_filename(name), m_stop { false }, m_callback(callback), m_user_data(user_data) {
 	int ret;
 	bcm_host_init();
@@ -182,6 +184,20 @@ OmxCvImpl::OmxCvImpl(const char *name, int width, int height, int bitrate, int f
 		ret = OMX_SetParameter(ILC_GET_HANDLE(m_encoder_component), OMX_IndexParamVideoProfileLevelCurrent, &profileLevel);
 		CHECKED(ret != 0, "OMX_SetParameter failed for setting avc profile & level.");
 
+		if (intra_refresh_mbs > 0) {
+			//Cyclic intra refresh spreads the cost of an IDR over frames.
+			OMX_VIDEO_PARAM_INTRAREFRESHTYPE intra_refresh = { };
+			intra_refresh.nSize = sizeof(OMX_VIDEO_PARAM_INTRAREFRESHTYPE);
+			intra_refresh.nVersion.nVersion = OMX_VERSION;
+			intra_refresh.nPortIndex = OMX_ENCODE_PORT_OUT;
+			intra_refresh.eRefreshMode = OMX_VIDEO_IntraRefreshCyclic;
+			intra_refresh.nCirMBs = intra_refresh_mbs;
+			ret = OMX_SetParameter(ILC_GET_HANDLE(m_encoder_component), OMX_IndexParamVideoIntraRefresh, &intra_refresh);
+			if (ret != OMX_ErrorNone) {
+				printf("OMX_SetParameter failed for setting intra refresh.\n");
+			}
+		}
+
 //		//I think this decreases the chance of NALUs being split across buffers.
 //		OMX_CONFIG_BOOLEANTYPE frg = { };
 //		frg.nSize = sizeof(OMX_CONFIG_BOOLEANTYPE);
@@ -447,6 +463,50 @@ bool OmxCvImpl::process(const unsigned char *in_data, void *frame_data) {
 	return true;
 }
 
+/**
+ * Changes the target bitrate of a running H.264 encoder.
+ * @param [in] bitrate The bitrate, in Kbps.
+ * @return true iff the bitrate was changed.
+ */
+bool OmxCvImpl::set_bitrate(int bitrate) {
+	if (m_codec_type != H264) {
+		return false;
+	}
+	OMX_VIDEO_CONFIG_BITRATETYPE bitrate_type = { };
+	bitrate_type.nSize = sizeof(OMX_VIDEO_CONFIG_BITRATETYPE);
+	bitrate_type.nVersion.nVersion = OMX_VERSION;
+	bitrate_type.nPortIndex = OMX_ENCODE_PORT_OUT;
+	bitrate_type.nEncodeBitrate = bitrate * 1000;
+	int ret = OMX_SetConfig(ILC_GET_HANDLE(m_encoder_component), OMX_IndexConfigVideoBitrate, &bitrate_type);
+	if (ret != OMX_ErrorNone) {
+		printf("OMX_SetConfig failed for setting encoder bitrate.\n");
+		return false;
+	}
+	m_bitrate = bitrate;
+	return true;
+}
+
+/**
+ * Makes the next frame an IDR frame.
+ * @return true iff the request was accepted.
+ */
+bool OmxCvImpl::request_keyframe() {
+	if (m_codec_type != H264) {
+		return false;
+	}
+	OMX_CONFIG_PORTBOOLEANTYPE request = { };
+	request.nSize = sizeof(OMX_CONFIG_PORTBOOLEANTYPE);
+	request.nVersion.nVersion = OMX_VERSION;
+	request.nPortIndex = OMX_ENCODE_PORT_OUT;
+	request.bEnabled = OMX_TRUE;
+	int ret = OMX_SetConfig(ILC_GET_HANDLE(m_encoder_component), OMX_IndexConfigBrcmVideoRequestIFrame, &request);
+	if (ret != OMX_ErrorNone) {
+		printf("OMX_SetConfig failed for requesting i frame.\n");
+		return false;
+	}
+	return true;
+}
+
 /**
  * Constructor for our wrapper.
  * @param [in] name The file to save to.
@@ -455,9 +515,10 @@ bool OmxCvImpl::process(const unsigned char *in_data, void *frame_data) {
  * @param [in] bitrate The bitrate, in Kbps.
  * @param [in] fpsnum The FPS numerator.
  * @param [in] fpsden The FPS denominator.
+ * @param [in] intra_refresh_mbs Macroblocks refreshed per frame, 0 for IDR only.
  */
-OmxCv::OmxCv(const char *name, int width, int height, int bitrate, int fpsnum, int fpsden, OMXCV_CALLBACK callback, void *user_data) {
-	m_impl = new OmxCvImpl(name, width, height, bitrate, fpsnum, fpsden, callback, user_data);
+OmxCv::OmxCv(const char *name, int width, int height, int bitrate, int fpsnum, int fpsden, OMXCV_CALLBACK callback, void *user_data, int intra_refresh_mbs) {
+	m_impl = new OmxCvImpl(name, width, height, bitrate, fpsnum, fpsden, callback, user_data, intra_refresh_mbs);
 }
 
 /**
@@ -475,3 +536,20 @@ OmxCv::~OmxCv() {
 bool OmxCv::Encode(const unsigned char *in_data, void *frame_data) {
 	return m_impl->process(in_data, frame_data);
 }
+
+/**
+ * Change bitrate without restarting the stream.
+ * @param [in] bitrate The bitrate, in Kbps.
+ * @return true iff the bitrate was changed.
+ */
+bool OmxCv::SetBitrate(int bitrate) {
+	return m_impl->set_bitrate(bitrate);
+}
+
+/**
+ * Encode next image as IDR.
+ * @return true iff the request was accepted.
+ */
+bool OmxCv::RequestKeyframe() {
+	return m_impl->request_keyframe();
+}
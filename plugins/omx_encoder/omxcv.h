@@ -22,8 +22,10 @@ namespace omxcv {
      */
     class OmxCv {
         public:
-            OmxCv(const char *name, int width, int height, int bitrate=3000, int fpsnum=25, int fpsden=1, OMXCV_CALLBACK callback=NULL, void *user_data=NULL);
+            OmxCv(const char *name, int width, int height, int bitrate=3000, int fpsnum=25, int fpsden=1, OMXCV_CALLBACK callback=NULL, void *user_data=NULL, int intra_refresh_mbs=0);
             bool Encode(const unsigned char *in_data, void *frame_data);
+            bool SetBitrate(int bitrate);
+            bool RequestKeyframe();
             virtual ~OmxCv();
         private:
             OmxCvImpl *m_impl;
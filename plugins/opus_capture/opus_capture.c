@@ -13,6 +13,7 @@
 #endif
 
 #include "opus_capture.h"
+#include "stream_framer.h"
 
 #define PT_AUDIO_BASE 120
 
@@ -39,96 +40,60 @@ typedef struct _opus_capture {
 	void *user_data;
 } opus_capture;
 
+typedef struct _OGG_PAGE_CONTEXT {
+	unsigned int header_len;
+	unsigned int comment_len;
+	unsigned char *header_buffer;
+	unsigned char *comment_buffer;
+} OGG_PAGE_CONTEXT;
+
+static void ogg_page_callback(unsigned char *frame_buffer, unsigned int frame_len, void *user_data) {
+	OGG_PAGE_CONTEXT *ctx = (OGG_PAGE_CONTEXT*) user_data;
+	const int SEGMENT_TABLE_HEAD = 28; //after page header with one segment
+	if (frame_len < SEGMENT_TABLE_HEAD + 8) { // avoid garbage data
+		return;
+	}
+	if (ctx->header_buffer == NULL && strncmp((char*) frame_buffer + SEGMENT_TABLE_HEAD, "OpusHead", strlen("OpusHead")) == 0) {
+		printf("OpusHead found\n");
+		ctx->header_len = frame_len;
+		ctx->header_buffer = malloc(ctx->header_len);
+		memcpy(ctx->header_buffer, frame_buffer, ctx->header_len);
+	} else if (ctx->comment_buffer == NULL && strncmp((char*) frame_buffer + SEGMENT_TABLE_HEAD, "OpusTags", strlen("OpusTags")) == 0) {
+		printf("OpusTags found\n");
+		ctx->comment_len = frame_len;
+		ctx->comment_buffer = malloc(ctx->comment_len);
+		memcpy(ctx->comment_buffer, frame_buffer, ctx->comment_len);
+	} else if (ctx->header_buffer && ctx->comment_buffer) {
+		rtp_sendpacket(lg_plugin_host->get_rtp(), ctx->header_buffer, ctx->header_len, PT_AUDIO_BASE + 0);
+		rtp_sendpacket(lg_plugin_host->get_rtp(), ctx->comment_buffer, ctx->comment_len, PT_AUDIO_BASE + 0);
+		rtp_sendpacket(lg_plugin_host->get_rtp(), frame_buffer, frame_len, PT_AUDIO_BASE + 0);
+		rtp_flush(lg_plugin_host->get_rtp());
+	}
+}
+
 static void *pout_thread_func(void* arg) {
-	const char sc[5] = { 'O', 'g', 'g', 'S', '\0' };
-	int marker = 0;
-	unsigned int data_len = 0;
+	const unsigned char sc[4] = { 'O', 'g', 'g', 'S' };
+	int data_len = 0;
 	unsigned int buff_size = 64 * 1024;
-	int frame_buffer_cur = 0;
-	unsigned int frame_size = 64 * 1024;
-	unsigned int frame_len = 0;
-	unsigned char *frame_buffer = malloc(frame_size);
-	unsigned int data_cur = 0;
 	unsigned char *data = malloc(buff_size);
 	opus_capture *_this = (opus_capture*) arg;
 
-	unsigned int header_len = 0;
-	unsigned int comment_len = 0;
-	unsigned char *header_buffer = NULL;
-	unsigned char *comment_buffer = NULL;
-
+	OGG_PAGE_CONTEXT ctx = { };
+	STREAM_FRAMER_T framer;
+	stream_framer_init(&framer, sc, sizeof(sc), NULL, ogg_page_callback, &ctx);
 	while ((data_len = read(_this->pout_fd, data, buff_size)) > 0) {
 		//printf("%d ", data_len);
 #define OPUS_BOUNDARY
 #ifdef OPUS_BOUNDARY
-		data_cur = 0;
-		for (int i = 0; i < data_len; i++) {
-			if (marker == 0 && data[i] == 'O') {
-				marker++;
-			} else if (marker == 1 && data[i] == 'g') {
-				marker++;
-			} else if (marker == 2 && data[i] == 'g') {
-				marker++;
-			} else if (marker == 3 && data[i] == 'S') {
-				if (frame_len != 0) { // avoid garbage data
-					int len = (i + 1) - 4 - data_cur;
-					if (len > 0) {
-						if (frame_len + len > frame_size) { // resize buffer
-							char *new_buff;
-							frame_size += len;
-							new_buff = malloc(frame_size);
-							memcpy(new_buff, frame_buffer, frame_len);
-							free(frame_buffer);
-							frame_buffer = new_buff;
-						}
-						memcpy(frame_buffer + frame_len, data + data_cur, len);
-					}
-					frame_len += len;
-					memcpy(frame_buffer, sc, 4); //start code
-					if (header_buffer == NULL && strncmp(frame_buffer + 28, "OpusHead", strlen("OpusHead")) == 0) {
-						printf("OpusHead found\n", data_len);
-						header_len = frame_len;
-						header_buffer = malloc(header_len);
-						memcpy(header_buffer, frame_buffer, header_len);
-					} else if (comment_buffer == NULL && strncmp(frame_buffer + 28, "OpusTags", strlen("OpusTags")) == 0) {
-						printf("OpusTags found\n", data_len);
-						comment_len = frame_len;
-						comment_buffer = malloc(comment_len);
-						memcpy(comment_buffer, frame_buffer, comment_len);
-					}else if (header_buffer && comment_buffer){
-						rtp_sendpacket(lg_plugin_host->get_rtp(), header_buffer, header_len, PT_AUDIO_BASE + 0);
-						rtp_sendpacket(lg_plugin_host->get_rtp(), comment_buffer, comment_len, PT_AUDIO_BASE + 0);
-						rtp_sendpacket(lg_plugin_host->get_rtp(), frame_buffer, frame_len, PT_AUDIO_BASE + 0);
-						rtp_flush(lg_plugin_host->get_rtp());
-					}
-				}
-
-				frame_len = 4;
-				data_cur = i + 1;
-				marker = 0;
-			} else {
-				marker = 0;
-			}
-		}
-		if (frame_len != 0) { // avoid garbage data
-			int len = data_len - data_cur;
-			if (len > 0) {
-				if (frame_len + len > frame_size) { // resize buffer
-					char *new_buff;
-					frame_size += len;
-					new_buff = malloc(frame_size);
-					memcpy(new_buff, frame_buffer, frame_len);
-					free(frame_buffer);
-					frame_buffer = new_buff;
-				}
-				memcpy(frame_buffer + frame_len, data + data_cur, len);
-			}
-			frame_len += len;
-		}
+		stream_framer_push(&framer, data, data_len);
 #else
 		rtp_sendpacket(lg_plugin_host->get_rtp(), data, data_len, PT_AUDIO_BASE + 0);
 #endif
 	}
+	stream_framer_deinit(&framer);
+	free(ctx.header_buffer);
+	free(ctx.comment_buffer);
+	free(data);
 	return NULL;
 }
 
@@ -0,0 +1,217 @@
+#define _GNU_SOURCE //pthread_setname_np
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include <jpeglib.h>
+
+#include "synthetic_capture.h"
+
+#define PLUGIN_NAME "synthetic_capture"
+#define CAPTURE_NAME "synthetic_capture"
+
+#define CYCLE_FRAMES 60 //pre-encoded frames, replayed in loop
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+static int lg_width = 1024;
+static int lg_height = 512;
+static float lg_fps = 30;
+static int lg_quality = 75;
+
+typedef struct _synthetic_capture {
+	CAPTURE_T super;
+
+	int cam_num;
+	bool run;
+	pthread_t thread;
+
+	unsigned char *jpegs[CYCLE_FRAMES];
+	unsigned long jpeg_lens[CYCLE_FRAMES];
+
+	int framecount;
+	float fps;
+} synthetic_capture;
+
+//gradient with a vertical bar moving by frame, so that frames differ like a camera
+static unsigned long encode_frame(int index, int cam_num, unsigned char **out) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	*out = NULL;
+	unsigned long out_len = 0;
+	jpeg_mem_dest(&cinfo, out, &out_len);
+	cinfo.image_width = lg_width;
+	cinfo.image_height = lg_height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, lg_quality, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+
+	unsigned char *row = (unsigned char*) malloc(lg_width * 3);
+	int bar_x = index * lg_width / CYCLE_FRAMES;
+	int bar_w = lg_width / 32 + 1;
+	while (cinfo.next_scanline < cinfo.image_height) {
+		int y = cinfo.next_scanline;
+		for (int x = 0; x < lg_width; x++) {
+			bool bar = (x >= bar_x && x < bar_x + bar_w);
+			row[x * 3 + 0] = bar ? 255 : x * 255 / lg_width;
+			row[x * 3 + 1] = bar ? 255 : y * 255 / lg_height;
+			row[x * 3 + 2] = bar ? 255 : (cam_num ? 192 : 64);
+		}
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	free(row);
+
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	return out_len;
+}
+
+static void *capture_thread_func(void *arg) {
+	synthetic_capture *_this = (synthetic_capture*) arg;
+	pthread_setname_np(pthread_self(), "SYNTHETIC");
+
+	for (int i = 0; i < CYCLE_FRAMES; i++) {
+		_this->jpeg_lens[i] = encode_frame(i, _this->cam_num, &_this->jpegs[i]);
+	}
+	printf("synthetic_capture : cam%d %dx%d %.1f fps, %lu bytes per frame\n", _this->cam_num, lg_width, lg_height, lg_fps, _this->jpeg_lens[0]);
+
+	long interval_ns = (long) (1000000000.0 / lg_fps);
+	struct timespec next;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	struct timespec last_time = next;
+	int last_framecount = 0;
+	while (_this->run) {
+		int index = _this->framecount % CYCLE_FRAMES;
+		lg_plugin_host->decode_video(_this->cam_num, _this->jpegs[index], _this->jpeg_lens[index]);
+		_this->framecount++;
+
+		//absolute deadline, a late frame does not shift the following ones
+		next.tv_nsec += interval_ns;
+		next.tv_sec += next.tv_nsec / 1000000000L;
+		next.tv_nsec %= 1000000000L;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		{ //fps
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			float diff_sec = (now.tv_sec - last_time.tv_sec) + (now.tv_nsec - last_time.tv_nsec) / 1000000000.0;
+			if (diff_sec > 1.0) {
+				_this->fps = (_this->framecount - last_framecount) / diff_sec;
+				last_framecount = _this->framecount;
+				last_time = now;
+			}
+		}
+	}
+	return NULL;
+}
+
+static void release(void *obj) {
+	synthetic_capture *_this = (synthetic_capture*) obj;
+	if (_this->run) {
+		_this->run = false;
+		pthread_join(_this->thread, NULL);
+	}
+	for (int i = 0; i < CYCLE_FRAMES; i++) {
+		free(_this->jpegs[i]);
+	}
+	free(obj);
+}
+
+static void start(void *obj, int cam_num, void *display, void *context, void *cam_texture, int n_buffers) {
+	synthetic_capture *_this = (synthetic_capture*) obj;
+
+	_this->cam_num = cam_num;
+	_this->run = true;
+	pthread_create(&_this->thread, NULL, capture_thread_func, (void*) _this);
+}
+
+static float get_fps(void *obj) {
+	synthetic_capture *_this = (synthetic_capture*) obj;
+	return _this->fps;
+}
+
+static void create_capture(void *user_data, CAPTURE_T **out_capture) {
+	CAPTURE_T *capture = (CAPTURE_T*) malloc(sizeof(synthetic_capture));
+	memset(capture, 0, sizeof(synthetic_capture));
+	strcpy(capture->name, CAPTURE_NAME);
+	capture->release = release;
+	capture->start = start;
+	capture->get_fps = get_fps;
+	capture->user_data = capture;
+
+	if (out_capture) {
+		*out_capture = capture;
+	}
+}
+
+static void release_plugin(void *obj) {
+	free(obj);
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+	json_t *value;
+	if ((value = json_object_get(options, PLUGIN_NAME ".width")) != NULL) {
+		lg_width = (int) json_number_value(value);
+	}
+	if ((value = json_object_get(options, PLUGIN_NAME ".height")) != NULL) {
+		lg_height = (int) json_number_value(value);
+	}
+	if ((value = json_object_get(options, PLUGIN_NAME ".fps")) != NULL) {
+		lg_fps = json_number_value(value);
+	}
+	if ((value = json_object_get(options, PLUGIN_NAME ".quality")) != NULL) {
+		lg_quality = (int) json_number_value(value);
+	}
+	if (lg_fps <= 0) {
+		lg_fps = 30;
+	}
+}
+
+static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".width", json_real(lg_width));
+	json_object_set_new(options, PLUGIN_NAME ".height", json_real(lg_height));
+	json_object_set_new(options, PLUGIN_NAME ".fps", json_real(lg_fps));
+	json_object_set_new(options, PLUGIN_NAME ".quality", json_real(lg_quality));
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release_plugin;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	{
+		CAPTURE_FACTORY_T *capture_factory = (CAPTURE_FACTORY_T*) malloc(sizeof(CAPTURE_FACTORY_T));
+		memset(capture_factory, 0, sizeof(CAPTURE_FACTORY_T));
+		strcpy(capture_factory->name, CAPTURE_NAME);
+		capture_factory->release = release_plugin;
+		capture_factory->create_capture = create_capture;
+
+		lg_plugin_host->add_capture_factory(capture_factory);
+	}
+}
@@ -0,0 +1,625 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <sys/time.h>
+
+#include <jpeglib.h>
+
+#include "turbojpeg_encoder.h"
+
+#define PLUGIN_NAME "turbojpeg_encoder"
+#define MJPEG_ENCODER_NAME "turbojpeg_mjpeg"
+
+#define FRAME_QUEUE_SIZE 2
+#define MCU_HEIGHT 16 //4:2:0
+#define MCU_ROWS_PER_STRIP 8 //a strip ends on RST7, so strips are joined without renumbering markers
+#define MAX_THREADS 16
+#define STAT_INTERVAL 100
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+static PLUGIN_HOST_T *lg_plugin_host = NULL;
+
+//applied on next init
+static int lg_quality = 80;
+static int lg_min_quality = 30; //lower bound when following bitrate
+static int lg_threads = 0; //0 : number of cores
+static bool lg_bench_running = false;
+
+typedef struct _jpeg_error {
+	struct jpeg_error_mgr super;
+	jmp_buf jmp;
+} jpeg_error;
+
+typedef struct _strip {
+	int y;
+	int height;
+	unsigned char *buff; //reused across frames
+	unsigned long capacity;
+	unsigned long len; //0 : failed
+} strip;
+
+struct _turbojpeg_encoder;
+
+typedef struct _strip_worker {
+	struct _turbojpeg_encoder *encoder;
+	pthread_t thread;
+	struct jpeg_compress_struct cinfo; //reused across strips
+	jpeg_error jerr;
+} strip_worker;
+
+typedef struct _turbojpeg_encoder {
+	ENCODER_T super;
+
+	bool initialized;
+	int width;
+	int height;
+	int fps;
+	int kbps; //0 : fixed quality
+	int quality;
+	int frame_size; //rgb, host reads back frames as rgb
+
+	//copied in add_frame, encoded in encode_thread
+	unsigned char *frames[FRAME_QUEUE_SIZE];
+	void *frame_data[FRAME_QUEUE_SIZE];
+	int frame_queue_head;
+	int frame_queue_num;
+	pthread_mutex_t mutex;
+	pthread_cond_t frame_queue_cond;
+	bool run;
+	pthread_t encode_thread;
+
+	//strips of current frame are taken by workers
+	strip *strips;
+	int strip_num;
+	const unsigned char *job_frame; //NULL : no job
+	int job_quality;
+	int next_strip;
+	int done_strip_num;
+	pthread_cond_t job_cond;
+	bool workers_run;
+	strip_worker workers[MAX_THREADS];
+	int worker_num;
+
+	unsigned char *out_buff;
+	int out_buff_size;
+
+	int stat_frame_num;
+	double stat_elapsed_ms;
+	double stat_bytes;
+
+	ENCODER_STREAM_CALLBACK callback;
+	void *user_data;
+} turbojpeg_encoder;
+
+static void error_exit(j_common_ptr cinfo) {
+	jpeg_error *jerr = (jpeg_error*) cinfo->err;
+	char msg[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message)(cinfo, msg);
+	printf("%s : %s\n", PLUGIN_NAME, msg);
+	longjmp(jerr->jmp, 1);
+}
+
+static void encode_rgb_rows(turbojpeg_encoder *_this, struct jpeg_compress_struct *cinfo, const unsigned char *frame, strip *s) {
+	JSAMPROW rows[MCU_HEIGHT];
+	while (cinfo->next_scanline < cinfo->image_height) {
+		int num = MIN(MCU_HEIGHT, cinfo->image_height - cinfo->next_scanline);
+		for (int i = 0; i < num; i++) {
+			rows[i] = (JSAMPROW) frame + (size_t) (s->y + cinfo->next_scanline + i) * _this->width * 3;
+		}
+		jpeg_write_scanlines(cinfo, rows, num);
+	}
+}
+
+static void encode_strip(strip_worker *worker, strip *s, const unsigned char *frame, int quality) {
+	turbojpeg_encoder *_this = worker->encoder;
+	struct jpeg_compress_struct *cinfo = &worker->cinfo;
+
+	s->len = 0;
+	if (setjmp(worker->jerr.jmp)) {
+		jpeg_abort_compress(cinfo);
+		return;
+	}
+	unsigned char *out = s->buff;
+	unsigned long out_size = s->capacity;
+	jpeg_mem_dest(cinfo, &out, &out_size);
+
+	cinfo->image_width = _this->width;
+	cinfo->image_height = s->height;
+	cinfo->input_components = 3;
+	cinfo->in_color_space = JCS_RGB;
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, quality, TRUE);
+	cinfo->dct_method = JDCT_IFAST;
+	cinfo->restart_in_rows = 1; //same tables and intervals in every strip
+	jpeg_start_compress(cinfo, TRUE);
+	encode_rgb_rows(_this, cinfo, frame, s);
+	jpeg_finish_compress(cinfo);
+
+	if (out != s->buff) { //grown by libjpeg
+		free(s->buff);
+		s->buff = out;
+		s->capacity = out_size;
+	}
+	s->len = out_size;
+}
+
+static void *worker_thread_func(void *arg) {
+	strip_worker *worker = (strip_worker*) arg;
+	turbojpeg_encoder *_this = worker->encoder;
+	pthread_mutex_lock(&_this->mutex);
+	while (1) {
+		while (_this->workers_run && (_this->job_frame == NULL || _this->next_strip >= _this->strip_num)) {
+			pthread_cond_wait(&_this->job_cond, &_this->mutex);
+		}
+		if (!_this->workers_run) {
+			break;
+		}
+		int idx = _this->next_strip++;
+		const unsigned char *frame = _this->job_frame;
+		int quality = _this->job_quality;
+		pthread_mutex_unlock(&_this->mutex);
+
+		encode_strip(worker, &_this->strips[idx], frame, quality);
+
+		pthread_mutex_lock(&_this->mutex);
+		_this->done_strip_num++;
+		if (_this->done_strip_num == _this->strip_num) {
+			pthread_cond_broadcast(&_this->job_cond);
+		}
+	}
+	pthread_mutex_unlock(&_this->mutex);
+	return NULL;
+}
+
+//returns length up to the end of SOS segment, -1 : broken
+static int get_header_len(const unsigned char *data, int len, int *sof_pos) {
+	int pos = 2; //SOI
+	while (pos + 4 <= len) {
+		if (data[pos] != 0xFF) {
+			return -1;
+		}
+		int marker = data[pos + 1];
+		int seg_len = (data[pos + 2] << 8) | data[pos + 3];
+		if (marker == 0xC0 || marker == 0xC1) {
+			*sof_pos = pos;
+		}
+		pos += 2 + seg_len;
+		if (marker == 0xDA) {
+			return pos;
+		}
+	}
+	return -1;
+}
+
+//headers of the first strip with frame height, then scans of all strips joined with RST7
+static int join_strips(turbojpeg_encoder *_this) {
+	int total = 0;
+	for (int i = 0; i < _this->strip_num; i++) {
+		if (_this->strips[i].len == 0) {
+			return -1;
+		}
+		total += _this->strips[i].len + 2;
+	}
+	if (total > _this->out_buff_size) {
+		_this->out_buff_size = total;
+		_this->out_buff = realloc(_this->out_buff, _this->out_buff_size);
+	}
+	int pos = 0;
+	for (int i = 0; i < _this->strip_num; i++) {
+		strip *s = &_this->strips[i];
+		int sof_pos = -1;
+		int header_len = get_header_len(s->buff, s->len, &sof_pos);
+		if (header_len < 0 || sof_pos < 0) {
+			return -1;
+		}
+		if (i == 0) {
+			memcpy(_this->out_buff, s->buff, header_len);
+			_this->out_buff[sof_pos + 5] = (_this->height >> 8) & 0xFF;
+			_this->out_buff[sof_pos + 6] = (_this->height >> 0) & 0xFF;
+			pos = header_len;
+		} else {
+			_this->out_buff[pos++] = 0xFF;
+			_this->out_buff[pos++] = 0xD7; //RST7
+		}
+		int scan_len = s->len - header_len - 2; //EOI
+		memcpy(_this->out_buff + pos, s->buff + header_len, scan_len);
+		pos += scan_len;
+	}
+	_this->out_buff[pos++] = 0xFF;
+	_this->out_buff[pos++] = 0xD9; //EOI
+	return pos;
+}
+
+//quality follows bitrate a step per frame, mjpeg has no rate control of its own
+static void update_quality(turbojpeg_encoder *_this, int kbps, int fps, int len) {
+	if (kbps <= 0) {
+		return;
+	}
+	int target = kbps * 1000 / 8 / MAX(fps, 1);
+	if (len > target * 11 / 10 && _this->quality > lg_min_quality) {
+		_this->quality--;
+	} else if (len < target * 9 / 10 && _this->quality < lg_quality) {
+		_this->quality++;
+	}
+}
+
+static void *encode_thread_func(void *arg) {
+	turbojpeg_encoder *_this = (turbojpeg_encoder*) arg;
+	while (1) {
+		pthread_mutex_lock(&_this->mutex);
+		while (_this->run && _this->frame_queue_num == 0) {
+			pthread_cond_wait(&_this->frame_queue_cond, &_this->mutex);
+		}
+		if (_this->frame_queue_num == 0) { //queued frames are flushed before release
+			pthread_mutex_unlock(&_this->mutex);
+			break;
+		}
+		int idx = _this->frame_queue_head;
+		int kbps = _this->kbps;
+		int fps = _this->fps;
+
+		struct timeval s, f;
+		gettimeofday(&s, NULL);
+
+		_this->job_frame = _this->frames[idx];
+		_this->job_quality = _this->quality;
+		_this->next_strip = 0;
+		_this->done_strip_num = 0;
+		pthread_cond_broadcast(&_this->job_cond);
+		while (_this->done_strip_num < _this->strip_num) {
+			pthread_cond_wait(&_this->job_cond, &_this->mutex);
+		}
+		_this->job_frame = NULL;
+		void *frame_data = _this->frame_data[idx];
+		_this->frame_data[idx] = NULL;
+		pthread_mutex_unlock(&_this->mutex);
+
+		int len = join_strips(_this);
+
+		pthread_mutex_lock(&_this->mutex);
+		_this->frame_queue_head = (_this->frame_queue_head + 1) % FRAME_QUEUE_SIZE;
+		_this->frame_queue_num--;
+		pthread_cond_broadcast(&_this->frame_queue_cond);
+		pthread_mutex_unlock(&_this->mutex);
+
+		if (len < 0) {
+			printf("%s : encode failed\n", PLUGIN_NAME);
+			if (frame_data) {
+				free(frame_data);
+			}
+			continue;
+		}
+		update_quality(_this, kbps, fps, len);
+
+		gettimeofday(&f, NULL);
+		_this->stat_elapsed_ms += (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
+		_this->stat_bytes += len;
+		_this->stat_frame_num++;
+		if (_this->stat_frame_num == STAT_INTERVAL) {
+			printf("%s : %dx%d %.3f ms/frame %.1f kB/frame quality=%d strips=%d threads=%d\n", PLUGIN_NAME, _this->width, _this->height,
+					_this->stat_elapsed_ms / _this->stat_frame_num, _this->stat_bytes / _this->stat_frame_num / 1024, _this->quality, _this->strip_num,
+					_this->worker_num);
+			_this->stat_frame_num = 0;
+			_this->stat_elapsed_ms = 0;
+			_this->stat_bytes = 0;
+		}
+
+		_this->callback(_this->out_buff, len, frame_data, _this->user_data);
+	}
+	return NULL;
+}
+
+static int get_thread_num() {
+	int num = lg_threads;
+	if (num <= 0) {
+		num = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	return MAX(MIN(num, MAX_THREADS), 1);
+}
+
+static void start(turbojpeg_encoder *_this, const int width, const int height, int bitrate_kbps, int fps, int thread_num,
+		ENCODER_STREAM_CALLBACK callback, void *user_data) {
+	_this->callback = callback;
+	_this->user_data = user_data;
+	_this->width = width;
+	_this->height = height;
+	_this->fps = fps;
+	_this->kbps = bitrate_kbps;
+	_this->quality = lg_quality;
+	_this->frame_size = width * height * 3;
+
+	int strip_height = MCU_HEIGHT * MCU_ROWS_PER_STRIP;
+	_this->strip_num = (height + strip_height - 1) / strip_height;
+	_this->strips = (strip*) malloc(sizeof(strip) * _this->strip_num);
+	memset(_this->strips, 0, sizeof(strip) * _this->strip_num);
+	for (int i = 0; i < _this->strip_num; i++) {
+		strip *s = &_this->strips[i];
+		s->y = i * strip_height;
+		s->height = MIN(strip_height, height - s->y);
+		s->capacity = width * s->height * 3 / 2 + 4096; //enough for 4:2:0 at any quality
+		s->buff = (unsigned char*) malloc(s->capacity);
+	}
+	for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+		_this->frames[i] = (unsigned char*) malloc(_this->frame_size);
+	}
+
+	pthread_mutex_init(&_this->mutex, 0);
+	pthread_cond_init(&_this->frame_queue_cond, 0);
+	pthread_cond_init(&_this->job_cond, 0);
+	_this->run = true;
+	_this->workers_run = true;
+	_this->worker_num = MIN(thread_num, _this->strip_num);
+	for (int i = 0; i < _this->worker_num; i++) {
+		strip_worker *worker = &_this->workers[i];
+		worker->encoder = _this;
+		worker->cinfo.err = jpeg_std_error(&worker->jerr.super);
+		worker->jerr.super.error_exit = error_exit;
+		jpeg_create_compress(&worker->cinfo);
+		pthread_create(&worker->thread, NULL, worker_thread_func, (void*) worker);
+	}
+	pthread_create(&_this->encode_thread, NULL, encode_thread_func, (void*) _this);
+	_this->initialized = true;
+
+	printf("%s : %dx%d %dkbps %dfps quality=%d strips=%d threads=%d\n", PLUGIN_NAME, width, height, bitrate_kbps, fps, lg_quality,
+			_this->strip_num, _this->worker_num);
+}
+
+static void init(void *obj, const int width, const int height, int bitrate_kbps, int fps, ENCODER_STREAM_CALLBACK callback, void *user_data) {
+	start((turbojpeg_encoder*) obj, width, height, bitrate_kbps, fps, get_thread_num(), callback, user_data);
+}
+
+static void release(void *obj) {
+	turbojpeg_encoder *_this = (turbojpeg_encoder*) obj;
+	if (_this->initialized) {
+		pthread_mutex_lock(&_this->mutex);
+		_this->run = false;
+		pthread_cond_broadcast(&_this->frame_queue_cond);
+		pthread_mutex_unlock(&_this->mutex);
+		pthread_join(_this->encode_thread, NULL);
+
+		pthread_mutex_lock(&_this->mutex);
+		_this->workers_run = false;
+		pthread_cond_broadcast(&_this->job_cond);
+		pthread_mutex_unlock(&_this->mutex);
+		for (int i = 0; i < _this->worker_num; i++) {
+			pthread_join(_this->workers[i].thread, NULL);
+			jpeg_destroy_compress(&_this->workers[i].cinfo);
+		}
+
+		for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+			free(_this->frames[i]);
+		}
+		for (int i = 0; i < _this->strip_num; i++) {
+			free(_this->strips[i].buff);
+		}
+		free(_this->strips);
+		pthread_cond_destroy(&_this->job_cond);
+		pthread_cond_destroy(&_this->frame_queue_cond);
+		pthread_mutex_destroy(&_this->mutex);
+	}
+	if (_this->out_buff) {
+		free(_this->out_buff);
+	}
+	free(obj);
+}
+
+//frame_data is malloc'd by host and handed over to the callback
+static void add_frame(void *obj, const unsigned char *in_data, void *frame_data) {
+	turbojpeg_encoder *_this = (turbojpeg_encoder*) obj;
+	if (!_this->initialized) {
+		if (frame_data) {
+			free(frame_data);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&_this->mutex);
+	while (_this->frame_queue_num == FRAME_QUEUE_SIZE) { //back pressure to renderer
+		pthread_cond_wait(&_this->frame_queue_cond, &_this->mutex);
+	}
+	int idx = (_this->frame_queue_head + _this->frame_queue_num) % FRAME_QUEUE_SIZE;
+	pthread_mutex_unlock(&_this->mutex);
+
+	//only producer touches slots outside of the queue
+	memcpy(_this->frames[idx], in_data, _this->frame_size);
+	_this->frame_data[idx] = frame_data;
+
+	pthread_mutex_lock(&_this->mutex);
+	_this->frame_queue_num++;
+	pthread_cond_broadcast(&_this->frame_queue_cond);
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+static void reconfigure(void *obj, int bitrate_kbps, int fps) {
+	turbojpeg_encoder *_this = (turbojpeg_encoder*) obj;
+	if (!_this->initialized) {
+		return;
+	}
+	//fps is handled by host dropping frames, target bytes per frame follows both
+	pthread_mutex_lock(&_this->mutex);
+	_this->kbps = bitrate_kbps;
+	_this->fps = fps;
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+static void request_keyframe(void *obj) {
+	//every frame is a keyframe
+}
+
+static turbojpeg_encoder *new_encoder(const char *name) {
+	ENCODER_T *encoder = (ENCODER_T*) malloc(sizeof(turbojpeg_encoder));
+	memset(encoder, 0, sizeof(turbojpeg_encoder));
+	strcpy(encoder->name, name);
+	encoder->release = release;
+	encoder->init = init;
+	encoder->add_frame = add_frame;
+	encoder->reconfigure = reconfigure;
+	encoder->request_keyframe = request_keyframe;
+	encoder->user_data = encoder;
+	return (turbojpeg_encoder*) encoder;
+}
+
+static void create_encoder(void *user_data, ENCODER_T **output_encoder) {
+	ENCODER_FACTORY_T *encoder_factory = (ENCODER_FACTORY_T*) user_data;
+	ENCODER_T *encoder = (ENCODER_T*) new_encoder(encoder_factory->name);
+
+	if (output_encoder) {
+		*output_encoder = encoder;
+	}
+}
+
+static void bench_callback(unsigned char *data, unsigned int data_len, void *frame_data, void *user_data) {
+	*(double*) user_data += data_len;
+}
+
+typedef struct _bench_params {
+	int width;
+	int height;
+	int frame_num;
+} bench_params;
+
+//encodes a synthetic frame with one thread and with configured threads
+static void bench(int width, int height, int frame_num) {
+	int frame_size = width * height * 3;
+	unsigned char *frame = (unsigned char*) malloc(frame_size);
+	for (int i = 0; i < frame_size; i++) {
+		frame[i] = (i / 3 % width + i / (width * 3) + (rand() & 0x0F)) & 0xFF; //gradient with noise
+	}
+	int thread_nums[2] = { 1, get_thread_num() };
+	for (int i = 0; i < 2; i++) {
+		double bytes = 0;
+		struct timeval s, f;
+		turbojpeg_encoder *encoder = new_encoder(MJPEG_ENCODER_NAME);
+		start(encoder, width, height, 0, 30, thread_nums[i], bench_callback, &bytes);
+		gettimeofday(&s, NULL);
+		for (int j = 0; j < frame_num; j++) {
+			add_frame(encoder, frame, NULL);
+		}
+		release(encoder);
+		gettimeofday(&f, NULL);
+		double elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
+		printf("%s : bench %dx%d threads=%d %.3f ms/frame %.1f kB/frame\n", PLUGIN_NAME, width, height, thread_nums[i], elapsed_ms / frame_num,
+				bytes / frame_num / 1024);
+	}
+	free(frame);
+}
+
+//out of command handler, it is called on main loop
+static void *bench_thread_func(void *arg) {
+	bench_params *params = (bench_params*) arg;
+	bench(params->width, params->height, params->frame_num);
+	printf("%s : completed\n", PLUGIN_NAME ".bench");
+	free(params);
+	lg_bench_running = false;
+	return NULL;
+}
+
+static int command_handler(void *user_data, const char *_buff) {
+	char buff[256];
+	strncpy(buff, _buff, sizeof(buff));
+	char *cmd = strtok(buff, " \n");
+	if (cmd == NULL) {
+		//do nothing
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_quality", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			sscanf(param, "%d", &lg_quality);
+			lg_quality = MAX(MIN(lg_quality, 100), 1);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".set_threads", sizeof(buff)) == 0) {
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			sscanf(param, "%d", &lg_threads);
+			printf("%s : completed\n", cmd);
+		}
+	} else if (strncmp(cmd, PLUGIN_NAME ".bench", sizeof(buff)) == 0) {
+		int width = 3840, height = 2160, frame_num = 30;
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			sscanf(param, "%dx%d", &width, &height);
+			param = strtok(NULL, " \n");
+		}
+		if (param != NULL) {
+			sscanf(param, "%d", &frame_num);
+		}
+		if (lg_bench_running) {
+			printf("%s : already running\n", cmd);
+		} else if (width > 0 && height > 0 && frame_num > 0) {
+			bench_params *params = (bench_params*) malloc(sizeof(bench_params));
+			params->width = width;
+			params->height = height;
+			params->frame_num = frame_num;
+			pthread_t thread;
+			lg_bench_running = true;
+			pthread_create(&thread, NULL, bench_thread_func, (void*) params);
+			pthread_detach(thread);
+		}
+	}
+	return 0;
+}
+
+static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id) {
+}
+
+static void init_options(void *user_data, json_t *options) {
+	json_t *value;
+	value = json_object_get(options, PLUGIN_NAME ".quality");
+	if (value) {
+		lg_quality = MAX(MIN((int) json_number_value(value), 100), 1);
+	}
+	value = json_object_get(options, PLUGIN_NAME ".min_quality");
+	if (value) {
+		lg_min_quality = MAX(MIN((int) json_number_value(value), 100), 1);
+	}
+	lg_threads = (int) json_number_value(json_object_get(options, PLUGIN_NAME ".threads"));
+}
+
+static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".quality", json_real(lg_quality));
+	json_object_set_new(options, PLUGIN_NAME ".min_quality", json_real(lg_min_quality));
+	json_object_set_new(options, PLUGIN_NAME ".threads", json_real(lg_threads));
+}
+
+static void release_plugin(void *user_data) {
+	free(user_data);
+}
+
+void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
+	lg_plugin_host = plugin_host;
+
+	{
+		PLUGIN_T *plugin = (PLUGIN_T*) malloc(sizeof(PLUGIN_T));
+		memset(plugin, 0, sizeof(PLUGIN_T));
+		strcpy(plugin->name, PLUGIN_NAME);
+		plugin->release = release_plugin;
+		plugin->command_handler = command_handler;
+		plugin->event_handler = event_handler;
+		plugin->init_options = init_options;
+		plugin->save_options = save_options;
+		plugin->get_info = NULL;
+		plugin->user_data = plugin;
+
+		*_plugin = plugin;
+	}
+	{
+		ENCODER_FACTORY_T *encoder_factory = (ENCODER_FACTORY_T*) malloc(sizeof(ENCODER_FACTORY_T));
+		memset(encoder_factory, 0, sizeof(ENCODER_FACTORY_T));
+		strcpy(encoder_factory->name, MJPEG_ENCODER_NAME);
+		encoder_factory->release = release_plugin;
+		encoder_factory->create_encoder = create_encoder;
+		encoder_factory->user_data = encoder_factory;
+
+		lg_plugin_host->add_encoder_factory(encoder_factory);
+	}
+}
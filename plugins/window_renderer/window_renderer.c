@@ -36,11 +36,16 @@
 
 static PLUGIN_HOST_T *lg_plugin_host = NULL;
 
+//window ignored overlap until USE_OVERLAP was shared with equirectangular, so it is opt-in here
+static bool lg_overlap = false;
+
 typedef struct _window_renderer {
 	RENDERER_T super;
 
 	int num_of_cam;
-	void *program_obj;
+	char *common; //preamble of host, any length
+	void *program_objs[RENDERER_OPTION_MAX]; //variants compiled on demand
+	void *program_obj; //current variant
 	GLuint vbo;
 	GLuint vbo_nop;
 	GLuint vao;
@@ -123,34 +128,43 @@ int spherewindow_mesh(float theta_degree, int phi_degree, int num_of_steps, GLui
 	return 0;
 }
 
+static void *create_program(window_renderer *_this, uint32_t options) {
+	char common[strlen(_this->common) + 128]; //defines below are short
+	snprintf(common, sizeof(common), "%s#define NUM_OF_CAM %d\n%s%s", _this->common, _this->num_of_cam, //
+			(lg_overlap && (options & RENDERER_OPTION_OVERLAP)) ? "#define USE_OVERLAP\n" : "", //
+			(options & RENDERER_OPTION_COLOR_OFFSET) ? "#define USE_COLOR_OFFSET\n" : "");
+
+	void *program_obj;
+	program_obj = GLProgram_new_from_memory(common, (const char*) window_vsh, window_vsh_len, (const char*) window_fsh, window_fsh_len);
+
+	return program_obj;
+}
+
 static void init(void *obj, const char *common, int num_of_cam) {
 	window_renderer *_this = (window_renderer*) obj;
 
 	_this->num_of_cam = num_of_cam;
+	_this->common = strdup(common);
 
 	float maxfov = 150.0;
 	spherewindow_mesh(maxfov, maxfov, 64, &_this->vbo, &_this->vbo_nop, &_this->vao);
-	{
-		const char *fsh_filepath = "/tmp/tmp.fsh";
-		const char *vsh_filepath = "/tmp/tmp.vsh";
-		int fsh_fd = open(fsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		int vsh_fd = open(vsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fsh_fd, window_fsh, window_fsh_len);
-		write(vsh_fd, window_vsh, window_vsh_len);
-		close(fsh_fd);
-		close(vsh_fd);
-		_this->program_obj = GLProgram_new(common, vsh_filepath, fsh_filepath, true);
-		remove(fsh_filepath);
-		remove(vsh_filepath);
-	}
+
+	_this->program_objs[RENDERER_OPTION_NONE] = create_program(_this, RENDERER_OPTION_NONE);
+	_this->program_obj = _this->program_objs[RENDERER_OPTION_NONE];
 }
 static void release(void *obj) {
 	window_renderer *_this = (window_renderer*) obj;
 	int status;
+	free(_this->common);
 	free(obj);
 }
-static int get_program(void *obj) {
+static int get_program(void *obj, uint32_t options) {
 	window_renderer *_this = (window_renderer*) obj;
+	options &= (RENDERER_OPTION_MAX - 1);
+	if (_this->program_objs[options] == NULL) {
+		_this->program_objs[options] = create_program(_this, options);
+	}
+	_this->program_obj = _this->program_objs[options];
 	return GLProgram_GetId(_this->program_obj);
 }
 static void render(void *obj, float fov) {
@@ -206,9 +220,14 @@ static void event_handler(void *user_data, uint32_t node_id, uint32_t event_id)
 }
 
 static void init_options(void *user_data, json_t *options) {
+	json_t *value = json_object_get(options, PLUGIN_NAME ".overlap");
+	if (value) {
+		lg_overlap = json_is_true(value);
+	}
 }
 
 static void save_options(void *user_data, json_t *options) {
+	json_object_set_new(options, PLUGIN_NAME ".overlap", json_boolean(lg_overlap));
 }
 
 void create_plugin(PLUGIN_HOST_T *plugin_host, PLUGIN_T **_plugin) {
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE //O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#include "async_writer.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+static int write_all(int fd, struct iovec *iov, int iovcnt) {
+	int total = 0;
+	while (iovcnt > 0) {
+		ssize_t res = writev(fd, iov, iovcnt);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		total += res;
+		for (; iovcnt > 0 && res >= iov->iov_len; iov++, iovcnt--) {
+			res -= iov->iov_len;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (unsigned char*) iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+	return total;
+}
+
+//write len bytes from tail, called with mutex locked
+static void write_pending(ASYNC_WRITER_T *_this, int len, uint64_t *last_sync) {
+	if (_this->fd < 0) {
+		_this->tail += len;
+		_this->stats.dropped_bytes += len;
+		return;
+	}
+	int off = _this->tail % _this->buff_size;
+	struct iovec iov[2];
+	int iovcnt = 1;
+	iov[0].iov_base = _this->buff + off;
+	iov[0].iov_len = MIN(len, _this->buff_size - off);
+	if (iov[0].iov_len < len) { //wrapped
+		iov[1].iov_base = _this->buff;
+		iov[1].iov_len = len - iov[0].iov_len;
+		iovcnt = 2;
+	}
+	//O_DIRECT leaves less than a block until more data
+	uint64_t unwritable = _this->direct ? ASYNC_WRITER_ALIGN - 1 : 0;
+	bool sync = (_this->sync_head > *last_sync && _this->tail + len + unwritable >= _this->sync_head);
+	pthread_mutex_unlock(&_this->mutex);
+
+	struct timeval s, f;
+	gettimeofday(&s, NULL);
+	int res = write_all(_this->fd, iov, iovcnt);
+	if (res < 0 && _this->stats.written_bytes == 0 && _this->stats.dropped_bytes == 0) {
+		printf("async_writer : write error %s : %s\n", _this->path, strerror(errno));
+	}
+	if (_this->sync_size > 0 && _this->tail + len - *last_sync >= _this->sync_size) {
+		sync = true;
+	}
+	if (res > 0 && sync) {
+		fdatasync(_this->fd); //this avoid that file size would be zero after os crash
+		*last_sync = _this->tail + len;
+	}
+	gettimeofday(&f, NULL);
+	float elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
+
+	pthread_mutex_lock(&_this->mutex);
+	_this->tail += len;
+	if (res < 0) {
+		_this->stats.dropped_bytes += len;
+	} else {
+		_this->stats.written_bytes += len;
+	}
+	if (elapsed_ms > ASYNC_WRITER_STALL_MS && !sync) {
+		_this->stats.stalls++;
+	}
+	_this->stats.max_write_ms = MAX(_this->stats.max_write_ms, elapsed_ms);
+}
+
+static int open_file(const char *path, bool *direct) {
+	int flags = O_CREAT | O_WRONLY | O_TRUNC;
+	mode_t mode = S_IRUSR | S_IWUSR | /* rw */
+	S_IRGRP | S_IWGRP | /* rw */
+	S_IROTH | S_IXOTH;
+	int fd = -1;
+	if (*direct) {
+		fd = open(path, flags | O_DIRECT, mode);
+		if (fd < 0) { //filesystem without O_DIRECT
+			*direct = false;
+		}
+	}
+	if (fd < 0) {
+		fd = open(path, flags, mode);
+	}
+	return fd;
+}
+
+static void *writer_thread_func(void *arg) {
+	ASYNC_WRITER_T *_this = (ASYNC_WRITER_T*) arg;
+	pthread_setname_np(pthread_self(), "ASYNC WRITER");
+
+	bool direct = _this->direct;
+	int fd = open_file(_this->path, &direct);
+	if (fd < 0) {
+		printf("async_writer : failed to open %s : %s\n", _this->path, strerror(errno));
+	}
+
+	uint64_t last_sync = 0;
+	pthread_mutex_lock(&_this->mutex);
+	_this->fd = fd;
+	_this->direct = direct;
+	_this->stats.open_failed = (fd < 0);
+	for (;;) {
+		bool flush = (_this->sync_head > _this->tail && (!_this->direct || _this->head - _this->tail >= ASYNC_WRITER_ALIGN));
+		if (!_this->closing && !flush && _this->head - _this->tail < ASYNC_WRITER_CHUNK) { //coalesce small writes
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += ASYNC_WRITER_FLUSH_MS * 1000000L;
+			ts.tv_sec += ts.tv_nsec / 1000000000L;
+			ts.tv_nsec %= 1000000000L;
+			pthread_cond_timedwait(&_this->cond, &_this->mutex, &ts);
+		}
+		int len = MIN(_this->head - _this->tail, ASYNC_WRITER_MAX_WRITE);
+		if (_this->direct) { //whole blocks only, the rest waits for more data or close
+			len &= ~(ASYNC_WRITER_ALIGN - 1);
+		}
+		if (len == 0) {
+			if (_this->closing) {
+				break;
+			}
+			continue;
+		}
+		write_pending(_this, len, &last_sync);
+	}
+	if (_this->head != _this->tail) { //unaligned tail of O_DIRECT file
+		if (_this->fd >= 0) {
+			fcntl(_this->fd, F_SETFL, fcntl(_this->fd, F_GETFL) & ~O_DIRECT);
+		}
+		write_pending(_this, _this->head - _this->tail, &last_sync);
+	}
+	pthread_mutex_unlock(&_this->mutex);
+
+	if (_this->fd >= 0) {
+		fdatasync(_this->fd);
+		close(_this->fd);
+	}
+	printf("async_writer : %s closed, written %.1f MB, dropped %llu bytes, stalls %u, max write %.1f ms\n", _this->path,
+			_this->stats.written_bytes / (1024.0 * 1024.0), (unsigned long long) _this->stats.dropped_bytes, _this->stats.stalls,
+			_this->stats.max_write_ms);
+
+	pthread_cond_destroy(&_this->cond);
+	pthread_mutex_destroy(&_this->mutex);
+	free(_this->buff);
+	free(_this);
+	return NULL;
+}
+
+ASYNC_WRITER_T *async_writer_open(const char *path, int buff_size, uint64_t sync_size, bool direct) {
+	ASYNC_WRITER_T *_this = (ASYNC_WRITER_T*) malloc(sizeof(ASYNC_WRITER_T));
+	memset(_this, 0, sizeof(ASYNC_WRITER_T));
+	strncpy(_this->path, path, sizeof(_this->path) - 1);
+	_this->fd = -1;
+	_this->direct = direct;
+	_this->sync_size = sync_size;
+	_this->buff_size = (MAX(buff_size, ASYNC_WRITER_ALIGN) + ASYNC_WRITER_ALIGN - 1) & ~(ASYNC_WRITER_ALIGN - 1);
+	if (posix_memalign((void**) &_this->buff, ASYNC_WRITER_ALIGN, _this->buff_size) != 0) {
+		printf("async_writer : no memory for %s\n", path);
+		free(_this);
+		return NULL;
+	}
+	pthread_mutex_init(&_this->mutex, 0);
+	pthread_cond_init(&_this->cond, 0);
+	if (pthread_create(&_this->thread, NULL, writer_thread_func, (void*) _this) != 0) {
+		printf("async_writer : failed to start thread for %s\n", path);
+		pthread_cond_destroy(&_this->cond);
+		pthread_mutex_destroy(&_this->mutex);
+		free(_this->buff);
+		free(_this);
+		return NULL;
+	}
+	pthread_detach(_this->thread);
+	return _this;
+}
+
+void async_writer_close(ASYNC_WRITER_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	_this->closing = true;
+	pthread_cond_signal(&_this->cond);
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+bool async_writer_write(ASYNC_WRITER_T *_this, const void *data, int data_len) {
+	struct iovec iov = { (void*) data, data_len };
+	return async_writer_writev(_this, &iov, 1);
+}
+
+bool async_writer_writev(ASYNC_WRITER_T *_this, const struct iovec *iov, int iovcnt) {
+	int len = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+	pthread_mutex_lock(&_this->mutex);
+	if (_this->closing || _this->stats.open_failed || _this->head - _this->tail + len > _this->buff_size) {
+		_this->stats.dropped_bytes += len;
+		_this->stats.dropped_writes++;
+		pthread_mutex_unlock(&_this->mutex);
+		return false;
+	}
+	for (int i = 0; i < iovcnt; i++) {
+		const unsigned char *data = (const unsigned char*) iov[i].iov_base;
+		int data_len = iov[i].iov_len;
+		while (data_len > 0) {
+			int off = _this->head % _this->buff_size;
+			int copy_len = MIN(data_len, _this->buff_size - off);
+			memcpy(_this->buff + off, data, copy_len);
+			_this->head += copy_len;
+			data += copy_len;
+			data_len -= copy_len;
+		}
+	}
+	int pending = _this->head - _this->tail;
+	_this->stats.max_pending = MAX(_this->stats.max_pending, pending);
+	if (pending >= ASYNC_WRITER_CHUNK) {
+		pthread_cond_signal(&_this->cond);
+	}
+	pthread_mutex_unlock(&_this->mutex);
+	return true;
+}
+
+void async_writer_flush(ASYNC_WRITER_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	_this->sync_head = _this->head;
+	pthread_cond_signal(&_this->cond);
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+void async_writer_get_stats(ASYNC_WRITER_T *_this, ASYNC_WRITER_STATS_T *stats) {
+	pthread_mutex_lock(&_this->mutex);
+	*stats = _this->stats;
+	pthread_mutex_unlock(&_this->mutex);
+}
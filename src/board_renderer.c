@@ -119,26 +119,14 @@ static void init(void *obj, const char *common, int num_of_cam) {
 	_this->num_of_cam = num_of_cam;
 
 	board_mesh(1, &_this->vbo, &_this->vbo_nop, &_this->vao);
-	{
-		const char *fsh_filepath = "/tmp/tmp.fsh";
-		const char *vsh_filepath = "/tmp/tmp.vsh";
-		int fsh_fd = open(fsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		int vsh_fd = open(vsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fsh_fd, board_fsh, board_fsh_len);
-		write(vsh_fd, board_vsh, board_vsh_len);
-		close(fsh_fd);
-		close(vsh_fd);
-		_this->program_obj = GLProgram_new(common, vsh_filepath, fsh_filepath, true);
-		remove(fsh_filepath);
-		remove(vsh_filepath);
-	}
+	_this->program_obj = GLProgram_new_from_memory(common, (const char*) board_vsh, board_vsh_len, (const char*) board_fsh, board_fsh_len);
 }
 static void release(void *obj) {
 	board_renderer *_this = (board_renderer*) obj;
 	int status;
 	free(obj);
 }
-static int get_program(void *obj) {
+static int get_program(void *obj, uint32_t options) {
 	board_renderer *_this = (board_renderer*) obj;
 	return GLProgram_GetId(_this->program_obj);
 }
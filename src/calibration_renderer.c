@@ -122,17 +122,10 @@ static void init(void *obj, const char *common, int num_of_cam) {
 
 	board_mesh(1, &_this->vbo, &_this->vbo_nop, &_this->vao);
 	{
-		const char *fsh_filepath = "/tmp/tmp.fsh";
-		const char *vsh_filepath = "/tmp/tmp.vsh";
-		int fsh_fd = open(fsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		int vsh_fd = open(vsh_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fsh_fd, calibration_fsh, calibration_fsh_len);
-		write(vsh_fd, calibration_vsh, calibration_vsh_len);
-		close(fsh_fd);
-		close(vsh_fd);
-		_this->program_obj = GLProgram_new(common, vsh_filepath, fsh_filepath, true);
-		remove(fsh_filepath);
-		remove(vsh_filepath);
+		char common_with_cam[512];
+		snprintf(common_with_cam, sizeof(common_with_cam), "%s#define NUM_OF_CAM %d\n", common, num_of_cam);
+
+		_this->program_obj = GLProgram_new_from_memory(common_with_cam, (const char*) calibration_vsh, calibration_vsh_len, (const char*) calibration_fsh, calibration_fsh_len);
 	}
 }
 static void release(void *obj) {
@@ -140,7 +133,7 @@ static void release(void *obj) {
 	int status;
 	free(obj);
 }
-static int get_program(void *obj) {
+static int get_program(void *obj, uint32_t options) {
 	calibration_renderer *_this = (calibration_renderer*) obj;
 	return GLProgram_GetId(_this->program_obj);
 }
@@ -185,14 +178,7 @@ void create_calibration_renderer(PLUGIN_HOST_T *plugin_host, RENDERER_T **out_re
 	renderer->user_data = renderer;
 
 	calibration_renderer *_this = (calibration_renderer*) renderer;
-	{
-		const char *tmp_filepath = "/tmp/tmp.png";
-		int fd = open(tmp_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fd, calibration_png, calibration_png_len);
-		close(fd);
-		plugin_host->load_texture(tmp_filepath, &_this->calibration_texture);
-		remove(tmp_filepath);
-	}
+	plugin_host->load_texture_from_memory(calibration_png, calibration_png_len, &_this->calibration_texture);
 
 	if (out_renderer) {
 		*out_renderer = renderer;
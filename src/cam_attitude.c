@@ -0,0 +1,51 @@
+#include <string.h>
+#include <math.h>
+
+#include "cam_attitude.h"
+
+#include <mat4/type.h>
+#include <mat4/identity.h>
+#include <mat4/rotateX.h>
+#include <mat4/rotateY.h>
+#include <mat4/rotateZ.h>
+#include <mat4/multiply.h>
+#include <mat4/transpose.h>
+#include <mat4/fromQuat.h>
+#include <mat4/invert.h>
+
+void cam_attitude_get_matrix(VECTOR4D_T view_quat, const float *_cam_matrix, const float *cam_offset, float *unif_matrix) {
+	float view_matrix[16];
+	float world_matrix[16];
+	float cam_matrix[16];
+
+	{ // Rv : view
+		mat4_identity(view_matrix);
+		mat4_fromQuat(view_matrix, view_quat.ary);
+		mat4_invert(view_matrix, view_matrix);
+	}
+
+	{ // Rw : view coodinate to world coodinate and view heading to ground initially
+		mat4_identity(world_matrix);
+		mat4_rotateX(world_matrix, world_matrix, -M_PI / 2);
+	}
+
+	{ // Rco : cam offset  //euler Y(yaw)X(pitch)Z(roll)
+		float cam_offset_matrix[16];
+		memcpy(cam_matrix, _cam_matrix, sizeof(cam_matrix));
+		mat4_identity(cam_offset_matrix);
+		mat4_rotateZ(cam_offset_matrix, cam_offset_matrix, cam_offset[0]);
+		mat4_rotateX(cam_offset_matrix, cam_offset_matrix, cam_offset[1]);
+		mat4_rotateY(cam_offset_matrix, cam_offset_matrix, cam_offset[2]);
+		mat4_invert(cam_offset_matrix, cam_offset_matrix);
+		mat4_multiply(cam_matrix, cam_matrix, cam_offset_matrix); // Rc'=RcoRc
+	}
+
+	{ //RcRv(Rc^-1)RcRw
+		mat4_identity(unif_matrix);
+		mat4_multiply(unif_matrix, unif_matrix, world_matrix); // Rw
+		mat4_multiply(unif_matrix, unif_matrix, view_matrix); // RvRw
+		//north is not applied, RnRvRw
+		mat4_multiply(unif_matrix, unif_matrix, cam_matrix); // RcRnRvRw
+	}
+	mat4_transpose(unif_matrix, unif_matrix); // this mat4 library is row primary, opengl is column primary
+}
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "command_channel.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define MAGIC_0 'P'
+#define MAGIC_1 'C'
+#define VERSION 2 //1 had no send base
+#define TYPE_DATA 1
+#define TYPE_ACK 2
+#define HEADER_LEN 8 //magic, version, type, session
+#define DATA_HEADER_LEN (HEADER_LEN + 4) //oldest unacked seq of sender
+#define DATA_ENTRY_HEADER_LEN 6 //seq, len
+#define ACK_LEN (HEADER_LEN + 8) //cumulative ack, selective ack bits of following seqs
+#define LATENCY_EWMA 0.1
+#define STATS_INTERVAL_SEC 1.0
+
+//only the latest one matters, keyed by name and id
+static const char *lg_coalesced_commands[] = { "set_view_quaternion", "set_fov", NULL };
+
+static void put_u16(unsigned char *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+static void put_u32(unsigned char *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+static uint16_t get_u16(const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+static uint32_t get_u32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_header(COMMAND_CHANNEL_T *_this, unsigned char *p, int type) {
+	p[0] = MAGIC_0;
+	p[1] = MAGIC_1;
+	p[2] = VERSION;
+	p[3] = type;
+	put_u32(p + 4, _this->session);
+}
+
+static bool check_header(const unsigned char *data, int data_len, int type) {
+	return data_len >= HEADER_LEN && data[0] == MAGIC_0 && data[1] == MAGIC_1 && data[2] == VERSION && data[3] == type;
+}
+
+//"name id=N" of a coalesced command, empty otherwise
+static void get_key(const char *cmd, char *key, int key_size) {
+	key[0] = '\0';
+	int name_len = strcspn(cmd, " \n");
+	for (int i = 0; lg_coalesced_commands[i]; i++) {
+		int len = strlen(lg_coalesced_commands[i]);
+		if (name_len < len || strncmp(cmd + name_len - len, lg_coalesced_commands[i], len) != 0) {
+			continue;
+		}
+		if (name_len != len && cmd[name_len - len - 1] != '.') { //domain or plugin prefix
+			continue;
+		}
+		int id = 0; //default
+		const char *p = strstr(cmd + name_len, " id=");
+		if (p) {
+			sscanf(p, " id=%d", &id);
+		}
+		snprintf(key, key_size, "%.*s id=%d", name_len, cmd, id);
+		return;
+	}
+}
+
+void command_channel_init(COMMAND_CHANNEL_T *_this, int max_packet_len, COMMAND_CHANNEL_SEND send_data, COMMAND_CHANNEL_SEND send_ack,
+		COMMAND_CHANNEL_DELIVER deliver, void *user_data) {
+	memset(_this, 0, sizeof(COMMAND_CHANNEL_T));
+	pthread_mutex_init(&_this->mutex, 0);
+	_this->max_packet_len = max_packet_len;
+	{
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		_this->session = (uint32_t) (now.tv_sec * 1000000 + now.tv_usec) | 1; //0 : no peer yet
+	}
+	_this->send_base = 1;
+	_this->next_seq = 1;
+	_this->send_data = send_data;
+	_this->send_ack = send_ack;
+	_this->deliver = deliver;
+	_this->user_data = user_data;
+}
+
+void command_channel_deinit(COMMAND_CHANNEL_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	while (_this->pending) {
+		COMMAND_CHANNEL_PENDING_T *next = _this->pending->next;
+		free(_this->pending);
+		_this->pending = next;
+	}
+	_this->pending_num = 0;
+	pthread_mutex_unlock(&_this->mutex);
+	pthread_mutex_destroy(&_this->mutex);
+}
+
+void command_channel_push(COMMAND_CHANNEL_T *_this, const char *cmd, double now) {
+	char key[96];
+	get_key(cmd, key, sizeof(key));
+
+	pthread_mutex_lock(&_this->mutex);
+	_this->queued++;
+	if (key[0] != '\0') {
+		//in flight ones are not replaced, receiver may have them already
+		for (uint32_t seq = _this->send_base; seq != _this->next_seq; seq++) {
+			COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[seq % COMMAND_CHANNEL_WINDOW];
+			if (!slot->acked && !slot->superseded && strcmp(slot->key, key) == 0) {
+				slot->superseded = true;
+			}
+		}
+		for (COMMAND_CHANNEL_PENDING_T *item = _this->pending; item != NULL; item = item->next) {
+			if (strcmp(item->key, key) == 0) {
+				strncpy(item->cmd, cmd, sizeof(item->cmd) - 1);
+				_this->coalesced++;
+				pthread_mutex_unlock(&_this->mutex);
+				return;
+			}
+		}
+	}
+	if (_this->pending_num >= COMMAND_CHANNEL_MAX_PENDING) { //peer does not ack, oldest one is dropped
+		COMMAND_CHANNEL_PENDING_T *oldest = _this->pending;
+		_this->pending = oldest->next;
+		_this->pending_num--;
+		_this->dropped++;
+		free(oldest);
+	}
+	COMMAND_CHANNEL_PENDING_T **cur = &_this->pending;
+	for (; *cur != NULL; cur = &(*cur)->next)
+		;
+	*cur = (COMMAND_CHANNEL_PENDING_T*) malloc(sizeof(COMMAND_CHANNEL_PENDING_T));
+	memset(*cur, 0, sizeof(COMMAND_CHANNEL_PENDING_T));
+	strncpy((*cur)->cmd, cmd, sizeof((*cur)->cmd) - 1);
+	strncpy((*cur)->key, key, sizeof((*cur)->key) - 1);
+	(*cur)->queued_time = now;
+	_this->pending_num++;
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+static float get_rto_ms(COMMAND_CHANNEL_T *_this) {
+	float rto_ms = COMMAND_CHANNEL_INITIAL_RTO_MS;
+	if (_this->srtt_ms > 0) {
+		rto_ms = MAX(_this->srtt_ms + 4 * _this->rttvar_ms, COMMAND_CHANNEL_MIN_RTO_MS);
+	}
+	return MIN(rto_ms * (1 << _this->backoff), COMMAND_CHANNEL_MAX_RTO_MS);
+}
+
+//a peer down is not flooded, every in flight command times out together
+static void on_timeout(COMMAND_CHANNEL_T *_this) {
+	if ((COMMAND_CHANNEL_INITIAL_RTO_MS << _this->backoff) < COMMAND_CHANNEL_MAX_RTO_MS) {
+		_this->backoff++;
+	}
+	if (!_this->peer_acked && !_this->legacy && _this->backoff >= COMMAND_CHANNEL_LEGACY_RTOS) {
+		_this->legacy = true;
+		_this->backoff = 0;
+		for (uint32_t seq = _this->send_base; seq != _this->next_seq; seq++) { //sent at once in the other format
+			_this->slots[seq % COMMAND_CHANNEL_WINDOW].transmissions = 0;
+		}
+		printf("command_channel : no ack from upstream, falling back to legacy commands\n");
+	}
+}
+
+//one command at a time as older peers expect, seq is the command id
+static void update_legacy(COMMAND_CHANNEL_T *_this, double now, unsigned char *packet) {
+	while (_this->send_base != _this->next_seq && _this->slots[_this->send_base % COMMAND_CHANNEL_WINDOW].superseded) { //no nop in legacy
+		_this->slots[_this->send_base % COMMAND_CHANNEL_WINDOW].acked = true;
+		_this->send_base++;
+	}
+	if (_this->send_base == _this->next_seq) {
+		return;
+	}
+	COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[_this->send_base % COMMAND_CHANNEL_WINDOW];
+	if (slot->transmissions > 0) {
+		if (now - slot->sent_time < get_rto_ms(_this) / 1000) {
+			return;
+		}
+		_this->retransmitted++;
+		on_timeout(_this);
+	}
+	int len = snprintf((char*) packet, _this->max_packet_len, "<picam360:command id=\"%u\" value=\"%s\" />", slot->seq, slot->cmd);
+	_this->send_data(packet, MIN(len, _this->max_packet_len - 1), _this->user_data);
+	slot->transmissions++;
+	slot->sent_time = now;
+}
+
+void command_channel_update(COMMAND_CHANNEL_T *_this, double now) {
+	unsigned char *packet = (unsigned char*) malloc(_this->max_packet_len);
+	int packet_len = 0;
+
+	pthread_mutex_lock(&_this->mutex);
+	while (_this->pending && _this->next_seq - _this->send_base < COMMAND_CHANNEL_WINDOW) {
+		COMMAND_CHANNEL_PENDING_T *item = _this->pending;
+		COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[_this->next_seq % COMMAND_CHANNEL_WINDOW];
+		memset(slot, 0, sizeof(COMMAND_CHANNEL_SLOT_T));
+		slot->seq = _this->next_seq++;
+		strncpy(slot->cmd, item->cmd, sizeof(slot->cmd) - 1);
+		strncpy(slot->key, item->key, sizeof(slot->key) - 1);
+		slot->queued_time = item->queued_time;
+		_this->pending = item->next;
+		_this->pending_num--;
+		free(item);
+	}
+	if (_this->legacy) {
+		update_legacy(_this, now, packet);
+	}
+	float rto_sec = get_rto_ms(_this) / 1000;
+	bool timeout = false;
+	for (uint32_t seq = _this->send_base; seq != _this->next_seq && !_this->legacy; seq++) {
+		COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[seq % COMMAND_CHANNEL_WINDOW];
+		if (slot->acked || (slot->transmissions > 0 && now - slot->sent_time < rto_sec)) {
+			continue;
+		}
+		int len = slot->superseded ? 0 : strlen(slot->cmd);
+		if (packet_len == 0) {
+			put_header(_this, packet, TYPE_DATA);
+			put_u32(packet + HEADER_LEN, _this->send_base);
+			packet_len = DATA_HEADER_LEN;
+		}
+		if (packet_len + DATA_ENTRY_HEADER_LEN + len > _this->max_packet_len) {
+			_this->send_data(packet, packet_len, _this->user_data);
+			packet_len = DATA_HEADER_LEN;
+		}
+		put_u32(packet + packet_len, slot->seq);
+		put_u16(packet + packet_len + 4, len);
+		memcpy(packet + packet_len + DATA_ENTRY_HEADER_LEN, slot->cmd, len);
+		packet_len += DATA_ENTRY_HEADER_LEN + len;
+		if (slot->transmissions > 0) {
+			_this->retransmitted++;
+			timeout = true;
+		}
+		slot->transmissions++;
+		slot->sent_time = now;
+	}
+	if (packet_len > DATA_HEADER_LEN) {
+		_this->send_data(packet, packet_len, _this->user_data);
+	}
+	if (timeout) {
+		on_timeout(_this);
+	}
+
+	if (now - _this->stats_time >= STATS_INTERVAL_SEC) {
+		if (_this->stats_time > 0) {
+			_this->commands_per_sec = _this->stats_acked / (now - _this->stats_time);
+		}
+		_this->stats_acked = 0;
+		_this->stats_time = now;
+	}
+	pthread_mutex_unlock(&_this->mutex);
+	free(packet);
+}
+
+static void ack_slot(COMMAND_CHANNEL_T *_this, COMMAND_CHANNEL_SLOT_T *slot, double now) {
+	if (slot->acked) {
+		return;
+	}
+	slot->acked = true;
+	_this->acked++;
+	_this->stats_acked++;
+	_this->backoff = 0;
+
+	float latency_ms = (now - slot->queued_time) * 1000;
+	_this->latency_ms = (_this->acked == 1) ? latency_ms : _this->latency_ms * (1 - LATENCY_EWMA) + latency_ms * LATENCY_EWMA;
+	_this->max_latency_ms = MAX(_this->max_latency_ms, latency_ms);
+	if (slot->transmissions == 1) { //karn, retransmitted ones are ambiguous
+		float rtt_ms = (now - slot->sent_time) * 1000;
+		if (_this->srtt_ms == 0) {
+			_this->srtt_ms = rtt_ms;
+			_this->rttvar_ms = rtt_ms / 2;
+		} else {
+			_this->rttvar_ms = _this->rttvar_ms * 0.75 + (rtt_ms > _this->srtt_ms ? rtt_ms - _this->srtt_ms : _this->srtt_ms - rtt_ms) * 0.25;
+			_this->srtt_ms = _this->srtt_ms * 0.875 + rtt_ms * 0.125;
+		}
+	}
+}
+
+void command_channel_receive_ack(COMMAND_CHANNEL_T *_this, const unsigned char *data, int data_len, double now) {
+	if (data_len < ACK_LEN || !check_header(data, data_len, TYPE_ACK) || get_u32(data + 4) != _this->session) {
+		return;
+	}
+	uint32_t cum = get_u32(data + HEADER_LEN);
+	uint32_t sack = get_u32(data + HEADER_LEN + 4);
+
+	pthread_mutex_lock(&_this->mutex);
+	_this->peer_acked = true;
+	for (uint32_t seq = _this->send_base; seq != _this->next_seq; seq++) {
+		COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[seq % COMMAND_CHANNEL_WINDOW];
+		int32_t diff = (int32_t) (seq - cum);
+		if (diff <= 0 || (diff <= 32 && (sack & (1u << (diff - 1))))) {
+			ack_slot(_this, slot, now);
+		}
+	}
+	while (_this->send_base != _this->next_seq && _this->slots[_this->send_base % COMMAND_CHANNEL_WINDOW].acked) {
+		_this->send_base++;
+	}
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+void command_channel_receive_legacy_ack(COMMAND_CHANNEL_T *_this, int id, double now) {
+	pthread_mutex_lock(&_this->mutex);
+	COMMAND_CHANNEL_SLOT_T *slot = &_this->slots[_this->send_base % COMMAND_CHANNEL_WINDOW];
+	if (_this->legacy && _this->send_base != _this->next_seq && slot->seq == (uint32_t) id) {
+		ack_slot(_this, slot, now);
+		_this->send_base++;
+	}
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+bool command_channel_receive_data(COMMAND_CHANNEL_T *_this, const unsigned char *data, int data_len) {
+	if (data_len < DATA_HEADER_LEN || !check_header(data, data_len, TYPE_DATA)) {
+		return false;
+	}
+	char (*delivered)[COMMAND_CHANNEL_MAX_CMD_LEN] = malloc(COMMAND_CHANNEL_WINDOW * COMMAND_CHANNEL_MAX_CMD_LEN);
+	int delivered_num = 0;
+	unsigned char ack[ACK_LEN];
+
+	pthread_mutex_lock(&_this->mutex);
+	uint32_t session = get_u32(data + 4);
+	if (session != _this->peer_session) { //sender or this receiver restarted, sender keeps its seq in the latter
+		_this->peer_session = session;
+		_this->recv_cum = get_u32(data + HEADER_LEN) - 1;
+		memset(_this->recv_has, 0, sizeof(_this->recv_has));
+	}
+	for (int i = DATA_HEADER_LEN; i + DATA_ENTRY_HEADER_LEN <= data_len;) {
+		uint32_t seq = get_u32(data + i);
+		int len = get_u16(data + i + 4);
+		i += DATA_ENTRY_HEADER_LEN;
+		if (i + len > data_len) {
+			break;
+		}
+		int32_t diff = (int32_t) (seq - _this->recv_cum);
+		if (diff > 0 && diff <= COMMAND_CHANNEL_WINDOW && !_this->recv_has[seq % COMMAND_CHANNEL_WINDOW]) {
+			int cmd_len = MIN(len, COMMAND_CHANNEL_MAX_CMD_LEN - 1);
+			memcpy(_this->recv_cmd[seq % COMMAND_CHANNEL_WINDOW], data + i, cmd_len);
+			_this->recv_cmd[seq % COMMAND_CHANNEL_WINDOW][cmd_len] = '\0';
+			_this->recv_has[seq % COMMAND_CHANNEL_WINDOW] = true;
+		}
+		i += len;
+	}
+	//in order, nop of a superseded command just moves on
+	while (_this->recv_has[(_this->recv_cum + 1) % COMMAND_CHANNEL_WINDOW]) {
+		_this->recv_cum++;
+		_this->recv_has[_this->recv_cum % COMMAND_CHANNEL_WINDOW] = false;
+		if (_this->recv_cmd[_this->recv_cum % COMMAND_CHANNEL_WINDOW][0] != '\0') {
+			strcpy(delivered[delivered_num++], _this->recv_cmd[_this->recv_cum % COMMAND_CHANNEL_WINDOW]);
+		}
+	}
+	uint32_t sack = 0;
+	for (int i = 0; i < 32 && i < COMMAND_CHANNEL_WINDOW; i++) {
+		if (_this->recv_has[(_this->recv_cum + 1 + i) % COMMAND_CHANNEL_WINDOW]) {
+			sack |= 1u << i;
+		}
+	}
+	put_header(_this, ack, TYPE_ACK);
+	put_u32(ack + 4, session); //echo sender session
+	put_u32(ack + HEADER_LEN, _this->recv_cum);
+	put_u32(ack + HEADER_LEN + 4, sack);
+	_this->delivered += delivered_num;
+	pthread_mutex_unlock(&_this->mutex);
+
+	_this->send_ack(ack, ACK_LEN, _this->user_data);
+	for (int i = 0; i < delivered_num; i++) {
+		_this->deliver(delivered[i], _this->user_data);
+	}
+	free(delivered);
+	return true;
+}
+
+int command_channel_get_in_flight(COMMAND_CHANNEL_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	int num = _this->next_seq - _this->send_base;
+	pthread_mutex_unlock(&_this->mutex);
+	return num;
+}
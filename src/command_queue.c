@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "command_queue.h"
+
+#define INDEX_MASK 0xffffffffULL
+
+static COMMAND_QUEUE_NODE_T *alloc_node(COMMAND_QUEUE_T *_this) {
+	uint64_t old = __atomic_load_n(&_this->free_head, __ATOMIC_ACQUIRE);
+	for (;;) {
+		uint32_t idx = old & INDEX_MASK;
+		if (idx == 0) { //pool exhausted by a burst
+			COMMAND_QUEUE_NODE_T *node = (COMMAND_QUEUE_NODE_T*) malloc(sizeof(COMMAND_QUEUE_NODE_T));
+			node->pooled = false;
+			return node;
+		}
+		COMMAND_QUEUE_NODE_T *node = &_this->pool[idx - 1];
+		uint32_t next = __atomic_load_n(&node->free_next, __ATOMIC_RELAXED);
+		uint64_t new = (((old >> 32) + 1) << 32) | next;
+		if (__atomic_compare_exchange_n(&_this->free_head, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return node;
+		}
+	}
+}
+
+static void free_node(COMMAND_QUEUE_T *_this, COMMAND_QUEUE_NODE_T *node) {
+	if (!node->pooled) {
+		free(node);
+		return;
+	}
+	uint32_t idx = (node - _this->pool) + 1;
+	uint64_t old = __atomic_load_n(&_this->free_head, __ATOMIC_ACQUIRE);
+	for (;;) {
+		__atomic_store_n(&node->free_next, (uint32_t) (old & INDEX_MASK), __ATOMIC_RELAXED);
+		uint64_t new = (((old >> 32) + 1) << 32) | idx;
+		if (__atomic_compare_exchange_n(&_this->free_head, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return;
+		}
+	}
+}
+
+static void push_node(COMMAND_QUEUE_T *_this, COMMAND_QUEUE_NODE_T *node) {
+	__atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+	COMMAND_QUEUE_NODE_T *prev = __atomic_exchange_n(&_this->head, node, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+void command_queue_init(COMMAND_QUEUE_T *_this) {
+	memset(_this, 0, sizeof(COMMAND_QUEUE_T));
+	_this->head = &_this->stub;
+	_this->tail = &_this->stub;
+
+	_this->pool = (COMMAND_QUEUE_NODE_T*) malloc(sizeof(COMMAND_QUEUE_NODE_T) * COMMAND_QUEUE_POOL_SIZE);
+	for (int i = 0; i < COMMAND_QUEUE_POOL_SIZE; i++) {
+		_this->pool[i].pooled = true;
+		_this->pool[i].free_next = (i + 1 < COMMAND_QUEUE_POOL_SIZE) ? i + 2 : 0;
+	}
+	_this->free_head = 1;
+}
+
+void command_queue_deinit(COMMAND_QUEUE_T *_this) {
+	for (COMMAND_QUEUE_NODE_T *node; (node = command_queue_pop(_this)) != NULL;) {
+		command_queue_release(_this, node);
+	}
+	free(_this->pool);
+	_this->pool = NULL;
+}
+
+void command_queue_push(COMMAND_QUEUE_T *_this, const char *cmd) {
+	COMMAND_QUEUE_NODE_T *node = alloc_node(_this);
+	strncpy(node->cmd, cmd, sizeof(node->cmd) - 1);
+	node->cmd[sizeof(node->cmd) - 1] = '\0';
+	push_node(_this, node);
+}
+
+COMMAND_QUEUE_NODE_T *command_queue_pop(COMMAND_QUEUE_T *_this) {
+	COMMAND_QUEUE_NODE_T *tail = _this->tail;
+	COMMAND_QUEUE_NODE_T *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (tail == &_this->stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		_this->tail = next;
+		tail = next;
+		next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+	}
+	if (next) {
+		_this->tail = next;
+		return tail;
+	}
+	if (tail != __atomic_load_n(&_this->head, __ATOMIC_ACQUIRE)) { //a producer is linking, pick it up next time
+		return NULL;
+	}
+	push_node(_this, &_this->stub);
+	next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+	if (next) {
+		_this->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+void command_queue_release(COMMAND_QUEUE_T *_this, COMMAND_QUEUE_NODE_T *node) {
+	free_node(_this, node);
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "command_registry.h"
+
+#define INITIAL_SIZE 128
+
+static uint32_t get_hash(const char *name, int name_len) { //fnv-1a
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < name_len; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static COMMAND_REGISTRY_ENTRY_T *find_slot(COMMAND_REGISTRY_ENTRY_T *entries, int size, const char *name, int name_len, uint32_t hash) {
+	for (int i = hash & (size - 1);; i = (i + 1) & (size - 1)) {
+		COMMAND_REGISTRY_ENTRY_T *entry = &entries[i];
+		if (entry->name[0] == '\0') {
+			return entry;
+		}
+		if (entry->hash == hash && strncmp(entry->name, name, name_len) == 0 && entry->name[name_len] == '\0') {
+			return entry;
+		}
+	}
+}
+
+static void resize(COMMAND_REGISTRY_T *_this, int size) {
+	COMMAND_REGISTRY_ENTRY_T *entries = (COMMAND_REGISTRY_ENTRY_T*) malloc(sizeof(COMMAND_REGISTRY_ENTRY_T) * size);
+	memset(entries, 0, sizeof(COMMAND_REGISTRY_ENTRY_T) * size);
+	for (int i = 0; i < _this->size; i++) {
+		COMMAND_REGISTRY_ENTRY_T *entry = &_this->entries[i];
+		if (entry->name[0] != '\0') {
+			*find_slot(entries, size, entry->name, strlen(entry->name), entry->hash) = *entry;
+		}
+	}
+	free(_this->entries);
+	_this->entries = entries;
+	_this->size = size;
+}
+
+void command_registry_init(COMMAND_REGISTRY_T *_this) {
+	memset(_this, 0, sizeof(COMMAND_REGISTRY_T));
+	resize(_this, INITIAL_SIZE);
+}
+
+void command_registry_deinit(COMMAND_REGISTRY_T *_this) {
+	free(_this->entries);
+	memset(_this, 0, sizeof(COMMAND_REGISTRY_T));
+}
+
+void command_registry_add(COMMAND_REGISTRY_T *_this, const char *name, COMMAND_HANDLER handler, void *user_data) {
+	int name_len = strlen(name);
+	if (name_len == 0 || name_len >= sizeof(((COMMAND_REGISTRY_ENTRY_T*) 0)->name)) {
+		printf("command_registry : invalid name %s\n", name);
+		return;
+	}
+	if ((_this->num + 1) * 2 > _this->size) { //load factor 0.5
+		resize(_this, _this->size * 2);
+	}
+	uint32_t hash = get_hash(name, name_len);
+	COMMAND_REGISTRY_ENTRY_T *entry = find_slot(_this->entries, _this->size, name, name_len, hash);
+	if (entry->name[0] == '\0') {
+		strcpy(entry->name, name);
+		entry->hash = hash;
+		_this->num++;
+	}
+	entry->handler = handler;
+	entry->user_data = user_data;
+}
+
+const COMMAND_REGISTRY_ENTRY_T *command_registry_find(COMMAND_REGISTRY_T *_this, const char *name, int name_len) {
+	if (name_len <= 0 || name_len >= sizeof(((COMMAND_REGISTRY_ENTRY_T*) 0)->name)) {
+		return NULL;
+	}
+	COMMAND_REGISTRY_ENTRY_T *entry = find_slot(_this->entries, _this->size, name, name_len, get_hash(name, name_len));
+	return (entry->name[0] == '\0') ? NULL : entry;
+}
+
+const COMMAND_REGISTRY_ENTRY_T *command_registry_lookup(COMMAND_REGISTRY_T *_this, const char *cmd) {
+	cmd += strspn(cmd, " \n");
+	int name_len = strcspn(cmd, " \n");
+	const COMMAND_REGISTRY_ENTRY_T *entry = command_registry_find(_this, cmd, name_len);
+	if (entry == NULL) {
+		const char *dot = memchr(cmd, '.', name_len);
+		if (dot) {
+			entry = command_registry_find(_this, cmd, dot - cmd);
+		}
+	}
+	return entry;
+}
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "encoder_pool.h"
+
+static bool is_same_key(const ENCODER_POOL_KEY_T *a, const ENCODER_POOL_KEY_T *b) {
+	return strncmp(a->name, b->name, sizeof(a->name)) == 0 && a->width == b->width && a->height == b->height && a->kbps == b->kbps
+			&& a->fps == b->fps;
+}
+
+static void pooled_stream_callback(unsigned char *data, unsigned int data_len, void *frame_data, void *user_data) {
+	ENCODER_LEASE_T *lease = (ENCODER_LEASE_T*) user_data;
+	if (lease->callback == NULL) { //not leased yet
+		if (frame_data) {
+			free(frame_data);
+		}
+		return;
+	}
+	if (!lease->first_nal_received) {
+		struct timeval now;
+		struct timeval diff;
+		gettimeofday(&now, NULL);
+		timersub(&now, &lease->leased_time, &diff);
+		lease->time_to_first_nal_ms = diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0;
+		lease->first_nal_received = true;
+		printf("%s %dx%d@%dfps %dkbps : time to first nal %.3f ms (%s)\n", lease->key.name, lease->key.width, lease->key.height, lease->key.fps,
+				lease->key.kbps, lease->time_to_first_nal_ms, lease->warm ? "warm" : "cold");
+	}
+	lease->callback(data, data_len, frame_data, lease->user_data);
+}
+
+static void init_encoder(ENCODER_LEASE_T *lease) {
+	ENCODER_POOL_KEY_T *key = &lease->key;
+	lease->encoder->init(lease->encoder, key->width, key->height, key->kbps, key->fps, pooled_stream_callback, lease);
+}
+
+//initializes one encoder, false if every entry is full
+static bool refill_one(ENCODER_POOL_T *_this) {
+	ENCODER_LEASE_T *lease = NULL;
+
+	pthread_mutex_lock(&_this->mutex);
+	for (ENCODER_POOL_ENTRY_T *entry = _this->entries; entry != NULL && lease == NULL; entry = entry->next) {
+		int num = 0;
+		for (ENCODER_LEASE_T *idle = _this->idle; idle != NULL; idle = idle->next) {
+			if (is_same_key(&idle->key, &entry->key)) {
+				num++;
+			}
+		}
+		if (num >= entry->num) {
+			continue;
+		}
+		lease = (ENCODER_LEASE_T*) malloc(sizeof(ENCODER_LEASE_T));
+		memset(lease, 0, sizeof(ENCODER_LEASE_T));
+		lease->key = entry->key;
+		lease->warm = true;
+		for (int i = 0; i < _this->spare_num; i++) {
+			if (strncmp(_this->spares[i]->name, entry->key.name, sizeof(entry->key.name)) == 0) {
+				lease->encoder = _this->spares[i];
+				_this->spares[i] = _this->spares[--_this->spare_num];
+				break;
+			}
+		}
+		if (lease->encoder == NULL) {
+			entry->factory->create_encoder(entry->factory->user_data, &lease->encoder);
+		}
+	}
+	pthread_mutex_unlock(&_this->mutex);
+
+	if (lease == NULL) {
+		return false;
+	}
+	init_encoder(lease);
+
+	pthread_mutex_lock(&_this->mutex);
+	lease->next = _this->idle;
+	_this->idle = lease;
+	pthread_mutex_unlock(&_this->mutex);
+	return true;
+}
+
+static void *refill_thread_func(void *arg) {
+	ENCODER_POOL_T *_this = (ENCODER_POOL_T*) arg;
+	pthread_mutex_lock(&_this->mutex);
+	while (1) {
+		while (_this->run && !_this->refill_requested) {
+			pthread_cond_wait(&_this->refill_cond, &_this->mutex);
+		}
+		if (!_this->run) {
+			break;
+		}
+		_this->refill_requested = false;
+		pthread_mutex_unlock(&_this->mutex);
+
+		while (_this->run && refill_one(_this)) {
+		}
+
+		pthread_mutex_lock(&_this->mutex);
+	}
+	pthread_mutex_unlock(&_this->mutex);
+	return NULL;
+}
+
+void encoder_pool_init(ENCODER_POOL_T *_this) {
+	memset(_this, 0, sizeof(ENCODER_POOL_T));
+	pthread_mutex_init(&_this->mutex, 0);
+	pthread_cond_init(&_this->refill_cond, 0);
+	_this->run = true;
+	pthread_create(&_this->refill_thread, NULL, refill_thread_func, (void*) _this);
+}
+
+void encoder_pool_deinit(ENCODER_POOL_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	if (_this->run) {
+		_this->run = false;
+		pthread_cond_broadcast(&_this->refill_cond);
+		pthread_mutex_unlock(&_this->mutex);
+		pthread_join(_this->refill_thread, NULL);
+		pthread_mutex_lock(&_this->mutex);
+	}
+	while (_this->spare_num > 0) {
+		ENCODER_T *encoder = _this->spares[--_this->spare_num];
+		encoder->release(encoder);
+	}
+	while (_this->idle) {
+		ENCODER_LEASE_T *lease = _this->idle;
+		_this->idle = lease->next;
+		lease->encoder->release(lease->encoder);
+		free(lease);
+	}
+	while (_this->entries) {
+		ENCODER_POOL_ENTRY_T *entry = _this->entries;
+		_this->entries = entry->next;
+		free(entry);
+	}
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+void encoder_pool_add_entry(ENCODER_POOL_T *_this, ENCODER_FACTORY_T *factory, const ENCODER_POOL_KEY_T *key, int num) {
+	ENCODER_POOL_ENTRY_T *entry = (ENCODER_POOL_ENTRY_T*) malloc(sizeof(ENCODER_POOL_ENTRY_T));
+	memset(entry, 0, sizeof(ENCODER_POOL_ENTRY_T));
+	entry->factory = factory;
+	entry->key = *key;
+	entry->num = num;
+
+	pthread_mutex_lock(&_this->mutex);
+	entry->next = _this->entries;
+	_this->entries = entry;
+	pthread_mutex_unlock(&_this->mutex);
+	encoder_pool_refill(_this);
+
+	printf("encoder pool : keep %d %s %dx%d@%dfps %dkbps\n", num, key->name, key->width, key->height, key->fps, key->kbps);
+}
+
+void encoder_pool_refill(ENCODER_POOL_T *_this) {
+	pthread_mutex_lock(&_this->mutex);
+	if (_this->entries != NULL && !_this->refill_requested) {
+		_this->refill_requested = true;
+		pthread_cond_broadcast(&_this->refill_cond);
+	}
+	pthread_mutex_unlock(&_this->mutex);
+}
+
+ENCODER_LEASE_T *encoder_pool_lease(ENCODER_POOL_T *_this, ENCODER_T *encoder, const ENCODER_POOL_KEY_T *key, ENCODER_STREAM_CALLBACK callback,
+		void *user_data) {
+	ENCODER_LEASE_T *lease = NULL;
+
+	pthread_mutex_lock(&_this->mutex);
+	for (ENCODER_LEASE_T **idle_p = &_this->idle; *idle_p != NULL; idle_p = &(*idle_p)->next) {
+		if (is_same_key(&(*idle_p)->key, key)) {
+			lease = *idle_p;
+			*idle_p = lease->next;
+			lease->next = NULL;
+			break;
+		}
+	}
+	if (lease) {
+		//kept for refill to save a create, released when spares are full
+		if (_this->spare_num < sizeof(_this->spares) / sizeof(_this->spares[0])) {
+			_this->spares[_this->spare_num++] = encoder;
+			encoder = NULL;
+		}
+	}
+	pthread_mutex_unlock(&_this->mutex);
+
+	if (lease && encoder) {
+		encoder->release(encoder);
+	}
+
+	if (lease) {
+		gettimeofday(&lease->leased_time, NULL);
+		lease->user_data = user_data;
+		lease->callback = callback;
+	} else { //cold start
+		lease = (ENCODER_LEASE_T*) malloc(sizeof(ENCODER_LEASE_T));
+		memset(lease, 0, sizeof(ENCODER_LEASE_T));
+		lease->encoder = encoder;
+		lease->key = *key;
+		lease->warm = false;
+		gettimeofday(&lease->leased_time, NULL);
+		lease->user_data = user_data;
+		lease->callback = callback;
+		init_encoder(lease);
+	}
+	return lease;
+}
+
+void encoder_pool_return(ENCODER_POOL_T *_this, ENCODER_LEASE_T *lease) {
+	//a used encoder would start the next stream with inter frames,
+	//so it is released and refill initializes a fresh one
+	lease->encoder->release(lease->encoder);
+	free(lease);
+	encoder_pool_refill(_this);
+}
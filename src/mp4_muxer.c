@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "mp4_muxer.h"
+
+#ifndef MIN
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
+
+#define VIDEO_TRACK_ID 1
+#define META_TRACK_ID 2
+#define DEFAULT_DURATION (MP4_MUXER_TIMESCALE / 30)
+
+enum PARAM {
+	PARAM_VPS, PARAM_SPS, PARAM_PPS,
+};
+
+static void buff_reserve(MP4_BUFF_T *buff, int len) {
+	if (buff->len + len > buff->size) {
+		buff->size = MAX(buff->len + len, buff->size * 2);
+		buff->data = (unsigned char*) realloc(buff->data, buff->size);
+	}
+}
+static void put_bytes(MP4_BUFF_T *buff, const void *data, int len) {
+	buff_reserve(buff, len);
+	memcpy(buff->data + buff->len, data, len);
+	buff->len += len;
+}
+static void put_u8(MP4_BUFF_T *buff, uint8_t v) {
+	put_bytes(buff, &v, 1);
+}
+static void put_u16(MP4_BUFF_T *buff, uint16_t v) {
+	unsigned char p[2] = { v >> 8, v };
+	put_bytes(buff, p, 2);
+}
+static void put_u32(MP4_BUFF_T *buff, uint32_t v) {
+	unsigned char p[4] = { v >> 24, v >> 16, v >> 8, v };
+	put_bytes(buff, p, 4);
+}
+static void put_u64(MP4_BUFF_T *buff, uint64_t v) {
+	put_u32(buff, v >> 32);
+	put_u32(buff, v);
+}
+static void put_zero(MP4_BUFF_T *buff, int len) {
+	buff_reserve(buff, len);
+	memset(buff->data + buff->len, 0, len);
+	buff->len += len;
+}
+static void set_u32(MP4_BUFF_T *buff, int pos, uint32_t v) {
+	buff->data[pos + 0] = v >> 24;
+	buff->data[pos + 1] = v >> 16;
+	buff->data[pos + 2] = v >> 8;
+	buff->data[pos + 3] = v;
+}
+
+//returns position to be passed to box_end
+static int box_begin(MP4_BUFF_T *buff, const char *type) {
+	int pos = buff->len;
+	put_u32(buff, 0);
+	put_bytes(buff, type, 4);
+	return pos;
+}
+static int full_box_begin(MP4_BUFF_T *buff, const char *type, uint8_t version, uint32_t flags) {
+	int pos = box_begin(buff, type);
+	put_u32(buff, (version << 24) | (flags & 0xFFFFFF));
+	return pos;
+}
+static void box_end(MP4_BUFF_T *buff, int pos) {
+	set_u32(buff, pos, buff->len - pos);
+}
+
+static int get_nal_type(MP4_MUXER_T *_this, const unsigned char *nal) {
+	return (_this->codec == MP4_CODEC_H265) ? (nal[0] >> 1) & 0x3f : nal[0] & 0x1f;
+}
+static bool is_vcl(MP4_MUXER_T *_this, int type) {
+	return (_this->codec == MP4_CODEC_H265) ? type < 32 : (type >= 1 && type <= 5);
+}
+static bool is_key(MP4_MUXER_T *_this, int type) {
+	return (_this->codec == MP4_CODEC_H265) ? (type >= 16 && type <= 21) : type == 5;
+}
+static bool is_first_slice(MP4_MUXER_T *_this, const unsigned char *nal, int nal_len) { //first_mb_in_slice == 0, first_slice_segment_in_pic_flag
+	return (_this->codec == MP4_CODEC_H265) ? (nal_len > 2 && (nal[2] & 0x80)) : (nal_len > 1 && (nal[1] & 0x80));
+}
+static bool starts_access_unit(MP4_MUXER_T *_this, int type) { //non vcl nal preceding slices of a picture
+	if (_this->codec == MP4_CODEC_H265) {
+		return (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+	} else {
+		return (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+	}
+}
+static int get_param_index(MP4_MUXER_T *_this, int type) {
+	if (_this->codec == MP4_CODEC_H265) {
+		return (type >= 32 && type <= 34) ? type - 32 : -1;
+	} else {
+		return (type == 7) ? PARAM_SPS : (type == 8) ? PARAM_PPS : -1;
+	}
+}
+
+//without emulation prevention bytes
+static int get_rbsp(const unsigned char *data, int data_len, unsigned char *rbsp, int rbsp_len) {
+	int len = 0;
+	int zeros = 0;
+	for (int i = 0; i < data_len && len < rbsp_len; i++) {
+		if (zeros >= 2 && data[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		zeros = (data[i] == 0) ? zeros + 1 : 0;
+		rbsp[len++] = data[i];
+	}
+	return len;
+}
+
+static void put_avcc(MP4_MUXER_T *_this, MP4_BUFF_T *buff) {
+	const unsigned char *sps = _this->params[PARAM_SPS];
+	int box = box_begin(buff, "avcC");
+	put_u8(buff, 1);
+	put_u8(buff, sps[1]); //profile
+	put_u8(buff, sps[2]); //compatibility
+	put_u8(buff, sps[3]); //level
+	put_u8(buff, 0xFF); //4 bytes length
+	put_u8(buff, 0xE1); //1 sps
+	put_u16(buff, _this->params_len[PARAM_SPS]);
+	put_bytes(buff, sps, _this->params_len[PARAM_SPS]);
+	put_u8(buff, 1); //1 pps
+	put_u16(buff, _this->params_len[PARAM_PPS]);
+	put_bytes(buff, _this->params[PARAM_PPS], _this->params_len[PARAM_PPS]);
+	if (sps[1] == 100 || sps[1] == 110 || sps[1] == 122 || sps[1] == 144) { //high profiles, 4:2:0 8bit as encoders here output
+		put_u8(buff, 0xFC | 1);
+		put_u8(buff, 0xF8);
+		put_u8(buff, 0xF8);
+		put_u8(buff, 0);
+	}
+	box_end(buff, box);
+}
+
+static void put_hvcc(MP4_MUXER_T *_this, MP4_BUFF_T *buff) {
+	unsigned char ptl[13] = { }; //sub layers, then general profile_tier_level
+	get_rbsp(_this->params[PARAM_SPS] + 2, _this->params_len[PARAM_SPS] - 2, ptl, sizeof(ptl));
+	int box = box_begin(buff, "hvcC");
+	put_u8(buff, 1);
+	put_bytes(buff, ptl + 1, 12); //profile space, tier, profile, compatibility, constraint, level
+	put_u16(buff, 0xF000); //min_spatial_segmentation_idc
+	put_u8(buff, 0xFC); //parallelismType
+	put_u8(buff, 0xFC | 1); //4:2:0
+	put_u8(buff, 0xF8); //8bit
+	put_u8(buff, 0xF8);
+	put_u16(buff, 0); //avgFrameRate
+	put_u8(buff, ((((ptl[0] >> 1) & 0x7) + 1) << 3) | ((ptl[0] & 1) << 2) | 3); //temporal layers, nested, 4 bytes length
+	put_u8(buff, 3);
+	for (int i = PARAM_VPS; i <= PARAM_PPS; i++) {
+		put_u8(buff, 0x80 | (32 + i)); //array_completeness
+		put_u16(buff, 1);
+		put_u16(buff, _this->params_len[i]);
+		put_bytes(buff, _this->params[i], _this->params_len[i]);
+	}
+	box_end(buff, box);
+}
+
+static void put_matrix(MP4_BUFF_T *buff) {
+	const uint32_t matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+	for (int i = 0; i < 9; i++) {
+		put_u32(buff, matrix[i]);
+	}
+}
+
+static void put_trak(MP4_MUXER_T *_this, MP4_BUFF_T *buff, uint32_t track_id) {
+	bool video = (track_id == VIDEO_TRACK_ID);
+	int trak = box_begin(buff, "trak");
+	{
+		int tkhd = full_box_begin(buff, "tkhd", 0, 3); //enabled, in movie
+		put_u32(buff, 0); //creation_time
+		put_u32(buff, 0); //modification_time
+		put_u32(buff, track_id);
+		put_u32(buff, 0);
+		put_u32(buff, 0); //duration, in fragments
+		put_zero(buff, 8);
+		put_u16(buff, 0); //layer
+		put_u16(buff, 0); //alternate_group
+		put_u16(buff, 0); //volume
+		put_u16(buff, 0);
+		put_matrix(buff);
+		put_u32(buff, video ? _this->width << 16 : 0);
+		put_u32(buff, video ? _this->height << 16 : 0);
+		box_end(buff, tkhd);
+	}
+	int mdia = box_begin(buff, "mdia");
+	{
+		int mdhd = full_box_begin(buff, "mdhd", 0, 0);
+		put_u32(buff, 0);
+		put_u32(buff, 0);
+		put_u32(buff, MP4_MUXER_TIMESCALE);
+		put_u32(buff, 0);
+		put_u16(buff, 0x55C4); //und
+		put_u16(buff, 0);
+		box_end(buff, mdhd);
+	}
+	{
+		const char *name = video ? "VideoHandler" : "MetaHandler";
+		int hdlr = full_box_begin(buff, "hdlr", 0, 0);
+		put_u32(buff, 0);
+		put_bytes(buff, video ? "vide" : "meta", 4);
+		put_zero(buff, 12);
+		put_bytes(buff, name, strlen(name) + 1);
+		box_end(buff, hdlr);
+	}
+	int minf = box_begin(buff, "minf");
+	if (video) {
+		int vmhd = full_box_begin(buff, "vmhd", 0, 1);
+		put_zero(buff, 8); //graphicsmode, opcolor
+		box_end(buff, vmhd);
+	} else {
+		box_end(buff, full_box_begin(buff, "nmhd", 0, 0));
+	}
+	{
+		int dinf = box_begin(buff, "dinf");
+		int dref = full_box_begin(buff, "dref", 0, 0);
+		put_u32(buff, 1);
+		box_end(buff, full_box_begin(buff, "url ", 0, 1)); //in this file
+		box_end(buff, dref);
+		box_end(buff, dinf);
+	}
+	int stbl = box_begin(buff, "stbl");
+	{
+		int stsd = full_box_begin(buff, "stsd", 0, 0);
+		put_u32(buff, 1);
+		if (video) {
+			int entry = box_begin(buff, (_this->codec == MP4_CODEC_H265) ? "hev1" : "avc3"); //parameter sets also in band
+			put_zero(buff, 6);
+			put_u16(buff, 1); //data_reference_index
+			put_zero(buff, 16);
+			put_u16(buff, _this->width);
+			put_u16(buff, _this->height);
+			put_u32(buff, 0x00480000); //72dpi
+			put_u32(buff, 0x00480000);
+			put_u32(buff, 0);
+			put_u16(buff, 1); //frame_count
+			put_zero(buff, 32); //compressorname
+			put_u16(buff, 0x0018); //depth
+			put_u16(buff, 0xFFFF);
+			if (_this->codec == MP4_CODEC_H265) {
+				put_hvcc(_this, buff);
+			} else {
+				put_avcc(_this, buff);
+			}
+			box_end(buff, entry);
+		} else {
+			int entry = box_begin(buff, "mett");
+			put_zero(buff, 6);
+			put_u16(buff, 1);
+			put_u8(buff, 0); //content_encoding
+			put_bytes(buff, MP4_MUXER_META_MIME, strlen(MP4_MUXER_META_MIME) + 1);
+			box_end(buff, entry);
+		}
+		box_end(buff, stsd);
+	}
+	{ //samples are in fragments
+		const char *types[] = { "stts", "stsc", "stco" };
+		for (int i = 0; i < 3; i++) {
+			int box = full_box_begin(buff, types[i], 0, 0);
+			put_u32(buff, 0);
+			box_end(buff, box);
+		}
+		int stsz = full_box_begin(buff, "stsz", 0, 0);
+		put_u32(buff, 0);
+		put_u32(buff, 0);
+		box_end(buff, stsz);
+	}
+	box_end(buff, stbl);
+	box_end(buff, minf);
+	box_end(buff, mdia);
+	box_end(buff, trak);
+}
+
+static bool write_header(MP4_MUXER_T *_this) {
+	MP4_BUFF_T buff = { };
+	{
+		int ftyp = box_begin(&buff, "ftyp");
+		put_bytes(&buff, "iso6", 4);
+		put_u32(&buff, 0);
+		put_bytes(&buff, "iso6isommp41", 12);
+		box_end(&buff, ftyp);
+	}
+	int moov = box_begin(&buff, "moov");
+	{
+		int mvhd = full_box_begin(&buff, "mvhd", 0, 0);
+		put_u32(&buff, 0);
+		put_u32(&buff, 0);
+		put_u32(&buff, MP4_MUXER_TIMESCALE);
+		put_u32(&buff, 0);
+		put_u32(&buff, 0x00010000); //rate
+		put_u16(&buff, 0x0100); //volume
+		put_zero(&buff, 10);
+		put_matrix(&buff);
+		put_zero(&buff, 24);
+		put_u32(&buff, META_TRACK_ID + 1); //next_track_ID
+		box_end(&buff, mvhd);
+	}
+	put_trak(_this, &buff, VIDEO_TRACK_ID);
+	put_trak(_this, &buff, META_TRACK_ID);
+	{
+		int mvex = box_begin(&buff, "mvex");
+		for (uint32_t track_id = VIDEO_TRACK_ID; track_id <= META_TRACK_ID; track_id++) {
+			int trex = full_box_begin(&buff, "trex", 0, 0);
+			put_u32(&buff, track_id);
+			put_u32(&buff, 1); //sample description
+			put_u32(&buff, 0);
+			put_u32(&buff, 0);
+			put_u32(&buff, 0);
+			box_end(&buff, trex);
+		}
+		box_end(&buff, mvex);
+	}
+	box_end(&buff, moov);
+
+	bool res = async_writer_write(_this->writer, buff.data, buff.len);
+	if (res) {
+		_this->offset += buff.len;
+	}
+	free(buff.data);
+	return res;
+}
+
+static void put_traf(MP4_MUXER_T *_this, MP4_BUFF_T *buff, uint32_t track_id, uint64_t end_time, int *data_offset_pos) {
+	bool video = (track_id == VIDEO_TRACK_ID);
+	int traf = box_begin(buff, "traf");
+	{
+		int tfhd = full_box_begin(buff, "tfhd", 0, 0x020000); //default-base-is-moof
+		put_u32(buff, track_id);
+		box_end(buff, tfhd);
+	}
+	{
+		int tfdt = full_box_begin(buff, "tfdt", 1, 0);
+		put_u64(buff, _this->samples[0].time);
+		box_end(buff, tfdt);
+	}
+	{
+		int trun = full_box_begin(buff, "trun", 0, video ? 0x000701 : 0x000301); //data offset, duration, size, (flags)
+		put_u32(buff, _this->num_samples);
+		*data_offset_pos = buff->len;
+		put_u32(buff, 0);
+		for (int i = 0; i < _this->num_samples; i++) {
+			MP4_SAMPLE_T *sample = &_this->samples[i];
+			uint64_t next_time = (i + 1 < _this->num_samples) ? _this->samples[i + 1].time : end_time;
+			put_u32(buff, next_time - sample->time);
+			if (video) {
+				put_u32(buff, sample->size);
+				put_u32(buff, sample->key ? 0x02000000 : 0x01010000); //depends on nothing : depends on others, non sync
+			} else {
+				put_u32(buff, sample->meta_size);
+			}
+		}
+		box_end(buff, trun);
+	}
+	box_end(buff, traf);
+}
+
+static void flush_fragment(MP4_MUXER_T *_this, uint64_t end_time) {
+	if (_this->num_samples == 0) {
+		return;
+	}
+	MP4_BUFF_T moof = { };
+	int video_offset_pos;
+	int meta_offset_pos;
+	int box = box_begin(&moof, "moof");
+	{
+		int mfhd = full_box_begin(&moof, "mfhd", 0, 0);
+		put_u32(&moof, ++_this->sequence);
+		box_end(&moof, mfhd);
+	}
+	put_traf(_this, &moof, VIDEO_TRACK_ID, end_time, &video_offset_pos);
+	put_traf(_this, &moof, META_TRACK_ID, end_time, &meta_offset_pos);
+	box_end(&moof, box);
+	int moof_len = moof.len;
+	set_u32(&moof, video_offset_pos, moof_len + 8);
+	set_u32(&moof, meta_offset_pos, moof_len + 8 + _this->mdat.len);
+	put_u32(&moof, 8 + _this->mdat.len + _this->mdat_meta.len);
+	put_bytes(&moof, "mdat", 4);
+
+	struct iovec iov[] = { { moof.data, moof.len }, { _this->mdat.data, _this->mdat.len }, { _this->mdat_meta.data, _this->mdat_meta.len } };
+	if (async_writer_writev(_this->writer, iov, 3)) {
+		if (_this->samples[0].key) {
+			if (_this->num_index == _this->index_size) {
+				_this->index_size = MAX(64, _this->index_size * 2);
+				_this->index = (MP4_FRAGMENT_INDEX_T*) realloc(_this->index, sizeof(MP4_FRAGMENT_INDEX_T) * _this->index_size);
+			}
+			_this->index[_this->num_index].time = _this->samples[0].time;
+			_this->index[_this->num_index].moof_offset = _this->offset;
+			_this->num_index++;
+		}
+		_this->offset += moof.len + _this->mdat.len + _this->mdat_meta.len;
+		_this->fragments++;
+		async_writer_flush(_this->writer); //a crash loses at most the fragment being assembled
+	} else {
+		_this->dropped_fragments++;
+	}
+	free(moof.data);
+
+	_this->mdat.len = 0;
+	_this->mdat_meta.len = 0;
+	_this->num_samples = 0;
+}
+
+static void finish_sample(MP4_MUXER_T *_this) {
+	bool drop = false;
+	if (!_this->header_written) { //file starts from a key sample with parameter sets
+		int first_param = (_this->codec == MP4_CODEC_H265) ? PARAM_VPS : PARAM_SPS;
+		bool params = true;
+		for (int i = first_param; i <= PARAM_PPS; i++) {
+			params = params && (_this->params_len[i] > 0);
+		}
+		if (_this->sample_key && params) {
+			_this->header_written = write_header(_this);
+			_this->base_pts_us = _this->sample_pts_us;
+		}
+		drop = !_this->header_written;
+	}
+	if (!drop) {
+		uint64_t time;
+		if (_this->sample_pts_us > _this->last_pts_us) { //last is 0 on first sample, which is base
+			time = (_this->sample_pts_us - _this->base_pts_us) * MP4_MUXER_TIMESCALE / 1000000;
+		} else { //not monotonic
+			time = (_this->last_pts_us - _this->base_pts_us) * MP4_MUXER_TIMESCALE / 1000000 + _this->last_duration;
+			_this->sample_pts_us = _this->last_pts_us + (uint64_t) _this->last_duration * 1000000 / MP4_MUXER_TIMESCALE;
+		}
+		if (_this->num_samples > 0) {
+			MP4_SAMPLE_T *last = &_this->samples[_this->num_samples - 1];
+			_this->last_duration = MAX(time - last->time, 1);
+			if (_this->sample_key || _this->mdat.len >= MP4_MUXER_MAX_FRAGMENT_SIZE) {
+				flush_fragment(_this, time);
+			}
+		}
+		if (_this->num_samples == _this->samples_size) {
+			_this->samples_size = MAX(64, _this->samples_size * 2);
+			_this->samples = (MP4_SAMPLE_T*) realloc(_this->samples, sizeof(MP4_SAMPLE_T) * _this->samples_size);
+		}
+		MP4_SAMPLE_T *sample = &_this->samples[_this->num_samples++];
+		sample->time = time;
+		sample->size = _this->sample.len;
+		sample->meta_size = _this->sample_meta.len;
+		sample->key = _this->sample_key;
+		put_bytes(&_this->mdat, _this->sample.data, _this->sample.len);
+		put_bytes(&_this->mdat_meta, _this->sample_meta.data, _this->sample_meta.len);
+		_this->last_pts_us = _this->sample_pts_us;
+	}
+	_this->sample.len = 0;
+	_this->sample_meta.len = 0;
+	_this->sample_vcl = false;
+	_this->sample_key = false;
+}
+
+MP4_MUXER_T *mp4_muxer_open(ASYNC_WRITER_T *writer, enum MP4_CODEC codec, int width, int height) {
+	if (writer == NULL) {
+		return NULL;
+	}
+	MP4_MUXER_T *_this = (MP4_MUXER_T*) malloc(sizeof(MP4_MUXER_T));
+	memset(_this, 0, sizeof(MP4_MUXER_T));
+	_this->writer = writer;
+	_this->codec = codec;
+	_this->width = width;
+	_this->height = height;
+	_this->last_duration = DEFAULT_DURATION;
+	return _this;
+}
+
+void mp4_muxer_add_nal(MP4_MUXER_T *_this, const unsigned char *nal, int nal_len, uint64_t pts_us, const unsigned char *meta, int meta_len) {
+	if (nal_len <= 0) {
+		return;
+	}
+	int type = get_nal_type(_this, nal);
+	bool vcl = is_vcl(_this, type);
+	if (_this->sample_vcl && (vcl ? is_first_slice(_this, nal, nal_len) : starts_access_unit(_this, type))) {
+		finish_sample(_this);
+	}
+	int param = get_param_index(_this, type);
+	if (param >= 0 && nal_len <= MP4_MUXER_MAX_PARAM_LEN && !_this->header_written) {
+		memcpy(_this->params[param], nal, nal_len);
+		_this->params_len[param] = nal_len;
+	}
+	if (vcl && !_this->sample_vcl) {
+		_this->sample_vcl = true;
+		_this->sample_key = is_key(_this, type);
+		_this->sample_pts_us = pts_us;
+	}
+	if (meta && meta_len > 0 && _this->sample_meta.len == 0) {
+		put_bytes(&_this->sample_meta, meta, meta_len);
+	}
+	put_u32(&_this->sample, nal_len);
+	put_bytes(&_this->sample, nal, nal_len);
+}
+
+void mp4_muxer_close(MP4_MUXER_T *_this) {
+	if (_this->sample_vcl) {
+		finish_sample(_this);
+	}
+	if (_this->num_samples > 0) {
+		MP4_SAMPLE_T *last = &_this->samples[_this->num_samples - 1];
+		flush_fragment(_this, last->time + _this->last_duration);
+	}
+	if (_this->header_written) {
+		MP4_BUFF_T buff = { };
+		int mfra = box_begin(&buff, "mfra");
+		{
+			int tfra = full_box_begin(&buff, "tfra", 1, 0);
+			put_u32(&buff, VIDEO_TRACK_ID);
+			put_u32(&buff, 0); //1 byte traf, trun, sample number
+			put_u32(&buff, _this->num_index);
+			for (int i = 0; i < _this->num_index; i++) {
+				put_u64(&buff, _this->index[i].time);
+				put_u64(&buff, _this->index[i].moof_offset);
+				put_u8(&buff, 1);
+				put_u8(&buff, 1);
+				put_u8(&buff, 1);
+			}
+			box_end(&buff, tfra);
+		}
+		int mfro = full_box_begin(&buff, "mfro", 0, 0);
+		int mfro_size_pos = buff.len;
+		put_u32(&buff, 0);
+		box_end(&buff, mfro);
+		box_end(&buff, mfra);
+		set_u32(&buff, mfro_size_pos, buff.len);
+		async_writer_write(_this->writer, buff.data, buff.len);
+		free(buff.data);
+	}
+	printf("mp4_muxer : %u fragments, %d indexed, %u dropped\n", _this->fragments, _this->num_index, _this->dropped_fragments);
+	async_writer_close(_this->writer);
+
+	free(_this->sample.data);
+	free(_this->sample_meta.data);
+	free(_this->mdat.data);
+	free(_this->mdat_meta.data);
+	free(_this->samples);
+	free(_this->index);
+	free(_this);
+}
@@ -24,7 +24,11 @@
 #include "gl_program.h"
 #include "auto_calibration.h"
 #include "manual_mpu.h"
+#include "frame_meta.h"
+#include "cam_attitude.h"
 #include "img/logo_png.h"
+#include "glsl/downscale_fsh.h"
+#include "glsl/downscale_vsh.h"
 
 #include <mat4/type.h>
 //#include <mat4/create.h>
@@ -84,10 +88,20 @@ static void init_options_ex(PICAM360CAPTURE_T *state);
 static void save_options_ex(PICAM360CAPTURE_T *state);
 static void exit_func(void);
 static void redraw_render_texture(PICAM360CAPTURE_T *state, FRAME_T *frame, RENDERER_T *renderer, VECTOR4D_T view_quat);
+static void get_cam_attitude(PICAM360CAPTURE_T *state, VECTOR4D_T view_quat, int cam_num, float *unif_matrix);
+static void create_tiles(PICAM360CAPTURE_T *state, FRAME_T *frame);
+static void delete_tiles(FRAME_T *frame);
+static void create_renditions(PICAM360CAPTURE_T *state, FRAME_T *frame, const char *spec);
+static void delete_renditions(FRAME_T *frame);
+static void stop_encoder(FRAME_T *frame);
+static ENCODER_FACTORY_T *get_encoder_factory(const char *name);
+static enum OUTPUT_TYPE get_output_type(const char *encoder_name);
+static bool close_output(FRAME_T *frame);
 static void redraw_scene(PICAM360CAPTURE_T *state, FRAME_T *frame, MODEL_T *model);
 static void redraw_info(PICAM360CAPTURE_T *state, FRAME_T *frame);
 static void get_info_str(char *buff, int buff_len);
 static void get_menu_str(char *buff, int buff_len);
+static bool send_pose_upstream(const char *cmd);
 
 static void loading_callback(void *user_data, int ret);
 static void convert_snap_handler();
@@ -99,6 +113,18 @@ static float lg_cam_fps[MAX_CAM_NUM] = { };
 static float lg_cam_frameskip[MAX_CAM_NUM] = { };
 static float lg_cam_bandwidth = 0;
 
+//host metrics, registered by init_metrics
+static METRIC_T *lg_metric_frames;
+static METRIC_T *lg_metric_frame_ms;
+static METRIC_T *lg_metric_encoded_bytes;
+static METRIC_T *lg_metric_commands_queued;
+static METRIC_T *lg_metric_commands;
+static METRIC_T *lg_metric_poses_stale;
+static METRIC_T *lg_metric_pose_delay_ms;
+static METRIC_T *lg_metric_cam_fps[MAX_CAM_NUM];
+static METRIC_T *lg_metric_cam_frameskip[MAX_CAM_NUM];
+static METRIC_T *lg_metric_cam_bandwidth;
+
 
 static json_t *json_load_file_without_comment(const char *path, size_t flags, json_error_t *error) {
 	json_t *options;
@@ -308,10 +334,9 @@ static void init_ogl(PICAM360CAPTURE_T *state) {
 #endif
 }
 
-static int load_texture(const char *filename, uint32_t *tex_out) {
+static int upload_texture(IplImage *iplImage, uint32_t *tex_out) {
 	GLenum err;
 	GLuint tex;
-	IplImage *iplImage = cvLoadImage(filename, CV_LOAD_IMAGE_COLOR);
 
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
@@ -332,6 +357,29 @@ static int load_texture(const char *filename, uint32_t *tex_out) {
 	return 0;
 }
 
+static int load_texture(const char *filename, uint32_t *tex_out) {
+	IplImage *iplImage = cvLoadImage(filename, CV_LOAD_IMAGE_COLOR);
+	if (iplImage == NULL) {
+		printf("could not load %s\n", filename);
+		return -1;
+	}
+	int ret = upload_texture(iplImage, tex_out);
+	cvReleaseImage(&iplImage);
+	return ret;
+}
+
+static int load_texture_from_memory(const unsigned char *data, int data_len, uint32_t *tex_out) {
+	CvMat mat = cvMat(1, data_len, CV_8UC1, (void*) data);
+	IplImage *iplImage = cvDecodeImage(&mat, CV_LOAD_IMAGE_COLOR);
+	if (iplImage == NULL) {
+		printf("could not decode image\n");
+		return -1;
+	}
+	int ret = upload_texture(iplImage, tex_out);
+	cvReleaseImage(&iplImage);
+	return ret;
+}
+
 int board_mesh(int num_of_steps, GLuint *vbo_out, GLuint *n_out, GLuint *vao_out) {
 	GLuint vbo;
 
@@ -460,14 +508,7 @@ static void deinit_textures(PICAM360CAPTURE_T *state) {
 }
 static void init_textures(PICAM360CAPTURE_T *state) {
 
-	{
-		const char *tmp_filepath = "/tmp/tmp.png";
-		int *fd = open(tmp_filepath, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IXOTH);
-		write(fd, logo_png, logo_png_len);
-		close(fd);
-		load_texture(tmp_filepath, &state->logo_texture);
-		remove(tmp_filepath);
-	}
+	load_texture_from_memory(logo_png, logo_png_len, &state->logo_texture);
 
 	for (int i = 0; i < state->num_of_cam; i++) {
 		for (int j = 0; j < TEXTURE_BUFFER_NUM; j++) {
@@ -544,6 +585,8 @@ static void init_textures(PICAM360CAPTURE_T *state) {
  ***********************************************************/
 static void init_options(PICAM360CAPTURE_T *state) {
 	json_error_t error;
+	state->options.record_buffer_mb = 8;
+	state->options.record_sync_mb = 64;
 	json_t *options = json_load_file_without_comment(state->config_filepath, 0, &error);
 	if (options == NULL) {
 		fputs(error.text, stderr);
@@ -625,6 +668,44 @@ static void init_options(PICAM360CAPTURE_T *state) {
 			state->options.rtcp_tx_port = json_number_value(json_object_get(options, "rtcp_tx_port"));
 			state->options.rtcp_tx_type = rtp_get_rtp_socket_type(json_string_value(json_object_get(options, "rtcp_tx_type")));
 		}
+		{
+			json_t *value = json_object_get(options, "shader_cache_dir");
+			if (json_is_string(value)) {
+				strncpy(state->options.shader_cache_dir, json_string_value(value), sizeof(state->options.shader_cache_dir) - 1);
+			}
+		}
+		state->options.xml_meta = json_is_true(json_object_get(options, "xml_meta"));
+		state->options.metrics_port = json_number_value(json_object_get(options, "metrics_port"));
+		{ //record : {"buffer_mb":8,"sync_mb":64,"direct":false}
+			json_t *record = json_object_get(options, "record");
+			if (json_object_get(record, "buffer_mb")) {
+				state->options.record_buffer_mb = json_number_value(json_object_get(record, "buffer_mb"));
+			}
+			if (json_object_get(record, "sync_mb")) {
+				state->options.record_sync_mb = json_number_value(json_object_get(record, "sync_mb"));
+			}
+			state->options.record_direct = json_is_true(json_object_get(record, "direct"));
+		}
+		{ //status : {"interval":0.1,"snapshot_interval":5,"compress_threshold":512,"intervals":{"menu":1.0}}
+			STATUS_PUBLISHER_T *pub = &state->status_publisher;
+			json_t *status = json_object_get(options, "status");
+			if (json_object_get(status, "interval")) {
+				pub->interval = json_number_value(json_object_get(status, "interval"));
+			}
+			if (json_object_get(status, "snapshot_interval")) {
+				pub->snapshot_interval = json_number_value(json_object_get(status, "snapshot_interval"));
+			}
+			if (json_object_get(status, "compress_threshold")) {
+				pub->compress_threshold = json_number_value(json_object_get(status, "compress_threshold"));
+			}
+			json_t *intervals = json_object_get(status, "intervals");
+			const char *key;
+			json_t *value;
+			json_object_foreach(intervals, key, value)
+			{
+				status_publisher_set_interval(pub, key, json_number_value(value));
+			}
+		}
 
 		json_decref(options);
 	}
@@ -684,6 +765,31 @@ static void save_options(PICAM360CAPTURE_T *state) {
 		json_object_set_new(options, "rtcp_tx_port", json_integer(state->options.rtcp_tx_port));
 		json_object_set_new(options, "rtcp_tx_type", json_string(rtp_get_rtp_socket_type_str(state->options.rtcp_tx_type)));
 	}
+	json_object_set_new(options, "shader_cache_dir", json_string(state->options.shader_cache_dir));
+	json_object_set_new(options, "xml_meta", json_boolean(state->options.xml_meta));
+	json_object_set_new(options, "metrics_port", json_integer(state->options.metrics_port));
+	{
+		json_t *record = json_object();
+		json_object_set_new(record, "buffer_mb", json_integer(state->options.record_buffer_mb));
+		json_object_set_new(record, "sync_mb", json_integer(state->options.record_sync_mb));
+		json_object_set_new(record, "direct", json_boolean(state->options.record_direct));
+		json_object_set_new(options, "record", record);
+	}
+	{
+		STATUS_PUBLISHER_T *pub = &state->status_publisher;
+		json_t *status = json_object();
+		json_object_set_new(status, "interval", json_real(pub->interval));
+		json_object_set_new(status, "snapshot_interval", json_real(pub->snapshot_interval));
+		json_object_set_new(status, "compress_threshold", json_integer(pub->compress_threshold));
+		if (pub->intervals) {
+			json_t *intervals = json_object();
+			for (STATUS_PUBLISHER_INTERVAL_T *item = pub->intervals; item != NULL; item = item->next) {
+				json_object_set_new(intervals, item->name, json_real(item->interval));
+			}
+			json_object_set_new(status, "intervals", intervals);
+		}
+		json_object_set_new(options, "status", status);
+	}
 
 	if (state->plugin_paths) {
 		json_t *plugin_paths = json_array();
@@ -693,6 +799,21 @@ static void save_options(PICAM360CAPTURE_T *state) {
 		json_object_set_new(options, "plugin_paths", plugin_paths);
 	}
 
+	if (state->encoder_pool.entries) {
+		json_t *encoder_pool = json_array();
+		for (ENCODER_POOL_ENTRY_T *entry = state->encoder_pool.entries; entry != NULL; entry = entry->next) {
+			json_t *value = json_object();
+			json_object_set_new(value, "name", json_string(entry->key.name));
+			json_object_set_new(value, "width", json_integer(entry->key.width));
+			json_object_set_new(value, "height", json_integer(entry->key.height));
+			json_object_set_new(value, "fps", json_integer(entry->key.fps));
+			json_object_set_new(value, "kbps", json_integer(entry->key.kbps));
+			json_object_set_new(value, "num", json_integer(entry->num));
+			json_array_insert_new(encoder_pool, 0, value); //entries are in reverse order
+		}
+		json_object_set_new(options, "encoder_pool", encoder_pool);
+	}
+
 	for (int i = 0; state->plugins[i] != NULL; i++) {
 		if (state->plugins[i]->save_options) {
 			state->plugins[i]->save_options(state->plugins[i]->user_data, options);
@@ -742,6 +863,11 @@ static void save_options_ex(PICAM360CAPTURE_T *state) {
 static void exit_func(void)
 // Function to be passed to atexit().
 {
+	encoder_pool_deinit(&state->encoder_pool);
+	status_publisher_deinit(&state->status_publisher);
+	metrics_registry_stop(&state->metrics); //metrics are kept, plugin threads may still update them
+	command_channel_deinit(&state->command_channel);
+
 #ifdef USE_GLES
 	deinit_textures(state);
 
@@ -771,22 +897,60 @@ bool inputAvailable() {
 	return (FD_ISSET(0, &fds));
 }
 
+//a slot is owned by one frame id, so that frames never share the pose and its seq
+static void attach_pose_slot(FRAME_T *frame) {
+	frame->pose_slot = -1;
+	for (int i = 0; i < POSE_SLOT_NUM; i++) {
+		if (__atomic_load_n(&state->pose_slot_frame_ids[i], __ATOMIC_RELAXED) < 0) {
+			frame->pose_slot = i;
+			frame->pose_version = __atomic_load_n(&state->pose_slots[i].version, __ATOMIC_ACQUIRE); //pose of previous owner
+			__atomic_store_n(&state->pose_slot_frame_ids[i], frame->id, __ATOMIC_RELEASE);
+			return;
+		}
+	}
+	printf("no pose slot for id=%d, view is not updated by clients\n", frame->id);
+}
+
+static void detach_pose_slot(FRAME_T *frame) {
+	if (frame->pose_slot >= 0) {
+		__atomic_store_n(&state->pose_slot_frame_ids[frame->pose_slot], -1, __ATOMIC_RELEASE);
+		frame->pose_slot = -1;
+	}
+}
+
+//NULL if no frame of the id takes poses
+static POSE_SLOT_T *get_pose_slot(int frame_id) {
+	for (int i = 0; i < POSE_SLOT_NUM; i++) {
+		if (__atomic_load_n(&state->pose_slot_frame_ids[i], __ATOMIC_ACQUIRE) == frame_id) {
+			return &state->pose_slots[i];
+		}
+	}
+	return NULL;
+}
+
 FRAME_T *create_frame(PICAM360CAPTURE_T *state, int argc, char *argv[]) {
 	GLenum err;
 	int opt;
 	int render_width = 512;
 	int render_height = 512;
+	char rendition_spec[256] = { };
 	FRAME_T *frame = malloc(sizeof(FRAME_T));
 	memset(frame, 0, sizeof(FRAME_T));
 	frame->id = state->next_frame_id++;
 	frame->renderer = state->renderers[0];
 	frame->output_mode = OUTPUT_MODE_NONE;
 	frame->output_type = OUTPUT_TYPE_NONE;
-	frame->output_fd = -1;
+	frame->output_writer = NULL;
 	frame->fov = 120;
+	frame->tile_index = -1;
+	frame->rendition_index = -1;
+	view_predictor_init(&frame->view_predictor);
+	frame->view_predictor.enabled = false;
+	rate_controller_init(&frame->rate_controller);
+	frame->render_scale = 1.0;
 
 	optind = 1; // reset getopt
-	while ((opt = getopt(argc, argv, "w:h:m:o:s:v:f:k:")) != -1) {
+	while ((opt = getopt(argc, argv, "w:h:m:o:s:v:f:k:T:p:a:R:")) != -1) {
 		switch (opt) {
 		case 'w':
 			sscanf(optarg, "%d", &render_width);
@@ -813,22 +977,16 @@ FRAME_T *create_frame(PICAM360CAPTURE_T *state, int argc, char *argv[]) {
 			break;
 		case 's':
 			frame->output_mode = OUTPUT_MODE_STREAM;
-			for (int i = 0; state->encoder_factories[i] != NULL; i++) {
-				if (strncmp(state->encoder_factories[i]->name, optarg, sizeof(frame->encoder)) == 0) {
-					state->encoder_factories[i]->create_encoder(state->encoder_factories[i]->user_data, &frame->encoder);
+			{
+				ENCODER_FACTORY_T *encoder_factory = get_encoder_factory(optarg);
+				if (encoder_factory) {
+					encoder_factory->create_encoder(encoder_factory->user_data, &frame->encoder);
 				}
 			}
 			if (frame->encoder == NULL) {
 				printf("%s is not supported\n", optarg);
 			}
-			//h264 or mjpeg
-			if (strcasecmp(optarg, "h265") == 0) {
-				frame->output_type = OUTPUT_TYPE_H265;
-			} else if (strcasecmp(optarg, "h264") == 0) {
-				frame->output_type = OUTPUT_TYPE_H264;
-			} else {
-				frame->output_type = OUTPUT_TYPE_MJPEG;
-			}
+			frame->output_type = get_output_type(optarg);
 			break;
 		case 'f':
 			sscanf(optarg, "%f", &frame->fps);
@@ -836,6 +994,20 @@ FRAME_T *create_frame(PICAM360CAPTURE_T *state, int argc, char *argv[]) {
 		case 'k':
 			sscanf(optarg, "%f", &frame->kbps);
 			break;
+		case 'T':
+			sscanf(optarg, "%d", &frame->tile_scale);
+			break;
+		case 'p': //view prediction : gain[,horizon_ms]
+			sscanf(optarg, "%f,%f", &frame->view_predictor.gain, &frame->view_predictor.horizon_ms);
+			frame->view_predictor.enabled = (frame->view_predictor.gain > 0);
+			break;
+		case 'R': //simulcast renditions
+			strncpy(rendition_spec, optarg, sizeof(rendition_spec) - 1);
+			break;
+		case 'a': //adaptive bitrate : min_kbps[,max_kbps]
+			sscanf(optarg, "%f,%f", &frame->rate_controller.min_kbps, &frame->rate_controller.max_kbps);
+			frame->rate_controller.enabled = true;
+			break;
 		default:
 			break;
 		}
@@ -899,6 +1071,19 @@ FRAME_T *create_frame(PICAM360CAPTURE_T *state, int argc, char *argv[]) {
 		frame->img_buff = (unsigned char*) malloc(size);
 	}
 
+	if (frame->tile_scale > 0) {
+		create_tiles(state, frame);
+	}
+	if (rendition_spec[0] != '\0') {
+		create_renditions(state, frame, rendition_spec);
+	}
+	if (frame->rate_controller.enabled && (frame->tile_scale > 0 || frame->renditions[0] || frame->output_mode != OUTPUT_MODE_STREAM)) {
+		printf("adaptive bitrate is only for a not tiled stream without renditions\n");
+		frame->rate_controller.enabled = false;
+	}
+
+	attach_pose_slot(frame);
+
 	printf("create_frame id=%d\n", frame->id);
 
 	return frame;
@@ -911,6 +1096,10 @@ bool delete_frame(FRAME_T *frame) {
 		frame->befor_deleted_callback(state, frame);
 	}
 
+	detach_pose_slot(frame);
+	delete_tiles(frame);
+	delete_renditions(frame);
+
 	if (frame->framebuffer) {
 		glDeleteFramebuffers(1, &frame->framebuffer);
 		frame->framebuffer = 0;
@@ -929,22 +1118,811 @@ bool delete_frame(FRAME_T *frame) {
 	}
 
 	if (frame->encoder) { //stop record
-		frame->encoder->release(frame->encoder);
-		frame->encoder = NULL;
+		stop_encoder(frame);
 	}
 
-	if (frame->output_fd >= 0) {
-		close(frame->output_fd);
-		frame->output_fd = -1;
-	}
+	close_output(frame);
 
 	free(frame);
 
 	return true;
 }
 
+static float get_default_kbps(enum OUTPUT_TYPE output_type, int width, int height) {
+	float kbps;
+	float ave_sq = sqrt((float) width * (float) height) / 1.2;
+	if (output_type == OUTPUT_TYPE_H265) {
+		if (ave_sq <= 240) {
+			kbps = 100;
+		} else if (ave_sq <= 320) {
+			kbps = 200;
+		} else if (ave_sq <= 480) {
+			kbps = 400;
+		} else if (ave_sq <= 640) {
+			kbps = 800;
+		} else if (ave_sq <= 960) {
+			kbps = 1600;
+		} else {
+			kbps = 3200;
+		}
+	} else if (output_type == OUTPUT_TYPE_H264) {
+		if (ave_sq <= 240) {
+			kbps = 200;
+		} else if (ave_sq <= 320) {
+			kbps = 400;
+		} else if (ave_sq <= 480) {
+			kbps = 800;
+		} else if (ave_sq <= 640) {
+			kbps = 1600;
+		} else if (ave_sq <= 960) {
+			kbps = 3200;
+		} else {
+			kbps = 6400;
+		}
+	} else {
+		if (ave_sq <= 240) {
+			kbps = 800;
+		} else if (ave_sq <= 320) {
+			kbps = 1600;
+		} else if (ave_sq <= 480) {
+			kbps = 3200;
+		} else if (ave_sq <= 640) {
+			kbps = 6400;
+		} else if (ave_sq <= 960) {
+			kbps = 12800;
+		} else {
+			kbps = 25600;
+		}
+	}
+	return kbps;
+}
+
 static void stream_callback(unsigned char *data, unsigned int data_len, void *frame_data, void *user_data);
 
+//frame->output_writer and output_muxer, held by encoder output thread while writing
+static pthread_mutex_t lg_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lg_closed_dropped_bytes = 0; //of closed files, with lg_output_mutex
+
+static ASYNC_WRITER_T *open_output_writer(const char *path) {
+	const uint64_t MB = 1024 * 1024;
+	return async_writer_open(path, state->options.record_buffer_mb * MB, state->options.record_sync_mb * MB, state->options.record_direct);
+}
+
+//returns false without memory, open failure of the file is in record stats
+static bool start_output_writer(FRAME_T *frame) {
+	ASYNC_WRITER_T *writer = open_output_writer(frame->output_filepath);
+	if (writer == NULL) {
+		printf("error at start record to %s\n", frame->output_filepath);
+		return false;
+	}
+	pthread_mutex_lock(&lg_output_mutex);
+	frame->output_writer = writer;
+	pthread_mutex_unlock(&lg_output_mutex);
+	printf("start record to %s\n", frame->output_filepath);
+	return true;
+}
+
+static bool close_output(FRAME_T *frame) {
+	//encoder output thread uses them only with lg_output_mutex, nobody sees them after this
+	pthread_mutex_lock(&lg_output_mutex);
+	ASYNC_WRITER_T *writer = frame->output_writer;
+	MP4_MUXER_T *muxer = frame->output_muxer;
+	frame->output_writer = NULL;
+	frame->output_muxer = NULL;
+	{ //kept in total so that the counter does not go back, writers are freed by close
+		ASYNC_WRITER_T *closing = muxer ? muxer->writer : writer;
+		if (closing) {
+			ASYNC_WRITER_STATS_T stats;
+			async_writer_get_stats(closing, &stats);
+			lg_closed_dropped_bytes += stats.dropped_bytes;
+		}
+	}
+	pthread_mutex_unlock(&lg_output_mutex);
+	if (writer) {
+		async_writer_close(writer);
+	}
+	if (muxer) {
+		mp4_muxer_close(muxer);
+	}
+	return (writer || muxer);
+}
+
+//takes a pre-initialized encoder from pool if it matches, otherwise initializes frame->encoder
+static void start_encoder(FRAME_T *frame, int width, int height, float kbps, float fps, void *user_data) {
+	ENCODER_POOL_KEY_T key = { };
+	strncpy(key.name, frame->encoder->name, sizeof(key.name) - 1);
+	key.width = width;
+	key.height = height;
+	key.kbps = kbps;
+	key.fps = fps;
+	frame->encoder_lease = encoder_pool_lease(&state->encoder_pool, frame->encoder, &key, stream_callback, user_data);
+	frame->encoder = frame->encoder_lease->encoder;
+}
+
+static void stop_encoder(FRAME_T *frame) {
+	if (frame->encoder_lease) {
+		encoder_pool_return(&state->encoder_pool, frame->encoder_lease);
+		frame->encoder_lease = NULL;
+	} else {
+		frame->encoder->release(frame->encoder);
+	}
+	frame->encoder = NULL;
+}
+
+static void get_render_size(FRAME_T *frame, int *width, int *height) {
+	if (frame->render_scale <= 0 || frame->render_scale >= 1.0) {
+		*width = frame->width;
+		*height = frame->height;
+	} else { //aligned for readback and encoder
+		*width = MAX((int) (frame->width * frame->render_scale) & ~15, 16);
+		*height = MAX((int) (frame->height * frame->render_scale) & ~15, 16);
+	}
+}
+
+//exact name first, then a codec name like "mjpeg" matches any <impl>_<codec> e.g. "turbojpeg_mjpeg"
+static ENCODER_FACTORY_T *get_encoder_factory(const char *name) {
+	for (int i = 0; state->encoder_factories[i] != NULL; i++) {
+		if (strncmp(state->encoder_factories[i]->name, name, 64) == 0) {
+			return state->encoder_factories[i];
+		}
+	}
+	char suffix[66];
+	snprintf(suffix, sizeof(suffix), "_%s", name);
+	for (int i = 0; state->encoder_factories[i] != NULL; i++) {
+		if (end_width(state->encoder_factories[i]->name, suffix)) {
+			return state->encoder_factories[i];
+		}
+	}
+	return NULL;
+}
+
+//replaces encoders of a recording frame, start_record re-inits them with current parameters
+static bool restart_encoder(FRAME_T *frame) {
+	ENCODER_FACTORY_T *encoder_factory = get_encoder_factory(frame->encoder->name);
+	if (encoder_factory == NULL) {
+		return false;
+	}
+	stop_encoder(frame);
+	encoder_factory->create_encoder(encoder_factory->user_data, &frame->encoder);
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		FRAME_T *tile = frame->tiles[i];
+		if (tile && tile->is_recording) {
+			stop_encoder(tile);
+			encoder_factory->create_encoder(encoder_factory->user_data, &tile->encoder);
+			tile->is_recording = false;
+		}
+	}
+	for (int i = 0; i < MAX_RENDITION_NUM; i++) {
+		FRAME_T *rendition = frame->renditions[i];
+		if (rendition && rendition->is_recording) {
+			ENCODER_FACTORY_T *rendition_factory = get_encoder_factory(rendition->encoder->name);
+			if (rendition_factory == NULL) { //keeps current encoder
+				printf("%s is not available, rendition %d is not restarted\n", rendition->encoder->name, i);
+				continue;
+			}
+			stop_encoder(rendition);
+			rendition_factory->create_encoder(rendition_factory->user_data, &rendition->encoder);
+			rendition->is_recording = false;
+		}
+	}
+	frame->is_recording = false;
+	return true;
+}
+
+//next frame of every layer is encoded as IDR, requests within interval share one keyframe
+static void request_keyframe(FRAME_T *frame) {
+	if (!frame->is_recording || frame->encoder == NULL || frame->output_type == OUTPUT_TYPE_MJPEG) { //every mjpeg frame is a keyframe
+		return;
+	}
+	struct timeval now;
+	struct timeval diff;
+	gettimeofday(&now, NULL);
+	timersub(&now, &frame->last_keyframe_requested, &diff);
+	if (diff.tv_sec * 1000 + diff.tv_usec / 1000 < KEYFRAME_REQUEST_INTERVAL_MS) {
+		return;
+	}
+	frame->last_keyframe_requested = now;
+
+	if (frame->encoder->request_keyframe == NULL) {
+		//a restart re-forks external encoders, otherwise the next gop serves the request
+		timersub(&now, &frame->last_keyframe_restarted, &diff);
+		if (diff.tv_sec * 1000 + diff.tv_usec / 1000 < KEYFRAME_RESTART_INTERVAL_MS) {
+			return;
+		}
+		frame->last_keyframe_restarted = now;
+		restart_encoder(frame);
+		printf("request_keyframe id=%d : encoder restarted\n", frame->id);
+		return;
+	}
+	frame->encoder->request_keyframe(frame->encoder);
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		FRAME_T *tile = frame->tiles[i];
+		if (tile && tile->is_recording && tile->encoder->request_keyframe) {
+			tile->encoder->request_keyframe(tile->encoder);
+		}
+	}
+	for (int i = 0; i < MAX_RENDITION_NUM; i++) { //renditions may use another encoder
+		FRAME_T *rendition = frame->renditions[i];
+		if (rendition && rendition->is_recording && rendition->output_type != OUTPUT_TYPE_MJPEG && rendition->encoder->request_keyframe) {
+			rendition->encoder->request_keyframe(rendition->encoder);
+		}
+	}
+}
+
+typedef struct _SAVE_JPEG_T {
+	char path[256];
+	unsigned char *img_buff; //copy, render thread goes on
+	int width;
+	int height;
+	ENCODER_FACTORY_T *encoder_factory;
+	int fd;
+	unsigned char last_byte;
+	bool finished;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} SAVE_JPEG_T;
+
+static int lg_save_jpeg_num = 0; //in flight
+static pthread_mutex_t lg_save_jpeg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lg_save_jpeg_cond = PTHREAD_COND_INITIALIZER;
+
+static void save_jpeg_callback(unsigned char *data, unsigned int data_len, void *frame_data, void *user_data) {
+	SAVE_JPEG_T *save = (SAVE_JPEG_T*) user_data;
+	if (frame_data) {
+		free(frame_data);
+	}
+	if (data_len == 0) {
+		return;
+	}
+	pthread_mutex_lock(&save->mutex);
+	if (!save->finished) {
+		write(save->fd, data, data_len);
+		unsigned char prev = (data_len >= 2) ? data[data_len - 2] : save->last_byte;
+		if (prev == 0xFF && data[data_len - 1] == 0xD9) { //EOI, encoders may deliver a frame in pieces
+			save->finished = true;
+			pthread_cond_broadcast(&save->cond);
+		}
+		save->last_byte = data[data_len - 1];
+	}
+	pthread_mutex_unlock(&save->mutex);
+}
+
+static void *save_jpeg_thread_func(void *arg) {
+	SAVE_JPEG_T *save = (SAVE_JPEG_T*) arg;
+	ENCODER_FACTORY_T *encoder_factory = save->encoder_factory;
+	ENCODER_T *encoder = NULL;
+	encoder_factory->create_encoder(encoder_factory->user_data, &encoder);
+	encoder->init(encoder, save->width, save->height, get_default_kbps(OUTPUT_TYPE_MJPEG, save->width, save->height), 1, save_jpeg_callback,
+			save);
+	encoder->add_frame(encoder, save->img_buff, NULL);
+
+	struct timespec timeout;
+	clock_gettime(CLOCK_REALTIME, &timeout);
+	timeout.tv_sec += SAVE_JPEG_TIMEOUT_SEC;
+	pthread_mutex_lock(&save->mutex);
+	while (!save->finished) {
+		if (pthread_cond_timedwait(&save->cond, &save->mutex, &timeout) != 0) {
+			break;
+		}
+	}
+	bool finished = save->finished;
+	save->finished = true; //late output is dropped
+	pthread_mutex_unlock(&save->mutex);
+
+	encoder->release(encoder);
+	close(save->fd);
+	if (finished) {
+		printf("snap saved to %s\n", save->path);
+	} else {
+		printf("timeout on jpeg encoding %s\n", save->path);
+		unlink(save->path); //no partial file
+	}
+	pthread_cond_destroy(&save->cond);
+	pthread_mutex_destroy(&save->mutex);
+	free(save->img_buff);
+	free(save);
+
+	pthread_mutex_lock(&lg_save_jpeg_mutex);
+	lg_save_jpeg_num--;
+	pthread_cond_broadcast(&lg_save_jpeg_cond);
+	pthread_mutex_unlock(&lg_save_jpeg_mutex);
+	return NULL;
+}
+
+//one frame through whichever plugin serves mjpeg, encoded on its own thread
+//false if it could not be started, the result is printed by the thread
+static bool save_jpeg(const unsigned char *img_buff, int width, int height, const char *path) {
+	ENCODER_FACTORY_T *encoder_factory = get_encoder_factory("mjpeg");
+	if (encoder_factory == NULL) {
+		printf("no mjpeg encoder for %s\n", path);
+		return false;
+	}
+	SAVE_JPEG_T *save = (SAVE_JPEG_T*) malloc(sizeof(SAVE_JPEG_T));
+	memset(save, 0, sizeof(SAVE_JPEG_T));
+	strncpy(save->path, path, sizeof(save->path) - 1);
+	save->fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, /*  */
+	S_IRUSR | S_IWUSR | /* rw */
+	S_IRGRP | S_IWGRP | /* rw */
+	S_IROTH | S_IXOTH);
+	if (save->fd < 0) {
+		printf("can not open %s\n", path);
+		free(save);
+		return false;
+	}
+	save->width = width;
+	save->height = height;
+	save->encoder_factory = encoder_factory;
+	save->img_buff = (unsigned char*) malloc(width * height * 3);
+	memcpy(save->img_buff, img_buff, width * height * 3);
+	pthread_mutex_init(&save->mutex, 0);
+	pthread_cond_init(&save->cond, 0);
+
+	pthread_mutex_lock(&lg_save_jpeg_mutex);
+	while (lg_save_jpeg_num >= SAVE_JPEG_MAX_NUM) { //back pressure to renderer
+		pthread_cond_wait(&lg_save_jpeg_cond, &lg_save_jpeg_mutex);
+	}
+	lg_save_jpeg_num++;
+	pthread_mutex_unlock(&lg_save_jpeg_mutex);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, save_jpeg_thread_func, (void*) save);
+	pthread_detach(thread);
+	return true;
+}
+
+//bitrate is changed in place if encoder supports it, size or fps change restarts encoder
+static void update_send_kbps(FRAME_T *frame, double now) {
+	uint64_t bytes = __atomic_load_n(&frame->stream_bytes, __ATOMIC_RELAXED);
+	if (frame->send_time_last <= 0 || bytes < frame->send_bytes_last) {
+		frame->send_bytes_last = bytes;
+		frame->send_time_last = now;
+		return;
+	}
+	double elapsed = now - frame->send_time_last;
+	if (elapsed < 0.5) {
+		return;
+	}
+	float kbps = (bytes - frame->send_bytes_last) * 8 / elapsed / 1000;
+	frame->send_kbps = (frame->send_kbps > 0) ? frame->send_kbps * 0.5 + kbps * 0.5 : kbps;
+	frame->send_bytes_last = bytes;
+	frame->send_time_last = now;
+}
+
+static void apply_rate_control(FRAME_T *frame, double now) {
+	RATE_CONTROLLER_T *rc = &frame->rate_controller;
+	update_send_kbps(frame, now);
+	if (!rate_controller_update(rc, now, frame->send_kbps)) {
+		return;
+	}
+	bool restart = (rc->scale != frame->render_scale || frame->encoder->reconfigure == NULL);
+	if (restart && rc->scale == frame->render_scale && rc->level == rc->applied_level
+			&& fabs(rc->target_kbps - rc->applied_kbps) < rc->applied_kbps * 0.25) {
+		return; //not worth the keyframe of a restart
+	}
+	if (!restart) {
+		frame->encoder->reconfigure(frame->encoder, rc->target_kbps, rc->fps);
+	} else if (!restart_encoder(frame)) {
+		return;
+	}
+	printf("rate control id=%d : %d kbps %.1f fps scale %.2f (loss %.3f delay %s %.1fms/s)%s\n", frame->id, (int) rc->target_kbps, rc->fps, rc->scale,
+			rc->loss, rate_controller_get_delay_state_str(rc), rc->delay_slope, restart ? " restart" : "");
+	rate_controller_applied(rc);
+}
+
+static void *lg_downscale_program = NULL;
+static GLuint lg_downscale_vbo = 0;
+static GLint lg_downscale_tex_loc = -1;
+static GLint lg_downscale_tex_step_loc = -1;
+#ifndef USE_VAO
+static GLint lg_downscale_position_loc = -1;
+#endif
+#ifdef USE_VAO
+static GLuint lg_downscale_vao = 0;
+#endif
+
+static void init_downscale_program() {
+#ifdef USE_GLES
+	char *common = "#version 100\n";
+#else
+	char *common = "#version 330\n";
+#endif
+	float points[] = { 0, 0, 0, 1, 1, 0, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1 };
+
+	glGenBuffers(1, &lg_downscale_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, lg_downscale_vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
+#ifdef USE_VAO
+	glGenVertexArrays(1, &lg_downscale_vao);
+	glBindVertexArray(lg_downscale_vao);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	lg_downscale_program = GLProgram_new_from_memory(common, (const char*) downscale_vsh, downscale_vsh_len, (const char*) downscale_fsh,
+			downscale_fsh_len);
+
+	int program = GLProgram_GetId(lg_downscale_program);
+	lg_downscale_tex_loc = glGetUniformLocation(program, "tex");
+	lg_downscale_tex_step_loc = glGetUniformLocation(program, "tex_step");
+#ifndef USE_VAO
+	lg_downscale_position_loc = glGetAttribLocation(program, "vPosition");
+#endif
+}
+
+//render target of a downscale pass
+static void create_downscale_target(GLuint *framebuffer, GLuint *texture, int width, int height) {
+	glGenFramebuffers(1, framebuffer);
+	glGenTextures(1, texture);
+	glBindTexture(GL_TEXTURE_2D, *texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, *framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *texture, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//filtered pass from frame texture into img_buff, expected within 4x of frame to avoid aliasing
+static void downscale_texture(GLuint texture, GLuint framebuffer, int width, int height, unsigned char *img_buff) {
+	if (lg_downscale_program == NULL) {
+		init_downscale_program();
+	}
+	int program = GLProgram_GetId(lg_downscale_program);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER, lg_downscale_vbo);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glUniform1i(lg_downscale_tex_loc, 0);
+	glUniform2f(lg_downscale_tex_step_loc, 0.25 / width, 0.25 / height);
+#ifdef USE_VAO
+	glBindVertexArray(lg_downscale_vao);
+#else
+	GLuint loc = lg_downscale_position_loc;
+	glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(loc);
+#endif
+	glDisable(GL_BLEND);
+	glDisable(GL_CULL_FACE);
+	glViewport(0, 0, width, height);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glFinish();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1); //rows of any width are packed
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, img_buff);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+#ifdef USE_VAO
+	glBindVertexArray(0);
+#else
+	glDisableVertexAttribArray(loc);
+#endif
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+//tiled streaming
+//the 3x2 layout of a cubemap renderer is rendered once in world coordinate,
+//faces in client view are encoded as independent high quality tiles (PT_TILE_BASE + face)
+//and the whole layout is downscaled by tile_scale as low quality layer (PT_CAM_BASE)
+static bool is_tileable_renderer(RENDERER_T *renderer) {
+	return renderer != NULL && strstr(renderer->projection, ":3x2:") != NULL;
+}
+
+//same as cubemap.vsh
+static void get_face_direction(int face, float s, float t, bool eac, float *dir) {
+	if (eac) {
+		s = tan(s * M_PI / 4);
+		t = tan(t * M_PI / 4);
+	}
+	switch (face) {
+	case 0:
+		dir[0] = 1.0, dir[1] = -t, dir[2] = -s;
+		break;
+	case 1:
+		dir[0] = -1.0, dir[1] = -t, dir[2] = s;
+		break;
+	case 2:
+		dir[0] = s, dir[1] = 1.0, dir[2] = t;
+		break;
+	case 3:
+		dir[0] = s, dir[1] = -1.0, dir[2] = -t;
+		break;
+	case 4:
+		dir[0] = s, dir[1] = -t, dir[2] = 1.0;
+		break;
+	default:
+		dir[0] = -s, dir[1] = -t, dir[2] = -1.0;
+		break;
+	}
+	float len = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+	for (int i = 0; i < 3; i++) {
+		dir[i] /= len;
+	}
+}
+
+static void create_tiles(PICAM360CAPTURE_T *state, FRAME_T *frame) {
+	if (!is_tileable_renderer(frame->renderer) || frame->encoder == NULL || frame->double_size) {
+		printf("tiled streaming needs a 3x2 layout renderer, an encoder and render width <= 2048\n");
+		frame->tile_scale = 0;
+		return;
+	}
+	ENCODER_FACTORY_T *encoder_factory = get_encoder_factory(frame->encoder->name);
+	if (encoder_factory == NULL) {
+		printf("tiled streaming needs an encoder factory of %s\n", frame->encoder->name);
+		frame->tile_scale = 0;
+		return;
+	}
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		FRAME_T *tile = malloc(sizeof(FRAME_T));
+		memset(tile, 0, sizeof(FRAME_T));
+		tile->id = frame->id;
+		tile->tile_index = i;
+		tile->rendition_index = -1;
+		tile->renderer = frame->renderer;
+		tile->output_mode = OUTPUT_MODE_STREAM;
+		tile->output_type = frame->output_type;
+		tile->output_writer = NULL;
+		tile->width = frame->width / 3;
+		tile->height = frame->height / 2;
+		tile->img_width = tile->width;
+		tile->img_height = tile->height;
+		tile->img_buff = (unsigned char*) malloc(tile->width * tile->height * 3);
+		encoder_factory->create_encoder(encoder_factory->user_data, &tile->encoder);
+		frame->tiles[i] = tile;
+	}
+	frame->lq_img_buff = (unsigned char*) malloc((frame->width / frame->tile_scale) * (frame->height / frame->tile_scale) * 3);
+	create_downscale_target(&frame->lq_framebuffer, &frame->lq_texture, frame->width / frame->tile_scale, frame->height / frame->tile_scale);
+	frame->last_tile_mask = 0;
+}
+
+static void delete_tiles(FRAME_T *frame) {
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		if (frame->tiles[i]) {
+			delete_frame(frame->tiles[i]);
+			frame->tiles[i] = NULL;
+		}
+	}
+	if (frame->lq_img_buff) {
+		free(frame->lq_img_buff);
+		frame->lq_img_buff = NULL;
+	}
+	if (frame->lq_framebuffer) {
+		glDeleteFramebuffers(1, &frame->lq_framebuffer);
+		frame->lq_framebuffer = 0;
+	}
+	if (frame->lq_texture) {
+		glDeleteTextures(1, &frame->lq_texture);
+		frame->lq_texture = 0;
+	}
+}
+
+static void init_tile_encoders(FRAME_T *frame, float fps) {
+	frame->last_tile_mask = 0; //new encoders start with keyframes
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		FRAME_T *tile = frame->tiles[i];
+		float kbps = get_default_kbps(tile->output_type, tile->width, tile->height);
+		start_encoder(tile, tile->width, tile->height, kbps, fps, tile);
+		tile->is_recording = true;
+	}
+}
+
+static uint32_t get_visible_tiles(PICAM360CAPTURE_T *state, FRAME_T *frame, VECTOR4D_T view_quat) {
+	const VECTOR4D_T identity_quat = { .ary = { 0, 0, 0, 1 } };
+	float view_attitude[16];
+	float world_attitude[16];
+	float cam_dir[3];
+	float view_dir[3];
+	get_cam_attitude(state, view_quat, 0, view_attitude);
+	get_cam_attitude(state, identity_quat, 0, world_attitude);
+	for (int i = 0; i < 3; i++) { //forward(0,0,1) of the view in camera coordinate
+		cam_dir[i] = view_attitude[2 * 4 + i];
+	}
+	for (int j = 0; j < 3; j++) { //back to world coordinate with transposed rotation
+		view_dir[j] = 0;
+		for (int i = 0; i < 3; i++) {
+			view_dir[j] += world_attitude[j * 4 + i] * cam_dir[i];
+		}
+	}
+
+	uint32_t tile_mask = 0;
+	{ //face including the view direction
+		int axis = 0;
+		for (int i = 1; i < 3; i++) {
+			if (fabs(view_dir[i]) > fabs(view_dir[axis])) {
+				axis = i;
+			}
+		}
+		tile_mask |= 1 << (axis * 2 + (view_dir[axis] < 0 ? 1 : 0));
+	}
+	//diagonal of the view plus margin for head motion
+	float cos_thresh = cos(fmin(frame->fov / 2 * M_SQRT2 + 10, 180) * M_PI / 180);
+	bool eac = (strncmp(frame->renderer->projection, "eac", 3) == 0);
+	for (int face = 0; face < MAX_TILE_NUM; face++) {
+		for (int k = 0; k < 9 && !(tile_mask & (1 << face)); k++) {
+			float dir[3];
+			get_face_direction(face, (k % 3) - 1, (k / 3) - 1, eac, dir);
+			float dot = dir[0] * view_dir[0] + dir[1] * view_dir[1] + dir[2] * view_dir[2];
+			if (dot > cos_thresh) {
+				tile_mask |= 1 << face;
+			}
+		}
+	}
+	return tile_mask;
+}
+
+static void add_tiles_frame(FRAME_T *frame, FRAME_INFO_T *frame_info) {
+	for (int i = 0; i < MAX_TILE_NUM; i++) {
+		if (!(frame_info->tile_mask & (1 << i))) {
+			continue;
+		}
+		FRAME_T *tile = frame->tiles[i];
+		if (!(frame->last_tile_mask & (1 << i)) && tile->encoder->request_keyframe) { //references of the client are stale
+			tile->encoder->request_keyframe(tile->encoder);
+		}
+		int x = (i % 3) * tile->width;
+		int y = (i / 3) * tile->height;
+		for (int j = 0; j < tile->height; j++) {
+			memcpy(tile->img_buff + tile->width * 3 * j, frame->img_buff + (frame->width * (y + j) + x) * 3, tile->width * 3);
+		}
+		FRAME_INFO_T *frame_info_p = malloc(sizeof(FRAME_INFO_T));
+		memcpy(frame_info_p, frame_info, sizeof(FRAME_INFO_T));
+		tile->encoder->add_frame(tile->encoder, tile->img_buff, frame_info_p);
+	}
+	frame->last_tile_mask = frame_info->tile_mask;
+	{ //low quality layer
+		downscale_texture(frame->texture, frame->lq_framebuffer, frame->width / frame->tile_scale, frame->height / frame->tile_scale, frame->lq_img_buff);
+		FRAME_INFO_T *frame_info_p = malloc(sizeof(FRAME_INFO_T));
+		memcpy(frame_info_p, frame_info, sizeof(FRAME_INFO_T));
+		frame->encoder->add_frame(frame->encoder, frame->lq_img_buff, frame_info_p);
+	}
+}
+
+//simulcast
+//the frame is rendered once, each rendition is a GPU downscale of frame texture
+//with its own encoder and payload type (PT_RENDITION_BASE + index)
+//codec is the name or its suffix, see get_encoder_factory
+static enum OUTPUT_TYPE get_output_type(const char *encoder_name) {
+	size_t len = strlen(encoder_name);
+	const char *codec = (len >= 4) ? encoder_name + len - 4 : encoder_name;
+	if (strcasecmp(codec, "h265") == 0) {
+		return OUTPUT_TYPE_H265;
+	} else if (strcasecmp(codec, "h264") == 0) {
+		return OUTPUT_TYPE_H264;
+	} else {
+		return OUTPUT_TYPE_MJPEG;
+	}
+}
+
+//spec : WxH:encoder[:kbps][,WxH:encoder[:kbps]...]
+static void create_renditions(PICAM360CAPTURE_T *state, FRAME_T *frame, const char *spec) {
+	if (frame->output_mode != OUTPUT_MODE_STREAM || frame->tile_scale > 0 || frame->double_size) {
+		printf("simulcast needs a stream output without tiles and render width <= 2048\n");
+		return;
+	}
+	char buff[256];
+	strncpy(buff, spec, sizeof(buff) - 1);
+	buff[sizeof(buff) - 1] = '\0';
+	char *saveptr = NULL;
+	int num = 0;
+	for (char *item = strtok_r(buff, ",", &saveptr); item != NULL && num < MAX_RENDITION_NUM; item = strtok_r(NULL, ",", &saveptr)) {
+		int width = 0, height = 0;
+		char name[64] = { };
+		float kbps = 0;
+		if (sscanf(item, "%dx%d:%63[^:]:%f", &width, &height, name, &kbps) < 3 || width < 16 || height < 16) { //16 aligned below
+			printf("invalid rendition %s\n", item);
+			continue;
+		}
+		if (width > frame->width || height > frame->height) {
+			printf("rendition %dx%d is larger than frame\n", width, height);
+			continue;
+		}
+		ENCODER_FACTORY_T *encoder_factory = get_encoder_factory(name);
+		if (encoder_factory == NULL) {
+			printf("%s is not supported\n", name);
+			continue;
+		}
+		FRAME_T *rendition = malloc(sizeof(FRAME_T));
+		memset(rendition, 0, sizeof(FRAME_T));
+		rendition->id = frame->id;
+		rendition->tile_index = -1;
+		rendition->rendition_index = num;
+		rendition->renderer = frame->renderer;
+		rendition->output_mode = OUTPUT_MODE_STREAM;
+		rendition->output_type = get_output_type(name);
+		rendition->output_writer = NULL;
+		rendition->kbps = kbps;
+		rendition->width = width & ~15;
+		rendition->height = height & ~15;
+		rendition->img_width = rendition->width;
+		rendition->img_height = rendition->height;
+		rendition->img_buff = (unsigned char*) malloc(rendition->width * rendition->height * 3);
+
+		create_downscale_target(&rendition->framebuffer, &rendition->texture, rendition->width, rendition->height);
+
+		encoder_factory->create_encoder(encoder_factory->user_data, &rendition->encoder);
+		frame->renditions[num++] = rendition;
+		printf("rendition %d : %dx%d %s\n", rendition->rendition_index, rendition->width, rendition->height, name);
+	}
+}
+
+static void delete_renditions(FRAME_T *frame) {
+	for (int i = 0; i < MAX_RENDITION_NUM; i++) {
+		if (frame->renditions[i]) {
+			delete_frame(frame->renditions[i]);
+			frame->renditions[i] = NULL;
+		}
+	}
+}
+
+static void init_rendition_encoders(FRAME_T *frame, float fps) {
+	for (int i = 0; i < MAX_RENDITION_NUM; i++) {
+		FRAME_T *rendition = frame->renditions[i];
+		if (rendition == NULL || rendition->is_recording) {
+			continue;
+		}
+		float kbps = rendition->kbps;
+		if (kbps == 0) {
+			kbps = get_default_kbps(rendition->output_type, rendition->width, rendition->height);
+		}
+		start_encoder(rendition, rendition->width, rendition->height, kbps, fps, rendition);
+		rendition->is_recording = true;
+	}
+}
+
+static void add_renditions_frame(PICAM360CAPTURE_T *state, FRAME_T *frame, FRAME_INFO_T *frame_info) {
+	for (int i = 0; i < MAX_RENDITION_NUM; i++) {
+		FRAME_T *rendition = frame->renditions[i];
+		if (rendition == NULL || !rendition->is_recording) {
+			continue;
+		}
+		downscale_texture(frame->texture, rendition->framebuffer, rendition->width, rendition->height, rendition->img_buff);
+
+		FRAME_INFO_T *frame_info_p = malloc(sizeof(FRAME_INFO_T));
+		memcpy(frame_info_p, frame_info, sizeof(FRAME_INFO_T));
+		rendition->encoder->add_frame(rendition->encoder, rendition->img_buff, frame_info_p);
+	}
+}
+
+static int lg_pose_received = 0;
+static int lg_pose_received_binary = 0;
+static int lg_pose_stale = 0;
+static int lg_pose_applied = 0;
+static float lg_pose_delay_ms = 0; //received to render, ewma
+static float lg_pose_delay_max_ms = 0;
+
+static void apply_view_pose(FRAME_T *frame, const POSE_T *pose) {
+	if (frame->view_mpu == NULL || frame->view_mpu->set_quaternion == NULL) {
+		return;
+	}
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	double now_sec = now.tv_sec + now.tv_usec / 1000000.0;
+
+	state->plugin_host.lock_texture();
+	frame->view_mpu->set_quaternion(frame->view_mpu->user_data, pose->quat);
+	view_predictor_push(&frame->view_predictor, pose->quat, (pose->flags & POSE_FLAG_CLIENT_TIME) ? pose->client_time / 1000 : -1, pose->received_time);
+	if (pose->flags & POSE_FLAG_RTT) {
+		frame->view_predictor.rtt_ms = pose->rtt_ms;
+	}
+	state->plugin_host.unlock_texture();
+	if (pose->flags & POSE_FLAG_FOV) {
+		frame->fov = pose->fov;
+	}
+	if (pose->flags & POSE_FLAG_CLIENT_KEY) {
+		strncpy(frame->client_key, pose->client_key, sizeof(frame->client_key));
+		gettimeofday(&frame->server_key, NULL);
+	}
+
+	float delay_ms = (now_sec - pose->received_time) * 1000;
+	lg_pose_delay_ms = (lg_pose_applied == 0) ? delay_ms : lg_pose_delay_ms * 0.9 + delay_ms * 0.1;
+	lg_pose_delay_max_ms = MAX(lg_pose_delay_max_ms, delay_ms);
+	lg_pose_applied++;
+	metric_observe(lg_metric_pose_delay_ms, delay_ms);
+}
+
 void frame_handler() {
 	struct timeval s, f;
 	double elapsed_ms;
@@ -956,19 +1934,26 @@ void frame_handler() {
 		gettimeofday(&s, NULL);
 
 		if (frame->fps > 0) {
+			float fps = frame->fps;
+			if (frame->rate_controller.enabled && frame->rate_controller.started) {
+				fps = MIN(fps, frame->rate_controller.fps);
+			}
 			struct timeval diff;
 			timersub(&s, &frame->last_updated, &diff);
 			float diff_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-			if (diff_sec < 1.0 / frame->fps) {
+			if (diff_sec < 1.0 / fps) {
 				frame_pp = &frame->next;
 				continue;
 			}
 		}
 
+		if (frame->is_recording && frame->output_mode == OUTPUT_MODE_STREAM && frame->rate_controller.enabled) {
+			apply_rate_control(frame, s.tv_sec + s.tv_usec / 1000000.0);
+		}
+
 		//start & stop recording
 		if (frame->is_recording && frame->output_mode == OUTPUT_MODE_NONE) { //stop record
-			frame->encoder->release(frame->encoder);
-			frame->encoder = NULL;
+			stop_encoder(frame);
 
 			frame->frame_elapsed /= frame->frame_num;
 			printf("stop record : frame num : %d : fps %.3lf\n", frame->frame_num, 1000.0 / frame->frame_elapsed);
@@ -976,87 +1961,72 @@ void frame_handler() {
 			frame->output_mode = OUTPUT_MODE_NONE;
 			frame->is_recording = false;
 			frame->delete_after_processed = true;
-			if (frame->output_fd >= 0) {
-				close(frame->output_fd);
-				frame->output_fd = -1;
-			}
+			close_output(frame);
 		}
 		if (!frame->is_recording && frame->output_mode == OUTPUT_MODE_VIDEO) {
 			int ratio = frame->double_size ? 2 : 1;
 			float fps = MAX(frame->fps, 1);
-			frame->encoder->init(frame->encoder, frame->width * ratio, frame->height, 4000 * ratio, fps, stream_callback, NULL);
+			start_encoder(frame, frame->width * ratio, frame->height, 4000 * ratio, fps, NULL);
 			frame->frame_num = 0;
 			frame->frame_elapsed = 0;
 			frame->is_recording = true;
 			frame->output_start = false;
-			frame->output_fd = open(frame->output_filepath, O_CREAT | O_WRONLY | O_TRUNC, /*  */
-			S_IRUSR | S_IWUSR | /* rw */
-			S_IRGRP | S_IWGRP | /* rw */
-			S_IROTH | S_IXOTH);
-			printf("start_record saved to %s\n", frame->output_filepath);
+			start_output_writer(frame);
 		}
 		if (!frame->is_recording && frame->output_mode == OUTPUT_MODE_STREAM) {
 			int ratio = frame->double_size ? 2 : 1;
 			float fps = MAX(frame->fps, 1);
 			float kbps = frame->kbps;
-			if (kbps == 0) {
-				float ave_sq = sqrt((float) frame->width * (float) frame->height) / 1.2;
-				if (frame->output_type == OUTPUT_TYPE_H265) {
-					if (ave_sq <= 240) {
-						kbps = 100;
-					} else if (ave_sq <= 320) {
-						kbps = 200;
-					} else if (ave_sq <= 480) {
-						kbps = 400;
-					} else if (ave_sq <= 640) {
-						kbps = 800;
-					} else if (ave_sq <= 960) {
-						kbps = 1600;
-					} else {
-						kbps = 3200;
-					}
-				} else if (frame->output_type == OUTPUT_TYPE_H264) {
-					if (ave_sq <= 240) {
-						kbps = 200;
-					} else if (ave_sq <= 320) {
-						kbps = 400;
-					} else if (ave_sq <= 480) {
-						kbps = 800;
-					} else if (ave_sq <= 640) {
-						kbps = 1600;
-					} else if (ave_sq <= 960) {
-						kbps = 3200;
-					} else {
-						kbps = 6400;
-					}
-				} else {
-					if (ave_sq <= 240) {
-						kbps = 800;
-					} else if (ave_sq <= 320) {
-						kbps = 1600;
-					} else if (ave_sq <= 480) {
-						kbps = 3200;
-					} else if (ave_sq <= 640) {
-						kbps = 6400;
-					} else if (ave_sq <= 960) {
-						kbps = 12800;
-					} else {
-						kbps = 25600;
-					}
+			if (frame->tile_scale > 0) { //low quality layer
+				int width = frame->width / frame->tile_scale;
+				int height = frame->height / frame->tile_scale;
+				if (kbps == 0) {
+					kbps = get_default_kbps(frame->output_type, width, height);
+				}
+				start_encoder(frame, width, height, kbps, fps, frame);
+				init_tile_encoders(frame, fps);
+			} else {
+				if (kbps == 0) {
+					kbps = get_default_kbps(frame->output_type, frame->width, frame->height);
+				}
+				kbps *= ratio;
+				if (frame->rate_controller.enabled) {
+					rate_controller_start(&frame->rate_controller, kbps, fps, !frame->double_size);
+					kbps = frame->rate_controller.target_kbps;
+					fps = frame->rate_controller.fps;
+					frame->render_scale = frame->rate_controller.scale;
+					frame->send_time_last = 0; //send_kbps window restarts with the stream
 				}
+				int width, height;
+				get_render_size(frame, &width, &height);
+				start_encoder(frame, width * ratio, height, kbps, fps, frame);
+				init_rendition_encoders(frame, fps);
 			}
-			frame->encoder->init(frame->encoder, frame->width * ratio, frame->height, kbps * ratio, fps, stream_callback, frame);
 			frame->frame_num = 0;
 			frame->frame_elapsed = 0;
 			frame->is_recording = true;
 			printf("start_record saved to %s : %d kbps\n", frame->output_filepath, (int) kbps);
 		}
 
+		{ //newest pose since last frame
+			POSE_T pose;
+			if (frame->pose_slot >= 0 && pose_slot_read(&state->pose_slots[frame->pose_slot], &pose, &frame->pose_version) && pose.frame_id == frame->id) {
+				apply_view_pose(frame, &pose);
+			}
+		}
 		{ //rendering to buffer
 			VECTOR4D_T view_quat = { .ary = { 0, 0, 0, 1 } };
 			if (frame->view_mpu) {
 				view_quat = frame->view_mpu->get_quaternion(frame->view_mpu);
 			}
+			if (frame->view_predictor.enabled) {
+				VECTOR4D_T predicted_quat;
+				state->plugin_host.lock_texture();
+				if (view_predictor_predict(&frame->view_predictor, s.tv_sec + s.tv_usec / 1000000.0, &predicted_quat)) {
+					view_quat = predicted_quat;
+				}
+				state->plugin_host.unlock_texture();
+			}
 
 			{ //store info
 				memcpy(frame_info.client_key, frame->client_key, sizeof(frame_info.client_key));
@@ -1064,6 +2034,11 @@ void frame_handler() {
 				gettimeofday(&frame_info.before_redraw_render_texture, NULL);
 				frame_info.fov = frame->fov;
 				frame_info.view_quat = view_quat;
+				frame_info.tile_mask = 0;
+			}
+			if (frame->tile_scale > 0) { //tiles are rendered in world coordinate
+				frame_info.tile_mask = get_visible_tiles(state, frame, view_quat);
+				view_quat = (VECTOR4D_T ) { .ary = { 0, 0, 0, 1 } };
 			}
 
 			state->plugin_host.lock_texture();
@@ -1088,8 +2063,10 @@ void frame_handler() {
 				free(image_buffer);
 			} else {
 				unsigned char *image_buffer = frame->img_buff;
-				frame->img_width = frame->width;
-				frame->img_height = frame->height;
+				int width, height;
+				get_render_size(frame, &width, &height);
+				frame->img_width = width;
+				frame->img_height = height;
 				state->split = 0;
 
 				glBindFramebuffer(GL_FRAMEBUFFER, frame->framebuffer);
@@ -1098,7 +2075,7 @@ void frame_handler() {
 					redraw_info(state, frame);
 				}
 				glFinish();
-				glReadPixels(0, 0, frame->width, frame->height, GL_RGB, GL_UNSIGNED_BYTE, image_buffer);
+				glReadPixels(0, 0, frame->img_width, frame->img_height, GL_RGB, GL_UNSIGNED_BYTE, image_buffer);
 				glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			}
 			state->plugin_host.unlock_texture();
@@ -1106,62 +2083,67 @@ void frame_handler() {
 			{ //store info
 				gettimeofday(&frame_info.after_redraw_render_texture, NULL);
 			}
+			if (!state->first_frame_rendered) {
+				struct timeval diff;
+				timersub(&frame_info.after_redraw_render_texture, &state->startup_time, &diff);
+				printf("cold to first frame : %.3lf ms\n", diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0);
+				state->first_frame_rendered = true;
+			}
 		}
 
 		switch (frame->output_mode) {
 		case OUTPUT_MODE_STILL:
-#if(0)
-			SaveJpeg(frame->img_buff, frame->img_width, frame->img_height, frame->output_filepath, 70);
-			printf("snap saved to %s\n", frame->output_filepath);
+			save_jpeg(frame->img_buff, frame->img_width, frame->img_height, frame->output_filepath);
 
 			gettimeofday(&f, NULL);
 			elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
 			printf("elapsed %.3lf ms\n", elapsed_ms);
-#endif
 			frame->output_mode = OUTPUT_MODE_NONE;
 			frame->delete_after_processed = true;
 
 			snap_finished = true;
 			break;
 		case OUTPUT_MODE_VIDEO:
-			if (frame->output_fd > 0) {
+			if (frame->output_writer) {
 				frame->encoder->add_frame(frame->encoder, frame->img_buff, NULL);
 
 				gettimeofday(&f, NULL);
 				elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
 				frame->frame_num++;
 				frame->frame_elapsed += elapsed_ms;
+				metric_inc(lg_metric_frames);
+				metric_observe(lg_metric_frame_ms, elapsed_ms);
 			} else {
 				frame->output_mode = OUTPUT_MODE_NONE;
 				frame->delete_after_processed = true;
 			}
 			break;
 		case OUTPUT_MODE_STREAM:
-			if (1) {
+			if (frame->tile_scale > 0) {
+				add_tiles_frame(frame, &frame_info);
+			} else {
 				FRAME_INFO_T *frame_info_p = malloc(sizeof(FRAME_INFO_T));
 				memcpy(frame_info_p, &frame_info, sizeof(FRAME_INFO_T));
 				frame->encoder->add_frame(frame->encoder, frame->img_buff, frame_info_p);
+				add_renditions_frame(state, frame, &frame_info);
 			}
 
 			gettimeofday(&f, NULL);
 			elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
 			frame->frame_num++;
 			frame->frame_elapsed += elapsed_ms;
+			metric_inc(lg_metric_frames);
+			metric_observe(lg_metric_frame_ms, elapsed_ms);
 
 			if (end_width(frame->output_filepath, ".jpeg")) {
-#if(0)
-				SaveJpeg(frame->img_buff, frame->img_width, frame->img_height, frame->output_filepath, 70);
-				printf("snap saved to %s\n", frame->output_filepath);
-#endif
+				save_jpeg(frame->img_buff, frame->img_width, frame->img_height, frame->output_filepath);
 				frame->output_filepath[0] = '\0';
 			} else if (end_width(frame->output_filepath, ".h265")) {
 				if (frame->output_type == OUTPUT_TYPE_H265) {
 					frame->output_start = false;
-					frame->output_fd = open(frame->output_filepath, O_CREAT | O_WRONLY | O_TRUNC, /*  */
-					S_IRUSR | S_IWUSR | /* rw */
-					S_IRGRP | S_IWGRP | /* rw */
-					S_IROTH | S_IXOTH);
-					printf("start record to %s\n", frame->output_filepath);
+					if (start_output_writer(frame)) {
+						request_keyframe(frame); //file starts from parameter sets
+					}
 				} else {
 					printf("error type : %s\n", frame->output_filepath);
 				}
@@ -1169,11 +2151,29 @@ void frame_handler() {
 			} else if (end_width(frame->output_filepath, ".h264")) {
 				if (frame->output_type == OUTPUT_TYPE_H264) {
 					frame->output_start = false;
-					frame->output_fd = open(frame->output_filepath, O_CREAT | O_WRONLY | O_TRUNC, /*  */
-					S_IRUSR | S_IWUSR | /* rw */
-					S_IRGRP | S_IWGRP | /* rw */
-					S_IROTH | S_IXOTH);
-					printf("start record to %s\n", frame->output_filepath);
+					if (start_output_writer(frame)) {
+						request_keyframe(frame); //file starts from parameter sets
+					}
+				} else {
+					printf("error type : %s\n", frame->output_filepath);
+				}
+				frame->output_filepath[0] = '\0';
+			} else if (end_width(frame->output_filepath, ".mp4")) {
+				if (frame->output_type == OUTPUT_TYPE_H264 || frame->output_type == OUTPUT_TYPE_H265) {
+					//sample entry has the size of sps, which is scaled by rate control
+					int width = frame->encoder_lease ? frame->encoder_lease->key.width : frame->width;
+					int height = frame->encoder_lease ? frame->encoder_lease->key.height : frame->height;
+					enum MP4_CODEC codec = (frame->output_type == OUTPUT_TYPE_H265) ? MP4_CODEC_H265 : MP4_CODEC_H264;
+					MP4_MUXER_T *muxer = mp4_muxer_open(open_output_writer(frame->output_filepath), codec, width, height);
+					if (muxer) {
+						pthread_mutex_lock(&lg_output_mutex);
+						frame->output_muxer = muxer;
+						pthread_mutex_unlock(&lg_output_mutex);
+						request_keyframe(frame); //file starts from parameter sets
+						printf("start record to %s\n", frame->output_filepath);
+					} else {
+						printf("error at start record to %s\n", frame->output_filepath);
+					}
 				} else {
 					printf("error type : %s\n", frame->output_filepath);
 				}
@@ -1181,11 +2181,7 @@ void frame_handler() {
 			} else if (end_width(frame->output_filepath, ".mjpeg")) {
 				if (frame->output_type == OUTPUT_TYPE_MJPEG) {
 					frame->output_start = false;
-					frame->output_fd = open(frame->output_filepath, O_CREAT | O_WRONLY | O_TRUNC, /*  */
-					S_IRUSR | S_IWUSR | /* rw */
-					S_IRGRP | S_IWGRP | /* rw */
-					S_IROTH | S_IXOTH);
-					printf("start record to %s\n", frame->output_filepath);
+					start_output_writer(frame);
 				} else {
 					printf("error type : %s\n", frame->output_filepath);
 				}
@@ -1232,27 +2228,171 @@ void frame_handler() {
 
 static double calib_step = 0.01;
 
-int _command_handler(const char *_buff) {
+enum HOST_COMMAND {
+	HOST_COMMAND_EXIT,
+	HOST_COMMAND_SAVE,
+	HOST_COMMAND_ACTIVE_CAM,
+	HOST_COMMAND_SNAP,
+	HOST_COMMAND_CREATE_FRAME,
+	HOST_COMMAND_DELETE_FRAME,
+	HOST_COMMAND_SET_FPS,
+	HOST_COMMAND_SET_MODE,
+	HOST_COMMAND_START_RECORD,
+	HOST_COMMAND_STOP_RECORD,
+	HOST_COMMAND_START_AC,
+	HOST_COMMAND_STOP_AC,
+	HOST_COMMAND_START_RECORD_RAW,
+	HOST_COMMAND_STOP_RECORD_RAW,
+	HOST_COMMAND_LOAD_FILE,
+	HOST_COMMAND_PICAM360_START_RECORDING,
+	HOST_COMMAND_PICAM360_STOP_RECORDING,
+	HOST_COMMAND_PICAM360_START_LOADING,
+	HOST_COMMAND_PICAM360_STOP_LOADING,
+	HOST_COMMAND_CAM_MODE,
+	HOST_COMMAND_GET_LOADING_POS,
+	HOST_COMMAND_SET_CAMERA_ORIENTATION,
+	HOST_COMMAND_SET_VIEW_QUATERNION,
+	HOST_COMMAND_SET_VIEW_PREDICTION,
+	HOST_COMMAND_GET_VIEW_PREDICTION,
+	HOST_COMMAND_RECEIVER_REPORT,
+	HOST_COMMAND_REQUEST_KEYFRAME,
+	HOST_COMMAND_SET_ABR,
+	HOST_COMMAND_GET_ABR,
+	HOST_COMMAND_SET_STATUS_INTERVAL,
+	HOST_COMMAND_GET_STATUS_STATS,
+	HOST_COMMAND_GET_POSE_STATS,
+	HOST_COMMAND_GET_COMMAND_STATS,
+	HOST_COMMAND_GET_RECORD_STATS,
+	HOST_COMMAND_GET_METRICS,
+	HOST_COMMAND_REQUEST_STATUS_SNAPSHOT,
+	HOST_COMMAND_SET_FOV,
+	HOST_COMMAND_SET_STEREO,
+	HOST_COMMAND_SET_CONF_SYNC,
+	HOST_COMMAND_SET_PREVIEW,
+	HOST_COMMAND_ADD_CAMERA_HORIZON_R,
+	HOST_COMMAND_ADD_CAMERA_OFFSET_X,
+	HOST_COMMAND_ADD_CAMERA_OFFSET_Y,
+	HOST_COMMAND_ADD_CAMERA_OFFSET_YAW,
+	HOST_COMMAND_SET_CAMERA_HORIZON_R_BIAS,
+	HOST_COMMAND_SET_PLAY_SPEED,
+	HOST_COMMAND_ADD_COLOR_OFFSET,
+	HOST_COMMAND_SET_FRAME_SYNC,
+	HOST_COMMAND_SET_MENU_VISIBLE,
+	HOST_COMMAND_SELECT_ACTIVE_MENU,
+	HOST_COMMAND_DESELECT_ACTIVE_MENU,
+	HOST_COMMAND_GO2NEXT_MENU,
+	HOST_COMMAND_BACK2PREVIOUSE_MENU,
+	HOST_COMMAND_CALIBRATION,
+};
+
+static const struct {
+	const char *name;
+	enum HOST_COMMAND id;
+} lg_host_commands[] = { //several names may share a handler
+	{ "exit", HOST_COMMAND_EXIT },
+	{ "q", HOST_COMMAND_EXIT },
+	{ "quit", HOST_COMMAND_EXIT },
+	{ "save", HOST_COMMAND_SAVE },
+	{ "0", HOST_COMMAND_ACTIVE_CAM },
+	{ "1", HOST_COMMAND_ACTIVE_CAM },
+	{ "2", HOST_COMMAND_ACTIVE_CAM },
+	{ "3", HOST_COMMAND_ACTIVE_CAM },
+	{ "4", HOST_COMMAND_ACTIVE_CAM },
+	{ "5", HOST_COMMAND_ACTIVE_CAM },
+	{ "6", HOST_COMMAND_ACTIVE_CAM },
+	{ "7", HOST_COMMAND_ACTIVE_CAM },
+	{ "8", HOST_COMMAND_ACTIVE_CAM },
+	{ "9", HOST_COMMAND_ACTIVE_CAM },
+	{ "snap", HOST_COMMAND_SNAP },
+	{ "create_frame", HOST_COMMAND_CREATE_FRAME },
+	{ "delete_frame", HOST_COMMAND_DELETE_FRAME },
+	{ "set_fps", HOST_COMMAND_SET_FPS },
+	{ "set_mode", HOST_COMMAND_SET_MODE },
+	{ "start_record", HOST_COMMAND_START_RECORD },
+	{ "stop_record", HOST_COMMAND_STOP_RECORD },
+	{ "start_ac", HOST_COMMAND_START_AC },
+	{ "stop_ac", HOST_COMMAND_STOP_AC },
+	{ "start_record_raw", HOST_COMMAND_START_RECORD_RAW },
+	{ "stop_record_raw", HOST_COMMAND_STOP_RECORD_RAW },
+	{ "load_file", HOST_COMMAND_LOAD_FILE },
+	{ PLUGIN_NAME ".start_recording", HOST_COMMAND_PICAM360_START_RECORDING },
+	{ PLUGIN_NAME ".stop_recording", HOST_COMMAND_PICAM360_STOP_RECORDING },
+	{ PLUGIN_NAME ".start_loading", HOST_COMMAND_PICAM360_START_LOADING },
+	{ PLUGIN_NAME ".stop_loading", HOST_COMMAND_PICAM360_STOP_LOADING },
+	{ "cam_mode", HOST_COMMAND_CAM_MODE },
+	{ "get_loading_pos", HOST_COMMAND_GET_LOADING_POS },
+	{ "set_camera_orientation", HOST_COMMAND_SET_CAMERA_ORIENTATION },
+	{ "set_view_quaternion", HOST_COMMAND_SET_VIEW_QUATERNION },
+	{ "set_view_prediction", HOST_COMMAND_SET_VIEW_PREDICTION },
+	{ "get_view_prediction", HOST_COMMAND_GET_VIEW_PREDICTION },
+	{ "receiver_report", HOST_COMMAND_RECEIVER_REPORT },
+	{ "request_keyframe", HOST_COMMAND_REQUEST_KEYFRAME },
+	{ "set_abr", HOST_COMMAND_SET_ABR },
+	{ "get_abr", HOST_COMMAND_GET_ABR },
+	{ "set_status_interval", HOST_COMMAND_SET_STATUS_INTERVAL },
+	{ "get_status_stats", HOST_COMMAND_GET_STATUS_STATS },
+	{ "get_pose_stats", HOST_COMMAND_GET_POSE_STATS },
+	{ "get_command_stats", HOST_COMMAND_GET_COMMAND_STATS },
+	{ "get_record_stats", HOST_COMMAND_GET_RECORD_STATS },
+	{ "get_metrics", HOST_COMMAND_GET_METRICS },
+	{ "request_status_snapshot", HOST_COMMAND_REQUEST_STATUS_SNAPSHOT },
+	{ "set_fov", HOST_COMMAND_SET_FOV },
+	{ "set_stereo", HOST_COMMAND_SET_STEREO },
+	{ "set_conf_sync", HOST_COMMAND_SET_CONF_SYNC },
+	{ "set_preview", HOST_COMMAND_SET_PREVIEW },
+	{ "add_camera_horizon_r", HOST_COMMAND_ADD_CAMERA_HORIZON_R },
+	{ "add_camera_offset_x", HOST_COMMAND_ADD_CAMERA_OFFSET_X },
+	{ "add_camera_offset_y", HOST_COMMAND_ADD_CAMERA_OFFSET_Y },
+	{ "add_camera_offset_yaw", HOST_COMMAND_ADD_CAMERA_OFFSET_YAW },
+	{ "set_camera_horizon_r_bias", HOST_COMMAND_SET_CAMERA_HORIZON_R_BIAS },
+	{ "set_play_speed", HOST_COMMAND_SET_PLAY_SPEED },
+	{ "add_color_offset", HOST_COMMAND_ADD_COLOR_OFFSET },
+	{ "set_frame_sync", HOST_COMMAND_SET_FRAME_SYNC },
+	{ "set_menu_visible", HOST_COMMAND_SET_MENU_VISIBLE },
+	{ "select_active_menu", HOST_COMMAND_SELECT_ACTIVE_MENU },
+	{ "deselect_active_menu", HOST_COMMAND_DESELECT_ACTIVE_MENU },
+	{ "go2next_menu", HOST_COMMAND_GO2NEXT_MENU },
+	{ "back2previouse_menu", HOST_COMMAND_BACK2PREVIOUSE_MENU },
+	{ "step", HOST_COMMAND_CALIBRATION },
+	{ "u", HOST_COMMAND_CALIBRATION },
+	{ "t", HOST_COMMAND_CALIBRATION },
+	{ "d", HOST_COMMAND_CALIBRATION },
+	{ "b", HOST_COMMAND_CALIBRATION },
+	{ "l", HOST_COMMAND_CALIBRATION },
+	{ "r", HOST_COMMAND_CALIBRATION },
+	{ "s", HOST_COMMAND_CALIBRATION },
+	{ "w", HOST_COMMAND_CALIBRATION },
+};
+
+static int _command_handler(void *user_data, const char *_buff) {
 	int opt;
 	int ret = 0;
 	char buff[256];
 	strncpy(buff, _buff, sizeof(buff));
 	char *cmd = strtok(buff, " \n");
 	if (cmd == NULL) {
-		//do nothing
-	} else if (strncmp(cmd, "exit", sizeof(buff)) == 0 || strncmp(cmd, "q", sizeof(buff)) == 0 || strncmp(cmd, "quit", sizeof(buff)) == 0) {
+		return 0;
+	}
+	switch ((int) (intptr_t) user_data) {
+	case HOST_COMMAND_EXIT: {
 		printf("exit\n");
 		exit(0);
-	} else if (strncmp(cmd, "save", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SAVE: {
 		save_options(state);
 		{ //send upstream
 			char cmd[256];
 			sprintf(cmd, "upstream.save");
 			state->plugin_host.send_command(cmd);
 		}
-	} else if (cmd[1] == '\0' && cmd[0] >= '0' && cmd[0] <= '9') {
+		break;
+	}
+	case HOST_COMMAND_ACTIVE_CAM: {
 		state->active_cam = cmd[0] - '0';
-	} else if (strncmp(cmd, "snap", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SNAP: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			int id = -1;
@@ -1291,7 +2431,9 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "create_frame", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_CREATE_FRAME: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			const int kMaxArgs = 32;
@@ -1309,7 +2451,9 @@ int _command_handler(const char *_buff) {
 			frame->next = state->frame;
 			state->frame = frame;
 		}
-	} else if (strncmp(cmd, "delete_frame", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_DELETE_FRAME: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			bool delete_all = false;
@@ -1342,7 +2486,9 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "set_fps", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_FPS: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			int id = -1;
@@ -1374,7 +2520,9 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "set_mode", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_MODE: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			int id = -1;
@@ -1407,7 +2555,9 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "start_record", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_START_RECORD: {
 		char *param = strtok(NULL, "\n");
 		if (param != NULL) {
 			int id = -1;
@@ -1446,11 +2596,12 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "stop_record", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_STOP_RECORD: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			int id = -1;
-			int target_frame = -1;
 			const int kMaxArgs = 32;
 			int argc = 1;
 			char *argv[kMaxArgs];
@@ -1471,10 +2622,8 @@ int _command_handler(const char *_buff) {
 			}
 			if (id >= 0) {
 				for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
-					if (frame->id == target_frame) {
-						if (frame->output_fd > 0) {
-							close(frame->output_fd);
-							frame->output_fd = -1;
+					if (frame->id == id) {
+						if (close_output(frame)) {
 							printf("stop_record %d\n", frame->id);
 						} else {
 							printf("error at stop_record %d\n", frame->id);
@@ -1484,7 +2633,9 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "start_ac", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_START_AC: {
 		bool checkAcMode = false;
 		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
 			if (is_auto_calibration(frame)) {
@@ -1518,7 +2669,9 @@ int _command_handler(const char *_buff) {
 
 			printf("start_ac\n");
 		}
-	} else if (strncmp(cmd, "stop_ac", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_STOP_AC: {
 		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
 			if (is_auto_calibration(frame)) {
 				frame->delete_after_processed = true;
@@ -1526,17 +2679,23 @@ int _command_handler(const char *_buff) {
 				break;
 			}
 		}
-	} else if (strncmp(cmd, "start_record_raw", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_START_RECORD_RAW: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL && !state->output_raw) {
 			strncpy(state->output_raw_filepath, param, sizeof(state->output_raw_filepath) - 1);
 			state->output_raw = true;
 			printf("start_record_raw saved to %s\n", param);
 		}
-	} else if (strncmp(cmd, "stop_record_raw", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_STOP_RECORD_RAW: {
 		printf("stop_record_raw\n");
 		state->output_raw = false;
-	} else if (strncmp(cmd, "load_file", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_LOAD_FILE: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			strncpy(state->input_filepath, param, sizeof(state->input_filepath) - 1);
@@ -1545,34 +2704,48 @@ int _command_handler(const char *_buff) {
 			state->input_file_size = 0;
 			printf("load_file from %s\n", param);
 		}
-	} else if (strncmp(cmd, PLUGIN_NAME ".start_recording", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_PICAM360_START_RECORDING: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			rtp_start_recording(state->rtp, param);
 			printf("start_recording : completed\n");
 		}
-	} else if (strncmp(cmd, PLUGIN_NAME ".stop_recording", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_PICAM360_STOP_RECORDING: {
 		rtp_stop_recording(state->rtp);
 		printf("stop_recording : completed\n");
-	} else if (strncmp(cmd, PLUGIN_NAME ".start_loading", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_PICAM360_START_LOADING: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			rtp_start_loading(state->rtp, param, true, true, (RTP_LOADING_CALLBACK) loading_callback, NULL);
 			printf("start_loading : completed\n");
 		}
-	} else if (strncmp(cmd, PLUGIN_NAME ".stop_loading", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_PICAM360_STOP_LOADING: {
 		rtp_stop_loading(state->rtp);
 		printf("stop_loading : completed\n");
-	} else if (strncmp(cmd, "cam_mode", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_CAM_MODE: {
 		state->input_mode = INPUT_MODE_CAM;
-	} else if (strncmp(cmd, "get_loading_pos", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_GET_LOADING_POS: {
 		if (state->input_file_size == 0) {
 			printf("%d\n", -1);
 		} else {
 			double ratio = 100 * state->input_file_cur / state->input_file_size;
 			printf("%d\n", (int) ratio);
 		}
-	} else if (strncmp(cmd, "set_camera_orientation", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_CAMERA_ORIENTATION: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float pitch;
@@ -1584,59 +2757,276 @@ int _command_handler(const char *_buff) {
 			state->camera_roll = roll * M_PI / 180.0;
 			printf("set_camera_orientation\n");
 		}
-	} else if (strncmp(cmd, "set_view_quaternion", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_VIEW_QUATERNION: { //applied by renderer, newest wins
+		POSE_T pose;
+		if (pose_parse_params(_buff + (cmd - buff) + strlen(cmd), &pose)) {
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			pose.received_time = now.tv_sec + now.tv_usec / 1000000.0;
+			POSE_SLOT_T *slot = get_pose_slot(pose.frame_id);
+			if (slot) {
+				pose_slot_write(slot, &pose);
+			}
+			lg_pose_received++;
+		}
+		break;
+	}
+	case HOST_COMMAND_SET_VIEW_PREDICTION: {
 		char *param = NULL;
 		int id = 0; //default
-		bool quat_valid = false;
-		float x, y, z, w;
-		bool fov_valid = false;
-		float fov;
-		bool client_key_valid = false;
-		char *client_key = NULL;
+		float gain = -1;
+		float horizon = -1;
+		float window = -1;
+		float max_angle = -1;
+		bool reset_stats = false;
 		do {
 			param = strtok(NULL, " \n");
 			if (param != NULL) {
-				if (strncmp(param, "quat=", 5) == 0) {
-					int num = sscanf(param, "quat=%f,%f,%f,%f", &x, &y, &z, &w);
-					if (num == 4) {
-						quat_valid = true;
-					}
-				} else if (strncmp(param, "fov=", 4) == 0) {
-					int num = sscanf(param, "fov=%f", &fov);
-					if (num == 1) {
-						fov_valid = true;
-					}
-				} else if (strncmp(param, "client_key=", 11) == 0) {
-					client_key = param + 11;
-					client_key_valid = true;
-				} else if (strncmp(param, "id=", 3) == 0) {
-					int num = sscanf(param, "id=%d", &id);
-					if (num == 1) {
-					}
+				if (strncmp(param, "id=", 3) == 0) {
+					sscanf(param, "id=%d", &id);
+				} else if (strncmp(param, "gain=", 5) == 0) {
+					sscanf(param, "gain=%f", &gain);
+				} else if (strncmp(param, "horizon=", 8) == 0) {
+					sscanf(param, "horizon=%f", &horizon);
+				} else if (strncmp(param, "window=", 7) == 0) {
+					sscanf(param, "window=%f", &window);
+				} else if (strncmp(param, "max_angle=", 10) == 0) {
+					sscanf(param, "max_angle=%f", &max_angle);
+				} else if (strncmp(param, "reset_stats", 11) == 0) {
+					reset_stats = true;
+				}
+			}
+		} while (param);
+
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				VIEW_PREDICTOR_T *predictor = &frame->view_predictor;
+				state->plugin_host.lock_texture();
+				if (gain >= 0) {
+					predictor->gain = gain;
+					predictor->enabled = (gain > 0);
+				}
+				if (horizon >= 0) {
+					predictor->horizon_ms = horizon;
+				}
+				if (window > 0) {
+					predictor->window_ms = window;
+				}
+				if (max_angle > 0) {
+					predictor->max_angle = max_angle;
+				}
+				if (reset_stats) {
+					view_predictor_reset_stats(predictor);
+				}
+				state->plugin_host.unlock_texture();
+				printf("set_view_prediction id=%d gain=%.2f horizon=%.1fms\n", id, predictor->gain, view_predictor_get_horizon(predictor));
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_GET_VIEW_PREDICTION: {
+		char *param = strtok(NULL, " \n");
+		int id = 0; //default
+		if (param != NULL) {
+			sscanf(param, "id=%d", &id);
+		}
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				float mean, rms, max;
+				int num;
+				view_predictor_get_stats(&frame->view_predictor, &mean, &rms, &max, &num);
+				printf("view_prediction id=%d : enabled=%d horizon=%.1fms error mean=%.2fdeg rms=%.2fdeg max=%.2fdeg num=%d\n", id, frame->view_predictor.enabled,
+						view_predictor_get_horizon(&frame->view_predictor), mean, rms, max, num);
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_RECEIVER_REPORT: {
+		//owd : mean of client receive time - rtp header send time in ms over interval, any clock offset
+		char *param = NULL;
+		int id = 0; //default
+		int received = 0;
+		int lost = 0;
+		int bytes = -1;
+		float interval = -1; //ms
+		float owd = -1;
+		do {
+			param = strtok(NULL, " \n");
+			if (param != NULL) {
+				if (strncmp(param, "id=", 3) == 0) {
+					sscanf(param, "id=%d", &id);
+				} else if (strncmp(param, "received=", 9) == 0) {
+					sscanf(param, "received=%d", &received);
+				} else if (strncmp(param, "lost=", 5) == 0) {
+					sscanf(param, "lost=%d", &lost);
+				} else if (strncmp(param, "bytes=", 6) == 0) {
+					sscanf(param, "bytes=%d", &bytes);
+				} else if (strncmp(param, "interval=", 9) == 0) {
+					sscanf(param, "interval=%f", &interval);
+				} else if (strncmp(param, "owd=", 4) == 0) {
+					sscanf(param, "owd=%f", &owd);
+				}
+			}
+		} while (param);
+
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				struct timeval now;
+				gettimeofday(&now, NULL);
+				rate_controller_push_report(&frame->rate_controller, now.tv_sec + now.tv_usec / 1000000.0, received, lost, bytes, interval, owd);
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_REQUEST_KEYFRAME: {
+		char *param = strtok(NULL, " \n");
+		int id = 0; //default
+		if (param != NULL) {
+			sscanf(param, "id=%d", &id);
+		}
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				request_keyframe(frame);
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_SET_ABR: {
+		char *param = NULL;
+		int id = 0; //default
+		int enabled = -1;
+		float min_kbps = -1;
+		float max_kbps = -1;
+		float threshold = -1;
+		do {
+			param = strtok(NULL, " \n");
+			if (param != NULL) {
+				if (strncmp(param, "id=", 3) == 0) {
+					sscanf(param, "id=%d", &id);
+				} else if (strncmp(param, "enabled=", 8) == 0) {
+					sscanf(param, "enabled=%d", &enabled);
+				} else if (strncmp(param, "min=", 4) == 0) {
+					sscanf(param, "min=%f", &min_kbps);
+				} else if (strncmp(param, "max=", 4) == 0) {
+					sscanf(param, "max=%f", &max_kbps);
+				} else if (strncmp(param, "threshold=", 10) == 0) {
+					sscanf(param, "threshold=%f", &threshold);
 				}
 			}
 		} while (param);
 
-		if (quat_valid) {
-			for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
-				if (frame->id == id && frame->view_mpu && frame->view_mpu->set_quaternion) {
-					VECTOR4D_T value = { .ary = { x, y, z, w } };
-					state->plugin_host.lock_texture();
-					frame->view_mpu->set_quaternion(frame->view_mpu->user_data, value);
-					state->plugin_host.unlock_texture();
-					//printf("set_view_quaternion\n");
-					if (fov_valid) {
-						frame->fov = fov;
-					}
-					if (client_key_valid) {
-						strncpy(frame->client_key, client_key, sizeof(frame->client_key));
-						gettimeofday(&frame->server_key, NULL);
-					}
-					break;
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				RATE_CONTROLLER_T *rc = &frame->rate_controller;
+				if (enabled == 1 && (frame->tile_scale > 0 || frame->renditions[0] || frame->output_mode != OUTPUT_MODE_STREAM)) {
+					printf("adaptive bitrate is only for a not tiled stream without renditions\n");
+				} else if (enabled >= 0) {
+					rc->enabled = (enabled != 0);
+				}
+				if (min_kbps >= 0) {
+					rc->min_kbps = min_kbps;
+				}
+				if (max_kbps >= 0) {
+					rc->max_kbps = max_kbps;
+				}
+				if (threshold > 0) {
+					rc->overuse_threshold = threshold;
+				}
+				printf("set_abr id=%d enabled=%d min=%.0fkbps max=%.0fkbps threshold=%.1fms/s\n", id, rc->enabled, rc->min_kbps, rc->max_kbps,
+						rc->overuse_threshold);
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_GET_ABR: {
+		char *param = strtok(NULL, " \n");
+		int id = 0; //default
+		if (param != NULL) {
+			sscanf(param, "id=%d", &id);
+		}
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			if (frame->id == id) {
+				RATE_CONTROLLER_T *rc = &frame->rate_controller;
+				printf("abr id=%d : enabled=%d %d kbps %.1f fps scale %.2f level %d : loss %.3f receive %d kbps send %d kbps delay %s %.1fms/s reports %d\n", id,
+						rc->enabled, (int) rc->target_kbps, rc->fps, rc->scale, rc->level, rc->loss, (int) rc->receive_kbps,
+						(int) frame->send_kbps, rate_controller_get_delay_state_str(rc), rc->delay_slope, rc->num_of_reports);
+				break;
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_SET_STATUS_INTERVAL: { //set_status_interval menu=1.0, default=0.1, snapshot=5
+		char *param = strtok(NULL, " \n");
+		if (param != NULL) {
+			char name[64];
+			float interval;
+			if (sscanf(param, "%63[^=]=%f", name, &interval) == 2) {
+				if (strcmp(name, "default") == 0) {
+					state->status_publisher.interval = MAX(interval, 0);
+				} else if (strcmp(name, "snapshot") == 0) {
+					state->status_publisher.snapshot_interval = MAX(interval, 0);
+				} else {
+					status_publisher_set_interval(&state->status_publisher, name, interval);
 				}
+				printf("%s : completed\n", cmd);
+			}
+		}
+		break;
+	}
+	case HOST_COMMAND_GET_STATUS_STATS: {
+		STATUS_PUBLISHER_T *pub = &state->status_publisher;
+		printf("status : %.1f bytes/s, sent %llu bytes %llu entries, polled %llu\n", pub->bytes_per_sec, (unsigned long long) pub->sent_bytes,
+				(unsigned long long) pub->sent_entries, (unsigned long long) pub->polled_entries);
+		break;
+	}
+	case HOST_COMMAND_GET_POSE_STATS: {
+		printf("pose : received %d (binary %d) stale %d applied %d, pose to render %.2f ms max %.2f ms\n", lg_pose_received, lg_pose_received_binary,
+				lg_pose_stale, lg_pose_applied, lg_pose_delay_ms, lg_pose_delay_max_ms);
+		break;
+	}
+	case HOST_COMMAND_GET_COMMAND_STATS: {
+		COMMAND_CHANNEL_T *ch = &state->command_channel;
+		printf("command : %.1f cmd/s, latency %.1f ms max %.1f ms, rtt %.1f ms, in flight %d, queued %llu coalesced %llu acked %llu retransmitted %llu dropped %llu delivered %llu\n",
+				ch->commands_per_sec, ch->latency_ms, ch->max_latency_ms, ch->srtt_ms, command_channel_get_in_flight(ch), (unsigned long long) ch->queued,
+				(unsigned long long) ch->coalesced, (unsigned long long) ch->acked, (unsigned long long) ch->retransmitted, (unsigned long long) ch->dropped,
+				(unsigned long long) ch->delivered);
+		break;
+	}
+	case HOST_COMMAND_GET_RECORD_STATS: {
+		pthread_mutex_lock(&lg_output_mutex);
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			ASYNC_WRITER_T *writer = frame->output_muxer ? frame->output_muxer->writer : frame->output_writer;
+			if (writer) {
+				ASYNC_WRITER_STATS_T stats;
+				async_writer_get_stats(writer, &stats);
+				printf("record %d : written %.1f MB, dropped %llu bytes in %u writes, stalls %u, max write %.1f ms, max pending %.1f MB%s\n", frame->id,
+						stats.written_bytes / (1024.0 * 1024.0), (unsigned long long) stats.dropped_bytes, stats.dropped_writes, stats.stalls,
+						stats.max_write_ms, stats.max_pending / (1024.0 * 1024.0), stats.open_failed ? ", open failed" : "");
 			}
 		}
-	} else if (strncmp(cmd, "set_fov", sizeof(buff)) == 0) {
+		pthread_mutex_unlock(&lg_output_mutex);
+		break;
+	}
+	case HOST_COMMAND_GET_METRICS: {
+		int len = metrics_registry_write(&state->metrics, NULL, 0, false);
+		char *buff = (char*) malloc(len + 1);
+		metrics_registry_write(&state->metrics, buff, len + 1, false);
+		printf("%s", buff);
+		free(buff);
+		break;
+	}
+	case HOST_COMMAND_REQUEST_STATUS_SNAPSHOT: { //for a client joined, all statuses are sent on next update
+		status_publisher_request_snapshot(&state->status_publisher);
+		break;
+	}
+	case HOST_COMMAND_SET_FOV: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			int id;
@@ -1650,25 +3040,33 @@ int _command_handler(const char *_buff) {
 				}
 			}
 		}
-	} else if (strncmp(cmd, "set_stereo", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_STEREO: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			state->stereo = (param[0] == '1');
 			printf("set_stereo %s\n", param);
 		}
-	} else if (strncmp(cmd, "set_conf_sync", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_CONF_SYNC: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			state->conf_sync = (param[0] == '1');
 			printf("set_conf_sync %s\n", param);
 		}
-	} else if (strncmp(cmd, "set_preview", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_PREVIEW: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			state->preview = (param[0] == '1');
 			printf("set_preview %s\n", param);
 		}
-	} else if (strncmp(cmd, "add_camera_horizon_r", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_ADD_CAMERA_HORIZON_R: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float *cam_horizon_r = (state->options.config_ex_enabled) ? state->options.cam_horizon_r_ex : state->options.cam_horizon_r;
@@ -1697,7 +3095,9 @@ int _command_handler(const char *_buff) {
 
 			printf("add_camera_horizon_r : completed\n");
 		}
-	} else if (strncmp(cmd, "add_camera_offset_x", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_ADD_CAMERA_OFFSET_X: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float *cam_offset_x = (state->options.config_ex_enabled) ? state->options.cam_offset_x_ex : state->options.cam_offset_x;
@@ -1726,7 +3126,9 @@ int _command_handler(const char *_buff) {
 
 			printf("add_camera_offset_x : completed\n");
 		}
-	} else if (strncmp(cmd, "add_camera_offset_y", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_ADD_CAMERA_OFFSET_Y: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float *cam_offset_y = (state->options.config_ex_enabled) ? state->options.cam_offset_y_ex : state->options.cam_offset_y;
@@ -1755,7 +3157,9 @@ int _command_handler(const char *_buff) {
 
 			printf("add_camera_offset_y : completed\n");
 		}
-	} else if (strncmp(cmd, "add_camera_offset_yaw", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_ADD_CAMERA_OFFSET_YAW: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			int cam_num = 0;
@@ -1779,7 +3183,9 @@ int _command_handler(const char *_buff) {
 
 			printf("add_camera_offset_yaw : completed\n");
 		}
-	} else if (strncmp(cmd, "set_camera_horizon_r_bias", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_CAMERA_HORIZON_R_BIAS: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float value = 0;
@@ -1787,7 +3193,9 @@ int _command_handler(const char *_buff) {
 			state->camera_horizon_r_bias = value;
 			printf("set_camera_horizon_r_bias : completed\n");
 		}
-	} else if (strncmp(cmd, "set_play_speed", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_PLAY_SPEED: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float value = 0;
@@ -1796,7 +3204,9 @@ int _command_handler(const char *_buff) {
 			rtp_set_play_speed(state->rtp, value);
 			printf("set_play_speed : completed\n");
 		}
-	} else if (strncmp(cmd, "add_color_offset", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_ADD_COLOR_OFFSET: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			float value = 0;
@@ -1804,27 +3214,45 @@ int _command_handler(const char *_buff) {
 			state->options.color_offset += value;
 			printf("add_color_offset : completed\n");
 		}
-	} else if (strncmp(cmd, "set_frame_sync", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_FRAME_SYNC: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			state->frame_sync = (param[0] == '1');
 			printf("set_frame_sync %s\n", param);
 		}
-	} else if (strncmp(cmd, "set_menu_visible", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SET_MENU_VISIBLE: {
 		char *param = strtok(NULL, " \n");
 		if (param != NULL) {
 			state->menu_visible = (param[0] == '1');
 			printf("set_menu_visible %s\n", param);
 		}
-	} else if (strncmp(cmd, "select_active_menu", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_SELECT_ACTIVE_MENU: {
 		menu_operate(state->menu, MENU_OPERATE_SELECT);
-	} else if (strncmp(cmd, "deselect_active_menu", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_DESELECT_ACTIVE_MENU: {
 		menu_operate(state->menu, MENU_OPERATE_DESELECT);
-	} else if (strncmp(cmd, "go2next_menu", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_GO2NEXT_MENU: {
 		menu_operate(state->menu, MENU_OPERATE_ACTIVE_NEXT);
-	} else if (strncmp(cmd, "back2previouse_menu", sizeof(buff)) == 0) {
+		break;
+	}
+	case HOST_COMMAND_BACK2PREVIOUSE_MENU: {
 		menu_operate(state->menu, MENU_OPERATE_ACTIVE_BACK);
-	} else if (state->frame != NULL && strcasecmp(state->frame->renderer->name, "CALIBRATION") == 0) {
+		break;
+	}
+	case HOST_COMMAND_CALIBRATION: {
+		if (state->frame == NULL || strcasecmp(state->frame->renderer->name, "CALIBRATION") != 0) {
+			printf("unknown command : %s\n", buff);
+			break;
+		}
 		if (strncmp(cmd, "step", sizeof(buff)) == 0) {
 			char *param = strtok(NULL, " \n");
 			if (param != NULL) {
@@ -1849,44 +3277,45 @@ int _command_handler(const char *_buff) {
 		if (strncmp(cmd, "w", sizeof(buff)) == 0) {
 			state->options.sharpness_gain -= calib_step;
 		}
-	} else {
-		printf("unknown command : %s\n", buff);
+		break;
+	}
+	default:
+		break;
 	}
 	return ret;
 }
 
-int command_handler() {
-	int ret = 0;
+static void register_host_commands() {
+	for (int i = 0; i < sizeof(lg_host_commands) / sizeof(lg_host_commands[0]); i++) {
+		command_registry_add(&state->command_registry, lg_host_commands[i].name, _command_handler,
+				(void*) (intptr_t) lg_host_commands[i].id);
+	}
+}
 
-	for (int i = 0; i < 10; i++) {
-		char *buff = NULL;
-		{
-			pthread_mutex_lock(&state->cmd_list_mutex);
+#define COMMAND_TIME_BUDGET_MS 5.0 //per main loop, the rest stays queued
 
-			if (state->cmd_list) {
-				LIST_T *cur = state->cmd_list;
-				buff = (char*) cur->value;
-				state->cmd_list = cur->next;
-				free(cur);
-			}
+int command_handler() {
+	int ret = 0;
+	struct timeval s, f;
+	gettimeofday(&s, NULL);
 
-			pthread_mutex_unlock(&state->cmd_list_mutex);
+	for (;;) {
+		COMMAND_QUEUE_NODE_T *node = command_queue_pop(&state->cmd_queue);
+		if (node == NULL) {
+			break;
 		}
+		metric_inc(lg_metric_commands);
+		const COMMAND_REGISTRY_ENTRY_T *entry = command_registry_lookup(&state->command_registry, node->cmd);
+		if (entry) {
+			ret = entry->handler(entry->user_data, node->cmd);
+		} else if (node->cmd[strspn(node->cmd, " \n")] != '\0') {
+			printf("unknown command : %s\n", node->cmd);
+		}
+		command_queue_release(&state->cmd_queue, node);
 
-		if (buff) {
-			bool handled = false;
-			for (int i = 0; state->plugins[i] != NULL; i++) {
-				int name_len = strlen(state->plugins[i]->name);
-				if (strncmp(buff, state->plugins[i]->name, name_len) == 0 && buff[name_len] == '.') {
-					ret = state->plugins[i]->command_handler(state->plugins[i]->user_data, buff);
-					handled = true;
-				}
-			}
-			if (!handled) {
-				ret = _command_handler(buff);
-			}
-			free(buff);
-		} else {
+		gettimeofday(&f, NULL);
+		double elapsed_ms = (f.tv_sec - s.tv_sec) * 1000.0 + (f.tv_usec - s.tv_usec) / 1000.0;
+		if (elapsed_ms > COMMAND_TIME_BUDGET_MS) {
 			break;
 		}
 	}
@@ -1920,6 +3349,95 @@ static void *quaternion_thread_func(void* arg) {
 	return NULL;
 }
 ///////////////////////////////////////////
+#if (1) //metrics block
+
+#define METRICS_UPDATE_INTERVAL 1.0 //sec, for values sampled in main loop
+
+static METRIC_T *lg_metric_rtp_bandwidth;
+static METRIC_T *lg_metric_command_queue_depth;
+static METRIC_T *lg_metric_command_latency_ms;
+static METRIC_T *lg_metric_decoder_fps[MAX_CAM_NUM];
+static METRIC_T *lg_metric_decoder_frameskip[MAX_CAM_NUM];
+static METRIC_T *lg_metric_record_dropped_bytes;
+static METRIC_T *lg_metric_record_max_write_ms;
+
+static void init_metrics() {
+	METRICS_REGISTRY_T *m = &state->metrics;
+	char labels[64];
+	lg_metric_frames = metrics_registry_add(m, METRIC_COUNTER, "picam360_frames_total", NULL, "frames rendered for encoders");
+	lg_metric_frame_ms = metrics_registry_add(m, METRIC_HISTOGRAM, "picam360_frame_ms", NULL, "render to encoder hand-off of a frame");
+	lg_metric_encoded_bytes = metrics_registry_add(m, METRIC_COUNTER, "picam360_encoded_bytes_total", NULL, "encoder output");
+	lg_metric_commands_queued = metrics_registry_add(m, METRIC_COUNTER, "picam360_commands_queued_total", NULL, "commands to host and plugins");
+	lg_metric_commands = metrics_registry_add(m, METRIC_COUNTER, "picam360_commands_total", NULL, "commands handled");
+	lg_metric_command_queue_depth = metrics_registry_add(m, METRIC_GAUGE, "picam360_command_queue_depth", NULL, "commands waiting for main loop");
+	lg_metric_command_latency_ms = metrics_registry_add(m, METRIC_GAUGE, "picam360_command_latency_ms", NULL, "upstream command delivery, ewma");
+	lg_metric_poses_stale = metrics_registry_add(m, METRIC_COUNTER, "picam360_poses_stale_total", NULL, "view poses older than the one in slot");
+	lg_metric_pose_delay_ms = metrics_registry_add(m, METRIC_HISTOGRAM, "picam360_pose_delay_ms", NULL, "view pose received to render");
+	lg_metric_rtp_bandwidth = metrics_registry_add(m, METRIC_GAUGE, "picam360_rtp_tx_mbps", NULL, "rtp tx bandwidth, ewma");
+	lg_metric_cam_bandwidth = metrics_registry_add(m, METRIC_GAUGE, "picam360_upstream_mbps", NULL, "bandwidth reported by upstream");
+	for (int i = 0; i < 2; i++) { //upstream reports two cameras
+		snprintf(labels, sizeof(labels), "cam=\"%d\"", i);
+		lg_metric_cam_fps[i] = metrics_registry_add(m, METRIC_GAUGE, "picam360_upstream_fps", labels, "camera fps reported by upstream");
+		lg_metric_cam_frameskip[i] = metrics_registry_add(m, METRIC_GAUGE, "picam360_upstream_frameskip", labels, "camera frameskip reported by upstream");
+	}
+	for (int i = 0; i < state->num_of_cam; i++) {
+		snprintf(labels, sizeof(labels), "cam=\"%d\"", i);
+		lg_metric_decoder_fps[i] = metrics_registry_add(m, METRIC_GAUGE, "picam360_decoder_fps", labels, NULL);
+		lg_metric_decoder_frameskip[i] = metrics_registry_add(m, METRIC_GAUGE, "picam360_decoder_frameskip", labels, NULL);
+	}
+	lg_metric_record_dropped_bytes = metrics_registry_add(m, METRIC_COUNTER, "picam360_record_dropped_bytes_total", NULL, "of recorded files");
+	lg_metric_record_max_write_ms = metrics_registry_add(m, METRIC_GAUGE, "picam360_record_max_write_ms", NULL, "of files being recorded");
+
+	if (state->options.metrics_port > 0) {
+		metrics_registry_serve(m, state->options.metrics_port);
+	}
+}
+
+static void update_metrics(double now) {
+	static double last_update = 0;
+	if (now - last_update < METRICS_UPDATE_INTERVAL) {
+		return;
+	}
+	last_update = now;
+
+	if (state->rtp) {
+		metric_set(lg_metric_rtp_bandwidth, rtp_get_bandwidth(state->rtp));
+	}
+	//commands are counted before push and after pop
+	metric_set(lg_metric_command_queue_depth, metric_get(lg_metric_commands_queued) - metric_get(lg_metric_commands));
+	metric_set(lg_metric_command_latency_ms, state->command_channel.latency_ms);
+	for (int i = 0; i < state->num_of_cam; i++) {
+		DECODER_T *decoder = state->decoders[i];
+		if (decoder && decoder->get_fps && decoder->get_frameskip) {
+			metric_set(lg_metric_decoder_fps[i], decoder->get_fps(decoder));
+			metric_set(lg_metric_decoder_frameskip[i], decoder->get_frameskip(decoder));
+		}
+	}
+	{
+		static uint64_t reported_dropped_bytes = 0;
+		float max_write_ms = 0;
+		pthread_mutex_lock(&lg_output_mutex);
+		uint64_t dropped_bytes = lg_closed_dropped_bytes;
+		for (FRAME_T *frame = state->frame; frame != NULL; frame = frame->next) {
+			ASYNC_WRITER_T *writer = frame->output_muxer ? frame->output_muxer->writer : frame->output_writer;
+			if (writer) {
+				ASYNC_WRITER_STATS_T stats;
+				async_writer_get_stats(writer, &stats);
+				dropped_bytes += stats.dropped_bytes;
+				max_write_ms = MAX(max_write_ms, stats.max_write_ms);
+			}
+		}
+		pthread_mutex_unlock(&lg_output_mutex);
+		if (dropped_bytes > reported_dropped_bytes) {
+			metric_add(lg_metric_record_dropped_bytes, dropped_bytes - reported_dropped_bytes);
+			reported_dropped_bytes = dropped_bytes;
+		}
+		metric_set(lg_metric_record_max_write_ms, max_write_ms);
+	}
+}
+
+#endif //metrics block
+///////////////////////////////////////////
 #if (1) //plugin host methods
 static VECTOR4D_T get_view_quaternion() {
 	VECTOR4D_T ret = { };
@@ -2102,6 +3620,20 @@ static int xmp(char *buff, int buff_len, int cam_num) {
 	VECTOR4D_T compass = state->mpu->get_compass(state->mpu);
 	VECTOR4D_T camera_offset = state->plugin_host.get_camera_offset(cam_num);
 
+	if (!state->options.xml_meta) {
+		FRAME_META_T meta = { };
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		meta.fields = FRAME_META_TIMESTAMP | FRAME_META_CAMERA_QUAT | FRAME_META_COMPASS | FRAME_META_TEMPERATURE | FRAME_META_CAMERA_OFFSET;
+		meta.timestamp_us = (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+		meta.camera_quat = quat;
+		meta.compass = compass;
+		meta.temperature = state->mpu->get_temperature(state->mpu);
+		meta.camera_offset = camera_offset;
+		xmp_len = frame_meta_write_app(&meta, (unsigned char*) buff, buff_len);
+		return MAX(xmp_len, 0);
+	}
+
 	xmp_len = 0;
 	buff[xmp_len++] = 0xFF;
 	buff[xmp_len++] = 0xE1;
@@ -2132,37 +3664,31 @@ static int xmp(char *buff, int buff_len, int cam_num) {
 	return xmp_len;
 }
 
-static void send_command(const char *_cmd) {
-	pthread_mutex_lock(&state->cmd_list_mutex);
-
-	char *cmd = (char*) _cmd;
-	LIST_T **cur = NULL;
+static void send_command(const char *_cmd) { //lock free, called from any thread
+	const char *cmd = _cmd;
+	COMMAND_QUEUE_T *queue = NULL;
 	if (strncmp(cmd, ENDPOINT_DOMAIN, ENDPOINT_DOMAIN_SIZE) == 0) {
 		if (state->options.rtp_rx_port == 0) {
 			//endpoint
-			cur = &state->cmd_list;
+			queue = &state->cmd_queue;
 			cmd += ENDPOINT_DOMAIN_SIZE;
 		} else {
 			//send to upstream
-			cur = &state->cmd2upstream_list;
+			queue = &state->cmd2upstream_queue;
 		}
 	} else if (strncmp(cmd, UPSTREAM_DOMAIN, UPSTREAM_DOMAIN_SIZE) == 0) {
-		cur = &state->cmd2upstream_list;
+		queue = &state->cmd2upstream_queue;
 		cmd += UPSTREAM_DOMAIN_SIZE;
+		if (send_pose_upstream(cmd)) {
+			return;
+		}
 	} else {
-		cur = &state->cmd_list;
+		queue = &state->cmd_queue;
 	}
-	for (; *cur != NULL; cur = &(*cur)->next)
-		;
-	*cur = malloc(sizeof(LIST_T));
-	memset(*cur, 0, sizeof(LIST_T));
-	int slr_len = MIN(strlen(cmd), 256);
-	char *cmd_clone = malloc(slr_len + 1);
-	strncpy(cmd_clone, cmd, slr_len);
-	cmd_clone[slr_len] = '\0';
-	(*cur)->value = cmd_clone;
-
-	pthread_mutex_unlock(&state->cmd_list_mutex);
+	if (queue == &state->cmd_queue) {
+		metric_inc(lg_metric_commands_queued);
+	}
+	command_queue_push(queue, cmd);
 }
 
 static void event_handler(uint32_t node_id, uint32_t event_id) {
@@ -2351,7 +3877,18 @@ static void add_watch(STATUS_T *watch) {
 	}
 }
 
+static void add_command_handler(const char *name, int (*handler)(void *user_data, const char *cmd), void *user_data) {
+	command_registry_add(&state->command_registry, name, handler, user_data);
+}
+
+static METRIC_T *add_metric(enum METRIC_TYPE type, const char *name, const char *labels, const char *help) {
+	return metrics_registry_add(&state->metrics, type, name, labels, help);
+}
+
 static void add_plugin(PLUGIN_T *plugin) {
+	if (plugin->command_handler) { //commands prefixed by plugin name
+		command_registry_add(&state->command_registry, plugin->name, plugin->command_handler, plugin->user_data);
+	}
 	for (int i = 0; state->plugins[i] != (void*) -1; i++) {
 		if (state->plugins[i] == NULL) {
 			state->plugins[i] = plugin;
@@ -2413,6 +3950,7 @@ static void init_plugins(PICAM360CAPTURE_T *state) {
 		state->plugin_host.get_texture_size = get_texture_size;
 		state->plugin_host.set_texture_size = set_texture_size;
 		state->plugin_host.load_texture = load_texture;
+		state->plugin_host.load_texture_from_memory = load_texture_from_memory;
 
 		state->plugin_host.get_menu = get_menu;
 		state->plugin_host.get_menu_visible = get_menu_visible;
@@ -2436,6 +3974,8 @@ static void init_plugins(PICAM360CAPTURE_T *state) {
 		state->plugin_host.add_status = add_status;
 		state->plugin_host.add_watch = add_watch;
 		state->plugin_host.add_plugin = add_plugin;
+		state->plugin_host.add_command_handler = add_command_handler;
+		state->plugin_host.add_metric = add_metric;
 
 		state->plugin_host.snap = snap;
 	}
@@ -2497,6 +4037,40 @@ static void init_plugins(PICAM360CAPTURE_T *state) {
 			}
 		}
 
+		{ //encoder pool : [{"name":"h265","width":1024,"height":1024,"fps":15,"kbps":0,"num":1}]
+			json_t *encoder_pool = json_object_get(options, "encoder_pool");
+			if (json_is_array(encoder_pool)) {
+				for (int i = 0; i < json_array_size(encoder_pool); i++) {
+					json_t *value = json_array_get(encoder_pool, i);
+					ENCODER_POOL_KEY_T key = { };
+					strncpy(key.name, json_string_value(json_object_get(value, "name")) ? json_string_value(json_object_get(value, "name")) : "",
+							sizeof(key.name) - 1);
+					key.width = json_number_value(json_object_get(value, "width"));
+					key.height = json_number_value(json_object_get(value, "height"));
+					key.fps = json_number_value(json_object_get(value, "fps"));
+					key.kbps = json_number_value(json_object_get(value, "kbps"));
+					int num = json_number_value(json_object_get(value, "num"));
+					if (num <= 0) {
+						num = 1;
+					}
+					if (key.width <= 0 || key.height <= 0 || key.fps <= 0) {
+						printf("encoder_pool : invalid entry %d\n", i);
+						continue;
+					}
+					ENCODER_FACTORY_T *encoder_factory = get_encoder_factory(key.name);
+					if (encoder_factory == NULL) {
+						printf("encoder_pool : encoder %s not found\n", key.name);
+						continue;
+					}
+					strncpy(key.name, encoder_factory->name, sizeof(key.name) - 1); //leases match encoder->name
+					if (key.kbps == 0) { //same default as start_record
+						key.kbps = get_default_kbps(get_output_type(key.name), key.width, key.height);
+					}
+					encoder_pool_add_entry(&state->encoder_pool, encoder_factory, &key, num);
+				}
+			}
+		}
+
 		json_decref(options);
 	}
 }
@@ -2508,78 +4082,157 @@ static void init_plugins(PICAM360CAPTURE_T *state) {
 
 #define PT_STATUS 100
 #define PT_CMD 101
+#define PT_CMD_ACK 108
+#define PT_POSE 109
+#define PT_TILE_BASE 102 //102-107 : faces of 3x2 layout
 #define PT_CAM_BASE 110
+#define PT_RENDITION_BASE 121 //121-124 : simulcast renditions
 
-static char lg_command[256] = { };
-static int lg_command_id = 0;
 static int lg_ack_command_id_downstream = -1;
 static int lg_ack_command_id_upstream = -1;
+static bool lg_ack_command_id_resend = false; //duplicate legacy command, ack status was lost
 
 static bool lg_debug_dump = false;
-static int lg_debug_dump_num = 0;
-static int lg_debug_dump_fd = -1;
+static ASYNC_WRITER_T *lg_debug_dump_writer = NULL;
+//SOI, 4-byte length, sei nal
+static void send_header_pack(FRAME_T *frame, FRAME_INFO_T *frame_info, bool h265, const unsigned char *SOI, int pt) {
+	unsigned char header_pack[2 + 4 + FRAME_META_SEI_MAX_LEN];
+	unsigned char *sei = header_pack + 2 + 4;
+	int len = 0;
+	int server_key = 0;
+	float idle_time_sec = 0;
+	float frame_processed_sec = 0;
+	float encoded_sec = 0;
+	if (frame_info) {
+		server_key = frame_info->server_key.tv_sec * 1000 + frame_info->server_key.tv_usec;
+		if (frame_info->client_key[0] != '\0') {
+			struct timeval diff;
+			gettimeofday(&frame_info->after_encoded, NULL);
+
+			timersub(&frame_info->before_redraw_render_texture, &frame_info->server_key, &diff);
+			idle_time_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+
+			timersub(&frame_info->after_redraw_render_texture, &frame_info->before_redraw_render_texture, &diff);
+			frame_processed_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+
+			timersub(&frame_info->after_encoded, &frame_info->after_redraw_render_texture, &diff);
+			encoded_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
+		}
+	}
+	if (state->options.xml_meta) {
+		char tile_attr[64] = { };
+		if (frame->tile_index >= 0) {
+			sprintf(tile_attr, " tile=\"%d\"", frame->tile_index);
+		} else if (frame->rendition_index >= 0) {
+			sprintf(tile_attr, " rendition=\"%d\"", frame->rendition_index);
+		} else if (frame->tile_scale > 0 && frame_info) {
+			sprintf(tile_attr, " tile_mask=\"%d\" tile_scale=\"%d\"", frame_info->tile_mask, frame->tile_scale);
+		}
+		sei[0] = h265 ? 40 << 1 : 6; //nal_type:sei
+		if (frame_info) { // sei for a frame
+			len = snprintf((char*) sei + 1, sizeof(header_pack) - 7,
+					"<picam360:frame frame_id=\"%d\" mode=\"%s\" projection=\"%s\" view_quat=\"%.3f,%.3f,%.3f,%.3f\" fov=\"%.3f\" client_key=\"%s\" server_key=\"%d\" idle_time=\"%.3f\" frame_processed=\"%.3f\" encoded=\"%.3f\"%s />",
+					frame->id, frame->renderer->name, frame->renderer->projection, frame_info->view_quat.x, frame_info->view_quat.y, frame_info->view_quat.z, frame_info->view_quat.w,
+					frame_info->fov, frame_info->client_key, server_key, idle_time_sec, frame_processed_sec, encoded_sec, tile_attr);
+		} else {
+			len = snprintf((char*) sei + 1, sizeof(header_pack) - 7, "<picam360:frame frame_id=\"%d\" />", frame->id);
+		}
+		len = MIN(len, (int) sizeof(header_pack) - 8) + 1; //nal header
+	} else {
+		FRAME_META_T meta = { };
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		meta.fields = FRAME_META_FRAME_ID | FRAME_META_TIMESTAMP;
+		meta.frame_id = frame->id;
+		meta.timestamp_us = (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+		if (frame_info) {
+			meta.fields |= FRAME_META_VIEW_QUAT | FRAME_META_FOV | FRAME_META_SERVER_KEY | FRAME_META_TIMING | FRAME_META_MODE | FRAME_META_PROJECTION;
+			meta.view_quat = frame_info->view_quat;
+			meta.fov = frame_info->fov;
+			meta.server_key = server_key;
+			meta.idle_time = idle_time_sec;
+			meta.frame_processed = frame_processed_sec;
+			meta.encoded = encoded_sec;
+			strncpy(meta.mode, frame->renderer->name, sizeof(meta.mode) - 1);
+			strncpy(meta.projection, frame->renderer->projection, sizeof(meta.projection) - 1);
+			if (frame_info->client_key[0] != '\0') {
+				meta.fields |= FRAME_META_CLIENT_KEY;
+				strncpy(meta.client_key, frame_info->client_key, sizeof(meta.client_key) - 1);
+			}
+		}
+		if (frame->tile_index >= 0) {
+			meta.fields |= FRAME_META_TILE;
+			meta.tile = frame->tile_index;
+		} else if (frame->rendition_index >= 0) {
+			meta.fields |= FRAME_META_RENDITION;
+			meta.rendition = frame->rendition_index;
+		} else if (frame->tile_scale > 0 && frame_info) {
+			meta.fields |= FRAME_META_TILE_MASK;
+			meta.tile_mask = frame_info->tile_mask;
+			meta.tile_scale = frame->tile_scale;
+		}
+		len = frame_meta_write_sei(&meta, h265, sei, FRAME_META_SEI_MAX_LEN);
+		if (len < 0) {
+			return;
+		}
+	}
+	memcpy(header_pack, SOI, 2);
+	header_pack[2] = (len >> 24) & 0xFF;
+	header_pack[3] = (len >> 16) & 0xFF;
+	header_pack[4] = (len >> 8) & 0xFF;
+	header_pack[5] = (len >> 0) & 0xFF;
+	rtp_sendpacket(state->rtp, header_pack, 2 + 4 + len, pt);
+}
+
+//one nal with 4 bytes length, timed by render time of the frame
+static void record_mp4_nal(MP4_MUXER_T *muxer, FRAME_T *frame, FRAME_INFO_T *frame_info, unsigned char *data, unsigned int data_len) {
+	struct timeval pts;
+	unsigned char meta_block[FRAME_META_MAX_LEN];
+	int meta_len = 0;
+	if (frame_info) { //first slice of a frame
+		pts = frame_info->before_redraw_render_texture;
+
+		FRAME_META_T meta = { };
+		meta.fields = FRAME_META_FRAME_ID | FRAME_META_TIMESTAMP | FRAME_META_VIEW_QUAT | FRAME_META_FOV | FRAME_META_MODE | FRAME_META_PROJECTION;
+		meta.frame_id = frame->id;
+		meta.timestamp_us = (uint64_t) pts.tv_sec * 1000000 + pts.tv_usec;
+		meta.view_quat = frame_info->view_quat;
+		meta.fov = frame_info->fov;
+		strncpy(meta.mode, frame->renderer->name, sizeof(meta.mode) - 1);
+		strncpy(meta.projection, frame->renderer->projection, sizeof(meta.projection) - 1);
+		meta_len = MAX(frame_meta_encode(&meta, meta_block, sizeof(meta_block)), 0);
+	} else {
+		gettimeofday(&pts, NULL);
+	}
+	mp4_muxer_add_nal(muxer, data + 4, data_len - 4, (uint64_t) pts.tv_sec * 1000000 + pts.tv_usec, meta_block, meta_len);
+}
+
 static void stream_callback(unsigned char *data, unsigned int data_len, void *frame_data, void *user_data) {
 	FRAME_T *frame = (FRAME_T*) user_data;
 	FRAME_INFO_T *frame_info = (FRAME_INFO_T*) frame_data;
+	metric_add(lg_metric_encoded_bytes, data_len);
+	if (frame->output_mode == OUTPUT_MODE_STREAM) {
+		__atomic_add_fetch(&frame->stream_bytes, data_len, __ATOMIC_RELAXED);
+	}
+	int pt = PT_CAM_BASE;
+	if (frame->tile_index >= 0) {
+		pt = PT_TILE_BASE + frame->tile_index;
+	} else if (frame->rendition_index >= 0) {
+		pt = PT_RENDITION_BASE + frame->rendition_index;
+	}
 	if (frame->output_mode == OUTPUT_MODE_STREAM) {
 		if (frame->output_type == OUTPUT_TYPE_H265) {
 			const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
 			const unsigned char SOI[] = { 0x48, 0x45 }; //'H', 'E'
 			const unsigned char EOI[] = { 0x56, 0x43 }; //'V', 'C'
-			//header pack
-			//printf("debug info h265 len=%d, type=%d\n", data_len, ((data[4] & 0x7e) >> 1));
-			if (frame_info) { // sei for a frame
-				int server_key = frame_info->server_key.tv_sec * 1000 + frame_info->server_key.tv_usec;
-				float idle_time_sec = 0;
-				float frame_processed_sec = 0;
-				float encoded_sec = 0;
-				if (frame_info->client_key[0] != '\0') {
-					struct timeval diff;
-					gettimeofday(&frame_info->after_encoded, NULL);
-
-					timersub(&frame_info->before_redraw_render_texture, &frame_info->server_key, &diff);
-					idle_time_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-
-					timersub(&frame_info->after_redraw_render_texture, &frame_info->before_redraw_render_texture, &diff);
-					frame_processed_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-
-					timersub(&frame_info->after_encoded, &frame_info->after_redraw_render_texture, &diff);
-					encoded_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-				}
-
-				unsigned char header_pack[512];
-				char *sei = (char*) header_pack + sizeof(SOI);
-				sei[4] = 40 << 1; //nal_type:sei
-				int len =
-						sprintf(sei + 5,
-								"<picam360:frame frame_id=\"%d\" mode=\"%s\" view_quat=\"%.3f,%.3f,%.3f,%.3f\" fov=\"%.3f\" client_key=\"%s\" server_key=\"%d\" idle_time=\"%.3f\" frame_processed=\"%.3f\" encoded=\"%.3f\" />",
-								frame->id, frame->renderer->name, frame_info->view_quat.x, frame_info->view_quat.y, frame_info->view_quat.z, frame_info->view_quat.w, frame_info->fov,
-								frame_info->client_key, server_key, idle_time_sec, frame_processed_sec, encoded_sec);
-				len += 1; //nal header
-				sei[0] = (len >> 24) & 0xFF;
-				sei[1] = (len >> 16) & 0xFF;
-				sei[2] = (len >> 8) & 0xFF;
-				sei[3] = (len >> 0) & 0xFF;
-				len += 4; //start code
-				memcpy(header_pack, SOI, sizeof(SOI));
-				len += 2; //SOI
-				rtp_sendpacket(state->rtp, header_pack, len, PT_CAM_BASE);
-			} else {
-				unsigned char header_pack[512];
-				char *sei = (char*) header_pack + sizeof(SOI);
-				sei[4] = 40 << 1; //nal_type:sei
-				int len = sprintf(sei + 5, "<picam360:frame frame_id=\"%d\" />", frame->id);
-				len += 1; //nal header
-				sei[0] = (len >> 24) & 0xFF;
-				sei[1] = (len >> 16) & 0xFF;
-				sei[2] = (len >> 8) & 0xFF;
-				sei[3] = (len >> 0) & 0xFF;
-				len += 4; //start code
-				memcpy(header_pack, SOI, sizeof(SOI));
-				len += 2; //SOI
-				rtp_sendpacket(state->rtp, header_pack, len, PT_CAM_BASE);
-			}
-			if (frame->output_fd > 0) {
+			send_header_pack(frame, frame_info, true, SOI, pt);
+			pthread_mutex_lock(&lg_output_mutex);
+			MP4_MUXER_T *muxer = frame->output_muxer;
+			if (muxer) {
+				record_mp4_nal(muxer, frame, frame_info, data, data_len);
+			}
+			ASYNC_WRITER_T *writer = frame->output_writer;
+			if (writer) {
 				if (!frame->output_start) {
 					if (((data[4] & 0x7e) >> 1) == 32) { // wait for vps
 						printf("output_start\n");
@@ -2587,10 +4240,11 @@ static void stream_callback(unsigned char *data, unsigned int data_len, void *fr
 					}
 				}
 				if (frame->output_start) {
-					write(frame->output_fd, SC, 4);
-					write(frame->output_fd, data + 4, data_len - 4);
+					struct iovec iov[] = { { (void*) SC, 4 }, { data + 4, data_len - 4 } };
+					async_writer_writev(writer, iov, 2);
 				}
 			}
+			pthread_mutex_unlock(&lg_output_mutex);
 			for (int j = 0; j < data_len;) {
 				int len;
 				if (j + RTP_MAXPAYLOADSIZE < data_len) {
@@ -2598,68 +4252,23 @@ static void stream_callback(unsigned char *data, unsigned int data_len, void *fr
 				} else {
 					len = data_len - j;
 				}
-				rtp_sendpacket(state->rtp, data + j, len, PT_CAM_BASE);
+				rtp_sendpacket(state->rtp, data + j, len, pt);
 				j += len;
 			}
-			rtp_sendpacket(state->rtp, EOI, sizeof(EOI), PT_CAM_BASE);
+			rtp_sendpacket(state->rtp, EOI, sizeof(EOI), pt);
 			rtp_flush(state->rtp);
 		} else if (frame->output_type == OUTPUT_TYPE_H264) {
 			const unsigned char SC[] = { 0x00, 0x00, 0x00, 0x01 };
 			const unsigned char SOI[] = { 0x4E, 0x41 }; //'N', 'A'
 			const unsigned char EOI[] = { 0x4C, 0x55 }; //'L', 'U'
-			//header pack
-			if (frame_info) { // sei for a frame
-				int server_key = frame_info->server_key.tv_sec * 1000 + frame_info->server_key.tv_usec;
-				float idle_time_sec = 0;
-				float frame_processed_sec = 0;
-				float encoded_sec = 0;
-				if (frame_info->client_key[0] != '\0') {
-					struct timeval diff;
-					gettimeofday(&frame_info->after_encoded, NULL);
-
-					timersub(&frame_info->before_redraw_render_texture, &frame_info->server_key, &diff);
-					idle_time_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-
-					timersub(&frame_info->after_redraw_render_texture, &frame_info->before_redraw_render_texture, &diff);
-					frame_processed_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-
-					timersub(&frame_info->after_encoded, &frame_info->after_redraw_render_texture, &diff);
-					encoded_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-				}
-
-				unsigned char header_pack[512];
-				char *sei = (char*) header_pack + sizeof(SOI);
-				sei[4] = 6; //nal_type:sei
-				int len =
-						sprintf(sei + 5,
-								"<picam360:frame frame_id=\"%d\" mode=\"%s\" view_quat=\"%.3f,%.3f,%.3f,%.3f\" fov=\"%.3f\" client_key=\"%s\" server_key=\"%d\" idle_time=\"%.3f\" frame_processed=\"%.3f\" encoded=\"%.3f\" />",
-								frame->id, frame->renderer->name, frame_info->view_quat.x, frame_info->view_quat.y, frame_info->view_quat.z, frame_info->view_quat.w, frame_info->fov,
-								frame_info->client_key, server_key, idle_time_sec, frame_processed_sec, encoded_sec);
-				len += 1; //nal header
-				sei[0] = (len >> 24) & 0xFF;
-				sei[1] = (len >> 16) & 0xFF;
-				sei[2] = (len >> 8) & 0xFF;
-				sei[3] = (len >> 0) & 0xFF;
-				len += 4; //start code
-				memcpy(header_pack, SOI, sizeof(SOI));
-				len += 2; //SOI
-				rtp_sendpacket(state->rtp, header_pack, len, PT_CAM_BASE);
-			} else {
-				unsigned char header_pack[512];
-				char *sei = (char*) header_pack + sizeof(SOI);
-				sei[4] = 6; //nal_type:sei
-				int len = sprintf(sei + 5, "<picam360:frame frame_id=\"%d\" />", frame->id);
-				len += 1; //nal header
-				sei[0] = (len >> 24) & 0xFF;
-				sei[1] = (len >> 16) & 0xFF;
-				sei[2] = (len >> 8) & 0xFF;
-				sei[3] = (len >> 0) & 0xFF;
-				len += 4; //start code
-				memcpy(header_pack, SOI, sizeof(SOI));
-				len += 2; //SOI
-				rtp_sendpacket(state->rtp, header_pack, len, PT_CAM_BASE);
-			}
-			if (frame->output_fd > 0) {
+			send_header_pack(frame, frame_info, false, SOI, pt);
+			pthread_mutex_lock(&lg_output_mutex);
+			MP4_MUXER_T *muxer = frame->output_muxer;
+			if (muxer) {
+				record_mp4_nal(muxer, frame, frame_info, data, data_len);
+			}
+			ASYNC_WRITER_T *writer = frame->output_writer;
+			if (writer) {
 				if (!frame->output_start) {
 					if ((data[4] & 0x1f) == 7) { // wait for sps
 						printf("output_start\n");
@@ -2667,10 +4276,11 @@ static void stream_callback(unsigned char *data, unsigned int data_len, void *fr
 					}
 				}
 				if (frame->output_start) {
-					write(frame->output_fd, SC, 4);
-					write(frame->output_fd, data + 4, data_len - 4);
+					struct iovec iov[] = { { (void*) SC, 4 }, { data + 4, data_len - 4 } };
+					async_writer_writev(writer, iov, 2);
 				}
 			}
+			pthread_mutex_unlock(&lg_output_mutex);
 			for (int j = 0; j < data_len;) {
 				int len;
 				if (j + RTP_MAXPAYLOADSIZE < data_len) {
@@ -2678,30 +4288,18 @@ static void stream_callback(unsigned char *data, unsigned int data_len, void *fr
 				} else {
 					len = data_len - j;
 				}
-				rtp_sendpacket(state->rtp, data + j, len, PT_CAM_BASE);
+				rtp_sendpacket(state->rtp, data + j, len, pt);
 				j += len;
 			}
-			rtp_sendpacket(state->rtp, EOI, sizeof(EOI), PT_CAM_BASE);
+			rtp_sendpacket(state->rtp, EOI, sizeof(EOI), pt);
 			rtp_flush(state->rtp);
 		} else if (frame->output_type == OUTPUT_TYPE_MJPEG) {
-			if (lg_debug_dump) {
-				if (data[0] == 0xFF && data[1] == 0xD8) { //
-					char path[256];
-					sprintf(path, "/tmp/debug_%03d.jpeg", lg_debug_dump_num++);
-					lg_debug_dump_fd = open(path, //
-							O_CREAT | O_WRONLY | O_TRUNC, /*  */
-							S_IRUSR | S_IWUSR | /* rw */
-							S_IRGRP | S_IWGRP | /* rw */
-							S_IROTH | S_IXOTH);
+			if (lg_debug_dump) { //jpegs are concatenated in one file, playable as mjpeg
+				if (lg_debug_dump_writer == NULL) {
+					lg_debug_dump_writer = async_writer_open("/tmp/debug.mjpeg", 8 * 1024 * 1024, 0, false);
 				}
-				if (lg_debug_dump_fd > 0) {
-					write(lg_debug_dump_fd, data, data_len);
-				}
-				if (data[data_len - 2] == 0xFF && data[data_len - 1] == 0xD9) {
-					if (lg_debug_dump_fd > 0) {
-						close(lg_debug_dump_fd);
-						lg_debug_dump_fd = -1;
-					}
+				if (lg_debug_dump_writer) {
+					async_writer_write(lg_debug_dump_writer, data, data_len);
 				}
 			}
 			for (int i = 0; i < data_len;) {
@@ -2711,84 +4309,104 @@ static void stream_callback(unsigned char *data, unsigned int data_len, void *fr
 				} else {
 					len = data_len - i;
 				}
-				rtp_sendpacket(state->rtp, data + i, len, PT_CAM_BASE);
+				rtp_sendpacket(state->rtp, data + i, len, pt);
 				i += len;
 			}
 			rtp_flush(state->rtp);
-			if (frame->output_fd > 0) {
-				write(frame->output_fd, data, data_len);
+			pthread_mutex_lock(&lg_output_mutex);
+			ASYNC_WRITER_T *writer = frame->output_writer;
+			if (writer) {
+				async_writer_write(writer, data, data_len);
 			}
+			pthread_mutex_unlock(&lg_output_mutex);
 		}
 	}
 	if (frame_info) {
+		if (frame->tile_index < 0) {
+			struct timeval now;
+			struct timeval diff;
+			gettimeofday(&now, NULL);
+			timersub(&now, &frame_info->before_redraw_render_texture, &diff);
+			view_predictor_set_process_time(&frame->view_predictor, diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0);
+		}
 		free(frame_info);
 	}
 }
 
 static int command2upstream_handler() {
-	static struct timeval last_try = { };
-	static bool is_first_try = false;
-	int len = strlen(lg_command);
-	if (len != 0 && lg_command_id != lg_ack_command_id_upstream) {
-		struct timeval s;
-		gettimeofday(&s, NULL);
-		if (!is_first_try) {
-			struct timeval diff;
-			timersub(&s, &last_try, &diff);
-			float diff_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-			if (diff_sec < 0.050) {
-				return 0;
-			}
+	struct timeval s;
+	gettimeofday(&s, NULL);
+	double now = s.tv_sec + s.tv_usec / 1000000.0;
+	for (;;) {
+		COMMAND_QUEUE_NODE_T *node = command_queue_pop(&state->cmd2upstream_queue);
+		if (node == NULL) {
+			break;
 		}
-		rtp_sendpacket(state->rtcp, (unsigned char*) lg_command, len, PT_CMD);
-		rtp_flush(state->rtcp);
-		last_try = s;
-		is_first_try = false;
-		return 0;
-	} else {
-		memset(lg_command, 0, sizeof(lg_command));
+		command_channel_push(&state->command_channel, node->cmd, now);
+		command_queue_release(&state->cmd2upstream_queue, node);
 	}
+	command_channel_update(&state->command_channel, now);
+	return 0;
+}
 
-	char *buff = NULL;
-	{
-		pthread_mutex_lock(&state->cmd_list_mutex);
+static void send_command_packet(const unsigned char *data, int data_len, void *user_data) {
+	rtp_sendpacket(state->rtcp, (unsigned char*) data, data_len, PT_CMD);
+	rtp_flush(state->rtcp);
+}
 
-		if (state->cmd2upstream_list) {
-			LIST_T *cur = state->cmd2upstream_list;
-			buff = (char*) cur->value;
-			state->cmd2upstream_list = cur->next;
-			free(cur);
-		}
+static void send_command_ack_packet(const unsigned char *data, int data_len, void *user_data) {
+	rtp_sendpacket(state->rtp, (unsigned char*) data, data_len, PT_CMD_ACK);
+	rtp_flush(state->rtp);
+}
 
-		pthread_mutex_unlock(&state->cmd_list_mutex);
-	}
+//pose of set_view_quaternion to upstream goes by its own packet instead of command queue
+static bool send_pose_upstream(const char *cmd) {
+	static uint16_t session = 0;
+	static uint32_t seq = 0;
+	const char name[] = "set_view_quaternion ";
+	if (strncmp(cmd, name, sizeof(name) - 1) != 0 || state->rtcp == NULL) {
+		return false;
+	}
+	POSE_T pose;
+	if (!pose_parse_params(cmd + sizeof(name) - 1, &pose)) {
+		return false;
+	}
+	if (session == 0) {
+		session = pose_session_new();
+	}
+	pose.flags |= POSE_FLAG_SEQ;
+	pose.session = session;
+	pose.seq = ++seq;
+	unsigned char packet[POSE_MESSAGE_LEN];
+	int len = pose_message_encode(&pose, packet, sizeof(packet));
+	rtp_sendpacket(state->rtcp, packet, len, PT_POSE);
+	rtp_flush(state->rtcp);
+	return true;
+}
 
-	if (buff) {
-		lg_command_id++;
-		snprintf(lg_command, sizeof(lg_command), "<picam360:command id=\"%d\" value=\"%s\" />", lg_command_id, buff);
-		free(buff);
-	}
-	return 0;
+static void deliver_command(const char *cmd, void *user_data) {
+	state->plugin_host.send_command(cmd);
 }
 
-static void status_handler(char *data, int data_len) {
-	for (int i = 0; i < data_len; i++) {
-		if (data[i] == '<') {
-			char name[64] = UPSTREAM_DOMAIN;
-			char value[256];
-			int num = sscanf(&data[i], "<picam360:status name=\"%63[^\"]\" value=\"%255[^\"]\" />", name + UPSTREAM_DOMAIN_SIZE, value);
-			if (num == 2) {
-				for (int i = 0; state->watches[i] != NULL; i++) {
-					if (strncmp(state->watches[i]->name, name, 64) == 0) {
-						state->watches[i]->set_value(state->watches[i]->user_data, value);
-						break;
-					}
-				}
-			}
+static void set_watch_value(const char *_name, const char *value, void *user_data) {
+	char name[64] = UPSTREAM_DOMAIN;
+	strncpy(name + UPSTREAM_DOMAIN_SIZE, _name, sizeof(name) - UPSTREAM_DOMAIN_SIZE - 1);
+	for (int i = 0; state->watches[i] != NULL; i++) {
+		if (strncmp(state->watches[i]->name, name, 64) == 0) {
+			state->watches[i]->set_value(state->watches[i]->user_data, value);
+			break;
 		}
 	}
 }
 
+static void status_handler(char *data, int data_len) {
+	status_publisher_parse(data, data_len, set_watch_value, NULL);
+}
+
+static void send_status_packet(const unsigned char *data, int data_len, void *user_data) {
+	rtp_sendpacket(state->rtp, (unsigned char*) data, data_len, PT_STATUS);
+}
+
 static int rtp_callback(unsigned char *data, unsigned int data_len, unsigned char pt, unsigned int seq_num, void *user_data) {
 	if (data_len == 0) {
 		return -1;
@@ -2801,6 +4419,10 @@ static int rtp_callback(unsigned char *data, unsigned int data_len, unsigned cha
 
 	if (pt == PT_STATUS) {
 		status_handler((char*) data, data_len);
+	} else if (pt == PT_CMD_ACK) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		command_channel_receive_ack(&state->command_channel, data, data_len, now.tv_sec + now.tv_usec / 1000000.0);
 	}
 	return 0;
 }
@@ -2815,13 +4437,31 @@ static int rtcp_callback(unsigned char *data, unsigned int data_len, unsigned ch
 	}
 	last_seq_num = seq_num;
 
-	if (pt == PT_CMD) {
+	if (pt == PT_POSE) {
+		POSE_T pose;
+		if (pose_message_decode(data, data_len, &pose)) {
+			struct timeval now;
+			gettimeofday(&now, NULL);
+			pose.received_time = now.tv_sec + now.tv_usec / 1000000.0;
+			POSE_SLOT_T *slot = get_pose_slot(pose.frame_id);
+			if (slot && !pose_slot_write(slot, &pose)) {
+				lg_pose_stale++;
+				metric_inc(lg_metric_poses_stale);
+			}
+			lg_pose_received++;
+			lg_pose_received_binary++;
+		}
+	} else if (pt == PT_CMD && command_channel_receive_data(&state->command_channel, data, data_len)) {
+		//delivered in order
+	} else if (pt == PT_CMD) { //legacy stop and wait, acked by ack_command_id status
 		int id;
 		char value[256];
 		int num = sscanf((char*) data, "<picam360:command id=\"%d\" value=\"%255[^\"]\" />", &id, value);
 		if (num == 2 && id != lg_ack_command_id_downstream) {
 			lg_ack_command_id_downstream = id;
 			state->plugin_host.send_command(value);
+		} else if (num == 2) { //statuses are sent as deltas, so ack again
+			__atomic_store_n(&lg_ack_command_id_resend, true, __ATOMIC_RELEASE);
 		}
 	}
 	return 0;
@@ -2842,6 +4482,10 @@ static STATUS_T *STATUS_VAR(quaternion);
 static STATUS_T *STATUS_VAR(north);
 static STATUS_T *STATUS_VAR(info);
 static STATUS_T *STATUS_VAR(menu);
+static STATUS_T *STATUS_VAR(view_prediction);
+static STATUS_T *STATUS_VAR(abr);
+static STATUS_T *STATUS_VAR(projection);
+static STATUS_T *STATUS_VAR(metrics);
 //watch status from upstream
 static STATUS_T *WATCH_VAR(ack_command_id);
 static STATUS_T *WATCH_VAR(quaternion);
@@ -2870,12 +4514,47 @@ static void status_get_value(void *user_data, char *buff, int buff_len) {
 		get_info_str(buff, buff_len);
 	} else if (status == STATUS_VAR(menu)) {
 		get_menu_str(buff, buff_len);
+	} else if (status == STATUS_VAR(view_prediction)) { //id:horizon_ms,mean_deg,rms_deg,max_deg;...
+		int len = 0;
+		buff[0] = '\0';
+		for (FRAME_T *frame = state->frame; frame != NULL && len < buff_len; frame = frame->next) {
+			if (!frame->view_predictor.enabled) {
+				continue;
+			}
+			float mean, rms, max;
+			view_predictor_get_stats(&frame->view_predictor, &mean, &rms, &max, NULL);
+			len += snprintf(buff + len, buff_len - len, "%d:%.1f,%.2f,%.2f,%.2f;", frame->id, view_predictor_get_horizon(&frame->view_predictor), mean, rms, max);
+		}
+	} else if (status == STATUS_VAR(abr)) { //id:kbps,fps,scale;...
+		int len = 0;
+		buff[0] = '\0';
+		for (FRAME_T *frame = state->frame; frame != NULL && len < buff_len; frame = frame->next) {
+			if (!frame->rate_controller.enabled || !frame->rate_controller.started) {
+				continue;
+			}
+			len += snprintf(buff + len, buff_len - len, "%d:%d,%.1f,%.2f;", frame->id, (int) frame->rate_controller.target_kbps, frame->rate_controller.fps,
+					frame->rate_controller.scale);
+		}
+	} else if (status == STATUS_VAR(projection)) { //id:projection;... of frames covering whole sphere
+		int len = 0;
+		buff[0] = '\0';
+		for (FRAME_T *frame = state->frame; frame != NULL && len < buff_len; frame = frame->next) {
+			if (frame->renderer == NULL || frame->renderer->projection[0] == '\0') {
+				continue;
+			}
+			len += snprintf(buff + len, buff_len - len, "%d:%s;", frame->id, frame->renderer->projection);
+		}
+	} else if (status == STATUS_VAR(metrics)) { //name{labels} value per line
+		metrics_registry_write(&state->metrics, buff, buff_len, true);
 	}
 }
 static void status_set_value(void *user_data, const char *value) {
 	STATUS_T *status = (STATUS_T*) user_data;
 	if (status == WATCH_VAR(ack_command_id)) {
 		sscanf(value, "%d", &lg_ack_command_id_upstream);
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		command_channel_receive_legacy_ack(&state->command_channel, lg_ack_command_id_upstream, now.tv_sec + now.tv_usec / 1000000.0);
 	} else if (status == WATCH_VAR(quaternion)) {
 		VECTOR4D_T vec = { };
 		sscanf(value, "%f,%f,%f,%f", &vec.x, &vec.y, &vec.z, &vec.w);
@@ -2890,10 +4569,17 @@ static void status_set_value(void *user_data, const char *value) {
 		state->plugin_host.set_camera_temperature(temperature);
 	} else if (status == WATCH_VAR(bandwidth)) {
 		sscanf(value, "%f", &lg_cam_bandwidth);
+		metric_set(lg_metric_cam_bandwidth, lg_cam_bandwidth);
 	} else if (status == WATCH_VAR(cam_fps)) {
 		sscanf(value, "%f,%f", &lg_cam_fps[0], &lg_cam_fps[1]);
+		for (int i = 0; i < 2; i++) {
+			metric_set(lg_metric_cam_fps[i], lg_cam_fps[i]);
+		}
 	} else if (status == WATCH_VAR(cam_frameskip)) {
 		sscanf(value, "%f,%f", &lg_cam_frameskip[0], &lg_cam_frameskip[1]);
+		for (int i = 0; i < 2; i++) {
+			metric_set(lg_metric_cam_frameskip[i], lg_cam_frameskip[i]);
+		}
 	}
 }
 
@@ -2914,6 +4600,10 @@ static void init_status() {
 	STATUS_INIT(&state->plugin_host, "", north);
 	STATUS_INIT(&state->plugin_host, "", info);
 	STATUS_INIT(&state->plugin_host, "", menu);
+	STATUS_INIT(&state->plugin_host, "", view_prediction);
+	STATUS_INIT(&state->plugin_host, "", abr);
+	STATUS_INIT(&state->plugin_host, "", projection);
+	STATUS_INIT(&state->plugin_host, "", metrics);
 	WATCH_INIT(&state->plugin_host, UPSTREAM_DOMAIN, ack_command_id);
 	WATCH_INIT(&state->plugin_host, UPSTREAM_DOMAIN, quaternion);
 	WATCH_INIT(&state->plugin_host, UPSTREAM_DOMAIN, compass);
@@ -3739,6 +5429,7 @@ int main(int argc, char *argv[]) {
 	// Clear application state
 	const int INITIAL_SPACE = 16;
 	memset(state, 0, sizeof(*state));
+	gettimeofday(&state->startup_time, NULL);
 	state->cam_width = 2048;
 	state->cam_height = 2048;
 	state->num_of_cam = 1;
@@ -3757,6 +5448,7 @@ int main(int argc, char *argv[]) {
 	state->rtp_play_speed = 1.0;
 	strncpy(state->default_view_coordinate_mode, "manual", sizeof(state->default_view_coordinate_mode));
 	strncpy(state->config_filepath, "config.json", sizeof(state->config_filepath));
+	strncpy(state->options.shader_cache_dir, "/var/tmp/picam360-shader-cache", sizeof(state->options.shader_cache_dir));
 
 	{
 		state->plugins = malloc(sizeof(PLUGIN_T*) * INITIAL_SPACE);
@@ -3839,7 +5531,20 @@ int main(int argc, char *argv[]) {
 	}
 
 	//init options
+	command_queue_init(&state->cmd_queue);
+	command_queue_init(&state->cmd2upstream_queue);
+	command_registry_init(&state->command_registry);
+	register_host_commands();
+	metrics_registry_init(&state->metrics);
+	status_publisher_init(&state->status_publisher, RTP_MAXPAYLOADSIZE, send_status_packet, NULL);
+	command_channel_init(&state->command_channel, RTP_MAXPAYLOADSIZE, send_command_packet, send_command_ack_packet, deliver_command, NULL);
+	for (int i = 0; i < POSE_SLOT_NUM; i++) {
+		pose_slot_init(&state->pose_slots[i]);
+		state->pose_slot_frame_ids[i] = -1;
+	}
+	status_publisher_set_interval(&state->status_publisher, "metrics", METRICS_UPDATE_INTERVAL); //options can override
 	init_options(state);
+	GLProgram_set_cache_dir(state->options.shader_cache_dir);
 
 	{ //mrevent & mutex init
 		for (int i = 0; i < state->num_of_cam; i++) {
@@ -3854,8 +5559,6 @@ int main(int argc, char *argv[]) {
 		pthread_mutex_init(&state->texture_mutex, 0);
 		//texture size mutex init
 		pthread_mutex_init(&state->texture_size_mutex, 0);
-		//frame mutex init
-		pthread_mutex_init(&state->cmd_list_mutex, 0);
 	}
 #if BCM_HOST
 	bcm_host_init();
@@ -3869,6 +5572,7 @@ int main(int argc, char *argv[]) {
 	_init_menu();
 
 	// init plugin
+	encoder_pool_init(&state->encoder_pool);
 	init_plugins(state);
 
 	// Setup the model world
@@ -3876,10 +5580,18 @@ int main(int argc, char *argv[]) {
 
 	//init rtp
 	_init_rtp(state);
+	init_metrics();
 
 	// initialise the OGLES texture(s)
 	init_textures(state);
 
+	{
+		struct timeval now, diff;
+		gettimeofday(&now, NULL);
+		timersub(&now, &state->startup_time, &diff);
+		printf("initialized in %.3lf ms\n", diff.tv_sec * 1000.0 + diff.tv_usec / 1000.0);
+	}
+
 	//frame id=0
 	if (frame_param[0]) {
 		char cmd[256];
@@ -3899,9 +5611,6 @@ int main(int argc, char *argv[]) {
 	static struct timeval last_time = { };
 	gettimeofday(&last_time, NULL);
 
-	static struct timeval last_statuses_handled_time = { };
-	gettimeofday(&last_statuses_handled_time, NULL);
-
 	//readline
 	pthread_t readline_thread;
 	pthread_create(&readline_thread, NULL, readline_thread_func, (void*) NULL);
@@ -3910,11 +5619,6 @@ int main(int argc, char *argv[]) {
 	pthread_t quaternion_thread;
 	pthread_create(&quaternion_thread, NULL, quaternion_thread_func, (void*) NULL);
 
-	//status buffer
-	char *status_value = (char*) malloc(RTP_MAXPAYLOADSIZE);
-	char *status_buffer = (char*) malloc(RTP_MAXPAYLOADSIZE);
-	char *status_packet = (char*) malloc(RTP_MAXPAYLOADSIZE);
-
 	while (!terminate) {
 		struct timeval time = { };
 		gettimeofday(&time, NULL);
@@ -3953,28 +5657,12 @@ int main(int argc, char *argv[]) {
 				usleep(delay_ms * 1000);
 			}
 		}
-		{ //status
-			struct timeval diff;
-			timersub(&time, &last_statuses_handled_time, &diff);
-			float diff_sec = (float) diff.tv_sec + (float) diff.tv_usec / 1000000;
-			if (diff_sec > 0.100) { //less than 10Hz
-				int cur = 0;
-				for (int i = 0; state->statuses[i]; i++) {
-					state->statuses[i]->get_value(state->statuses[i]->user_data, status_value, RTP_MAXPAYLOADSIZE);
-					int len = snprintf(status_buffer, RTP_MAXPAYLOADSIZE, "<picam360:status name=\"%s\" value=\"%s\" />", state->statuses[i]->name, status_value);
-					if (cur != 0 && cur + len > RTP_MAXPAYLOADSIZE) {
-						rtp_sendpacket(state->rtp, (unsigned char*) status_packet, cur, PT_STATUS);
-						cur = 0;
-					} else {
-						strncpy(status_packet + cur, status_buffer, len);
-						cur += len;
-					}
-				}
-				if (cur != 0) {
-					rtp_sendpacket(state->rtp, (unsigned char*) status_packet, cur, PT_STATUS);
-				}
-				last_statuses_handled_time = time;
+		update_metrics(time.tv_sec + time.tv_usec / 1000000.0);
+		{ //status, each status has own interval
+			if (__atomic_exchange_n(&lg_ack_command_id_resend, false, __ATOMIC_ACQ_REL)) {
+				status_publisher_resend(&state->status_publisher, STATUS_VAR(ack_command_id));
 			}
+			status_publisher_update(&state->status_publisher, state->statuses, time.tv_sec + time.tv_usec / 1000000.0);
 		}
 		last_time = time;
 	}
@@ -3982,6 +5670,26 @@ int main(int argc, char *argv[]) {
 	return 0;
 }
 
+//depth axis is z, vertical asis is y
+//unif_matrix is column primary as uploaded to the shader
+static void get_cam_attitude(PICAM360CAPTURE_T *state, VECTOR4D_T view_quat, int cam_num, float *unif_matrix) {
+	float cam_matrix[16];
+	{ // Rc : cam orientation
+		mat4_identity(cam_matrix);
+		if (state->camera_coordinate_from_device) {
+			mat4_fromQuat(cam_matrix, state->camera_quaternion[cam_num].ary);
+		} else {
+			//euler Y(yaw)X(pitch)Z(roll)
+			mat4_rotateZ(cam_matrix, cam_matrix, state->camera_roll);
+			mat4_rotateX(cam_matrix, cam_matrix, state->camera_pitch);
+			mat4_rotateY(cam_matrix, cam_matrix, state->camera_yaw);
+		}
+	}
+	float cam_offset[3] = { state->options.cam_offset_roll[cam_num], state->options.cam_offset_pitch[cam_num],
+			state->options.cam_offset_yaw[cam_num] };
+	cam_attitude_get_matrix(view_quat, cam_matrix, cam_offset, unif_matrix);
+}
+
 /***********************************************************
  * Name: redraw_scene
  *
@@ -3999,10 +5707,19 @@ static void redraw_render_texture(PICAM360CAPTURE_T *state, FRAME_T *frame, REND
 		return;
 	}
 
-	int frame_width = (state->stereo) ? frame->width / 2 : frame->width;
-	int frame_height = frame->height;
+	int render_width, render_height;
+	get_render_size(frame, &render_width, &render_height);
+	int frame_width = (state->stereo) ? render_width / 2 : render_width;
+	int frame_height = render_height;
 
-	int program = renderer->get_program(renderer);
+	uint32_t renderer_options = RENDERER_OPTION_NONE;
+	if (state->options.overlap != 0) {
+		renderer_options |= RENDERER_OPTION_OVERLAP;
+	}
+	if (state->options.color_offset != 0) {
+		renderer_options |= RENDERER_OPTION_COLOR_OFFSET;
+	}
+	int program = renderer->get_program(renderer, renderer_options);
 	glUseProgram(program);
 
 	glViewport(0, 0, frame_width, frame_height);
@@ -4024,62 +5741,10 @@ static void redraw_render_texture(PICAM360CAPTURE_T *state, FRAME_T *frame, REND
 		glUniform1iv(glGetUniformLocation(program, "cam_texture"), state->num_of_cam, cam_texture);
 	}
 
-	{ //cam_attitude //depth axis is z, vertical asis is y
+	{ //cam_attitude
 		float cam_attitude[16 * MAX_CAM_NUM];
-		float view_matrix[16];
-		float north_matrix[16];
-		float world_matrix[16];
-
-		{ // Rv : view
-			mat4_identity(view_matrix);
-			mat4_fromQuat(view_matrix, view_quat.ary);
-			mat4_invert(view_matrix, view_matrix);
-		}
-
-		{ // Rn : north
-			mat4_identity(north_matrix);
-			float north = state->plugin_host.get_view_north();
-			mat4_rotateY(north_matrix, north_matrix, north * M_PI / 180);
-		}
-
-		{ // Rw : view coodinate to world coodinate and view heading to ground initially
-			mat4_identity(world_matrix);
-			mat4_rotateX(world_matrix, world_matrix, -M_PI / 2);
-		}
-
 		for (int i = 0; i < state->num_of_cam; i++) {
-			float *unif_matrix = cam_attitude + 16 * i;
-			float cam_matrix[16];
-			{ // Rc : cam orientation
-				mat4_identity(cam_matrix);
-				if (state->camera_coordinate_from_device) {
-					mat4_fromQuat(cam_matrix, state->camera_quaternion[i].ary);
-				} else {
-					//euler Y(yaw)X(pitch)Z(roll)
-					mat4_rotateZ(cam_matrix, cam_matrix, state->camera_roll);
-					mat4_rotateX(cam_matrix, cam_matrix, state->camera_pitch);
-					mat4_rotateY(cam_matrix, cam_matrix, state->camera_yaw);
-				}
-			}
-
-			{ // Rco : cam offset  //euler Y(yaw)X(pitch)Z(roll)
-				float cam_offset_matrix[16];
-				mat4_identity(cam_offset_matrix);
-				mat4_rotateZ(cam_offset_matrix, cam_offset_matrix, state->options.cam_offset_roll[i]);
-				mat4_rotateX(cam_offset_matrix, cam_offset_matrix, state->options.cam_offset_pitch[i]);
-				mat4_rotateY(cam_offset_matrix, cam_offset_matrix, state->options.cam_offset_yaw[i]);
-				mat4_invert(cam_offset_matrix, cam_offset_matrix);
-				mat4_multiply(cam_matrix, cam_matrix, cam_offset_matrix); // Rc'=RcoRc
-			}
-
-			{ //RcRv(Rc^-1)RcRw
-				mat4_identity(unif_matrix);
-				mat4_multiply(unif_matrix, unif_matrix, world_matrix); // Rw
-				mat4_multiply(unif_matrix, unif_matrix, view_matrix); // RvRw
-				//mat4_multiply(unif_matrix, unif_matrix, north_matrix); // RnRvRw
-				mat4_multiply(unif_matrix, unif_matrix, cam_matrix); // RcRnRvRw
-			}
-			mat4_transpose(unif_matrix, unif_matrix); // this mat4 library is row primary, opengl is column primary
+			get_cam_attitude(state, view_quat, i, cam_attitude + 16 * i);
 		}
 		glUniformMatrix4fv(glGetUniformLocation(program, "cam_attitude"), state->num_of_cam, GL_FALSE, (GLfloat*) cam_attitude);
 	}
@@ -4203,6 +5868,8 @@ static void get_info_str(char *buff, int buff_len) {
 		len += snprintf(buff + len, buff_len - len, "\nVehicle: Tmp %.1f degC, N %.1f, rx %.1f Mbps, fps %.1f:%.1f skip %.0f:%.0f", state->plugin_host.get_camera_temperature(), north * 180 / M_PI,
 				lg_cam_bandwidth, lg_cam_fps[0], lg_cam_fps[1], lg_cam_frameskip[0], lg_cam_frameskip[1]);
 	}
+	len += snprintf(buff + len, buff_len - len, "\nStatus : tx %.1f kB/s, cmd %.1f/s latency %.1f ms", state->status_publisher.bytes_per_sec / 1000,
+			state->command_channel.commands_per_sec, state->command_channel.latency_ms);
 	for (int i = 0; state->plugins[i] != NULL; i++) {
 		if (state->plugins[i]->get_info) {
 			char *info = state->plugins[i]->get_info(state->plugins[i]->user_data);
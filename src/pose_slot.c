@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "pose_slot.h"
+
+#define MAGIC_0 'P'
+#define MAGIC_1 'Q'
+#define VERSION 1
+
+void pose_slot_init(POSE_SLOT_T *_this) {
+	memset(_this, 0, sizeof(POSE_SLOT_T));
+	pthread_mutex_init(&_this->write_mutex, 0);
+	_this->pose.frame_id = -1;
+}
+
+void pose_slot_deinit(POSE_SLOT_T *_this) {
+	pthread_mutex_destroy(&_this->write_mutex);
+}
+
+bool pose_slot_write(POSE_SLOT_T *_this, const POSE_T *pose) {
+	pthread_mutex_lock(&_this->write_mutex);
+	const POSE_T *cur = &_this->pose;
+	//a restarted sender comes with new session, or older one without session is trusted again after timeout
+	if ((pose->flags & POSE_FLAG_SEQ) && (cur->flags & POSE_FLAG_SEQ) && cur->frame_id == pose->frame_id && cur->session == pose->session
+			&& pose->received_time - cur->received_time < POSE_SEQ_TIMEOUT && (int32_t) (pose->seq - cur->seq) <= 0) { //reordered by network
+		pthread_mutex_unlock(&_this->write_mutex);
+		return false;
+	}
+	__atomic_add_fetch(&_this->version, 1, __ATOMIC_ACQ_REL);
+	__atomic_thread_fence(__ATOMIC_RELEASE); //odd version is visible before the pose
+	_this->pose = *pose;
+	__atomic_add_fetch(&_this->version, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&_this->write_mutex);
+	return true;
+}
+
+bool pose_slot_read(POSE_SLOT_T *_this, POSE_T *pose, uint32_t *version) {
+	for (;;) {
+		uint32_t v = __atomic_load_n(&_this->version, __ATOMIC_ACQUIRE);
+		if (v == *version) {
+			return false;
+		}
+		if (v & 1) { //writing, a copy takes less than a microsecond
+			continue;
+		}
+		*pose = _this->pose;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&_this->version, __ATOMIC_RELAXED) == v) {
+			*version = v;
+			return true;
+		}
+	}
+}
+
+static void put_u16(unsigned char *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+static void put_u32(unsigned char *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+static void put_f32(unsigned char *p, float v) {
+	uint32_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_u32(p, u);
+}
+static void put_f64(unsigned char *p, double v) {
+	uint64_t u;
+	memcpy(&u, &v, sizeof(u));
+	put_u32(p, u >> 32);
+	put_u32(p + 4, u);
+}
+static uint16_t get_u16(const unsigned char *p) {
+	return (p[0] << 8) | p[1];
+}
+static uint32_t get_u32(const unsigned char *p) {
+	return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static float get_f32(const unsigned char *p) {
+	uint32_t u = get_u32(p);
+	float v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+static double get_f64(const unsigned char *p) {
+	uint64_t u = ((uint64_t) get_u32(p) << 32) | get_u32(p + 4);
+	double v;
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+uint16_t pose_session_new() {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	uint16_t session = (uint16_t) (now.tv_sec ^ now.tv_usec ^ getpid());
+	return session ? session : 1; //0 : sender without session
+}
+
+//magic, version, flags, frame_id, session, seq, quat, fov, client_time, rtt, client_key
+int pose_message_encode(const POSE_T *pose, unsigned char *buff, int buff_len) {
+	if (buff_len < POSE_MESSAGE_LEN) {
+		return -1;
+	}
+	memset(buff, 0, POSE_MESSAGE_LEN);
+	buff[0] = MAGIC_0;
+	buff[1] = MAGIC_1;
+	buff[2] = VERSION;
+	buff[3] = pose->flags;
+	put_u16(buff + 4, pose->frame_id);
+	put_u16(buff + 6, pose->session);
+	put_u32(buff + 8, pose->seq);
+	for (int i = 0; i < 4; i++) {
+		put_f32(buff + 12 + i * 4, pose->quat.ary[i]);
+	}
+	put_u16(buff + 28, (uint16_t) (pose->fov * 100 + 0.5)); //1/100 degree
+	put_f64(buff + 30, pose->client_time);
+	put_u16(buff + 38, (uint16_t) (pose->rtt_ms * 10 + 0.5)); //1/10 ms
+	memcpy(buff + 40, pose->client_key, strnlen(pose->client_key, POSE_CLIENT_KEY_LEN));
+	return POSE_MESSAGE_LEN;
+}
+
+bool pose_message_decode(const unsigned char *data, int data_len, POSE_T *pose) {
+	if (data_len < POSE_MESSAGE_LEN || data[0] != MAGIC_0 || data[1] != MAGIC_1 || data[2] != VERSION) {
+		return false;
+	}
+	memset(pose, 0, sizeof(POSE_T));
+	pose->flags = data[3];
+	pose->frame_id = get_u16(data + 4);
+	pose->session = get_u16(data + 6);
+	pose->seq = get_u32(data + 8);
+	for (int i = 0; i < 4; i++) {
+		pose->quat.ary[i] = get_f32(data + 12 + i * 4);
+	}
+	pose->fov = get_u16(data + 28) / 100.0f;
+	pose->client_time = get_f64(data + 30);
+	pose->rtt_ms = get_u16(data + 38) / 10.0f;
+	memcpy(pose->client_key, data + 40, POSE_CLIENT_KEY_LEN);
+	pose->client_key[POSE_CLIENT_KEY_LEN] = '\0';
+	return true;
+}
+
+bool pose_parse_params(const char *params, POSE_T *pose) {
+	char buff[256];
+	strncpy(buff, params, sizeof(buff) - 1);
+	buff[sizeof(buff) - 1] = '\0';
+
+	bool quat_valid = false;
+	memset(pose, 0, sizeof(POSE_T));
+	char *save = NULL;
+	for (char *param = strtok_r(buff, " \n", &save); param != NULL; param = strtok_r(NULL, " \n", &save)) {
+		if (strncmp(param, "quat=", 5) == 0) {
+			VECTOR4D_T *q = &pose->quat;
+			quat_valid = (sscanf(param, "quat=%f,%f,%f,%f", &q->x, &q->y, &q->z, &q->w) == 4);
+		} else if (strncmp(param, "fov=", 4) == 0) {
+			if (sscanf(param, "fov=%f", &pose->fov) == 1) {
+				pose->flags |= POSE_FLAG_FOV;
+			}
+		} else if (strncmp(param, "client_key=", 11) == 0) {
+			strncpy(pose->client_key, param + 11, sizeof(pose->client_key) - 1);
+			pose->flags |= POSE_FLAG_CLIENT_KEY;
+		} else if (strncmp(param, "client_time=", 12) == 0) {
+			if (sscanf(param, "client_time=%lf", &pose->client_time) == 1) {
+				pose->flags |= POSE_FLAG_CLIENT_TIME;
+			}
+		} else if (strncmp(param, "rtt=", 4) == 0) {
+			if (sscanf(param, "rtt=%f", &pose->rtt_ms) == 1) {
+				pose->flags |= POSE_FLAG_RTT;
+			}
+		} else if (strncmp(param, "id=", 3) == 0) {
+			sscanf(param, "id=%d", &pose->frame_id);
+		}
+	}
+	if (pose->frame_id < 0) {
+		return false;
+	}
+	return quat_valid;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "rate_controller.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define MIN_OWD_SAMPLES 6
+#define LOSS_EWMA 0.3
+#define LOSS_HIGH 0.10 //decrease above
+#define LOSS_LOW 0.02 //increase below
+#define OVERUSE_BACKOFF 0.85
+#define DECREASE_INTERVAL_SEC 0.5 //let a decrease reach the queue before the next one
+#define INCREASE_PER_SEC 1.08
+#define LEVEL_DOWN_HOLD_SEC 1.0
+#define LEVEL_UP_HOLD_SEC 5.0
+#define LEVEL_UP_HYSTERESIS 1.3
+#define APPLY_THRESHOLD 0.05
+
+//kbps / nominal_kbps needed to stay on each level
+static const struct {
+	float min_ratio;
+	float fps_ratio;
+	float scale;
+} lg_levels[RATE_CONTROLLER_LEVEL_NUM] = {
+	{ 0.60, 1.0, 1.0 },
+	{ 0.40, 0.67, 1.0 }, //frame rate first, it keeps detail of the view
+	{ 0.25, 0.5, 1.0 },
+	{ 0.15, 0.5, 0.75 },
+	{ 0.00, 0.5, 0.5 },
+};
+
+void rate_controller_init(RATE_CONTROLLER_T *_this) {
+	memset(_this, 0, sizeof(RATE_CONTROLLER_T));
+	_this->enabled = false;
+	_this->min_kbps = 100;
+	_this->max_kbps = 0;
+	_this->overuse_threshold = 10;
+	_this->fps = 0;
+	_this->scale = 1.0;
+}
+
+static int get_max_level(RATE_CONTROLLER_T *_this) {
+	return _this->scalable ? RATE_CONTROLLER_LEVEL_NUM - 1 : 2;
+}
+
+static void set_level(RATE_CONTROLLER_T *_this, int level, double now) {
+	_this->level = level;
+	_this->fps = MAX(_this->max_fps * lg_levels[level].fps_ratio, 1);
+	_this->scale = lg_levels[level].scale;
+	_this->last_level_change_time = now;
+}
+
+void rate_controller_start(RATE_CONTROLLER_T *_this, float nominal_kbps, float max_fps, bool scalable) {
+	if (_this->started) {
+		return;
+	}
+	_this->started = true;
+	_this->nominal_kbps = nominal_kbps;
+	_this->max_fps = max_fps;
+	_this->scalable = scalable;
+	if (_this->max_kbps <= 0) {
+		_this->max_kbps = nominal_kbps;
+	}
+	_this->target_kbps = MAX(MIN(nominal_kbps, _this->max_kbps), _this->min_kbps);
+	set_level(_this, 0, 0);
+	_this->applied_kbps = _this->target_kbps;
+	_this->applied_level = _this->level;
+}
+
+//least squares slope of one way delay, robust to the unknown clock offset
+static float get_delay_slope(RATE_CONTROLLER_T *_this) {
+	int num = _this->owd_num;
+	double t0 = _this->owd_time[(_this->owd_cur - num + RATE_CONTROLLER_HISTORY_NUM) % RATE_CONTROLLER_HISTORY_NUM];
+	double sum_t = 0, sum_d = 0;
+	for (int i = 0; i < num; i++) {
+		int idx = (_this->owd_cur - num + i + RATE_CONTROLLER_HISTORY_NUM) % RATE_CONTROLLER_HISTORY_NUM;
+		sum_t += _this->owd_time[idx] - t0;
+		sum_d += _this->owd_ms[idx];
+	}
+	double mean_t = sum_t / num;
+	double mean_d = sum_d / num;
+	double cov = 0, var = 0;
+	for (int i = 0; i < num; i++) {
+		int idx = (_this->owd_cur - num + i + RATE_CONTROLLER_HISTORY_NUM) % RATE_CONTROLLER_HISTORY_NUM;
+		double dt = _this->owd_time[idx] - t0 - mean_t;
+		cov += dt * (_this->owd_ms[idx] - mean_d);
+		var += dt * dt;
+	}
+	return (var > 0) ? cov / var : 0;
+}
+
+void rate_controller_push_report(RATE_CONTROLLER_T *_this, double now, int received, int lost, int bytes, float interval_ms, float owd_ms) {
+	if (received + lost > 0) {
+		float loss = (float) MAX(lost, 0) / (received + MAX(lost, 0));
+		_this->loss = (_this->num_of_reports == 0) ? loss : _this->loss * (1 - LOSS_EWMA) + loss * LOSS_EWMA;
+	}
+	if (bytes >= 0 && interval_ms > 0) {
+		_this->receive_kbps = 8.0 * bytes / interval_ms;
+	}
+	if (owd_ms >= 0) {
+		_this->owd_time[_this->owd_cur] = now;
+		_this->owd_ms[_this->owd_cur] = owd_ms;
+		_this->owd_cur = (_this->owd_cur + 1) % RATE_CONTROLLER_HISTORY_NUM;
+		_this->owd_num = MIN(_this->owd_num + 1, RATE_CONTROLLER_HISTORY_NUM);
+		if (_this->owd_num >= MIN_OWD_SAMPLES) {
+			_this->delay_slope = get_delay_slope(_this);
+			if (_this->delay_slope > _this->overuse_threshold) {
+				_this->delay_state = RATE_CONTROLLER_DELAY_OVERUSE;
+			} else if (_this->delay_slope < -_this->overuse_threshold) {
+				_this->delay_state = RATE_CONTROLLER_DELAY_UNDERUSE;
+			} else {
+				_this->delay_state = RATE_CONTROLLER_DELAY_NORMAL;
+			}
+		}
+	}
+	_this->num_of_reports++;
+	_this->last_report_time = now;
+}
+
+static void update_level(RATE_CONTROLLER_T *_this, double now) {
+	float ratio = _this->target_kbps / _this->nominal_kbps;
+	int level = _this->level;
+	while (level < get_max_level(_this) && ratio < lg_levels[level].min_ratio) {
+		level++;
+	}
+	if (level > _this->level) {
+		if (now - _this->last_level_change_time >= LEVEL_DOWN_HOLD_SEC) {
+			set_level(_this, level, now);
+		}
+		return;
+	}
+	if (_this->level > 0 && ratio >= lg_levels[_this->level - 1].min_ratio * LEVEL_UP_HYSTERESIS
+			&& now - _this->last_level_change_time >= LEVEL_UP_HOLD_SEC) {
+		set_level(_this, _this->level - 1, now);
+	}
+}
+
+bool rate_controller_update(RATE_CONTROLLER_T *_this, double now, float send_kbps) {
+	if (!_this->enabled || !_this->started || _this->num_of_reports == 0 || _this->last_report_time <= _this->last_update_time) {
+		return false;
+	}
+	float elapsed = (_this->last_update_time > 0) ? MIN(now - _this->last_update_time, 1.0) : 0;
+	_this->last_update_time = now;
+
+	float base_kbps = (_this->receive_kbps > 0) ? _this->receive_kbps : send_kbps;
+	if (_this->loss > LOSS_HIGH) {
+		if (now - _this->last_decrease_time >= DECREASE_INTERVAL_SEC) {
+			_this->target_kbps *= (1 - 0.5 * _this->loss);
+			_this->last_decrease_time = now;
+		}
+	} else if (_this->delay_state == RATE_CONTROLLER_DELAY_OVERUSE) {
+		if (now - _this->last_decrease_time >= DECREASE_INTERVAL_SEC) {
+			float kbps = (base_kbps > 0) ? MIN(base_kbps, _this->target_kbps) : _this->target_kbps;
+			_this->target_kbps = kbps * OVERUSE_BACKOFF;
+			_this->last_decrease_time = now;
+		}
+	} else if (_this->delay_state == RATE_CONTROLLER_DELAY_UNDERUSE) {
+		//hold while queue drains
+	} else if (_this->loss < LOSS_LOW) {
+		_this->target_kbps *= pow(INCREASE_PER_SEC, elapsed);
+		if (base_kbps > 0) { //do not run away from what actually goes through
+			_this->target_kbps = MIN(_this->target_kbps, base_kbps * 1.5);
+		}
+	}
+	_this->target_kbps = MAX(MIN(_this->target_kbps, _this->max_kbps), _this->min_kbps);
+
+	update_level(_this, now);
+
+	if (_this->level != _this->applied_level) {
+		return true;
+	}
+	return fabs(_this->target_kbps - _this->applied_kbps) > _this->applied_kbps * APPLY_THRESHOLD;
+}
+
+void rate_controller_applied(RATE_CONTROLLER_T *_this) {
+	_this->applied_kbps = _this->target_kbps;
+	_this->applied_level = _this->level;
+}
+
+const char *rate_controller_get_delay_state_str(RATE_CONTROLLER_T *_this) {
+	switch (_this->delay_state) {
+	case RATE_CONTROLLER_DELAY_OVERUSE:
+		return "overuse";
+	case RATE_CONTROLLER_DELAY_UNDERUSE:
+		return "underuse";
+	default:
+		return "normal";
+	}
+}
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <zlib.h>
+
+#include "status_publisher.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define STATS_INTERVAL_SEC 1.0
+#define MAX_DECODED_LEN (1024 * 1024) //guard of len attribute
+
+static const char lg_base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int base64_encode(const unsigned char *src, int src_len, char *dst, int dst_size) {
+	int len = 0;
+	for (int i = 0; i < src_len; i += 3) {
+		if (len + 4 >= dst_size) {
+			return -1;
+		}
+		uint32_t v = src[i] << 16;
+		if (i + 1 < src_len) {
+			v |= src[i + 1] << 8;
+		}
+		if (i + 2 < src_len) {
+			v |= src[i + 2];
+		}
+		dst[len++] = lg_base64[(v >> 18) & 0x3F];
+		dst[len++] = lg_base64[(v >> 12) & 0x3F];
+		dst[len++] = (i + 1 < src_len) ? lg_base64[(v >> 6) & 0x3F] : '=';
+		dst[len++] = (i + 2 < src_len) ? lg_base64[v & 0x3F] : '=';
+	}
+	dst[len] = '\0';
+	return len;
+}
+
+static int base64_decode(const char *src, int src_len, unsigned char *dst, int dst_size) {
+	int len = 0;
+	uint32_t v = 0;
+	int bits = 0;
+	for (int i = 0; i < src_len && src[i] != '='; i++) {
+		const char *p = strchr(lg_base64, src[i]);
+		if (p == NULL || src[i] == '\0') {
+			return -1;
+		}
+		v = (v << 6) | (p - lg_base64);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (len >= dst_size) {
+				return -1;
+			}
+			dst[len++] = (v >> bits) & 0xFF;
+		}
+	}
+	return len;
+}
+
+void status_publisher_init(STATUS_PUBLISHER_T *_this, int max_packet_len, STATUS_PUBLISHER_SEND send, void *user_data) {
+	memset(_this, 0, sizeof(STATUS_PUBLISHER_T));
+	_this->interval = STATUS_PUBLISHER_DEFAULT_INTERVAL;
+	_this->snapshot_interval = STATUS_PUBLISHER_DEFAULT_SNAPSHOT_INTERVAL;
+	_this->compress_threshold = STATUS_PUBLISHER_DEFAULT_COMPRESS_THRESHOLD;
+	_this->max_packet_len = max_packet_len;
+	_this->value_size = max_packet_len * 4; //compressed values may exceed a packet before deflate
+	_this->value_buff = (char*) malloc(_this->value_size);
+	_this->escape_buff = (char*) malloc(_this->value_size * 6); //&quot; at most
+	_this->entry_size = _this->value_size * 6 + 256;
+	_this->entry_buff = (char*) malloc(_this->entry_size);
+	_this->packet = (unsigned char*) malloc(max_packet_len);
+	_this->send = send;
+	_this->user_data = user_data;
+}
+
+void status_publisher_deinit(STATUS_PUBLISHER_T *_this) {
+	while (_this->entries) {
+		STATUS_PUBLISHER_ENTRY_T *entry = _this->entries;
+		_this->entries = entry->next;
+		free(entry->value);
+		free(entry);
+	}
+	while (_this->intervals) {
+		STATUS_PUBLISHER_INTERVAL_T *interval = _this->intervals;
+		_this->intervals = interval->next;
+		free(interval);
+	}
+	free(_this->value_buff);
+	free(_this->escape_buff);
+	free(_this->entry_buff);
+	free(_this->packet);
+	_this->value_buff = NULL;
+	_this->escape_buff = NULL;
+	_this->entry_buff = NULL;
+	_this->packet = NULL;
+}
+
+void status_publisher_set_interval(STATUS_PUBLISHER_T *_this, const char *name, float interval) {
+	for (STATUS_PUBLISHER_INTERVAL_T **cur = &_this->intervals; *cur != NULL; cur = &(*cur)->next) {
+		if (strncmp((*cur)->name, name, sizeof((*cur)->name)) == 0) {
+			if (interval < 0) {
+				STATUS_PUBLISHER_INTERVAL_T *next = (*cur)->next;
+				free(*cur);
+				*cur = next;
+			} else {
+				(*cur)->interval = interval;
+			}
+			return;
+		}
+	}
+	if (interval < 0) {
+		return;
+	}
+	STATUS_PUBLISHER_INTERVAL_T *item = (STATUS_PUBLISHER_INTERVAL_T*) malloc(sizeof(STATUS_PUBLISHER_INTERVAL_T));
+	memset(item, 0, sizeof(STATUS_PUBLISHER_INTERVAL_T));
+	strncpy(item->name, name, sizeof(item->name) - 1);
+	item->interval = interval;
+	item->next = _this->intervals;
+	_this->intervals = item;
+}
+
+void status_publisher_request_snapshot(STATUS_PUBLISHER_T *_this) {
+	_this->last_snapshot_time = 0;
+}
+
+static float get_interval(STATUS_PUBLISHER_T *_this, STATUS_T *status) {
+	for (STATUS_PUBLISHER_INTERVAL_T *item = _this->intervals; item != NULL; item = item->next) {
+		if (strncmp(item->name, status->name, sizeof(item->name)) == 0) {
+			return item->interval;
+		}
+	}
+	return _this->interval;
+}
+
+static STATUS_PUBLISHER_ENTRY_T *get_entry(STATUS_PUBLISHER_T *_this, STATUS_T *status) {
+	STATUS_PUBLISHER_ENTRY_T **cur = &_this->entries;
+	for (; *cur != NULL; cur = &(*cur)->next) {
+		if ((*cur)->status == status) {
+			return *cur;
+		}
+	}
+	*cur = (STATUS_PUBLISHER_ENTRY_T*) malloc(sizeof(STATUS_PUBLISHER_ENTRY_T));
+	memset(*cur, 0, sizeof(STATUS_PUBLISHER_ENTRY_T));
+	(*cur)->status = status;
+	(*cur)->value = (char*) malloc(_this->value_size);
+	(*cur)->value[0] = '\0';
+	(*cur)->last_poll_time = -1;
+	return *cur;
+}
+
+void status_publisher_resend(STATUS_PUBLISHER_T *_this, STATUS_T *status) {
+	get_entry(_this, status)->dirty = true;
+}
+
+static void flush_packet(STATUS_PUBLISHER_T *_this) {
+	if (_this->packet_len == 0) {
+		return;
+	}
+	_this->send(_this->packet, _this->packet_len, _this->user_data);
+	_this->sent_bytes += _this->packet_len;
+	_this->stats_bytes += _this->packet_len;
+	_this->packet_len = 0;
+}
+
+//values like compact metrics have quotes and newlines
+static void escape_xml(const char *src, char *dst, int dst_size) {
+	int len = 0;
+	for (; *src; src++) {
+		const char *ent = NULL;
+		switch (*src) {
+		case '&':
+			ent = "&amp;";
+			break;
+		case '<':
+			ent = "&lt;";
+			break;
+		case '>':
+			ent = "&gt;";
+			break;
+		case '"':
+			ent = "&quot;";
+			break;
+		case '\n':
+			ent = "&#10;";
+			break;
+		case '\r':
+			ent = "&#13;";
+			break;
+		}
+		int ent_len = ent ? strlen(ent) : 1;
+		if (len + ent_len >= dst_size) {
+			break;
+		}
+		if (ent) {
+			memcpy(dst + len, ent, ent_len);
+		} else {
+			dst[len] = *src;
+		}
+		len += ent_len;
+	}
+	dst[len] = '\0';
+}
+
+//in place, entities of escape_xml only
+static void unescape_xml(char *str) {
+	const char *ents[] = { "&amp;", "&lt;", "&gt;", "&quot;", "&#10;", "&#13;" };
+	const char chars[] = { '&', '<', '>', '"', '\n', '\r' };
+	char *dst = str;
+	for (const char *src = str; *src;) {
+		bool found = false;
+		if (*src == '&') {
+			for (int i = 0; i < sizeof(chars); i++) {
+				int ent_len = strlen(ents[i]);
+				if (strncmp(src, ents[i], ent_len) == 0) {
+					*dst++ = chars[i];
+					src += ent_len;
+					found = true;
+					break;
+				}
+			}
+		}
+		if (!found) {
+			*dst++ = *src++;
+		}
+	}
+	*dst = '\0';
+}
+
+//deflated and base64 encoded when it is shorter
+static int format_entry(STATUS_PUBLISHER_T *_this, STATUS_PUBLISHER_ENTRY_T *entry) {
+	int entry_size = _this->entry_size;
+	int value_len = strlen(entry->value);
+	if (_this->compress_threshold > 0 && value_len >= _this->compress_threshold) {
+		uLongf z_len = compressBound(value_len);
+		unsigned char *z = (unsigned char*) malloc(z_len);
+		char *b64 = (char*) malloc(z_len * 4 / 3 + 8);
+		int b64_len = -1;
+		if (compress2(z, &z_len, (const Bytef*) entry->value, value_len, Z_BEST_SPEED) == Z_OK) {
+			b64_len = base64_encode(z, z_len, b64, z_len * 4 / 3 + 8);
+		}
+		int len = -1;
+		if (b64_len > 0 && b64_len < value_len) {
+			len = snprintf(_this->entry_buff, entry_size, "<picam360:status name=\"%s\" value=\"%s\" ver=\"%u\" enc=\"z\" len=\"%d\" />", entry->status->name,
+					b64, entry->version, value_len);
+		}
+		free(z);
+		free(b64);
+		if (len > 0) {
+			return MIN(len, entry_size - 1);
+		}
+	}
+	escape_xml(entry->value, _this->escape_buff, _this->value_size * 6);
+	int len = snprintf(_this->entry_buff, entry_size, "<picam360:status name=\"%s\" value=\"%s\" ver=\"%u\" />", entry->status->name,
+			_this->escape_buff, entry->version);
+	return MIN(len, entry_size - 1);
+}
+
+static void send_entry(STATUS_PUBLISHER_T *_this, STATUS_PUBLISHER_ENTRY_T *entry) {
+	int len = format_entry(_this, entry);
+	if (len > _this->max_packet_len) {
+		if (!entry->oversize_reported) {
+			printf("status %s : %d bytes exceeds a packet, not sent\n", entry->status->name, len);
+			entry->oversize_reported = true;
+		}
+		return;
+	}
+	if (_this->packet_len + len > _this->max_packet_len) {
+		flush_packet(_this);
+	}
+	memcpy(_this->packet + _this->packet_len, _this->entry_buff, len);
+	_this->packet_len += len;
+	_this->sent_entries++;
+}
+
+void status_publisher_update(STATUS_PUBLISHER_T *_this, STATUS_T **statuses, double now) {
+	bool snapshot = false;
+	if (_this->snapshot_interval > 0 && now - _this->last_snapshot_time >= _this->snapshot_interval) {
+		snapshot = true;
+		_this->last_snapshot_time = now;
+	}
+	for (int i = 0; statuses[i] != NULL; i++) {
+		STATUS_PUBLISHER_ENTRY_T *entry = get_entry(_this, statuses[i]);
+		if (!snapshot && !entry->dirty && entry->last_poll_time >= 0 && now - entry->last_poll_time < get_interval(_this, statuses[i])) {
+			continue;
+		}
+		entry->last_poll_time = now;
+		_this->polled_entries++;
+
+		_this->value_buff[0] = '\0';
+		statuses[i]->get_value(statuses[i]->user_data, _this->value_buff, _this->value_size);
+		_this->value_buff[_this->value_size - 1] = '\0';
+		if (entry->version == 0 || strcmp(entry->value, _this->value_buff) != 0) {
+			strcpy(entry->value, _this->value_buff);
+			entry->version++;
+			entry->dirty = true;
+		}
+		if (entry->dirty || snapshot) {
+			send_entry(_this, entry);
+			entry->dirty = false;
+		}
+	}
+	flush_packet(_this);
+
+	if (now - _this->stats_time >= STATS_INTERVAL_SEC) {
+		if (_this->stats_time > 0) {
+			_this->bytes_per_sec = _this->stats_bytes / (now - _this->stats_time);
+		}
+		_this->stats_bytes = 0;
+		_this->stats_time = now;
+	}
+}
+
+//value of attr in [p, end), returns length or -1
+static int find_attr(const char *p, const char *end, const char *attr, const char **value) {
+	int attr_len = strlen(attr);
+	for (; p + attr_len < end; p++) {
+		if (memcmp(p, attr, attr_len) == 0) {
+			*value = p + attr_len;
+			const char *q = memchr(*value, '"', end - *value);
+			return q ? q - *value : -1;
+		}
+	}
+	return -1;
+}
+
+void status_publisher_parse(const char *data, int data_len, STATUS_PUBLISHER_VALUE_CALLBACK callback, void *user_data) {
+	const char tag[] = "<picam360:status ";
+	const char *end = data + data_len;
+	for (const char *p = data; p + sizeof(tag) - 1 < end; p++) {
+		if (*p != '<' || memcmp(p, tag, sizeof(tag) - 1) != 0) {
+			continue;
+		}
+		const char *elem_end = NULL;
+		for (const char *q = p; q + 1 < end; q++) {
+			if (q[0] == '/' && q[1] == '>') {
+				elem_end = q;
+				break;
+			}
+		}
+		if (elem_end == NULL) {
+			return;
+		}
+		const char *name_p, *value_p, *enc_p, *len_p;
+		int name_len = find_attr(p, elem_end, " name=\"", &name_p);
+		int value_len = find_attr(p, elem_end, " value=\"", &value_p);
+		if (name_len < 0 || value_len < 0) {
+			p = elem_end;
+			continue;
+		}
+		char name[64];
+		name_len = MIN(name_len, (int) sizeof(name) - 1);
+		memcpy(name, name_p, name_len);
+		name[name_len] = '\0';
+
+		char *value = NULL;
+		int enc_len = find_attr(value_p + value_len, elem_end, " enc=\"", &enc_p);
+		if (enc_len == 1 && enc_p[0] == 'z') {
+			int raw_len = 0;
+			if (find_attr(value_p + value_len, elem_end, " len=\"", &len_p) > 0) {
+				raw_len = atoi(len_p);
+			}
+			if (raw_len > 0 && raw_len <= MAX_DECODED_LEN) {
+				unsigned char *z = (unsigned char*) malloc(value_len);
+				int z_len = base64_decode(value_p, value_len, z, value_len);
+				uLongf dst_len = raw_len;
+				value = (char*) malloc(raw_len + 1);
+				if (z_len <= 0 || uncompress((Bytef*) value, &dst_len, z, z_len) != Z_OK) {
+					free(value);
+					value = NULL;
+				} else {
+					value[dst_len] = '\0';
+				}
+				free(z);
+			}
+		} else {
+			value = (char*) malloc(value_len + 1);
+			memcpy(value, value_p, value_len);
+			value[value_len] = '\0';
+			unescape_xml(value);
+		}
+		if (value) {
+			callback(name, value, user_data);
+			free(value);
+		} else {
+			printf("status %s : broken value\n", name);
+		}
+		p = elem_end;
+	}
+}
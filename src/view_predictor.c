@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "view_predictor.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define MAX_HORIZON_SEC 0.5
+#define CLOCK_DRIFT_FOLLOW 0.001
+#define PROCESS_TIME_EWMA 0.1
+
+static float get_angle(VECTOR4D_T a, VECTOR4D_T b) { //deg
+	float dot = fabs(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+	return 2 * acos(MIN(dot, 1.0)) * 180 / M_PI;
+}
+
+static VECTOR4D_T nlerp(VECTOR4D_T a, VECTOR4D_T b, float t) {
+	float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	float sign = (dot < 0) ? -1 : 1;
+	VECTOR4D_T q;
+	for (int i = 0; i < 4; i++) {
+		q.ary[i] = a.ary[i] * (1 - t) + sign * b.ary[i] * t;
+	}
+	q.t = 0;
+	return quaternion_normalize(q);
+}
+
+void view_predictor_init(VIEW_PREDICTOR_T *_this) {
+	memset(_this, 0, sizeof(VIEW_PREDICTOR_T));
+	_this->enabled = true;
+	_this->gain = 1.0;
+	_this->horizon_ms = 0;
+	_this->window_ms = 100;
+	_this->max_angle = 45;
+}
+
+static void evaluate_pending(VIEW_PREDICTOR_T *_this, VIEW_PREDICTOR_SAMPLE_T *prev, VIEW_PREDICTOR_SAMPLE_T *cur) {
+	for (int i = 0; i < VIEW_PREDICTOR_HISTORY_NUM; i++) {
+		VIEW_PREDICTOR_SAMPLE_T *pending = &_this->pending[i];
+		if (pending->client_time <= 0 || pending->client_time > cur->client_time) {
+			continue;
+		}
+		if (pending->client_time >= prev->client_time) {
+			double span = cur->client_time - prev->client_time;
+			float t = (span > 0) ? (pending->client_time - prev->client_time) / span : 1.0;
+			VECTOR4D_T actual = nlerp(prev->quat, cur->quat, t);
+			float error = get_angle(pending->quat, actual);
+			_this->error_num++;
+			_this->error_sum += error;
+			_this->error_sq_sum += error * error;
+			_this->error_max = MAX(_this->error_max, error);
+		}
+		pending->client_time = 0; //consumed or too old to evaluate
+	}
+}
+
+void view_predictor_push(VIEW_PREDICTOR_T *_this, VECTOR4D_T quat, double client_time, double server_time) {
+	if (client_time < 0) {
+		client_time = server_time;
+	}
+	{ //clock offset follows minimum delay
+		double offset = server_time - client_time;
+		if (!_this->clock_offset_valid || offset < _this->clock_offset) {
+			_this->clock_offset = offset;
+			_this->clock_offset_valid = true;
+		} else {
+			_this->clock_offset += (offset - _this->clock_offset) * CLOCK_DRIFT_FOLLOW;
+		}
+	}
+	VIEW_PREDICTOR_SAMPLE_T sample = { .quat = quaternion_normalize(quat), .client_time = client_time };
+	if (_this->history_num > 0) {
+		int latest = (_this->history_cur + VIEW_PREDICTOR_HISTORY_NUM - 1) % VIEW_PREDICTOR_HISTORY_NUM;
+		VIEW_PREDICTOR_SAMPLE_T *prev = &_this->history[latest];
+		if (client_time < prev->client_time) { //out of order
+			return;
+		}
+		evaluate_pending(_this, prev, &sample);
+	}
+	_this->history[_this->history_cur] = sample;
+	_this->history_cur = (_this->history_cur + 1) % VIEW_PREDICTOR_HISTORY_NUM;
+	_this->history_num = MIN(_this->history_num + 1, VIEW_PREDICTOR_HISTORY_NUM);
+}
+
+void view_predictor_set_process_time(VIEW_PREDICTOR_T *_this, float process_ms) {
+	float cur;
+	__atomic_load(&_this->process_ms, &cur, __ATOMIC_RELAXED);
+	if (cur != 0) {
+		process_ms = cur + (process_ms - cur) * PROCESS_TIME_EWMA;
+	}
+	__atomic_store(&_this->process_ms, &process_ms, __ATOMIC_RELAXED);
+}
+
+float view_predictor_get_horizon(VIEW_PREDICTOR_T *_this) {
+	if (_this->horizon_ms > 0) {
+		return _this->horizon_ms;
+	}
+	//clock_offset absorbs the minimum uplink delay,
+	//so a whole rtt is needed to reach client display time
+	float process_ms;
+	__atomic_load(&_this->process_ms, &process_ms, __ATOMIC_RELAXED);
+	return process_ms + _this->rtt_ms;
+}
+
+bool view_predictor_predict(VIEW_PREDICTOR_T *_this, double server_time, VECTOR4D_T *quat_out) {
+	if (_this->history_num == 0) {
+		*quat_out = quaternion_init();
+		return false;
+	}
+	int latest_idx = (_this->history_cur + VIEW_PREDICTOR_HISTORY_NUM - 1) % VIEW_PREDICTOR_HISTORY_NUM;
+	VIEW_PREDICTOR_SAMPLE_T *latest = &_this->history[latest_idx];
+	*quat_out = latest->quat;
+	if (!_this->enabled || _this->gain <= 0 || _this->history_num < 2) {
+		return false;
+	}
+
+	VIEW_PREDICTOR_SAMPLE_T *oldest = NULL;
+	for (int i = 1; i < _this->history_num; i++) {
+		VIEW_PREDICTOR_SAMPLE_T *sample = &_this->history[(latest_idx + VIEW_PREDICTOR_HISTORY_NUM - i) % VIEW_PREDICTOR_HISTORY_NUM];
+		if (latest->client_time - sample->client_time > _this->window_ms / 1000 && oldest != NULL) {
+			break;
+		}
+		oldest = sample;
+	}
+	double dt_window = latest->client_time - oldest->client_time;
+	if (dt_window <= 0) {
+		return false;
+	}
+	double target_time = server_time - _this->clock_offset + view_predictor_get_horizon(_this) / 1000;
+	double dt_predict = MIN(MAX(target_time - latest->client_time, 0), MAX_HORIZON_SEC);
+
+	//angular velocity as rotation from oldest to latest
+	VECTOR4D_T diff = quaternion_multiply(quaternion_conjugate(oldest->quat), latest->quat);
+	if (diff.w < 0) {
+		for (int i = 0; i < 4; i++) {
+			diff.ary[i] = -diff.ary[i];
+		}
+	}
+	float sin_half = sqrt(diff.x * diff.x + diff.y * diff.y + diff.z * diff.z);
+	if (sin_half < 1.0e-6) {
+		return false;
+	}
+	float angle = 2 * atan2(sin_half, diff.w) * _this->gain * dt_predict / dt_window;
+	angle = MIN(angle, _this->max_angle * M_PI / 180);
+
+	VECTOR4D_T delta;
+	delta.x = diff.x / sin_half * sin(angle / 2);
+	delta.y = diff.y / sin_half * sin(angle / 2);
+	delta.z = diff.z / sin_half * sin(angle / 2);
+	delta.w = cos(angle / 2);
+	delta.t = 0;
+	*quat_out = quaternion_normalize(quaternion_multiply(latest->quat, delta));
+
+	{ //keep for error statistics
+		VIEW_PREDICTOR_SAMPLE_T *pending = &_this->pending[_this->pending_cur];
+		pending->quat = *quat_out;
+		pending->client_time = latest->client_time + dt_predict;
+		_this->pending_cur = (_this->pending_cur + 1) % VIEW_PREDICTOR_HISTORY_NUM;
+	}
+	return true;
+}
+
+void view_predictor_get_stats(VIEW_PREDICTOR_T *_this, float *mean, float *rms, float *max, int *num) {
+	int n = _this->error_num;
+	if (mean) {
+		*mean = (n > 0) ? _this->error_sum / n : 0;
+	}
+	if (rms) {
+		*rms = (n > 0) ? sqrt(_this->error_sq_sum / n) : 0;
+	}
+	if (max) {
+		*max = _this->error_max;
+	}
+	if (num) {
+		*num = n;
+	}
+}
+
+void view_predictor_reset_stats(VIEW_PREDICTOR_T *_this) {
+	_this->error_num = 0;
+	_this->error_sum = 0;
+	_this->error_sq_sum = 0;
+	_this->error_max = 0;
+}